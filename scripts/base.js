@@ -13,7 +13,10 @@ Object.freeze((function () {
         activeInput : null,
         elements : [],
         positions : [],
-        lastInput : null,
+        levels : [],
+        input : "",
+        type : 0,
+        scrollTimeout : null,
         lastPosition : 0,
         newTab : false,
         notify : null,
@@ -406,62 +409,117 @@ Object.freeze((function () {
             __appendHint(hints, varructor, a, win, r, offsets);
         }
     };
-    var __createHints = function(win, varructor, type) 
+    // Read pass, collects the candidates of a window and its frames that are
+    // inside the viewport. Only layout is read, nothing is written so that
+    // layout is computed only once.
+    var __collectHints = function(win, type, frames) 
     {
-        var i;
+        var i, e, r, style, n = 0;
         try 
         {
             var doc = win.document;
             var res = doc.body.querySelectorAll(globals.hintTypes[type]); 
-            var e, r;
-            __createStyleSheet(doc);
-            var hints = doc.createDocumentFragment();
-            var oe = __getOffsets(doc);
-            for (i=0;i < res.length; i++) 
+            var height = win.innerHeight || doc.body.offsetHeight;
+            var width = win.innerWidth || doc.body.offsetWidth;
+            var frame = { 
+                win : win, 
+                oe : __getOffsets(doc), 
+                elements : [], 
+                rects : new Float64Array(4*res.length), 
+                maps : [] 
+            };
+            var subframes = [];
+            frames.push(frame);
+            for (i=0; i<res.length; i++) 
             {
                 e = res[i];
-                if ((r = __getVisibility(e, win)) === null) {
+                // the rect is cheaper than the computed style, offscreen
+                // elements are rejected first
+                r = e.getClientRects()[0];
+                if (!r || r.top > height || r.bottom < 0 || r.left > width ||  r.right < 0) 
                     continue;
-                }
-                if ( (e instanceof HTMLFrameElement || e instanceof HTMLIFrameElement)) {
-                    __createHints(e.contentWindow, varructor, type);
+                style = win.getComputedStyle(e, null);
+                if (style.getPropertyValue("visibility") == "hidden" || style.getPropertyValue("display") == "none") 
                     continue;
-                }
-                else if (e instanceof HTMLImageElement && type != HintTypes.HINT_T_IMAGES) {
+
+                if (e instanceof HTMLFrameElement || e instanceof HTMLIFrameElement) 
+                    subframes.push(e.contentWindow);
+                else if (e instanceof HTMLImageElement && type != HintTypes.HINT_T_IMAGES) 
+                {
                     if (e.hasAttribute("usemap")) 
-                        __createMap(hints, varructor, e, win, r, oe);
+                        frame.maps.push({ element : e, rect : r });
                 }
-                else {
-                    __appendHint(hints, varructor, e, win, r, oe);
+                else 
+                {
+                    frame.rects[4*n] = r.top;
+                    frame.rects[4*n+1] = r.left;
+                    frame.rects[4*n+2] = r.width;
+                    frame.rects[4*n+3] = r.height;
+                    frame.elements.push(e);
+                    n++;
                 }
             }
-            doc.body.appendChild(hints);
+            for (i=0; i<subframes.length; i++) 
+                __collectHints(subframes[i], type, frames);
         }
         catch(exc) 
         {
             console.error(exc);
         }
     };
-    var __showHints = function (type, newTab) 
+    // Write pass, creates the hints of all collected frames
+    var __createHints = function(frames, varructor) 
+    {
+        var i, j, f, rects, hints, r;
+        var fragments = [];
+        for (i=0; i<frames.length; i++) 
+        {
+            f = frames[i];
+            hints = f.win.document.createDocumentFragment();
+            rects = f.rects;
+            for (j=0; j<f.elements.length; j++) 
+            {
+                r = { top : rects[4*j], left : rects[4*j+1], width : rects[4*j+2], height : rects[4*j+3] };
+                __appendHint(hints, varructor, f.elements[j], f.win, r, f.oe);
+            }
+            for (j=0; j<f.maps.length; j++) 
+                __createMap(hints, varructor, f.maps[j].element, f.win, f.maps[j].rect, f.oe);
+            fragments.push(hints);
+        }
+        return fragments;
+    };
+    var __showHints = function (type, newTab, refresh) 
     {
         var i;
+        var frames = [];
+        var fragments;
         if (document.activeElement) 
         {
             document.activeElement.blur();
         }
         globals.newTab = newTab;
-        __createHints(window, globals.style == "letter" ? __letterHint : __numberHint, type);
+        globals.type = type;
+        __collectHints(window, type, frames);
+        fragments = __createHints(frames, globals.style == "letter" ? __letterHint : __numberHint);
         var l = globals.elements.length;
 
         if (l === 0) 
         {
             return "_dwb_no_hints_";
         }
-        else if (l == 1)  
+        else if (l == 1 && !refresh)  
         {
             return  __evaluate(globals.elements[0].element, type);
         }
 
+        // label the hints before they are inserted
+        __getTextHints(globals.elements);
+        for (i=0; i<frames.length; i++) 
+        {
+            __createStyleSheet(frames[i].win.document);
+            frames[i].win.document.body.appendChild(fragments[i]);
+        }
+
         globals.notify = document.createElement("div");
         globals.notify.style.cssText = 
             "bottom:0px;left:0px;position:fixed;z-index:1000;" + 
@@ -474,29 +532,77 @@ Object.freeze((function () {
         globals.notify.id = "dwb_hint_notifier";
         document.body.appendChild(globals.notify);
 
-        __getTextHints(globals.elements);
         globals.activeArr = globals.elements;
+        globals.levels = [ { input : "", activeArr : globals.elements, relabel : true } ];
         __setActive(globals.elements[0]);
+        window.addEventListener("scroll", __onScroll, false);
         return null;
     };
+    // Only the viewport gets hints, content that is scrolled into view gets
+    // hints as long as nothing has been typed
+    var __onScroll = function() 
+    {
+        if (globals.input !== "") 
+            return;
+        if (globals.scrollTimeout !== null) 
+            clearTimeout(globals.scrollTimeout);
+        globals.scrollTimeout = setTimeout(function() {
+            var type = globals.type, newTab = globals.newTab;
+            globals.scrollTimeout = null;
+            if (globals.input !== "") 
+                return;
+            __clear();
+            if (__showHints(type, newTab, true) !== null) 
+                window.addEventListener("scroll", __onScroll, false);
+        }, 100);
+    };
+    // Every level holds the hints that match a prefix of the input, the
+    // bottom level holds all hints. A shorter input pops levels and shows
+    // their hints again instead of recreating all hints.
+    var __popLevels = function(input) 
+    {
+        var levels = globals.levels;
+        var level = levels[levels.length-1];
+        var relabel = false;
+        var i;
+        if (input.indexOf(level.input) === 0) 
+            return level;
+
+        do 
+        {
+            relabel = relabel || level.relabel;
+            levels.pop();
+            level = levels[levels.length-1];
+        } while (input.indexOf(level.input) !== 0);
+
+        for (i=0; i<level.activeArr.length; i++) 
+            level.activeArr[i].hint.style.visibility = '';
+
+        // number hints are renumbered when they are filtered by text
+        if (relabel) 
+        {
+            for (i=levels.length-1; !levels[i].relabel; i--)
+                ;
+            __getTextHints(levels[i].activeArr);
+        }
+        return level;
+    };
     var __updateHints = function(input, type) 
     {
         var i;
         var array = [];
         var matchHint = false;
+        var level;
+        var raw = input;
         if (!globals.activeArr.length) 
         {
             __clear();
             __showHints(type, globals.newTab);
+            if (!globals.levels.length) 
+                return "_dwb_no_hints_";
         }
-        if (globals.lastInput && (globals.lastInput.length > input.length)) 
-        {
-            __clear();
-            globals.lastInput = input;
-            __showHints(type, globals.newTab);
-            return __updateHints(input, type);
-        }
-        globals.lastInput = input;
+        level = __popLevels(input);
+        globals.activeArr = level.activeArr;
         if (input) 
         {
             if (globals.style == "number") 
@@ -524,13 +630,20 @@ Object.freeze((function () {
                     input = input.match(new RegExp("[^" + lowerSeq + "]", "g")).join("");
             }
         }
-        for (i=0; i<globals.activeArr.length; i++) 
+        if (raw == level.input) 
+            array = level.activeArr;
+        else 
         {
-            var e = globals.activeArr[i];
-            if (e.matchText(input, matchHint)) 
-                array.push(e);
-            else
-                e.hint.style.visibility = 'hidden';
+            for (i=0; i<level.activeArr.length; i++) 
+            {
+                var e = level.activeArr[i];
+                if (e.matchText(input, matchHint)) 
+                    array.push(e);
+                else
+                    e.hint.style.visibility = 'hidden';
+            }
+            if (array.length > 0) 
+                globals.levels.push({ input : raw, activeArr : array, relabel : globals.style == "number" && !matchHint });
         }
         globals.activeArr = array;
         if (array.length === 0) 
@@ -593,8 +706,14 @@ Object.freeze((function () {
         globals.activeArr = [];
         globals.active = null;
         globals.lastPosition = 0;
-        globals.lastInput = null;
+        globals.levels = [];
         globals.positions = [];
+        window.removeEventListener("scroll", __onScroll, false);
+        if (globals.scrollTimeout !== null) 
+        {
+            clearTimeout(globals.scrollTimeout);
+            globals.scrollTimeout = null;
+        }
         if (globals.notify && globals.notify.parentNode)
         {
             globals.notify.parentNode.removeChild(globals.notify);
@@ -823,11 +942,14 @@ Object.freeze((function () {
         },
         showHints : function(obj) 
         {
+            globals.input = "";
             return __showHints(obj.type, obj.newTab);
         },
         updateHints : function (obj) 
         {
-            return __updateHints(obj.input, obj.type);
+            // only the changed end of the input is passed
+            globals.input = globals.input.substring(0, obj.keep) + obj.append;
+            return __updateHints(globals.input, obj.type);
         },
         clear : function () 
         {
@@ -861,11 +983,11 @@ Object.freeze((function () {
         {
             __pastePrimary(selection);
         },
-        insertAdblockRule : function(rule) 
+        insertAdblockStylesheet : function(stylesheet) 
         {
             var st=document.createElement('style');
+            st.textContent = stylesheet;
             document.head.appendChild(st);
-            document.styleSheets[document.styleSheets.length-1].insertRule(rule, 0);
         },
         init : function (obj) 
         {
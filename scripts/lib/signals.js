@@ -6,6 +6,26 @@
         signals[sig] = null;
         delete _registered[sig];
     }
+    // dwb only creates the arguments of a signal that a callback can see,
+    // argc is the largest number of parameters of the connected callbacks or 0
+    // if a callback might use its arguments object
+    function _updateArgc(sig) 
+    {
+        var i, sigs = _registered[sig], argc = 0;
+        for (i=0; i<sigs.length; i++) 
+        {
+            if (sigs[i].connected) 
+            {
+                if (sigs[i].callback.length === 0) 
+                {
+                    argc = 0;
+                    break;
+                }
+                argc = Math.max(argc, sigs[i].callback.length);
+            }
+        }
+        signals[sig].argc = argc;
+    }
     var _disconnectByProp = function(prop, obj) 
     {
         var sig, i, sigs;
@@ -23,6 +43,7 @@
                     else 
                     {
                         sigs[i].connected = false;
+                        _updateArgc(sig);
                     }
                     return true;
                 }
@@ -77,6 +98,7 @@
                         signals[sig] = function () { return signals.emit(sig, arguments); };
                     }
                     _registered[sig].push({callback : func, id : id, connected : true });
+                    _updateArgc(sig);
                     return id;
                 };
             })()
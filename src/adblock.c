@@ -17,6 +17,7 @@
  */
 
 #include <string.h>
+#include <sys/stat.h>
 #include <JavaScriptCore/JavaScript.h>
 #include "dwb.h"
 #include "util.h"
@@ -62,12 +63,54 @@ typedef enum _AdblockAttribute {
 #define AB_CLEAR_LOWER 0x3fff8000
 
 typedef struct _AdblockRule {
-    GRegex *pattern;
+    GRegex *regex;
+    char *pattern;
     AdblockOption options;
     AdblockAttribute attributes;
     char **domains;
 } AdblockRule;
 
+/* Rules are indexed by a literal token that every matching uri must contain,
+ * only rules without a usable token have to be checked for every request */
+typedef struct _AdblockFilter {
+    GPtrArray *rules;
+    GHashTable *tokens;
+    GPtrArray *untokenized;
+} AdblockFilter;
+
+/* A request that is checked against the filters, suburis are offsets of all
+ * subdomains in uri and lower, terminated by -1 */
+typedef struct _AdblockMatch {
+    const char *uri;
+    char *lower;
+    int suburis[SUBDOMAIN_MAX];
+    const DomainInfo *page;
+    AdblockAttribute attributes;
+    gboolean thirdparty;
+} AdblockMatch;
+#define ADBLOCK_TOKEN_CHAR(c) (g_ascii_isalnum(c) || (c) == '%')
+#define ADBLOCK_SEPARATOR(c) (!ADBLOCK_TOKEN_CHAR(c) && (c) != '_' && (c) != '-' && (c) != '.' && (guchar)(c) < 0x80)
+
+typedef struct _AdblockDecision {
+    char *key;
+    gboolean blocked;
+} AdblockDecision;
+
+/* A beforeload check running on the thread pool, element is only accessed on
+ * the main thread */
+typedef struct _AdblockJob {
+    WebKitDOMElement *element;
+    const char *attribute;
+    char *url;
+    char *realuri;
+    char *baseURI;
+    char *key;
+    AdblockAttribute attributes;
+    gboolean blocked;
+    /* s_generation when the job was created */
+    guint generation;
+} AdblockJob;
+
 typedef struct _AdblockElementHider {
     char *selector;
     char **domains;
@@ -76,10 +119,10 @@ typedef struct _AdblockElementHider {
 /*}}}*/
 
 /* Static variables {{{*/
-static GPtrArray *s_simple_rules;
-static GPtrArray *s_simple_exceptions;
-static GPtrArray *s_rules;
-static GPtrArray *s_exceptions;
+static AdblockFilter *s_simple_rules;
+static AdblockFilter *s_simple_exceptions;
+static AdblockFilter *s_rules;
+static AdblockFilter *s_exceptions;
 static GHashTable *s_hider_rules;
 gboolean s_has_hider_rules;
 /*  only used to freeing elementhider */
@@ -87,15 +130,74 @@ static GSList *s_hider_list;
 static GString *s_css_exceptions;
 static gboolean s_init = false;
 static GSList *s_css_hider_list;
+/* all chunks of s_css_hider_list in a single stylesheet */
+static char *s_css_hider_style;
+/* memoized domain specific stylesheets, keyed by host */
+static GHashTable *s_domain_css;
+#define ADBLOCK_DOMAIN_CSS_MAX 1024
 #define HIDER_LIST_MAX 3000
+/* the compiled filters, strings of rules that were loaded from the cache point
+ * into the mapped file */
+static GMappedFile *s_cache;
+#define ADBLOCK_CACHE_MAGIC "dwbadb01"
+#define ADBLOCK_CACHE_NULL G_MAXUINT32
+/* Recent decisions, the hash table maps keys to links of the queue, the most
+ * recently used decision is the head of the queue */
+static GHashTable *s_decisions;
+static GQueue s_decision_queue = G_QUEUE_INIT;
+static guint s_decision_hits;
+static guint s_decision_misses;
+/* only set by adblock_benchmark to measure the matcher alone */
+static gboolean s_decisions_disabled;
+#define ADBLOCK_DECISIONS_MAX 4096
+/* beforeload checks that are evaluated on the thread pool, the filters are
+ * never modified while the pool exists */
+static GThreadPool *s_pool;
+#define ADBLOCK_POOL_THREADS 4
+/* incremented whenever the decisions are flushed, decisions of older jobs are
+ * dropped */
+static guint s_generation;
+/* tokens that occur in almost every uri */
+static const char *s_common_tokens[] = { "http", "https", "www", "com", NULL };
 /*}}}*//*}}}*/
 
 /* NEW AND FREE {{{*/
+/* adblock_cache_contains(const char *) {{{*/
+static gboolean
+adblock_cache_contains(const char *string)
+{
+    if (s_cache == NULL || string == NULL)
+        return false;
+    const char *contents = g_mapped_file_get_contents(s_cache);
+    return string >= contents && string < contents + g_mapped_file_get_length(s_cache);
+}/*}}}*/
+
+/* adblock_free(char *) {{{*/
+static void
+adblock_free(char *string)
+{
+    if (!adblock_cache_contains(string))
+        g_free(string);
+}/*}}}*/
+
+/* adblock_strfreev(char **) {{{*/
+static void
+adblock_strfreev(char **strv)
+{
+    if (strv == NULL)
+        return;
+    if (adblock_cache_contains(strv[0]))
+        g_free(strv);
+    else 
+        g_strfreev(strv);
+}/*}}}*/
+
 /* adblock_rule_new {{{*/
 static AdblockRule *
 adblock_rule_new() 
 {
     AdblockRule *rule = dwb_malloc(sizeof(AdblockRule));
+    rule->regex = NULL;
     rule->pattern = NULL;
     rule->options = 0;
     rule->attributes = 0;
@@ -104,18 +206,120 @@ adblock_rule_new()
 }/*}}}*/
 
 /* adblock_rule_free {{{*/
-static void 
-adblock_rule_free(AdblockRule *rule) 
+static void
+adblock_rule_free(AdblockRule *rule)
 {
-    if (rule->pattern != NULL) 
-        g_regex_unref(rule->pattern);
+    if (rule->regex != NULL)
+        g_regex_unref(rule->regex);
 
-    if (rule->domains != NULL) 
-        g_strfreev(rule->domains);
-    
+    adblock_strfreev(rule->domains);
+    adblock_free(rule->pattern);
     g_free(rule);
 }/*}}}*/
 
+/* adblock_filter_new {{{*/
+static AdblockFilter *
+adblock_filter_new()
+{
+    AdblockFilter *filter = dwb_malloc(sizeof(AdblockFilter));
+    filter->rules = g_ptr_array_new_with_free_func((GDestroyNotify)adblock_rule_free);
+    filter->tokens = g_hash_table_new_full((GHashFunc)g_str_hash, (GEqualFunc)g_str_equal,
+            (GDestroyNotify)g_free, (GDestroyNotify)g_ptr_array_unref);
+    filter->untokenized = g_ptr_array_new();
+    return filter;
+}/*}}}*/
+
+/* adblock_filter_free {{{*/
+static void
+adblock_filter_free(AdblockFilter *filter)
+{
+    if (filter == NULL)
+        return;
+    g_hash_table_unref(filter->tokens);
+    g_ptr_array_free(filter->untokenized, true);
+    g_ptr_array_free(filter->rules, true);
+    g_free(filter);
+}/*}}}*/
+
+/* adblock_token_is_common(const char *token) {{{*/
+static gboolean
+adblock_token_is_common(const char *token)
+{
+    for (int i=0; s_common_tokens[i]; i++)
+    {
+        if (!strcmp(token, s_common_tokens[i]))
+            return true;
+    }
+    return false;
+}/*}}}*/
+
+/* adblock_filter_add(AdblockFilter *, AdblockRule *) {{{
+ * Adds a rule to the filter and indexes it by the token with the fewest
+ * rules so far. A token is only usable if it cannot be part of a longer token
+ * in the uri, i.e. it is delimited by a literal character or an anchor on both
+ * sides.
+ * */
+static void
+adblock_filter_add(AdblockFilter *filter, AdblockRule *rule)
+{
+    const char *cur = rule->pattern;
+    const char *start;
+    char *token, *best = NULL;
+    guint count, best_count = G_MAXUINT;
+    GPtrArray *bucket;
+
+    g_ptr_array_add(filter->rules, rule);
+
+    while (cur != NULL && *cur)
+    {
+        if (!ADBLOCK_TOKEN_CHAR(*cur))
+        {
+            cur++;
+            continue;
+        }
+        start = cur;
+        while (ADBLOCK_TOKEN_CHAR(*cur))
+            cur++;
+
+        if (start == rule->pattern ? !(rule->options & (AO_BEGIN | AO_BEGIN_DOMAIN)) : start[-1] == '*')
+            continue;
+        if (*cur == '\0' ? !(rule->options & AO_END) : *cur == '*')
+            continue;
+
+        token = g_ascii_strdown(start, cur - start);
+        if (adblock_token_is_common(token))
+        {
+            g_free(token);
+            continue;
+        }
+
+        bucket = g_hash_table_lookup(filter->tokens, token);
+        count = bucket == NULL ? 0 : bucket->len;
+        if (count < best_count || (count == best_count && strlen(token) > strlen(best)))
+        {
+            g_free(best);
+            best = token;
+            best_count = count;
+        }
+        else
+            g_free(token);
+    }
+    if (best != NULL)
+    {
+        bucket = g_hash_table_lookup(filter->tokens, best);
+        if (bucket == NULL)
+        {
+            bucket = g_ptr_array_new();
+            g_hash_table_insert(filter->tokens, best, bucket);
+        }
+        else
+            g_free(best);
+        g_ptr_array_add(bucket, rule);
+    }
+    else
+        g_ptr_array_add(filter->untokenized, rule);
+}/*}}}*/
+
 /* adblock_element_hider_new {{{*/
 static AdblockElementHider *
 adblock_element_hider_new(const char *selector, char **domains) 
@@ -132,114 +336,331 @@ adblock_element_hider_free(AdblockElementHider *hider)
 {
     if (hider) 
     {
-        if (hider->selector) 
-            g_free(hider->selector);
-        
-        if (hider->domains) 
-            g_strfreev(hider->domains);
+        adblock_free(hider->selector);
+        adblock_strfreev(hider->domains);
         
         g_free(hider);
     }
 }/*}}}*//*}}}*/
 
+/* adblock_element_hider_add(AdblockElementHider *) {{{
+ * Registers an element hider for all of its domains, a hider that only has
+ * inverse domains is an exception for all other domains
+ * */
+static void
+adblock_element_hider_add(AdblockElementHider *hider) 
+{
+    GSList *list;
+    const char *domain;
+    gboolean hider_exc = true;
+
+    for (char **domain_arr = hider->domains; *domain_arr; domain_arr++) 
+    {
+        domain = *domain_arr;
+        if (*domain == '~')
+            domain++;
+        else 
+            hider_exc = false;
+        list = g_hash_table_lookup(s_hider_rules, domain);
+        if (list == NULL) 
+        {
+            list = g_slist_append(list, hider);
+            g_hash_table_insert(s_hider_rules, g_strdup(domain), list);
+        }
+        else 
+        {
+            list = g_slist_append(list, hider);
+            (void) list;
+        }
+        s_has_hider_rules = true;
+    }
+    hider->exception = hider_exc;
+    if (hider_exc) 
+    {
+        g_string_append(s_css_exceptions, hider->selector);
+        g_string_append_c(s_css_exceptions, ',');
+    }
+    s_hider_list = g_slist_append(s_hider_list, hider);
+}/*}}}*/
+
 
 /* MATCH {{{*/
-/* inline adblock_do_match(AdblockRule *, const char *) {{{*/
+/* adblock_pattern_match(const char *pattern, const char *string, gboolean begin, gboolean end) {{{
+ * Matches a filter pattern with wildcards '*' and separators '^' against
+ * string, pattern and string must already have the same case. 
+ * */
+static gboolean
+adblock_pattern_match(const char *pattern, const char *string, gboolean begin, gboolean end)
+{
+    const char *p = pattern, *s = string;
+    const char *star_p = NULL, *star_s = NULL;
+
+    /* an unanchored pattern behaves like a pattern with a leading '*' */
+    if (!begin)
+    {
+        star_p = pattern;
+        star_s = string;
+    }
+    while (1)
+    {
+        if (*p == '\0')
+        {
+            if (!end || *s == '\0')
+                return true;
+        }
+        else if (*p == '*')
+        {
+            star_p = ++p;
+            star_s = s;
+            continue;
+        }
+        else if (*s != '\0' && (*p == '^' ? ADBLOCK_SEPARATOR(*s) : *p == *s))
+        {
+            p++;
+            s++;
+            continue;
+        }
+        /* a separator also matches the end of the string */
+        else if (*p == '^' && *s == '\0')
+        {
+            p++;
+            continue;
+        }
+        if (star_p == NULL || *star_s == '\0')
+            return false;
+        p = star_p;
+        s = ++star_s;
+    }
+}/*}}}*/
+
+/* inline adblock_do_match(AdblockRule *, const char *uri, const char *lower) {{{*/
 static inline gboolean
-adblock_do_match(AdblockRule *rule, const char *uri) 
+adblock_do_match(AdblockRule *rule, const char *uri, const char *lower) 
 {
-    if (g_regex_match(rule->pattern, uri, 0, NULL)) 
+    gboolean match;
+    if (rule->regex != NULL) 
+        match = g_regex_match(rule->regex, uri, 0, NULL);
+    else 
+        match = adblock_pattern_match(rule->pattern, rule->options & AO_MATCH_CASE ? uri : lower, 
+                rule->options & (AO_BEGIN | AO_BEGIN_DOMAIN), rule->options & AO_END);
+    if (match) 
     {
-        PRINT_DEBUG("blocked %s %s\n", uri, g_regex_get_pattern(rule->pattern));
+        PRINT_DEBUG("blocked %s %s\n", uri, rule->regex != NULL ? g_regex_get_pattern(rule->regex) : rule->pattern);
         return true;
     }
     return false;
 }/*}}}*/
 
-/* adblock_match(GPtrArray *, SoupURI *, const char *base_domain, * AdblockAttribute, gboolean thirdparty)  {{{
+/* adblock_rule_match(AdblockRule *, AdblockMatch *) {{{*/
+static gboolean
+adblock_rule_match(AdblockRule *rule, AdblockMatch *m)
+{
+    if ( (m->attributes & AA_DOCUMENT && !(rule->attributes & AA_DOCUMENT)) || (m->attributes & AA_SUBDOCUMENT && !(rule->attributes & AA_SUBDOCUMENT)) )
+        return false;
+    /* If exception attributes exists, check if exception is matched */
+    if (AA_CLEAR_FRAME(rule->attributes) & AB_CLEAR_LOWER && (AA_CLEAR_FRAME(rule->attributes) == (AA_CLEAR_FRAME(m->attributes)<<AB_INVERSE))) 
+        return false;
+    /* If attribute restriction exists, check if attribute is matched */
+    if (AA_CLEAR_FRAME(rule->attributes) & AB_CLEAR_UPPER && (AA_CLEAR_FRAME(rule->attributes) != AA_CLEAR_FRAME(m->attributes))) 
+        return false;
+    if (rule->domains && !domain_match(rule->domains, m->page)) 
+        return false;
+    if    ( (rule->options & AO_THIRDPARTY && !m->thirdparty) 
+            ||  (rule->options & AO_NOTHIRDPARTY && m->thirdparty) )
+        return false;
+    if (rule->options & AO_BEGIN_DOMAIN)  
+    {
+        for (int i=0; m->suburis[i] >= 0; i++) 
+        {
+            if ( adblock_do_match(rule, m->uri + m->suburis[i], m->lower + m->suburis[i]) ) 
+                return true;
+        }
+        return false;
+    }
+    return adblock_do_match(rule, m->uri, m->lower);
+}/*}}}*/
+
+/* adblock_match(AdblockFilter *, const char *uri, const DomainInfo *, const DomainInfo *, AdblockAttribute, gboolean thirdparty)  {{{
  * Params: 
- * array      - the filter array
+ * filter     - the filter 
  * uri        - the uri to check
- * uri_host   - the hostname of the request
- * uri_base   - the domainname of the request
- * host       - the hostname of the page
- * domain     - the domainname of the page
+ * request    - hostname and domainname of the request
+ * page       - hostname and domainname of the page
  * thirdparty - thirdparty request ? 
  * */
-gboolean                
-adblock_match(GPtrArray *array, const char *uri, const char *uri_host, const char *uri_base, const char *host, const char *domain, AdblockAttribute attributes, gboolean thirdparty) 
+static gboolean                
+adblock_match(AdblockFilter *filter, const char *uri, const DomainInfo *request, const DomainInfo *page, AdblockAttribute attributes, gboolean thirdparty) 
 {
-    if (array->len == 0)
+    if (filter->rules->len == 0)
         return false;
-    const char *base_start = strstr(uri, uri_base);
-    const char *uri_start = strstr(uri, uri_host);
-    const char *suburis[SUBDOMAIN_MAX];
-    int uc = 0;
-    const char *cur = uri_start;
-    const char *nextdot;
-    AdblockRule *rule;
+    const char *uri_start = strstr(uri, request->host);
+    char *token, *end;
+    char c;
+    gboolean ret = false;
+    GPtrArray *bucket;
+    AdblockMatch m;
+
+    if (uri_start == NULL)
+        return false;
+
+    m.uri = uri;
+    m.page = page;
+    m.attributes = attributes;
+    m.thirdparty = thirdparty;
+
     /* Get all suburis */
-    suburis[uc++] = cur;
-    while (cur != base_start) 
-    {
-        nextdot = strchr(cur, '.');
-        cur = nextdot + 1;
-        suburis[uc++] = cur;
-        if (uc == SUBDOMAIN_MAX-1)
-            break;
-    }
-    suburis[uc++] = NULL;
+    for (int i=0; (m.suburis[i] = request->subdomains[i]) >= 0; i++) 
+        m.suburis[i] += uri_start - uri;
+
+    m.lower = g_ascii_strdown(uri, -1);
 
-    for (guint i=0; i<array->len; i++) 
+    /* Only check rules that are indexed by a token of the uri */
+    for (token = m.lower; *token && !ret; token = end) 
     {
-        rule = g_ptr_array_index(array, i);
-        if ( (attributes & AA_DOCUMENT && !(rule->attributes & AA_DOCUMENT)) || (attributes & AA_SUBDOCUMENT && !(rule->attributes & AA_SUBDOCUMENT)) )
-            continue;
-        /* If exception attributes exists, check if exception is matched */
-        if (AA_CLEAR_FRAME(rule->attributes) & AB_CLEAR_LOWER && (AA_CLEAR_FRAME(rule->attributes) == (AA_CLEAR_FRAME(attributes)<<AB_INVERSE))) 
-            continue;
-        /* If attribute restriction exists, check if attribute is matched */
-        if (AA_CLEAR_FRAME(rule->attributes) & AB_CLEAR_UPPER && (AA_CLEAR_FRAME(rule->attributes) != AA_CLEAR_FRAME(attributes))) 
-            continue;
-        if (rule->domains && !domain_match(rule->domains, host, domain)) 
-            continue;
-        if    ( (rule->options & AO_THIRDPARTY && !thirdparty) 
-                ||  (rule->options & AO_NOTHIRDPARTY && thirdparty) )
-            continue;
-        if (rule->options & AO_BEGIN_DOMAIN)  
+        if (!ADBLOCK_TOKEN_CHAR(*token)) 
         {
-            for (int i=0; suburis[i]; i++) 
-            {
-                if ( adblock_do_match(rule, suburis[i]) ) 
-                    return true;
-            }
+            end = token + 1;
+            continue;
         }
-        else if (adblock_do_match(rule, uri)) 
-            return true;
+        for (end = token; ADBLOCK_TOKEN_CHAR(*end); end++)
+            ;
+        c = *end;
+        *end = '\0';
+        bucket = g_hash_table_lookup(filter->tokens, token);
+        *end = c;
+        if (bucket == NULL)
+            continue;
+        for (guint i=0; i<bucket->len && !ret; i++) 
+            ret = adblock_rule_match(g_ptr_array_index(bucket, i), &m);
     }
-    return false;
+    for (guint i=0; i<filter->untokenized->len && !ret; i++) 
+        ret = adblock_rule_match(g_ptr_array_index(filter->untokenized, i), &m);
+
+    g_free(m.lower);
+    return ret;
 }/*}}}*/
 
-/* adblock_prepare_match (const char *uri, const char *baseURI, AdblockAttribute attributes {{{ */
+/* DECISION CACHE {{{*/
+/* adblock_decision_key(char, const char *uri, const char *firsthost, AdblockAttribute) {{{
+ * type distinguishes resource requests from beforeload checks since they are
+ * matched against different filters
+ * */
+static char *
+adblock_decision_key(char type, const char *uri, const char *firsthost, AdblockAttribute attributes) 
+{
+    return g_strdup_printf("%c%x %s %s", type, attributes, firsthost, uri);
+}/*}}}*/
+
+/* adblock_decision_lookup(const char *key, gboolean *blocked) {{{*/
 static gboolean
-adblock_prepare_match(const char *uri, const char *baseURI, AdblockAttribute attributes) 
+adblock_decision_lookup(const char *key, gboolean *blocked) 
 {
-    char *realuri = NULL;
-    SoupURI *suri = NULL, *sbaseuri = NULL;
-    gboolean ret = false;
+    GList *link;
 
-    if (! g_regex_match_simple("^https?://", uri, 0, 0)) 
+    if (s_decisions_disabled)
+        return false;
+    link = s_decisions != NULL ? g_hash_table_lookup(s_decisions, key) : NULL;
+    if (link == NULL) 
     {
-        gboolean last_slash = g_str_has_suffix(baseURI, "/");
-        if (*uri == '/' && last_slash) 
-            realuri = g_strconcat(baseURI, uri+1, NULL);
-        else if (*uri != '/' && !last_slash)
-            realuri = g_strconcat(baseURI, "/", uri, NULL);
-        else 
-            realuri = g_strconcat(baseURI, uri, NULL);
+        s_decision_misses++;
+        return false;
     }
-    else 
-        realuri = g_strdup(uri);
+    s_decision_hits++;
+    if (link != s_decision_queue.head) 
+    {
+        g_queue_unlink(&s_decision_queue, link);
+        g_queue_push_head_link(&s_decision_queue, link);
+    }
+    *blocked = ((AdblockDecision*)link->data)->blocked;
+    return true;
+}/*}}}*/
+
+/* adblock_decision_insert(char *key, gboolean blocked) {{{
+ * Takes ownership of key, the least recently used decision is dropped if the
+ * cache is full
+ * */
+static void
+adblock_decision_insert(char *key, gboolean blocked) 
+{
+    AdblockDecision *decision;
+    GList *link;
+
+    if (s_decisions_disabled) 
+    {
+        g_free(key);
+        return;
+    }
+    if (s_decisions == NULL)
+        s_decisions = g_hash_table_new((GHashFunc)g_str_hash, (GEqualFunc)g_str_equal);
+
+    /* Checks that were running on the thread pool at the same time */
+    link = g_hash_table_lookup(s_decisions, key);
+    if (link != NULL) 
+    {
+        ((AdblockDecision*)link->data)->blocked = blocked;
+        g_free(key);
+        return;
+    }
+
+    if (s_decision_queue.length >= ADBLOCK_DECISIONS_MAX) 
+    {
+        decision = g_queue_pop_tail(&s_decision_queue);
+        g_hash_table_remove(s_decisions, decision->key);
+        g_free(decision->key);
+        g_free(decision);
+    }
+    decision = dwb_malloc(sizeof(AdblockDecision));
+    decision->key = key;
+    decision->blocked = blocked;
+    g_queue_push_head(&s_decision_queue, decision);
+    link = s_decision_queue.head;
+    g_hash_table_insert(s_decisions, key, link);
+}/*}}}*/
+
+/* adblock_decision_flush() {{{*/
+static void
+adblock_decision_flush() 
+{
+    AdblockDecision *decision;
+    if (s_decisions != NULL)
+        g_hash_table_remove_all(s_decisions);
+    while ((decision = g_queue_pop_head(&s_decision_queue)) != NULL) 
+    {
+        g_free(decision->key);
+        g_free(decision);
+    }
+    s_decision_hits = s_decision_misses = 0;
+    s_generation++;
+}/*}}}*/
+
+/* adblock_get_stats(guint *hits, guint *misses, guint *size) {{{*/
+void
+adblock_get_stats(guint *hits, guint *misses, guint *size) 
+{
+    *hits = s_decision_hits;
+    *misses = s_decision_misses;
+    *size = s_decision_queue.length;
+}/*}}}*//*}}}*/
+
+/* adblock_get_host(const char *uri) {{{
+ * Extracts the authority of an absolute uri without parsing it completely
+ * */
+static char *
+adblock_get_host(const char *uri) 
+{
+    const char *start = strstr(uri, "://");
+    if (start == NULL)
+        return g_strdup(uri);
+    start += 3;
+    return g_strndup(start, strcspn(start, "/?#"));
+}/*}}}*/
+
+/* adblock_match_uri(const char *uri, const char *baseURI, AdblockAttribute attributes) {{{*/
+static gboolean
+adblock_match_uri(const char *realuri, const char *baseURI, AdblockAttribute attributes) 
+{
+    SoupURI *suri = NULL, *sbaseuri = NULL;
+    gboolean ret = false;
 
     /* FIXME: soup_uri_get_host is just used to get parse the uri */
     suri = soup_uri_new(realuri);
@@ -257,66 +678,81 @@ adblock_prepare_match(const char *uri, const char *baseURI, AdblockAttribute att
     if (basehost == NULL)
         goto error_out;
 
-    const char *domain = domain_get_base_for_host(host);
-    const char *basedomain = domain_get_base_for_host(basehost);
-    gboolean thirdparty = g_strcmp0(domain, basedomain);
+    const DomainInfo *request = domain_get_info(host);
+    const DomainInfo *page = domain_get_info(basehost);
+    gboolean thirdparty = strcmp(request->base, page->base);
 
-    if (!adblock_match(s_exceptions, realuri, host, domain, basehost, basedomain, attributes, thirdparty)) 
+    if (!adblock_match(s_exceptions, realuri, request, page, attributes, thirdparty)) 
     {
-        if (adblock_match(s_rules, realuri, host, domain, basehost, basedomain, attributes, thirdparty)) 
+        if (adblock_match(s_rules, realuri, request, page, attributes, thirdparty)) 
             ret = true;
     }
 error_out:
-    if (realuri != NULL) g_free(realuri);
     if (sbaseuri != NULL) soup_uri_free(sbaseuri);
     if (suri != NULL) soup_uri_free(suri);
     return ret;
 }/*}}}*/
 
-/* adblock_apply_element_hider(WebKitWebFrame *frame, GList *gl) {{{*/
-void 
-adblock_apply_element_hider(WebKitWebFrame *frame, GList *gl) 
+/* adblock_resolve_uri(const char *uri, const char *baseURI) {{{*/
+static char *
+adblock_resolve_uri(const char *uri, const char *baseURI) 
 {
-    GSList *list;
+    if (! g_regex_match_simple("^https?://", uri, 0, 0)) 
+    {
+        gboolean last_slash = g_str_has_suffix(baseURI, "/");
+        if (*uri == '/' && last_slash) 
+            return g_strconcat(baseURI, uri+1, NULL);
+        else if (*uri != '/' && !last_slash)
+            return g_strconcat(baseURI, "/", uri, NULL);
+        else 
+            return g_strconcat(baseURI, uri, NULL);
+    }
+    return g_strdup(uri);
+}/*}}}*/
 
-    WebKitWebDataSource *datasource = webkit_web_frame_get_data_source(frame);
-    WebKitNetworkRequest *request = webkit_web_data_source_get_request(datasource);
+/* adblock_prepare_match (const char *uri, const char *baseURI, AdblockAttribute attributes {{{ */
+static gboolean
+adblock_prepare_match(const char *uri, const char *baseURI, AdblockAttribute attributes) 
+{
+    char *realuri = adblock_resolve_uri(uri, baseURI);
+    char *basehost, *key;
+    gboolean ret = false;
 
-    SoupMessage *msg = webkit_network_request_get_message(request);
-    if (msg == NULL)
-        return;
+    basehost = adblock_get_host(baseURI);
+    key = adblock_decision_key('b', realuri, basehost, attributes);
+    if (adblock_decision_lookup(key, &ret)) 
+        g_free(key);
+    else 
+    {
+        ret = adblock_match_uri(realuri, baseURI, attributes);
+        adblock_decision_insert(key, ret);
+    }
 
-    SoupURI *suri = soup_message_get_first_party(msg);
-    g_return_if_fail(suri != NULL);
+    g_free(basehost);
+    g_free(realuri);
+    return ret;
+}/*}}}*/
 
-    const char *host = soup_uri_get_host(suri);
-    const char *base_domain = domain_get_base_for_host(host);
-    g_return_if_fail(host != NULL);
-    g_return_if_fail(base_domain != NULL);
+/* adblock_get_domain_css(const char *host) {{{
+ * Returns the element hider rules for host, the stylesheets are built once
+ * per host
+ * */
+static const char *
+adblock_get_domain_css(const char *host) 
+{
+    char *css = g_hash_table_lookup(s_domain_css, host);
+    if (css != NULL)
+        return css;
 
+    GSList *list;
     AdblockElementHider *hider;
     GString *css_rule = g_string_new(NULL);
-
-    /* get all subdomains */
-    const char *subdomains[SUBDOMAIN_MAX];
-    char *nextdot = NULL;
-    int uc = 0;
-    const char *tmphost = host;
-    subdomains[uc++] = tmphost;
-    while (tmphost != base_domain) 
-    {
-        nextdot = strchr(tmphost, '.');
-        tmphost = nextdot + 1;
-        subdomains[uc++] = tmphost;
-        if (uc == SUBDOMAIN_MAX-1)
-            break;
-    }
-    subdomains[uc++] = NULL;
+    const DomainInfo *info = domain_get_info(host);
 
     gboolean has_exception = false;
-    for (int i=0; subdomains[i]; i++) 
+    for (int i=0; info->subdomains[i] >= 0; i++) 
     {
-        list = g_hash_table_lookup(s_hider_rules, subdomains[i]);
+        list = g_hash_table_lookup(s_hider_rules, info->host + info->subdomains[i]);
         if (list) 
         {
             for (GSList *l = list; l; l=l->next) 
@@ -324,7 +760,7 @@ adblock_apply_element_hider(WebKitWebFrame *frame, GList *gl)
                 hider = l->data;
                 if (hider->exception) 
                     has_exception = true;
-                else if  (domain_match(hider->domains, host, base_domain)) 
+                else if  (domain_match(hider->domains, info)) 
                 {
                     g_string_append(css_rule, hider->selector);
                     g_string_append_c(css_rule, ',');
@@ -337,51 +773,133 @@ adblock_apply_element_hider(WebKitWebFrame *frame, GList *gl)
     if (! has_exception) 
         g_string_append(css_rule, s_css_exceptions->str);
     
-    if (css_rule->str[css_rule->len-1] == ',') 
-        g_string_erase(css_rule, css_rule->len-1, 1);
+    if (css_rule->len > 0) 
+    {
+        if (css_rule->str[css_rule->len-1] == ',') 
+            g_string_erase(css_rule, css_rule->len-1, 1);
+
+        g_string_append(css_rule, "{display:none!important;}");
+    }
+    css = g_string_free(css_rule, false);
+
+    if (g_hash_table_size(s_domain_css) >= ADBLOCK_DOMAIN_CSS_MAX)
+        g_hash_table_remove_all(s_domain_css);
+    g_hash_table_insert(s_domain_css, g_strdup(host), css);
+    return css;
+}/*}}}*/
+
+/* adblock_apply_element_hider(WebKitWebFrame *frame, GList *gl) {{{
+ * Every frame gets a single stylesheet consisting of the general and the domain
+ * specific rules
+ * */
+void 
+adblock_apply_element_hider(WebKitWebFrame *frame, GList *gl) 
+{
+    WebKitWebDataSource *datasource = webkit_web_frame_get_data_source(frame);
+    WebKitNetworkRequest *request = webkit_web_data_source_get_request(datasource);
+
+    SoupMessage *msg = webkit_network_request_get_message(request);
+    if (msg == NULL)
+        return;
 
-    g_string_append(css_rule, "{display:none!important;}");
+    SoupURI *suri = soup_message_get_first_party(msg);
+    g_return_if_fail(suri != NULL);
+
+    const char *host = soup_uri_get_host(suri);
+    g_return_if_fail(host != NULL);
+
+    const char *domain_css = adblock_get_domain_css(host);
+    if (s_css_hider_style == NULL && *domain_css == '\0')
+        return;
+
+    char *stylesheet = g_strconcat(s_css_hider_style != NULL ? s_css_hider_style : "", "\n", domain_css, NULL);
 
     if (frame == webkit_web_view_get_main_frame(WEBVIEW(gl))) 
     {
         WebKitDOMDocument *doc = webkit_web_view_get_dom_document(WEBVIEW(gl));
         WebKitDOMHTMLHeadElement *head = webkit_dom_document_get_head(doc);
 
-        g_return_if_fail(G_IS_OBJECT(head));
-
-        for (GSList *l = VIEW(gl)->status->styles; l; l=l->next) 
-            webkit_dom_node_append_child(WEBKIT_DOM_NODE(head), WEBKIT_DOM_NODE(l->data), NULL);
-        
-        if (css_rule->len > 0) 
+        if (G_IS_OBJECT(head)) 
         {
-            webkit_dom_html_element_set_inner_html(WEBKIT_DOM_HTML_ELEMENT(VIEW(gl)->status->exc_style), 
-                    css_rule->str, NULL);
-            webkit_dom_node_append_child(WEBKIT_DOM_NODE(head), WEBKIT_DOM_NODE(VIEW(gl)->status->exc_style), NULL);
+            webkit_dom_html_element_set_inner_html(WEBKIT_DOM_HTML_ELEMENT(VIEW(gl)->status->hider_style), 
+                    stylesheet, NULL);
+            webkit_dom_node_append_child(WEBKIT_DOM_NODE(head), WEBKIT_DOM_NODE(VIEW(gl)->status->hider_style), NULL);
         }
     }
     else 
-    {
-        if (css_rule->len > 0) 
-        {
-            js_call_as_function(frame, VIEW(gl)->js_base, "insertAdblockRule", css_rule->str, kJSTypeString, NULL);
-        }
-        for (GSList *l = s_css_hider_list; l; l=l->next) 
-            js_call_as_function(frame, VIEW(gl)->js_base, "insertAdblockRule", l->data, kJSTypeString, NULL);
-    }
-    g_string_free(css_rule, true);
+        js_call_as_function(frame, VIEW(gl)->js_base, "insertAdblockStylesheet", stylesheet, kJSTypeString, NULL);
+
+    g_free(stylesheet);
 }/*}}}*/
 /*}}}*/
 
 
 /* LOAD_CALLBACKS {{{*/
 
-/* adblock_before_load_cb  (domcallback) {{{*/
+/* adblock_job_free(AdblockJob *) {{{*/
+static void
+adblock_job_free(AdblockJob *job) 
+{
+    g_object_unref(job->element);
+    g_free(job->url);
+    g_free(job->realuri);
+    g_free(job->baseURI);
+    g_free(job->key);
+    g_free(job);
+}/*}}}*/
+
+/* adblock_job_finish(AdblockJob *) {{{
+ * Applies the decision on the main thread, allowed elements are loaded again,
+ * the next beforeload check is answered by the decision cache. If the filters
+ * have changed since the job was created the decision is dropped and the
+ * element is checked again. Elements whose attribute has been changed in the
+ * meantime are left alone, the new value has been checked by its own
+ * beforeload event.
+ * */
+static gboolean
+adblock_job_finish(AdblockJob *job) 
+{
+    char *current;
+    gboolean stale = job->generation != s_generation;
+
+    if (!stale) 
+    {
+        adblock_decision_insert(job->key, job->blocked);
+        job->key = NULL;
+    }
+    if (!job->blocked || stale) 
+    {
+        current = webkit_dom_element_get_attribute(job->element, job->attribute);
+        if (!g_strcmp0(current, job->url))
+            webkit_dom_element_set_attribute(job->element, job->attribute, job->url, NULL);
+        g_free(current);
+    }
+    adblock_job_free(job);
+    return false;
+}/*}}}*/
+
+/* adblock_job_run(AdblockJob *, gpointer) {{{*/
+static void
+adblock_job_run(AdblockJob *job, gpointer data) 
+{
+    job->blocked = adblock_match_uri(job->realuri, job->baseURI, job->attributes);
+    g_idle_add((GSourceFunc)adblock_job_finish, job);
+}/*}}}*/
+
+/* adblock_before_load_cb  (domcallback) {{{
+ * Scripts and stylesheets have to be checked synchronously, they must be
+ * loaded in document order. Images and frames that aren't in the decision
+ * cache are blocked for now and checked on the thread pool.
+ * */
 static gboolean
 adblock_before_load_cb(WebKitDOMDOMWindow *win, WebKitDOMEvent *event, GList *gl) 
 {
     WebKitDOMElement *src = (void*)webkit_dom_event_get_src_element(event);
     char *tagname = webkit_dom_element_get_tag_name(src);
-    const char *url = NULL;
+    char *url = NULL;
+    const char *attribute = NULL;
+    char *realuri = NULL, *basehost = NULL, *key = NULL;
+    gboolean blocked = false;
 
     gboolean ret = false;
 
@@ -393,11 +911,14 @@ adblock_before_load_cb(WebKitDOMDOMWindow *win, WebKitDOMEvent *event, GList *gl
     AdblockAttribute attributes = win == main_win ? AA_DOCUMENT : AA_SUBDOCUMENT;
 
     if (webkit_dom_element_has_attribute(src, "src")) 
-        url = webkit_dom_element_get_attribute(src, "src");
+        attribute = "src";
     else if (webkit_dom_element_has_attribute(src, "href")) 
-        url = webkit_dom_element_get_attribute(src, "href");
+        attribute = "href";
     else if (webkit_dom_element_has_attribute(src, "data")) 
-        url = webkit_dom_element_get_attribute(src, "data");
+        attribute = "data";
+    if (attribute == NULL || baseURI == NULL) 
+        goto error_out;
+    url = webkit_dom_element_get_attribute(src, attribute);
     if (url == NULL) 
         goto error_out;
 
@@ -418,14 +939,53 @@ adblock_before_load_cb(WebKitDOMDOMWindow *win, WebKitDOMEvent *event, GList *gl
     else if (!g_strcmp0(tagname, "OBJECT") || ! g_strcmp0(tagname, "EMBED")) 
         attributes |= AA_OBJECT;
 
-    if (adblock_prepare_match(url, baseURI, attributes)) 
+    realuri = adblock_resolve_uri(url, baseURI);
+    basehost = adblock_get_host(baseURI);
+    key = adblock_decision_key('b', realuri, basehost, attributes);
+
+    if (adblock_decision_lookup(key, &blocked)) 
+    {
+        if (blocked)
+            webkit_dom_event_prevent_default(event);
+    }
+    else if (!g_strcmp0(tagname, "IMG") || !g_strcmp0(tagname, "IFRAME")) 
+    {
+        if (s_pool == NULL)
+            s_pool = g_thread_pool_new((GFunc)adblock_job_run, NULL, ADBLOCK_POOL_THREADS, false, NULL);
+
+        AdblockJob *job = dwb_malloc(sizeof(AdblockJob));
+        job->element = g_object_ref(src);
+        job->attribute = attribute;
+        job->url = url;
+        job->realuri = realuri;
+        job->baseURI = baseURI;
+        job->key = key;
+        job->attributes = attributes;
+        job->blocked = false;
+        job->generation = s_generation;
+        url = realuri = baseURI = key = NULL;
+
         webkit_dom_event_prevent_default(event);
+        g_thread_pool_push(s_pool, job, NULL);
+    }
+    else 
+    {
+        blocked = adblock_match_uri(realuri, baseURI, attributes);
+        adblock_decision_insert(key, blocked);
+        key = NULL;
+        if (blocked)
+            webkit_dom_event_prevent_default(event);
+    }
     
     ret = true;
 error_out:
     g_object_unref(src);
     g_free(tagname);
     g_free(baseURI);
+    g_free(url);
+    g_free(realuri);
+    g_free(basehost);
+    g_free(key);
     return ret;
 }/*}}}*/
 
@@ -439,12 +999,34 @@ adblock_frame_load_status_cb(WebKitWebFrame *frame, GParamSpec *p, GList *gl)
         dom_add_frame_listener(frame, "beforeload", G_CALLBACK(adblock_before_load_cb), true, gl);
 }
 
-/* adblock_frame_created_cb {{{*/
-void 
-adblock_frame_created_cb(WebKitWebView *wv, WebKitWebFrame *frame, GList *gl) 
-{
-    g_signal_connect(frame, "notify::load-status", G_CALLBACK(adblock_frame_load_status_cb), gl);
+/* adblock_frame_created_cb {{{*/
+void 
+adblock_frame_created_cb(WebKitWebView *wv, WebKitWebFrame *frame, GList *gl) 
+{
+    g_signal_connect(frame, "notify::load-status", G_CALLBACK(adblock_frame_load_status_cb), gl);
+}/*}}}*/
+/* adblock_match_request(const char *uri, const char *host, const char *firsthost, AdblockAttribute) {{{*/
+static gboolean
+adblock_match_request(const char *uri, const char *host, const char *firsthost, AdblockAttribute attribute)
+{
+    gboolean ret = false;
+    char *key = adblock_decision_key('r', uri, firsthost, attribute);
+    if (adblock_decision_lookup(key, &ret)) 
+    {
+        g_free(key);
+        return ret;
+    }
+
+    const DomainInfo *request = domain_get_info(host);
+    const DomainInfo *page = domain_get_info(firsthost);
+    gboolean thirdparty = strcmp(request->base, page->base);
+
+    if (!adblock_match(s_simple_exceptions, uri, request, page, attribute, thirdparty)) 
+        ret = adblock_match(s_simple_rules, uri, request, page, attribute, thirdparty);
+    adblock_decision_insert(key, ret);
+    return ret;
 }/*}}}*/
+
 /* adblock_resource_request_cb {{{*/
 static void 
 adblock_resource_request_cb(WebKitWebView *wv, WebKitWebFrame *frame,
@@ -469,10 +1051,6 @@ adblock_resource_request_cb(WebKitWebView *wv, WebKitWebFrame *frame,
     if (host == NULL)
         return;
 
-    const char *domain = domain_get_base_for_host(host);
-    if (domain == NULL)
-        return;
-
     SoupURI *sfirst_party = soup_message_get_first_party(msg);
     if (sfirst_party == NULL)
         return;
@@ -481,17 +1059,8 @@ adblock_resource_request_cb(WebKitWebView *wv, WebKitWebFrame *frame,
     if (firsthost == NULL)
         return;
 
-    const char *firstdomain = domain_get_base_for_host(firsthost);
-    if (firstdomain == NULL)
-        return;
-
-    gboolean thirdparty = g_strcmp0(domain, firstdomain);
-
-    if (!adblock_match(s_simple_exceptions, uri, host, domain, firsthost, firstdomain, attribute, thirdparty)) 
-    {
-        if (adblock_match(s_simple_rules, uri, host, domain, firsthost, firstdomain, attribute, thirdparty)) 
-            webkit_network_request_set_uri(request, "about:blank");
-    }
+    if (adblock_match_request(uri, host, firsthost, attribute))
+        webkit_network_request_set_uri(request, "about:blank");
 }/*}}}*/
  
 /* adblock_load_status_cb(WebKitWebView *, GParamSpec *, GList *) {{{*/
@@ -548,22 +1117,19 @@ adblock_connect(GList *gl)
 {
     if (!s_init && !adblock_init()) 
         return;
-    if (s_rules->len > 0 || s_css_hider_list != NULL || s_has_hider_rules) 
+    if (s_rules->rules->len > 0 || s_css_hider_list != NULL || s_has_hider_rules) 
     {
         VIEW(gl)->status->signals[SIG_AD_LOAD_STATUS] = g_signal_connect(WEBVIEW(gl), "notify::load-status", G_CALLBACK(adblock_load_status_cb), gl);
         VIEW(gl)->status->signals[SIG_AD_FRAME_CREATED] = g_signal_connect(WEBVIEW(gl), "frame-created", G_CALLBACK(adblock_frame_created_cb), gl);
     }
-    if (s_simple_rules->len > 0) 
+    if (s_simple_rules->rules->len > 0) 
         VIEW(gl)->status->signals[SIG_AD_RESOURCE_REQUEST] = g_signal_connect(WEBVIEW(gl), "resource-request-starting", G_CALLBACK(adblock_resource_request_cb), gl);
     
-    WebKitDOMDocument *doc = webkit_web_view_get_dom_document(WEBVIEW(gl));
-    for (GSList *l = s_css_hider_list; l; l=l->next) 
+    if (VIEW(gl)->status->hider_style == NULL) 
     {
-        WebKitDOMElement *style = webkit_dom_document_create_element(doc, "style", NULL);
-        webkit_dom_html_element_set_inner_html(WEBKIT_DOM_HTML_ELEMENT(style), l->data, NULL);
-        VIEW(gl)->status->styles = g_slist_prepend(VIEW(gl)->status->styles, style);
+        WebKitDOMDocument *doc = webkit_web_view_get_dom_document(WEBVIEW(gl));
+        VIEW(gl)->status->hider_style = webkit_dom_document_create_element(doc, "style", NULL);
     }
-    VIEW(gl)->status->exc_style = webkit_dom_document_create_element(doc, "style", NULL);
 
 }/*}}}*/
 
@@ -575,31 +1141,16 @@ adblock_warn_ignored(const char *message, const char *rule)
     fprintf(stderr, "Adblock warning: Rule %s will be ignored\n", rule);
 }/*}}}*/
 
-/* adblock_rule_parse(char *filterlist)  {{{*/
+/* adblock_rule_parse(const char *content)  {{{*/
 static void
-adblock_rule_parse(char *filterlist) 
+adblock_rule_parse(const char *content) 
 {
-    char **lines = NULL;
-    if  (g_file_test(filterlist, G_FILE_TEST_IS_DIR)) 
-    {
-        GString *string = g_string_new(NULL);
-        util_get_directory_content(string, filterlist, NULL);
-        if (string->str) 
-            lines = g_strsplit(string->str, "\n", -1);
-
-        g_string_free(string, true);
-    }
-    else 
-        lines = util_get_lines(filterlist);
-
-    if (lines == NULL)
-        return;
+    char **lines = g_strsplit(content, "\n", -1);
 
     char *pattern;
     GError *error = NULL;
     char **domain_arr = NULL;
     char *domains;
-    const char *domain;
     const char *tmp;
     const char *option_string;
     const char *o;
@@ -608,6 +1159,7 @@ adblock_rule_parse(char *filterlist)
     int option, attributes, inverse;
     gboolean exception;
     GRegex *rule;
+    char *pattern_string;
     char **options_arr;
     char warning[256];
     int n_css_rules = 0;
@@ -634,36 +1186,7 @@ adblock_rule_parse(char *filterlist)
                 domains = g_strndup(pattern, tmp-pattern);
                 domain_arr = g_strsplit(domains, ",", -1);
 
-                AdblockElementHider *hider = adblock_element_hider_new(tmp+2, domain_arr);
-                GSList *list;
-                gboolean hider_exc = true;
-                for (; *domain_arr; domain_arr++) 
-                {
-                    domain = *domain_arr;
-                    if (*domain == '~')
-                        domain++;
-                    else 
-                        hider_exc = false;
-                    list = g_hash_table_lookup(s_hider_rules, domain);
-                    if (list == NULL) 
-                    {
-                        list = g_slist_append(list, hider);
-                        g_hash_table_insert(s_hider_rules, g_strdup(domain), list);
-                    }
-                    else 
-                    {
-                        list = g_slist_append(list, hider);
-                        (void) list;
-                    }
-                    s_has_hider_rules = true;
-                }
-                hider->exception = hider_exc;
-                if (hider_exc) 
-                {
-                    g_string_append(s_css_exceptions, tmp + 2);
-                    g_string_append_c(s_css_exceptions, ',');
-                }
-                s_hider_list = g_slist_append(s_hider_list, hider);
+                adblock_element_hider_add(adblock_element_hider_new(tmp+2, domain_arr));
                 g_free(domains);
             }
             /* general rules */
@@ -690,6 +1213,7 @@ adblock_rule_parse(char *filterlist)
             option = 0;
             attributes = 0;
             rule = NULL;
+            pattern_string = NULL;
             domain_arr = NULL;
             /* Exception */
             tmp = pattern;
@@ -801,53 +1325,25 @@ adblock_rule_parse(char *filterlist)
             }
             else 
             {
+                /* Plain patterns are matched natively, consecutive wildcards
+                 * are merged */
                 GString *buffer = g_string_new(NULL);
-                if (option & AO_BEGIN || option & AO_BEGIN_DOMAIN) 
-                    g_string_append_c(buffer, '^');
-                
-                /*  FIXME: possibly use g_regex_escape_string */
-                for (const char *regexp_tmp = tmp; *regexp_tmp; regexp_tmp++ ) 
-                {
-                    switch (*regexp_tmp) {
-                        case '^' : g_string_append(buffer, "([\\x00-\\x24\\x26-\\x2C\\x2F\\x3A-\\x40\\x5B-\\x5E\\x60\\x7B-\\x80]|$)");
-                                   break;
-                        case '*' : g_string_append(buffer, ".*");
-                                   break;
-                        case '?' : 
-                        case '{' : 
-                        case '}' : 
-                        case '(' : 
-                        case ')' : 
-                        case '[' : 
-                        case ']' : 
-                        case '+' : 
-                        case '.' : 
-                        case '\\' : 
-                        case '|' : g_string_append_c(buffer, '\\');
-                        default  : g_string_append_c(buffer, *regexp_tmp);
-                    }
-                }
-                if (option & AO_END) 
-                    g_string_append_c(buffer, '$');
-                
-                if ( (option & AO_MATCH_CASE) != 0) 
-                    regex_flags &= ~G_REGEX_CASELESS;
-
-                rule = g_regex_new(buffer->str, regex_flags, 0, &error);
-
-                g_string_free(buffer, true);
-
-                if (error != NULL) 
+                for (const char *pattern_tmp = tmp; *pattern_tmp; pattern_tmp++) 
                 {
-                    fprintf(stderr, "dwb warning: ignoring adblock rule %s: %s\n", pattern, error->message);
-                    g_clear_error(&error);
-                    goto error_out;
+                    if (*pattern_tmp == '*' && buffer->len > 0 && buffer->str[buffer->len-1] == '*')
+                        continue;
+                    if ( (option & AO_MATCH_CASE) != 0) 
+                        g_string_append_c(buffer, *pattern_tmp);
+                    else 
+                        g_string_append_c(buffer, g_ascii_tolower(*pattern_tmp));
                 }
+                pattern_string = g_string_free(buffer, false);
             }
 
             AdblockRule *adrule = adblock_rule_new();
             adrule->attributes = attributes;
-            adrule->pattern = rule;
+            adrule->regex = rule;
+            adrule->pattern = pattern_string;
             adrule->options = option;
             adrule->domains = domain_arr;
 
@@ -857,16 +1353,16 @@ adblock_rule_parse(char *filterlist)
             if (!(attributes & ~(AA_SUBDOCUMENT | AA_DOCUMENT))) 
             {
                 if (exception) 
-                    g_ptr_array_add(s_simple_exceptions, adrule);
+                    adblock_filter_add(s_simple_exceptions, adrule);
                 else 
-                    g_ptr_array_add(s_simple_rules, adrule);
+                    adblock_filter_add(s_simple_rules, adrule);
             }
             else 
             {
                 if (exception) 
-                    g_ptr_array_add(s_exceptions, adrule);
+                    adblock_filter_add(s_exceptions, adrule);
                 else 
-                    g_ptr_array_add(s_rules, adrule);
+                    adblock_filter_add(s_rules, adrule);
             }
         }
 error_out:
@@ -883,49 +1379,378 @@ error_out:
     g_strfreev(lines);
 }/*}}}*/
 
+/* CACHE {{{*/
+/* The compiled filters are cached in FILES_CACHEDIR/adblock, the cache is only
+ * used if the key, i.e. modification time and checksum of the filterlist,
+ * matches. Strings are stored null-terminated so they can be used directly in
+ * the mapped file. */
+typedef struct _AdblockCacheReader {
+    const char *pos;
+    const char *end;
+} AdblockCacheReader;
+
+/* adblock_cache_write_int(GString *, guint32) {{{*/
+static void
+adblock_cache_write_int(GString *buffer, guint32 value) 
+{
+    g_string_append_len(buffer, (const char *)&value, sizeof(guint32));
+}/*}}}*/
+
+/* adblock_cache_write_string(GString *, const char *) {{{*/
+static void
+adblock_cache_write_string(GString *buffer, const char *string) 
+{
+    if (string == NULL) 
+    {
+        adblock_cache_write_int(buffer, ADBLOCK_CACHE_NULL);
+        return;
+    }
+    guint32 length = strlen(string);
+    adblock_cache_write_int(buffer, length);
+    g_string_append_len(buffer, string, length + 1);
+}/*}}}*/
+
+/* adblock_cache_write_strv(GString *, char **) {{{*/
+static void
+adblock_cache_write_strv(GString *buffer, char **strv) 
+{
+    if (strv == NULL) 
+    {
+        adblock_cache_write_int(buffer, ADBLOCK_CACHE_NULL);
+        return;
+    }
+    adblock_cache_write_int(buffer, g_strv_length(strv));
+    for (int i=0; strv[i] != NULL; i++)
+        adblock_cache_write_string(buffer, strv[i]);
+}/*}}}*/
+
+/* adblock_cache_write_filter(GString *, AdblockFilter *) {{{*/
+static void
+adblock_cache_write_filter(GString *buffer, AdblockFilter *filter) 
+{
+    AdblockRule *rule;
+
+    adblock_cache_write_int(buffer, filter->rules->len);
+    for (guint i=0; i<filter->rules->len; i++) 
+    {
+        rule = g_ptr_array_index(filter->rules, i);
+        adblock_cache_write_int(buffer, rule->options);
+        adblock_cache_write_int(buffer, rule->attributes);
+        adblock_cache_write_string(buffer, rule->pattern);
+        if (rule->regex != NULL) 
+        {
+            adblock_cache_write_string(buffer, g_regex_get_pattern(rule->regex));
+            adblock_cache_write_int(buffer, g_regex_get_compile_flags(rule->regex));
+        }
+        else 
+            adblock_cache_write_string(buffer, NULL);
+        adblock_cache_write_strv(buffer, rule->domains);
+    }
+}/*}}}*/
+
+/* adblock_cache_read_int(AdblockCacheReader *, guint32 *) {{{*/
+static gboolean
+adblock_cache_read_int(AdblockCacheReader *reader, guint32 *value) 
+{
+    if ((gsize)(reader->end - reader->pos) < sizeof(guint32))
+        return false;
+    memcpy(value, reader->pos, sizeof(guint32));
+    reader->pos += sizeof(guint32);
+    return true;
+}/*}}}*/
+
+/* adblock_cache_read_string(AdblockCacheReader *, char **) {{{*/
+static gboolean
+adblock_cache_read_string(AdblockCacheReader *reader, char **string) 
+{
+    guint32 length;
+    if (!adblock_cache_read_int(reader, &length))
+        return false;
+    if (length == ADBLOCK_CACHE_NULL) 
+    {
+        *string = NULL;
+        return true;
+    }
+    if ((gsize)(reader->end - reader->pos) <= length || reader->pos[length] != '\0')
+        return false;
+    *string = (char *)reader->pos;
+    reader->pos += length + 1;
+    return true;
+}/*}}}*/
+
+/* adblock_cache_read_strv(AdblockCacheReader *, char ***) {{{*/
+static gboolean
+adblock_cache_read_strv(AdblockCacheReader *reader, char ***strv) 
+{
+    guint32 length;
+    char **result;
+
+    if (!adblock_cache_read_int(reader, &length))
+        return false;
+    if (length == ADBLOCK_CACHE_NULL) 
+    {
+        *strv = NULL;
+        return true;
+    }
+    if (length > (gsize)(reader->end - reader->pos))
+        return false;
+    result = g_new0(char *, length + 1);
+    for (guint32 i=0; i<length; i++) 
+    {
+        if (!adblock_cache_read_string(reader, &result[i]) || result[i] == NULL) 
+        {
+            g_free(result);
+            return false;
+        }
+    }
+    *strv = result;
+    return true;
+}/*}}}*/
+
+/* adblock_cache_read_filter(AdblockCacheReader *, AdblockFilter *) {{{*/
+static gboolean
+adblock_cache_read_filter(AdblockCacheReader *reader, AdblockFilter *filter) 
+{
+    guint32 length, options, attributes, flags;
+    char *pattern, *regex;
+    AdblockRule *rule;
+    GError *error = NULL;
+
+    if (!adblock_cache_read_int(reader, &length))
+        return false;
+    for (guint32 i=0; i<length; i++) 
+    {
+        if (!adblock_cache_read_int(reader, &options) || 
+                !adblock_cache_read_int(reader, &attributes) || 
+                !adblock_cache_read_string(reader, &pattern) || 
+                !adblock_cache_read_string(reader, &regex))
+            return false;
+
+        rule = adblock_rule_new();
+        rule->options = options;
+        rule->attributes = attributes;
+        rule->pattern = pattern;
+        if (regex != NULL) 
+        {
+            if (!adblock_cache_read_int(reader, &flags)) 
+            {
+                adblock_rule_free(rule);
+                return false;
+            }
+            rule->regex = g_regex_new(regex, flags, 0, &error);
+            if (error != NULL) 
+            {
+                g_clear_error(&error);
+                adblock_rule_free(rule);
+                return false;
+            }
+        }
+        if (!adblock_cache_read_strv(reader, &rule->domains)) 
+        {
+            adblock_rule_free(rule);
+            return false;
+        }
+        adblock_filter_add(filter, rule);
+    }
+    return true;
+}/*}}}*/
+
+/* adblock_cache_get_path(const char *filterlist) {{{*/
+static char *
+adblock_cache_get_path(const char *filterlist) 
+{
+    char buffer[PATH_MAX];
+    char *dir = g_build_filename(dwb.files[FILES_CACHEDIR], "adblock", NULL);
+    char *path = NULL;
+
+    if (g_mkdir_with_parents(dir, 0700) == 0) 
+        path = g_build_filename(dir, util_normalize_filename(buffer, filterlist, sizeof(buffer)), NULL);
+    g_free(dir);
+    return path;
+}/*}}}*/
+
+/* adblock_cache_get_key(const char *filterlist, const char *content) {{{*/
+static char *
+adblock_cache_get_key(const char *filterlist, const char *content) 
+{
+    struct stat st;
+    char *checksum, *key;
+
+    if (stat(filterlist, &st) != 0)
+        return NULL;
+    checksum = g_compute_checksum_for_string(G_CHECKSUM_SHA1, content, -1);
+    key = g_strdup_printf("%ld:%s", (long)st.st_mtime, checksum);
+    g_free(checksum);
+    return key;
+}/*}}}*/
+
+/* adblock_cache_load(const char *path, const char *key) {{{*/
+static gboolean
+adblock_cache_load(const char *path, const char *key) 
+{
+    AdblockCacheReader reader;
+    AdblockElementHider *hider;
+    char *cached_key, *selector, **domains, *css_rule;
+    guint32 length;
+
+    s_cache = g_mapped_file_new(path, false, NULL);
+    if (s_cache == NULL)
+        return false;
+
+    reader.pos = g_mapped_file_get_contents(s_cache);
+    reader.end = reader.pos + g_mapped_file_get_length(s_cache);
+
+    if ((gsize)(reader.end - reader.pos) < sizeof(ADBLOCK_CACHE_MAGIC) - 1 || 
+            strncmp(reader.pos, ADBLOCK_CACHE_MAGIC, sizeof(ADBLOCK_CACHE_MAGIC) - 1))
+        return false;
+    reader.pos += sizeof(ADBLOCK_CACHE_MAGIC) - 1;
+
+    if (!adblock_cache_read_string(&reader, &cached_key) || g_strcmp0(cached_key, key))
+        return false;
+
+    if (!adblock_cache_read_filter(&reader, s_simple_rules) || 
+            !adblock_cache_read_filter(&reader, s_simple_exceptions) || 
+            !adblock_cache_read_filter(&reader, s_rules) || 
+            !adblock_cache_read_filter(&reader, s_exceptions))
+        return false;
+
+    if (!adblock_cache_read_int(&reader, &length))
+        return false;
+    for (guint32 i=0; i<length; i++) 
+    {
+        if (!adblock_cache_read_string(&reader, &selector) || selector == NULL || 
+                !adblock_cache_read_strv(&reader, &domains) || domains == NULL)
+            return false;
+        hider = dwb_malloc(sizeof(AdblockElementHider));
+        hider->selector = selector;
+        hider->domains = domains;
+        adblock_element_hider_add(hider);
+    }
+
+    if (!adblock_cache_read_int(&reader, &length))
+        return false;
+    for (guint32 i=0; i<length; i++) 
+    {
+        if (!adblock_cache_read_string(&reader, &css_rule) || css_rule == NULL)
+            return false;
+        s_css_hider_list = g_slist_append(s_css_hider_list, css_rule);
+    }
+    return reader.pos == reader.end;
+}/*}}}*/
+
+/* adblock_cache_save(const char *path, const char *key) {{{*/
+static void
+adblock_cache_save(const char *path, const char *key) 
+{
+    GError *error = NULL;
+    GString *buffer = g_string_new(ADBLOCK_CACHE_MAGIC);
+
+    adblock_cache_write_string(buffer, key);
+    adblock_cache_write_filter(buffer, s_simple_rules);
+    adblock_cache_write_filter(buffer, s_simple_exceptions);
+    adblock_cache_write_filter(buffer, s_rules);
+    adblock_cache_write_filter(buffer, s_exceptions);
+
+    adblock_cache_write_int(buffer, g_slist_length(s_hider_list));
+    for (GSList *l = s_hider_list; l; l=l->next) 
+    {
+        AdblockElementHider *hider = l->data;
+        adblock_cache_write_string(buffer, hider->selector);
+        adblock_cache_write_strv(buffer, hider->domains);
+    }
+
+    adblock_cache_write_int(buffer, g_slist_length(s_css_hider_list));
+    for (GSList *l = s_css_hider_list; l; l=l->next) 
+        adblock_cache_write_string(buffer, l->data);
+
+    if (!g_file_set_contents(path, buffer->str, buffer->len, &error)) 
+    {
+        fprintf(stderr, "Cannot write adblock cache: %s\n", error->message);
+        g_clear_error(&error);
+    }
+    g_string_free(buffer, true);
+}/*}}}*//*}}}*/
+
 /* adblock_end() {{{*/
 void 
 adblock_end() 
 {
+    if (s_pool != NULL) 
+    {
+        g_thread_pool_free(s_pool, false, true);
+        s_pool = NULL;
+    }
     for (GSList *l = s_css_hider_list; l; l=l->next) 
-        g_free(l->data);
+        adblock_free(l->data);
     
     g_slist_free(s_css_hider_list);
+    s_css_hider_list = NULL;
+    g_free(s_css_hider_style);
+    s_css_hider_style = NULL;
+    if (s_domain_css != NULL) 
+    {
+        g_hash_table_unref(s_domain_css);
+        s_domain_css = NULL;
+    }
     if (s_css_exceptions != NULL) 
+    {
         g_string_free(s_css_exceptions, true);
-    if (s_rules != NULL) 
-        g_ptr_array_free(s_rules, true);
-    if (s_simple_rules != NULL) 
-        g_ptr_array_free(s_simple_rules, true);
-    if (s_simple_exceptions != NULL) 
-        g_ptr_array_free(s_simple_exceptions, true);
-    if(s_exceptions != NULL) 
-        g_ptr_array_free(s_exceptions, true);
+        s_css_exceptions = NULL;
+    }
+    adblock_filter_free(s_rules);
+    adblock_filter_free(s_simple_rules);
+    adblock_filter_free(s_simple_exceptions);
+    adblock_filter_free(s_exceptions);
+    s_rules = s_simple_rules = s_simple_exceptions = s_exceptions = NULL;
     if (s_hider_rules != NULL) 
-        g_hash_table_remove_all(s_hider_rules);
+    {
+        g_hash_table_unref(s_hider_rules);
+        s_hider_rules = NULL;
+    }
     if (s_hider_list != NULL) 
     {
         for (GSList *l = s_hider_list; l; l=l->next) 
             adblock_element_hider_free((AdblockElementHider*)l->data);
 
         g_slist_free(s_hider_list);
+        s_hider_list = NULL;
+    }
+    s_has_hider_rules = false;
+    adblock_decision_flush();
+    if (s_cache != NULL) 
+    {
+        g_mapped_file_unref(s_cache);
+        s_cache = NULL;
     }
+    s_init = false;
 }/*}}}*/
 
-/* adblock_init() {{{*/
-gboolean
-adblock_init() 
+/* adblock_alloc() {{{*/
+static void
+adblock_alloc() 
 {
-    if (s_init)
-        return true;
-    if (!GET_BOOL("adblocker"))
-        return false;
+    s_rules              = adblock_filter_new();
+    s_exceptions         = adblock_filter_new();
+    s_simple_rules       = adblock_filter_new();
+    s_simple_exceptions  = adblock_filter_new();
+    s_hider_rules        = g_hash_table_new_full((GHashFunc)g_str_hash, (GEqualFunc)g_str_equal, 
+            (GDestroyNotify)g_free, (GDestroyNotify)g_slist_free);
+    s_css_exceptions     = g_string_new(NULL);
+    s_domain_css         = g_hash_table_new_full((GHashFunc)g_str_hash, (GEqualFunc)g_str_equal, 
+            (GDestroyNotify)g_free, (GDestroyNotify)g_free);
+}/*}}}*/
 
+/* adblock_load_filters() {{{*/
+static gboolean
+adblock_load_filters() 
+{
     char *filterlist = GET_CHAR("adblocker-filterlist");
     if (filterlist == NULL)
         return false;
 
     char buffer[PATH_MAX];
+    char *content = NULL;
+    char *key, *path;
 
     filterlist = util_expand_home(buffer, filterlist, sizeof(buffer));
     if (!g_file_test(filterlist, G_FILE_TEST_EXISTS)) 
@@ -933,16 +1758,189 @@ adblock_init()
         fprintf(stderr, "Filterlist not found: %s\n", filterlist);
         return false;
     }
+    if  (g_file_test(filterlist, G_FILE_TEST_IS_DIR)) 
+    {
+        GString *string = g_string_new(NULL);
+        util_get_directory_content(string, filterlist, NULL);
+        content = g_string_free(string, false);
+    }
+    else 
+        content = util_get_file_content(filterlist, NULL);
 
-    s_rules              = g_ptr_array_new_with_free_func((GDestroyNotify)adblock_rule_free);
-    s_exceptions         = g_ptr_array_new_with_free_func((GDestroyNotify)adblock_rule_free);
-    s_simple_rules       = g_ptr_array_new_with_free_func((GDestroyNotify)adblock_rule_free);
-    s_simple_exceptions  = g_ptr_array_new_with_free_func((GDestroyNotify)adblock_rule_free);
-    s_hider_rules        = g_hash_table_new_full((GHashFunc)g_str_hash, (GEqualFunc)g_str_equal, (GDestroyNotify)g_free, NULL);
-    s_css_exceptions     = g_string_new(NULL);
+    if (content == NULL)
+        return false;
+
+    adblock_decision_flush();
+    adblock_alloc();
 
-    adblock_rule_parse(filterlist);
+    key = adblock_cache_get_key(filterlist, content);
+    path = adblock_cache_get_path(filterlist);
+    if (key == NULL || path == NULL || !adblock_cache_load(path, key)) 
+    {
+        /* stale or corrupt cache, start from scratch */
+        adblock_end();
+        adblock_alloc();
+        adblock_rule_parse(content);
+        if (key != NULL && path != NULL)
+            adblock_cache_save(path, key);
+    }
+    if (s_css_hider_list != NULL) 
+    {
+        GString *style = g_string_new(NULL);
+        for (GSList *l = s_css_hider_list; l; l=l->next) 
+        {
+            g_string_append(style, l->data);
+            g_string_append_c(style, '\n');
+        }
+        s_css_hider_style = g_string_free(style, false);
+    }
     s_init = true;
 
+    g_free(key);
+    g_free(path);
+    g_free(content);
     return true;
+}/*}}}*/
+
+/* adblock_init() {{{*/
+gboolean
+adblock_init() 
+{
+    if (s_init)
+        return true;
+    if (!GET_BOOL("adblocker"))
+        return false;
+
+    return adblock_load_filters();
+}/*}}}*/
+
+/* adblock_benchmark_run(char **lines, int *n_requests, int *n_blocked) {{{
+ * Replays the corpus once, returns the time spent matching
+ * */
+static gdouble
+adblock_benchmark_run(char **lines, int *n_requests, int *n_blocked) 
+{
+    static const struct {
+        const char *name;
+        AdblockAttribute attribute;
+    } types[] = {
+        { "script",     AA_SCRIPT },
+        { "image",      AA_IMAGE },
+        { "stylesheet", AA_STYLESHEET },
+        { "object",     AA_OBJECT },
+    };
+    char **fields;
+    const char *uri, *firsturi;
+    SoupURI *suri, *sfirst_party;
+    AdblockAttribute attributes;
+    gboolean blocked;
+    gdouble elapsed;
+
+    *n_requests = *n_blocked = 0;
+
+    GTimer *timer = g_timer_new();
+    g_timer_stop(timer);
+    for (int i=0; lines[i] != NULL; i++) 
+    {
+        fields = g_strsplit(g_strstrip(lines[i]), " ", 3);
+        if (fields[0] == NULL || *fields[0] == '\0' || *fields[0] == '#') 
+            goto next;
+
+        uri = fields[0];
+        firsturi = fields[1] != NULL ? fields[1] : uri;
+        blocked = false;
+
+        if (fields[1] != NULL && fields[2] != NULL) 
+        {
+            attributes = AA_SUBDOCUMENT;
+            for (guint j=0; j<LENGTH(types); j++) 
+            {
+                if (!g_strcmp0(fields[2], types[j].name))
+                    attributes |= types[j].attribute;
+            }
+            g_timer_continue(timer);
+            blocked = adblock_prepare_match(uri, firsturi, attributes);
+            g_timer_stop(timer);
+        }
+        else 
+        {
+            suri = soup_uri_new(uri);
+            sfirst_party = soup_uri_new(firsturi);
+            if (suri != NULL && sfirst_party != NULL && suri->host != NULL && sfirst_party->host != NULL) 
+            {
+                g_timer_continue(timer);
+                blocked = adblock_match_request(uri, suri->host, sfirst_party->host, AA_SUBDOCUMENT);
+                g_timer_stop(timer);
+            }
+            if (suri != NULL)
+                soup_uri_free(suri);
+            if (sfirst_party != NULL)
+                soup_uri_free(sfirst_party);
+        }
+        (*n_requests)++;
+        if (blocked)
+            (*n_blocked)++;
+next:
+        g_strfreev(fields);
+    }
+    elapsed = g_timer_elapsed(timer, NULL);
+    g_timer_destroy(timer);
+    return elapsed;
+}/*}}}*/
+
+/* adblock_benchmark(const char *corpus) {{{
+ * Replays a corpus of requests against the filters. Every line of the corpus
+ * consists of the uri of a request, optionally followed by the uri of the page
+ * and the type of the element that is loaded, e.g. 'script' or 'image'. 
+ * Requests without a type are checked like resource requests.
+ * The corpus is replayed twice, first without the decision cache to measure
+ * the matcher, then with an empty cache.
+ * */
+int
+adblock_benchmark(const char *corpus) 
+{
+    AdblockFilter *filters[4];
+    char **lines;
+    int n_requests, n_blocked;
+    guint n_rules = 0, n_tokens = 0, n_untokenized = 0;
+    gdouble matcher, cached;
+
+    if (!s_init && !adblock_load_filters()) 
+        return 1;
+
+    lines = util_get_lines(corpus);
+    if (lines == NULL) 
+    {
+        fprintf(stderr, "Cannot read corpus %s\n", corpus);
+        return 1;
+    }
+
+    filters[0] = s_simple_rules; 
+    filters[1] = s_simple_exceptions; 
+    filters[2] = s_rules; 
+    filters[3] = s_exceptions;
+    for (guint i=0; i<LENGTH(filters); i++) 
+    {
+        n_rules += filters[i]->rules->len;
+        n_tokens += g_hash_table_size(filters[i]->tokens);
+        n_untokenized += filters[i]->untokenized->len;
+    }
+
+    adblock_decision_flush();
+    s_decisions_disabled = true;
+    matcher = adblock_benchmark_run(lines, &n_requests, &n_blocked);
+    s_decisions_disabled = false;
+
+    cached = adblock_benchmark_run(lines, &n_requests, &n_blocked);
+    g_strfreev(lines);
+
+    printf("Rules       : %u (%u indexed by %u tokens, %u untokenized)\n", 
+            n_rules, n_rules - n_untokenized, n_tokens, n_untokenized);
+    printf("Requests    : %d (%d blocked)\n", n_requests, n_blocked);
+    printf("Matcher     : %.3f s (%.2f us/request)\n", 
+            matcher, n_requests > 0 ? matcher * 1000000 / n_requests : 0);
+    printf("Cached      : %.3f s (%.2f us/request)\n", 
+            cached, n_requests > 0 ? cached * 1000000 / n_requests : 0);
+    printf("Cache       : %u hits, %u misses\n", s_decision_hits, s_decision_misses);
+    return 0;
 }/*}}}*//*}}}*/
@@ -24,5 +24,7 @@ gboolean adblock_running();
 void adblock_end();
 void adblock_connect(GList *gl);
 void adblock_disconnect(GList *gl);
+int adblock_benchmark(const char *corpus);
+void adblock_get_stats(guint *hits, guint *misses, guint *size);
 
 #endif // ADBLOCK_H
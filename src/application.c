@@ -17,13 +17,13 @@
  */
 
 #include <gtk/gtk.h>
-#include <sys/stat.h>
-#include <fcntl.h>
 #include "dwb.h"
 #include "view.h"
 #include "session.h"
 #include "util.h"
 #include "scripts.h"
+#include "adblock.h"
+#include "control.h"
 
 static gboolean application_parse_option(const gchar *, const gchar *, gpointer , GError **);
 static void application_execute_args(char **);
@@ -39,7 +39,7 @@ static gboolean s_opt_force = false;
 static gboolean s_opt_enable_scripts = false;
 static gchar *s_opt_restore = NULL;
 static gchar **s_opt_exe = NULL;
-static GIOChannel *s_fallback_channel;
+static gchar *s_opt_adblock_corpus = NULL;
 static GOptionEntry options[] = {
     { "embed", 'e', 0, G_OPTION_ARG_INT64, &dwb.gui.wid, "Embed into window with window id wid", "wid"},
     { "force", 'f', 0, G_OPTION_ARG_NONE, &s_opt_force, "Force restoring a saved session, even if another process has restored the session", NULL },
@@ -51,6 +51,7 @@ static GOptionEntry options[] = {
     { "execute", 'x', 0, G_OPTION_ARG_STRING_ARRAY, &s_opt_exe, "Execute commands", NULL},
     { "version", 'v', 0, G_OPTION_ARG_NONE, &s_opt_version, "Show version information and exit", NULL},
     { "enable-scripts", 'S', 0, G_OPTION_ARG_NONE, &s_opt_enable_scripts, "Enable javascript api", NULL},
+    { "benchmark-adblock", 0, 0, G_OPTION_ARG_FILENAME, &s_opt_adblock_corpus, "Replay the urls in 'corpus' against the adblock filters and exit", "corpus"},
     { NULL, 0, 0, 0, NULL, NULL, NULL }
 };
 static GOptionContext *option_context;
@@ -106,23 +107,6 @@ dwb_application_command_line(GApplication *app, GApplicationCommandLine *cl)
 }
 
 
-/* dwb_handle_channel {{{*/
-static gboolean
-application_handle_channel(GIOChannel *c, GIOCondition condition) 
-{
-    char *line = NULL;
-
-    g_io_channel_read_line(c, &line, NULL, NULL, NULL);
-    if (line) 
-    {
-        g_strstrip(line);
-        dwb_parse_commands(line);
-        g_io_channel_flush(c, NULL);
-        g_free(line);
-    }
-    return true;
-}/*}}}*/
-
 static char *
 application_local_path(const char *file) 
 {
@@ -146,10 +130,8 @@ dwb_application_local_command_line(GApplication *app, gchar ***argv, gint *exit_
     gint argc_remain, argc_exe = 0;
     gint argc = g_strv_length(*argv);
     gint i, count;
-    gchar **restore_args;
-    gint fd = -1;
-    FILE *ff = NULL; 
-    gchar *path, *unififo = NULL;
+    gchar **restore_args, **commands;
+    gchar *path;
     char *appid;
     GDBusConnection *bus;
 
@@ -183,6 +165,12 @@ dwb_application_local_command_line(GApplication *app, gchar ***argv, gint *exit_
     dwb_init_files();
     dwb_init_settings();
 
+    if (s_opt_adblock_corpus != NULL) 
+    {
+        *exit_status = adblock_benchmark(s_opt_adblock_corpus);
+        return true;
+    }
+
     single_instance = GET_BOOL("single-instance");
     if (s_opt_single || !single_instance) 
         g_application_set_flags(app, G_APPLICATION_NON_UNIQUE);
@@ -241,44 +229,33 @@ dwb_application_local_command_line(GApplication *app, gchar ***argv, gint *exit_
         }
         else 
         {
-            path = util_build_path();
-            unififo = g_build_filename(path, dwb.misc.profile, "dwb-uni.fifo", NULL);
-            g_free(path);
-
-            if (! g_file_test(unififo, G_FILE_TEST_EXISTS)) 
-                mkfifo(unififo, 0600);
-
-            fd = open(unififo, O_WRONLY | O_NONBLOCK);
-
-            if ( (ff = fdopen(fd, "w")) )
-                remote = true;
-
-            if ( remote ) 
+            /* Only commands are sent to a running instance, without
+             * arguments a new window is opened like before */
+            commands = g_malloc0_n(argc_remain + argc_exe + 1, sizeof(char*));
+            count = 0;
+            for (i=1; (*argv)[i]; i++) 
             {
-                if (argc_remain > 1 || s_opt_exe != NULL) 
+                if ( (path = application_local_path((*argv)[i])) ) 
                 {
-                    for (int i=1; (*argv)[i]; i++) 
-                    {
-                        if ( (path = application_local_path((*argv)[i])) ) 
-                        {
-                            fprintf(ff, "tabopen %s\n", path);
-                            g_free (path);
-                        }
-                        else 
-                            fprintf(ff, "tabopen %s\n", (*argv)[i]);
-                    }
-                    if (s_opt_exe != NULL) 
-                    {
-                        for (int i = 0; s_opt_exe[i]; i++) 
-                            fprintf(ff, "%s\n", s_opt_exe[i]);
-                    }
-                    goto clean;
+                    commands[count++] = g_strconcat("tabopen ", path, NULL);
+                    g_free (path);
                 }
+                else 
+                    commands[count++] = g_strconcat("tabopen ", (*argv)[i], NULL);
             }
-            else 
+            for (i=0; i<argc_exe; i++) 
+                commands[count++] = g_strdup(s_opt_exe[i]);
+
+            i = control_send(commands);
+            g_strfreev(commands);
+            if (i != -1) 
             {
-                GIOChannel *s_fallback_channel = g_io_channel_new_file(unififo, "r+", NULL);
-                g_io_add_watch(s_fallback_channel, G_IO_IN, (GIOFunc)application_handle_channel, NULL);
+                remote = true;
+                if (count > 0) 
+                {
+                    *exit_status = i > 0 ? 1 : 0;
+                    return true;
+                }
             }
         }
     }
@@ -286,12 +263,6 @@ dwb_application_local_command_line(GApplication *app, gchar ***argv, gint *exit_
         s_opt_force = true;
 
     application_start(app, *argv);
-clean:
-    if (ff != NULL)
-        fclose(ff);
-    if(fd > 0)
-        close(fd);
-    g_free(unififo);
     return true;
 }
 
@@ -350,6 +321,7 @@ application_start(GApplication *app, char **argv)
 
     dwb_pack(GET_CHAR("widget-packing"), false);
     scripts_init(s_opt_enable_scripts);
+    control_init();
 
     if (s_opt_force) 
         session_flags |= SESSION_FORCE;
@@ -417,11 +389,7 @@ application_parse_option(const gchar *key, const gchar *value, gpointer data, GE
 void /* application_stop() {{{*/
 application_stop(void) 
 {
-    if (s_fallback_channel != NULL) 
-    {
-        g_io_channel_shutdown(s_fallback_channel, true, NULL);
-        g_io_channel_unref(s_fallback_channel);
-    }
+    control_end();
     g_application_release(G_APPLICATION(s_app));
 }/*}}}*/
 
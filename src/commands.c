@@ -21,6 +21,8 @@
 #include "util.h"
 #include "view.h"
 #include "session.h"
+#include "history.h"
+#include "journal.h"
 #include "soup.h"
 #include "html.h"
 #include "commands.h"
@@ -32,6 +34,7 @@
 #include "scripts.h"
 #include "editor.h"
 #include "dom.h"
+#include "sync.h"
 
 inline static int 
 dwb_floor(double x) { 
@@ -264,8 +267,12 @@ commands_bookmark(KeyMap *km, Arg *arg)
     gboolean noerror = STATUS_ERROR;
     if ( (noerror = dwb_prepend_navigation(dwb.state.fview, &dwb.fc.bookmarks)) == STATUS_OK) 
     {
-        util_file_add_navigation(dwb.files[FILES_BOOKMARKS], dwb.fc.bookmarks->data, true, -1);
+        Navigation *n = dwb.fc.bookmarks->data;
+        char *text = g_strdup_printf("%s %s", n->first, n->second ? n->second : "");
+        journal_append(dwb.misc.bookmarks_journal, JOURNAL_ADD, text);
+        g_free(text);
         dwb.fc.bookmarks = g_list_sort(dwb.fc.bookmarks, (GCompareFunc)util_navigation_compare_first);
+        dwb_index_bookmarks();
         dwb_set_normal_message(dwb.state.fview, true, "Saved bookmark: %s", webkit_web_view_get_uri(CURRENT_WEBVIEW()));
     }
     return noerror;
@@ -350,7 +357,7 @@ commands_set_zoom_level(KeyMap *km, Arg *arg)
     GList *gl = arg->p ? arg->p : dwb.state.fview;
     double zoomlevel = dwb.state.nummod < 0 ? arg->d : (double)dwb.state.nummod  / 100;
 
-    webkit_web_view_set_zoom_level(WEBKIT_WEB_VIEW(((View*)gl->data)->web), zoomlevel);
+    webkit_web_view_set_zoom_level(WEBVIEW(gl), zoomlevel);
     dwb_set_normal_message(dwb.state.fview, true, "Zoomlevel: %d%%", (int)(zoomlevel * 100));
     return STATUS_OK;
 }/*}}}*/
@@ -551,8 +558,8 @@ commands_bookmarks(KeyMap *km, Arg *arg)
     completion_complete(COMP_BOOKMARK, 0);
     entry_focus();
 
-    if (dwb.comps.active_comp != NULL) 
-        completion_set_entry_text((Completion*)dwb.comps.active_comp->data);
+    if (dwb.comps.completions != NULL) 
+        completion_set_entry_text(COMPLETION_ACTIVE_ITEM());
 
     return STATUS_OK;
 }/*}}}*/
@@ -864,6 +871,7 @@ commands_toggle_lock_protect(KeyMap *km, Arg *arg)
 
   View *v = VIEW(gl);
   v->status->lockprotect ^= arg->n;
+  sync_set_dirty(SYNC_SESSION);
   dwb_update_status(gl, NULL);
 
   if (arg->n & LP_VISIBLE && gl != dwb.state.fview)
@@ -926,6 +934,7 @@ commands_tab_move(KeyMap *km, Arg *arg)
     gtk_box_reorder_child(GTK_BOX(dwb.gui.mainbox), CURRENT_VIEW()->scroll, newpos);
 
     dwb.state.views = g_list_remove_link(dwb.state.views, dwb.state.fview);
+    sync_set_dirty(SYNC_SESSION);
 
     sibling = g_list_nth(dwb.state.views, newpos);
     g_list_position(dwb.state.fview, sibling);
@@ -990,20 +999,28 @@ commands_sanitize(KeyMap *km, Arg *arg)
 
     if (s & SANITIZE_HISTORY) 
     {
-        dwb_free_list(dwb.fc.history, (void_func)dwb_navigation_free);
-        dwb.fc.history = NULL;
-        remove(dwb.files[FILES_HISTORY]);
+        history_clear();
     }
     if (s & (SANITIZE_HISTORY | SANITIZE_CACHE)) 
     {
         for (GList *gl = dwb.state.views; gl; gl=gl->next) 
         {
+            Placeholder *p = VIEW(gl)->status->placeholder;
+            /* the tab files still contain the old history */
+            VIEW(gl)->status->generation++;
+            if (p != NULL) 
+            {
+                g_free(p->history);
+                p->history = p->uri != NULL ? g_strdup_printf("0 %s %s\n", p->uri, p->title) : g_strdup("");
+                continue;
+            }
             WebKitWebBackForwardList *bf_list = webkit_web_view_get_back_forward_list(WEBVIEW(gl));
             webkit_web_back_forward_list_clear(bf_list);
         }
+        sync_set_dirty(SYNC_SESSION);
     }
     if (s & SANITIZE_COOKIES) 
-        remove(dwb.files[FILES_COOKIES]);
+        dwb_soup_remove_cookies();
 
     if (s & (SANITIZE_CACHE | SANITIZE_COOKIES)) 
         dwb_soup_clear_cookies();
@@ -1012,7 +1029,7 @@ commands_sanitize(KeyMap *km, Arg *arg)
         session_clear_session();
 
     if (s & (SANITIZE_ALLSESSIONS)) 
-        remove(dwb.files[FILES_SESSION]);
+        session_remove_all();
 
     dwb_set_normal_message(dwb.state.fview, true, "Sanitized %s", arg->p ? arg->p : "all");
     return STATUS_OK;
@@ -1063,3 +1080,21 @@ commands_reload_quickmarks(KeyMap *km, Arg *arg)
     dwb_reload_quickmarks();
     return STATUS_OK;
 }
+DwbStatus
+commands_sync_stats(KeyMap *km, Arg *arg)
+{
+    char *stats = sync_get_stats();
+    dwb_set_normal_message(dwb.state.fview, true, "%s", stats);
+    g_free(stats);
+    return STATUS_OK;
+}
+DwbStatus
+commands_adblock_stats(KeyMap *km, Arg *arg)
+{
+    guint hits, misses, size;
+    if (!adblock_running())
+        return STATUS_ERROR;
+    adblock_get_stats(&hits, &misses, &size);
+    dwb_set_normal_message(dwb.state.fview, true, "Adblock cache: %u hits, %u misses, %u entries", hits, misses, size);
+    return STATUS_OK;
+}
@@ -17,6 +17,8 @@
  */
 
 #include <string.h>
+#include <stdlib.h>
+#include <time.h>
 #include <libgen.h>
 #include <gdk/gdkkeysyms.h> 
 #include "dwb.h"
@@ -24,11 +26,22 @@
 #include "util.h"
 #include "entry.h"
 #include "completion.h"
+#include "history.h"
+#include "trigram.h"
+#include "dispatch.h"
+
+/* number of history and bookmark completions */
+#define COMPLETION_MAX_RESULTS 100
 
 static GList * completion_update_completion(GtkWidget *box, GList *comps, GList *active, int max, int back);
-static GList * completion_get_simple_completion(GList *gl);
+static void completion_get_simple_completion(GPtrArray *store, GList *gl);
 
 typedef gboolean (*Match_Func)(char*, const char*);
+typedef struct _CompletionCandidate {
+    Navigation *n;
+    int score;
+    guint order;
+} CompletionCandidate;
 static char *s_typed;
 static int s_last_buf;
 static gboolean s_leading0 = false;
@@ -93,14 +106,41 @@ completion_get_completion_item(const char  *left, const char *right, const char
     return c;
 }/*}}}*/
 
+/* completion_add_item(GPtrArray *store, const char *left, const char *right, const char *middle, void *data) {{{
+ * Candidates are only data, rows are created for the visible candidates
+ * */
+static CompletionItem * 
+completion_add_item(GPtrArray *store, const char *left, const char *right, const char *middle, void *data) 
+{
+    CompletionItem *item = g_malloc(sizeof(CompletionItem));
+    item->left = g_strdup(left);
+    item->right = g_strdup(right);
+    item->middle = g_strdup(middle);
+    item->markup = false;
+    item->data = data;
+    g_ptr_array_add(store, item);
+    return item;
+}/*}}}*/
+
+/* completion_item_free(CompletionItem *) {{{*/
+static void 
+completion_item_free(CompletionItem *item) 
+{
+    g_free(item->left);
+    g_free(item->right);
+    g_free(item->middle);
+    g_free(item);
+}/*}}}*/
+
 /* completion_init_completion {{{*/
-static GList * 
-completion_init_completion(GList *store, GList *gl, gboolean word_beginnings, void *data, const char *value) 
+static void 
+completion_init_completion(GPtrArray *store, GList *gl, gboolean word_beginnings, void *data, const char *value) 
 {
     Navigation *n;
     const char *input = GET_TEXT();
     gboolean match;
     char **token = NULL;
+    g_free(s_typed);
     s_typed = g_strdup(input);
     if (dwb.state.mode & COMMAND_MODE) 
         input = strchr(input, ' ');
@@ -131,30 +171,135 @@ completion_init_completion(GList *store, GList *gl, gboolean word_beginnings, vo
             }
         }
         if (match) 
+            completion_add_item(store, n->first, n->second, value, data);
+    }
+    g_strfreev(token);
+}/*}}}*/
+
+/* completion_score(Navigation *n, char **token, int frecency) {{{
+ * Matches at the beginning of the host rank higher than matches somewhere in
+ * the uri, which rank higher than matches in the title
+ * */
+static int
+completion_score(Navigation *n, char **token, int frecency) 
+{
+    const char *host = strstr(n->first, "://");
+    int quality = 1;
+    size_t length;
+
+    host = host != NULL ? host + 3 : n->first;
+    if (!g_ascii_strncasecmp(host, "www.", 4))
+        host += 4;
+
+    for (int i=0; token[i] != NULL; i++) 
+    {
+        if ((length = strlen(token[i])) == 0)
+            continue;
+        if (!g_ascii_strncasecmp(host, token[i], length))
+            quality += 2;
+        else if (util_strcasestr(n->first, token[i]))
+            quality += 1;
+    }
+    return (frecency + 1) * quality;
+}/*}}}*/
+
+/* completion_candidate_less(CompletionCandidate *, CompletionCandidate *) {{{*/
+static gboolean
+completion_candidate_less(const CompletionCandidate *a, const CompletionCandidate *b) 
+{
+    return a->score < b->score || (a->score == b->score && a->order > b->order);
+}/*}}}*/
+
+/* completion_candidate_compare(CompletionCandidate *, CompletionCandidate *) {{{*/
+static int
+completion_candidate_compare(const CompletionCandidate *a, const CompletionCandidate *b) 
+{
+    if (completion_candidate_less(a, b))
+        return 1;
+    if (completion_candidate_less(b, a))
+        return -1;
+    return 0;
+}/*}}}*/
+
+/* completion_heap_push(CompletionCandidate *heap, guint *size, guint max, CompletionCandidate *c) {{{
+ * Keeps the max best candidates in a min-heap
+ * */
+static void
+completion_heap_push(CompletionCandidate *heap, guint *size, guint max, const CompletionCandidate *c) 
+{
+    CompletionCandidate tmp;
+    guint i, child;
+
+    if (*size < max) 
+    {
+        i = (*size)++;
+        heap[i] = *c;
+        for (; i > 0 && completion_candidate_less(&heap[i], &heap[(i-1)/2]); i = (i-1)/2) 
         {
-            Completion *c = completion_get_completion_item(n->first, n->second, value, data);
-            gtk_box_pack_start(GTK_BOX(dwb.gui.compbox), c->event, false, false, 0);
-            store = g_list_append(store, c);
+            tmp = heap[i]; heap[i] = heap[(i-1)/2]; heap[(i-1)/2] = tmp;
+        }
+    }
+    else if (max > 0 && completion_candidate_less(&heap[0], c)) 
+    {
+        heap[0] = *c;
+        for (i=0; (child = 2*i + 1) < *size; i = child) 
+        {
+            if (child + 1 < *size && completion_candidate_less(&heap[child+1], &heap[child]))
+                child++;
+            if (!completion_candidate_less(&heap[child], &heap[i]))
+                break;
+            tmp = heap[i]; heap[i] = heap[child]; heap[child] = tmp;
         }
     }
-    g_strfreev(token);
-    return store;
 }/*}}}*/
 
-/* dwb_completion_set_text(Completion *) {{{*/
-void
-completion_set_entry_text(Completion *c) 
+/* completion_init_indexed_completion(GList *store, TrigramIndex *index, gboolean history, const char *value) {{{
+ * Completes history or bookmarks with the trigram index, only the
+ * COMPLETION_MAX_RESULTS best matches are added
+ * */
+static void 
+completion_init_indexed_completion(GPtrArray *store, TrigramIndex *index, gboolean history, const char *value) 
 {
-    const char *text; 
-    int l;
-    CompletionType type = dwb_eval_completion_type();
-    switch (type) 
+    const char *input = GET_TEXT();
+    CompletionCandidate heap[COMPLETION_MAX_RESULTS], c;
+    GPtrArray *matches;
+    HistoryEntry *entry;
+    char **token;
+    guint size = 0;
+    gint64 now = time(NULL);
+
+    if (index == NULL)
+        return;
+
+    g_free(s_typed);
+    s_typed = g_strdup(input);
+    if (dwb.state.mode & COMMAND_MODE) 
+        input = strchr(input, ' ');
+    if (input == NULL) 
+        input = "";
+
+    matches = trigram_index_match(index, input);
+    token = g_strsplit(input, " ", -1);
+    for (guint i=0; i<matches->len; i++) 
     {
-        case COMP_QUICKMARK: text = c->data; 
-                             break;
-        default: text = gtk_label_get_text(GTK_LABEL(c->llabel));
-                 break;
+        c.n = matches->pdata[i];
+        c.order = i;
+        entry = history ? (HistoryEntry *)c.n : history_lookup(c.n->first);
+        c.score = completion_score(c.n, token, entry != NULL ? history_frecency(entry, now) : 0);
+        completion_heap_push(heap, &size, COMPLETION_MAX_RESULTS, &c);
     }
+    g_strfreev(token);
+
+    qsort(heap, size, sizeof(CompletionCandidate), (int (*)(const void *, const void *))completion_candidate_compare);
+    for (guint i=0; i<size; i++) 
+        completion_add_item(store, heap[i].n->first, heap[i].n->second, value, NULL);
+}/*}}}*/
+
+/* completion_set_text(const char *) {{{*/
+static void
+completion_set_text(const char *text) 
+{
+    int l;
 
     if (dwb.state.mode & COMMAND_MODE && s_current_command) 
     {
@@ -178,6 +323,16 @@ completion_set_entry_text(Completion *c)
 
 }/*}}}*/
 
+/* completion_set_entry_text(CompletionItem *) {{{*/
+void
+completion_set_entry_text(CompletionItem *item) 
+{
+    if (dwb_eval_completion_type() == COMP_QUICKMARK) 
+        completion_set_text(item->data);
+    else 
+        completion_set_text(item->left);
+}/*}}}*/
+
 /* completion_update_completion(GtkWidget *box, GList *comps, GList *active, int max, int back)    Return *GList (Completions*){{{*/
 static GList *
 completion_update_completion(GtkWidget *box, GList *comps, GList *active, int max, int back) 
@@ -256,7 +411,7 @@ completion_update_completion(GtkWidget *box, GList *comps, GList *active, int ma
     completion_modify_completion_item(old->data, &dwb.color.normal_c_fg, &dwb.color.normal_c_bg, dwb.font.fd_inactive);
     completion_modify_completion_item(new->data, &dwb.color.active_c_fg, &dwb.color.active_c_bg, dwb.font.fd_active);
     active = new;
-    completion_set_entry_text(active->data);
+    completion_set_text(gtk_label_get_text(GTK_LABEL(((Completion*)active->data)->llabel)));
     return active;
 }/*}}}*/
 /*}}}*/
@@ -266,18 +421,19 @@ completion_update_completion(GtkWidget *box, GList *comps, GList *active, int ma
 void 
 completion_clean_completion(gboolean set_text) 
 {
-    for (GList *l = dwb.comps.completions; l; l=l->next) 
-    {
-        g_free(l->data);
-    }
-    g_list_free(dwb.comps.completions);
+    if (dwb.comps.completions != NULL) 
+        g_ptr_array_free(dwb.comps.completions, true);
+    if (dwb.comps.rows != NULL) 
+        g_ptr_array_free(dwb.comps.rows, true);
 
     if (dwb.comps.view != NULL) 
         gtk_widget_destroy(dwb.gui.compbox);
 
     dwb.comps.view = NULL;
     dwb.comps.completions = NULL;
-    dwb.comps.active_comp = NULL;
+    dwb.comps.rows = NULL;
+    dwb.comps.active = 0;
+    dwb.comps.offset = 0;
     if (set_text && s_typed != NULL)
         entry_set_text(s_typed);
 
@@ -297,127 +453,149 @@ completion_clean_completion(gboolean set_text)
         dwb.state.mode &= ~(COMPLETION_MODE|COMPLETE_PATH);
 }/*}}}*/
 
-/* completion_show_completion(int back) {{{*/
+/* completion_render() {{{
+ * Fills the rows with the candidates around the active candidate
+ * */
 static void 
-completion_show_completion(int back) 
+completion_render() 
 {
-    int i=0;
-    if (back) 
-    {
-        dwb.comps.active_comp = g_list_last(dwb.comps.completions);
-        for (GList *l = dwb.comps.active_comp; l && i<dwb.misc.max_c_items; l=l->prev, i++) 
-        {
-            gtk_widget_show_all(((Completion*)l->data)->event);
-        }
-    }
-    else 
+    GPtrArray *items = dwb.comps.completions;
+    GPtrArray *rows = dwb.comps.rows;
+    CompletionItem *item;
+    Completion *c;
+    int n = rows->len;
+
+    dwb.comps.offset = CLAMP(dwb.comps.active - (n - 1) / 2, 0, (int)items->len - n);
+    for (int i=0; i<n; i++) 
     {
-        dwb.comps.active_comp = g_list_first(dwb.comps.completions);
-        for (GList *l = dwb.comps.active_comp; l && i<dwb.misc.max_c_items; l=l->next, i++) 
-        {
-            gtk_widget_show_all(((Completion*)l->data)->event);
-        }
+        item = items->pdata[dwb.comps.offset + i];
+        c = rows->pdata[i];
+        if (item->markup) 
+            gtk_label_set_markup(GTK_LABEL(c->llabel), item->left);
+        else 
+            gtk_label_set_text(GTK_LABEL(c->llabel), item->left);
+        gtk_label_set_text(GTK_LABEL(c->mlabel), item->middle);
+        gtk_label_set_text(GTK_LABEL(c->rlabel), item->right);
+        c->data = item->data;
+
+        if (dwb.comps.offset + i == dwb.comps.active) 
+            completion_modify_completion_item(c, &dwb.color.active_c_fg, &dwb.color.active_c_bg, dwb.font.fd_active);
+        else 
+            completion_modify_completion_item(c, &dwb.color.normal_c_fg, &dwb.color.normal_c_bg, dwb.font.fd_inactive);
     }
-    if (dwb.comps.active_comp != NULL) 
+}/*}}}*/
+
+/* completion_show_completion(int back) {{{
+ * Creates a fixed pool of max-completion rows that are reused while
+ * scrolling
+ * */
+static void 
+completion_show_completion(int back) 
+{
+    GPtrArray *items = dwb.comps.completions;
+    CompletionItem *first = items->pdata[0];
+    Completion *c;
+    int n = MAX(MIN(dwb.misc.max_c_items, (int)items->len), 1);
+
+    dwb.comps.rows = g_ptr_array_new_with_free_func(g_free);
+    for (int i=0; i<n; i++) 
     {
-        completion_modify_completion_item(dwb.comps.active_comp->data, &dwb.color.active_c_fg, &dwb.color.active_c_bg, dwb.font.fd_active);
-        completion_set_entry_text(dwb.comps.active_comp->data);
-        gtk_widget_show(dwb.gui.compbox);
+        c = completion_get_completion_item(NULL, first->right, first->middle, NULL);
+        gtk_box_pack_start(GTK_BOX(dwb.gui.compbox), c->event, false, false, 0);
+        gtk_widget_show_all(c->event);
+        g_ptr_array_add(dwb.comps.rows, c);
     }
-
+    dwb.comps.active = back ? (int)items->len - 1 : 0;
+    completion_render();
+    completion_set_entry_text(items->pdata[dwb.comps.active]);
+    gtk_widget_show(dwb.gui.compbox);
 }/*}}}*/
 
-/* dwb_completion_get_normal      return: GList *Completions{{{*/
-static GList *
-completion_get_normal_completion() 
+/* completion_move(int back) {{{
+ * Moves the active candidate, only the rows are updated
+ * */
+static void 
+completion_move(int back) 
 {
-    GList *list = NULL;
+    int length = dwb.comps.completions->len;
+
+    dwb.comps.active = (dwb.comps.active + (back ? length - 1 : 1)) % length;
+    completion_render();
+    completion_set_entry_text(dwb.comps.completions->pdata[dwb.comps.active]);
+}/*}}}*/
 
+/* dwb_completion_get_normal {{{*/
+static void
+completion_get_normal_completion(GPtrArray *store) 
+{
     if (!(dwb.state.mode & COMMAND_MODE) ) 
     {
         if (GET_BOOL("complete-userscripts")) 
-            list = completion_init_completion(list, dwb.misc.userscripts, false, NULL, "Userscript");
+            completion_init_completion(store, dwb.misc.userscripts, false, NULL, "Userscript");
         if (GET_BOOL("complete-searchengines")) 
-            list = completion_init_completion(list, dwb.fc.se_completion, false, NULL, "Searchengine");
+            completion_init_completion(store, dwb.fc.se_completion, false, NULL, "Searchengine");
     }
     if (GET_BOOL("complete-bookmarks")) 
-        list = completion_init_completion(list, dwb.fc.bookmarks, false, NULL, "Bookmark");
+        completion_init_indexed_completion(store, dwb.comps.bookmarks, false, "Bookmark");
     if (GET_BOOL("complete-history")) 
-        list = completion_init_completion(list, dwb.fc.history, false, NULL, "History");
-
-    return  list;
+        completion_init_indexed_completion(store, dwb.comps.history, true, "History");
 }/*}}}*/
 
-/* completion_get_simple_completion      return: GList *Completions{{{*/
-static GList *
-completion_get_simple_completion(GList *gl) 
+/* completion_get_simple_completion {{{*/
+static void
+completion_get_simple_completion(GPtrArray *store, GList *gl) 
 {
-    GList *list = NULL;
-    list = completion_init_completion(list, gl, false, NULL, NULL);
-    return  list;
+    completion_init_completion(store, gl, false, NULL, NULL);
 }/*}}}*/
 
-/* dwb_completion_get_settings      return: GList *Completions{{{*/
-static GList *
-completion_get_settings_completion() 
+/* dwb_completion_get_settings {{{*/
+static void
+completion_get_settings_completion(GPtrArray *store) 
 {
-    GList *l = g_hash_table_get_values(dwb.settings);
-    l = g_list_sort(l, (GCompareFunc)util_web_settings_sort_first);
+    GList *list = g_hash_table_get_values(dwb.settings);
+    list = g_list_sort(list, (GCompareFunc)util_web_settings_sort_first);
     const char *input = GET_TEXT();
-    GList *list = NULL;
 
-    for (; l; l=l->next) 
+    for (GList *l = list; l; l=l->next) 
     {
         WebSettings *s = l->data;
         Navigation n = s->n;
         if (g_strrstr(n.first, input)) 
         {
             char *value = util_arg_to_char(&s->arg, s->type);
-            Completion *c = completion_get_completion_item(s->n.first, s->n.second, value, s);
-            gtk_box_pack_start(GTK_BOX(dwb.gui.compbox), c->event, false, false, 0);
-            list = g_list_append(list, c);
+            completion_add_item(store, s->n.first, s->n.second, value, s);
+            g_free(value);
         }
     }
-    if (l != NULL)
-        g_list_free(l);
-    return list;
+    g_list_free(list);
 }/*}}}*/
 
-/* completion_create_key_completion(GList *l, const char *first, KeyMap *m) {{{*/
-static GList * 
-completion_create_key_completion(GList *l, const char *first, KeyMap *m) 
+/* completion_create_key_completion(GPtrArray *store, const char *first, KeyMap *m) {{{*/
+static void 
+completion_create_key_completion(GPtrArray *store, const char *first, KeyMap *m) 
 {
     char *mod = dwb_modmask_to_string(m->mod);
     char *value = g_strdup_printf("%s %s", mod, m->key);
-    Completion *c = completion_get_completion_item(first, m->map->n.second, value, m);
-    gtk_box_pack_start(GTK_BOX(dwb.gui.compbox), c->event, false, false, 0);
-    l = g_list_append(l, c);
+    completion_add_item(store, first, m->map->n.second, value, m);
     g_free(value);
     g_free(mod);
-    return l;
 }/*}}}*/
 
-static GList *
-completion_complete_scripts() 
+static void
+completion_complete_scripts(GPtrArray *store) 
 {
-    GList *list = NULL;
     for (GList *l = dwb.state.script_completion; l; l=l->next) 
-    {
-        Completion *c = completion_get_completion_item(((Navigation*)l->data)->first, ((Navigation*)l->data)->second, NULL, NULL);
-        gtk_box_pack_start(GTK_BOX(dwb.gui.compbox), c->event, false, false, 0);
-        list = g_list_append(list, c);
-    }
+        completion_add_item(store, ((Navigation*)l->data)->first, ((Navigation*)l->data)->second, NULL, NULL);
     dwb.state.mode = COMPLETE_SCRIPTS;
-    return list;
 }
-/*dwb_completion_get_keys()         return  GList *Completions{{{*/
-static GList * 
-completion_get_key_completion(gboolean entry) 
+/*dwb_completion_get_keys() {{{*/
+static void 
+completion_get_key_completion(GPtrArray *store, gboolean entry) 
 {
-    GList *list = NULL;
     const char *input = GET_TEXT();
 
     dwb.keymap = g_list_sort(dwb.keymap, (GCompareFunc)util_keymap_sort_first);
+    dispatch_invalidate();
     input = dwb_parse_nummod(input);
 
     /* check for aliases first */
@@ -433,7 +611,7 @@ completion_get_key_completion(gboolean entry)
             {
                 if (g_str_has_prefix(m->map->alias[i], input) || !g_strcmp0(input, m->map->alias[i]) ) 
                 {
-                    list = completion_create_key_completion(list, m->map->alias[i], m);
+                    completion_create_key_completion(store, m->map->alias[i], m);
                     break;
                 }
             }
@@ -449,9 +627,8 @@ completion_get_key_completion(gboolean entry)
         
         Navigation n = m->map->n;
         if (g_str_has_prefix(n.first, input)) 
-            list = completion_create_key_completion(list, n.first, m);
+            completion_create_key_completion(store, n.first, m);
     }
-    return list;
 }/*}}}*/
 
 /* completion_path {{{*/
@@ -464,13 +641,14 @@ completion_path(void)
 }/*}}}*/
 
 /* completion_get_quickmarks {{{*/
-static  GList *
-completion_get_quickmarks(int back) 
+static void
+completion_get_quickmarks(GPtrArray *store, int back) 
 {
-    GList *list = NULL;
     Quickmark *q;
+    CompletionItem *item;
     char *escaped = NULL;
     const char *input = GET_TEXT();
+    g_free(s_typed);
     s_typed = g_strdup(input);
 
     for (GList *l = dwb.fc.quickmarks; l; l=l->next) 
@@ -478,23 +656,26 @@ completion_get_quickmarks(int back)
         q = l->data;
         if (g_str_has_prefix(q->key, input)) 
         {
-            Completion *c = completion_get_completion_item(NULL, q->nav->first, NULL, q->key);
+            item = completion_add_item(store, NULL, q->nav->first, NULL, q->key);
             escaped = g_markup_printf_escaped("%s\t\t<span style='italic'>%s</span>", q->key, q->nav->second);
             if (escaped != NULL) 
             {
-                gtk_label_set_markup(GTK_LABEL(c->llabel), escaped);
-                g_free(escaped);
+                item->left = escaped;
+                item->markup = true;
             }
             else 
-                gtk_label_set_text(GTK_LABEL(c->llabel), q->key);
-
-            gtk_box_pack_start(GTK_BOX(dwb.gui.compbox), c->event, false, false, 0);
-            list = g_list_append(list, c);
+                item->left = g_strdup(q->key);
+        }
+    }
+    if (back) 
+    {
+        for (guint i=0; i<store->len/2; i++) 
+        {
+            gpointer tmp = store->pdata[i];
+            store->pdata[i] = store->pdata[store->len-1-i];
+            store->pdata[store->len-1-i] = tmp;
         }
     }
-    if (back)
-        list = g_list_reverse(list);
-    return list;
 }/*}}}*/
 
 static void
@@ -504,7 +685,7 @@ completion_buffer_exec(GList *gl)
     dwb_focus_view(gl, "buffer");
     dwb_change_mode(NORMAL_MODE, true);
 }
-#define COMPLETION_BUFFER_GET_PRIVATE(c)  (((Completion*)((c)->data))->data)
+#define COMPLETION_BUFFER_GET_PRIVATE()  (COMPLETION_ACTIVE_ITEM()->data)
 void
 completion_buffer_key_press(GdkEventKey *e) 
 {
@@ -539,25 +720,29 @@ void
 completion_eval_buffer_completion(void) 
 {
     /* TODO Wrong View is saved  */
-    GList *l = COMPLETION_BUFFER_GET_PRIVATE(dwb.comps.active_comp);
+    GList *l = COMPLETION_BUFFER_GET_PRIVATE();
     completion_buffer_exec(l);
 }
 #undef COMPLETION_BUFFER_GET_PRIVATE
 /* completion_complete_buffer {{{*/
-static GList *
-completion_complete_buffer() 
+static void
+completion_complete_buffer(GPtrArray *store) 
 {
-    GList *list = NULL;
     int i=1;
     const char *uri, *title, *format;
     char *text;
-    Completion *c; 
     WebKitWebView *wv;
 
     format = g_list_length(dwb.state.views) > 10 ? "%02d : %s" : "%d : %s";
     for (GList *l = dwb.state.views;l; l=l->next) 
     {
-        if (VIEW(l)->status->deferred) 
+        if (VIEW(l)->status->placeholder != NULL) 
+        {
+            Placeholder *p = VIEW(l)->status->placeholder;
+            text = g_strdup_printf(format, i, p->title != NULL ? p->title : p->uri);
+            uri = p->uri;
+        }
+        else if (VIEW(l)->status->deferred) 
         {
             text = g_strdup_printf(format, i, VIEW(l)->status->deferred_uri);
             uri = "deferred";
@@ -569,20 +754,16 @@ completion_complete_buffer()
             uri = webkit_web_view_get_uri(wv);
             text = g_strdup_printf(format, i, title != NULL ? title : uri);
         }
-        c = completion_get_completion_item(text, uri, NULL, l);
-
-        gtk_box_pack_start(GTK_BOX(dwb.gui.compbox), c->event, false, false, 0);
-        list = g_list_append(list, c);
+        completion_add_item(store, text, uri, NULL, l);
 
         g_free(text);
         i++;
     }
-    if (list != NULL) 
+    if (store->len > 0) 
     {
         dwb.state.mode = COMPLETE_BUFFER;
         entry_focus();
     }
-    return list;
 }/*}}}*/
 
 static gboolean
@@ -663,30 +844,35 @@ completion_complete(CompletionType type, int back)
         dwb.gui.compbox = gtk_vbox_new(true, 0);
 #endif
         gtk_box_pack_start(GTK_BOX(dwb.gui.bottombox), dwb.gui.compbox, false, false, 0);
+        GPtrArray *store = g_ptr_array_new_with_free_func((GDestroyNotify)completion_item_free);
         switch (type) 
         {
-            case COMP_SETTINGS:    dwb.comps.completions = completion_get_settings_completion(); break;
-            case COMP_KEY:         dwb.comps.completions = completion_get_key_completion(true); break;
-            case COMP_COMMAND:     dwb.comps.completions = completion_get_key_completion(false); break;
-            case COMP_BOOKMARK:    dwb.comps.completions = completion_get_simple_completion(dwb.fc.bookmarks); break;
-            case COMP_HISTORY:     dwb.comps.completions = completion_get_simple_completion(dwb.fc.history); break;
-            case COMP_USERSCRIPT:  dwb.comps.completions = completion_get_simple_completion(dwb.misc.userscripts); break;
-            case COMP_SEARCH:      dwb.comps.completions = completion_get_simple_completion(dwb.fc.se_completion); break;
-            case COMP_QUICKMARK:   dwb.comps.completions = completion_get_quickmarks(back); break;
-            case COMP_PATH:        completion_path(); return STATUS_OK;
-            case COMP_BUFFER:      dwb.comps.completions = completion_complete_buffer(); break;
-            case COMP_SCRIPT:      dwb.comps.completions = completion_complete_scripts(); break;
-            default:               dwb.comps.completions = completion_get_normal_completion(); break;
+            case COMP_SETTINGS:    completion_get_settings_completion(store); break;
+            case COMP_KEY:         completion_get_key_completion(store, true); break;
+            case COMP_COMMAND:     completion_get_key_completion(store, false); break;
+            case COMP_BOOKMARK:    completion_get_simple_completion(store, dwb.fc.bookmarks); break;
+            case COMP_HISTORY:     completion_init_indexed_completion(store, dwb.comps.history, true, NULL); break;
+            case COMP_USERSCRIPT:  completion_get_simple_completion(store, dwb.misc.userscripts); break;
+            case COMP_SEARCH:      completion_get_simple_completion(store, dwb.fc.se_completion); break;
+            case COMP_QUICKMARK:   completion_get_quickmarks(store, back); break;
+            case COMP_PATH:        g_ptr_array_free(store, true); completion_path(); return STATUS_OK;
+            case COMP_BUFFER:      completion_complete_buffer(store); break;
+            case COMP_SCRIPT:      completion_complete_scripts(store); break;
+            default:               completion_get_normal_completion(store); break;
         }
-        if (!dwb.comps.completions) 
+        if (store->len == 0) 
+        {
+            g_ptr_array_free(store, true);
             return STATUS_ERROR;
+        }
         
+        dwb.comps.completions = store;
         dwb.state.mode |= COMPLETION_MODE;
         completion_show_completion(back);
         dwb.comps.view = dwb.state.fview;
     }
-    else if (dwb.comps.completions && dwb.comps.active_comp) 
-        dwb.comps.active_comp = completion_update_completion(dwb.gui.compbox, dwb.comps.completions, dwb.comps.active_comp, dwb.misc.max_c_items, back);
+    else if (dwb.comps.completions != NULL && dwb.comps.rows != NULL) 
+        completion_move(back);
 
     return ret;
 }/*}}}*/
@@ -22,8 +22,12 @@
 
 #define COMP_EVENT_BOX(X)    (((Completion*)((X)->data))->event)
 
+#define COMPLETION_ACTIVE_ITEM()   ((CompletionItem*)g_ptr_array_index(dwb.comps.completions, dwb.comps.active))
+
 typedef struct _Completion Completion;
+typedef struct _CompletionItem CompletionItem;
 
+/* A row of the completion */
 struct _Completion {
   GtkWidget *event;
   GtkWidget *rlabel;
@@ -31,11 +35,20 @@ struct _Completion {
   GtkWidget *mlabel;
   void *data;
 };
+/* A completion candidate, only the visible candidates are rendered to rows */
+struct _CompletionItem {
+  char *left;
+  char *right;
+  char *middle;
+  /* left is pango markup */
+  gboolean markup;
+  void *data;
+};
 
 void completion_clean_completion(gboolean);
 void completion_clean_autocompletion(void);
 void completion_clean_path_completion(void);
-void completion_set_entry_text(Completion *);
+void completion_set_entry_text(CompletionItem *);
 
 DwbStatus completion_set_autcompletion(GList *, WebSettings *);
 void completion_autocomplete(GList *, GdkEventKey *e);
@@ -186,6 +186,8 @@ static KeyValue KEYS[] = {
   { "toggle_tab",               {   "@Tab@",      GDK_CONTROL_MASK, 0 }, }, 
   { "reload_bookmarks",         {   NULL,         0, 0 }, }, 
   { "reload_quickmarks",        {   NULL,         0, 0 }, }, 
+  { "adblock_stats",            {   NULL,         0, 0 }, }, 
+  { "sync_stats",               {   NULL,         0, 0 }, }, 
   { "print_preview",        {   NULL,         0, 0 }, }, 
 };
 
@@ -200,6 +202,12 @@ static FunctionMap FMAP [] = {
   { { "reload_bookmarks",              "Reload bookmarks",                    }, CP_COMMANDLINE, 
     (Func)commands_reload_bookmarks,            NULL,                            ALWAYS_SM,     
     { .p = NULL },                          EP_NONE,    { NULL }, },
+  { { "adblock_stats",              "Show adblock cache statistics",                    }, CP_COMMANDLINE, 
+    (Func)commands_adblock_stats,            "Adblocker not running",                            ALWAYS_SM,     
+    { .p = NULL },                          EP_NONE,    { "adblock-stats", NULL }, },
+  { { "sync_stats",              "Show written bytes and time spent per synced file",                    }, CP_COMMANDLINE, 
+    (Func)commands_sync_stats,            NULL,                            ALWAYS_SM,     
+    { .p = NULL },                          EP_NONE,    { "sync-stats", NULL }, },
   { { "toggle_tab",              "Toggle between last and current tab",                    }, CP_COMMANDLINE, 
     (Func)commands_toggle_tab,            NULL,                            ALWAYS_SM,     
     { .p = NULL },                          EP_NONE,    { "ttab" }, },
@@ -1168,6 +1176,10 @@ static WebSettings DWB_SETTINGS[] = {
     SETTING_GLOBAL,  INTEGER, { .i = 250 }, NULL,   { 0 }, }, 
   { { "load-on-focus",                            "Load uris at the earliest when a tab gets focus", },                                            
     SETTING_GLOBAL,  BOOLEAN, { .b = false }, NULL,   { 0 }, }, 
+  { { "hibernate-timeout",                            "Minutes after which unfocused tabs are unloaded or 0 to keep them", },                                            
+    SETTING_GLOBAL|SETTING_ONINIT,  INTEGER, { .i = 0 }, (S_Func) dwb_set_hibernate_timeout,   { 0 }, }, 
+  { { "hibernate-memory",                            "Resident memory in megabytes above which unfocused tabs are unloaded or 0 for no limit", },                                            
+    SETTING_GLOBAL|SETTING_ONINIT,  INTEGER, { .i = 0 }, (S_Func) dwb_set_hibernate_memory,   { 0 }, }, 
   { { "print-previewer",                            "Command used for the printing preview", },                                            
     SETTING_GLOBAL,  CHAR, { .p = NULL }, NULL,   { 0 }, }, 
   { { "accept-language",                            "If set will be used for 'Accept-Language' header in all requests", },                                            
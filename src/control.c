@@ -0,0 +1,647 @@
+/*
+ * Copyright (c) 2010-2013 Stefan Bolte <portix@gmx.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include "dwb.h"
+#include "util.h"
+#include "scripts.h"
+#include "control.h"
+
+/*
+ * The first instance listens on the unix domain socket <profile>/control,
+ * every line a client sends is a request
+ *
+ *   <id> <commands>              executes commands like the commandline, 
+ *                                multiple commands are separated by ;;
+ *   <id> subscribe <signal>..    sends the signals to the client, * subscribes 
+ *                                to all signals
+ *   <id> unsubscribe [signal]..  stops sending signals, all signals if none 
+ *                                is given
+ *
+ * The id is chosen by the client. Requests are answered in order with
+ *
+ *   <id> ok
+ *   <id> error <message>
+ *
+ * so a client can send any number of requests without waiting for replies.
+ * All complete requests that have been received are executed at once and
+ * their replies are sent with a single write. Signals are sent as
+ *
+ *   * <signal> {"data":<json>,"webview":<object>,"objects":[<object>,..]}
+ *
+ * where an object is {"type":<type>,"uri":<uri>}, uri is only set if the
+ * object has a uri. Events are sent when the main loop is idle, so events of
+ * one iteration are sent with a single write, too. A client that doesn't read
+ * is disconnected when more than CONTROL_MAX_PENDING bytes are waiting.
+ */
+#define CONTROL_READ_SIZE   65536
+#define CONTROL_MAX_LINE    65536
+#define CONTROL_MAX_PENDING (4*1024*1024)
+#define CONTROL_BACKLOG     64
+
+typedef struct _ControlClient {
+    int fd;
+    GIOChannel *channel;
+    guint in_source;
+    guint out_source;
+    /* incomplete request */
+    GString *in;
+    /* replies and events, the first sent bytes have already been sent */
+    GString *out;
+    gsize sent;
+    /* mask of SCRIPTS_SIG_* */
+    int signals;
+    int ref;
+    /* whether requests are executed */
+    gboolean busy;
+    /* the client won't send more requests, it is closed when everything has
+     * been sent */
+    gboolean eof;
+    gboolean closed;
+} ControlClient;
+
+static int s_fd = -1;
+static char *s_path;
+static GIOChannel *s_channel;
+static guint s_source;
+static GSList *s_clients;
+
+static gboolean control_client_write_cb(GIOChannel *, GIOCondition, ControlClient *);
+
+/* control_update_signals() {{{*/
+static void
+control_update_signals()
+{
+    dwb.misc.control_signals = 0;
+    for (GSList *l = s_clients; l; l=l->next)
+        dwb.misc.control_signals |= ((ControlClient*)l->data)->signals;
+}/*}}}*/
+
+/* control_client_unref(ControlClient *) {{{*/
+static void
+control_client_unref(ControlClient *client)
+{
+    if (--client->ref > 0)
+        return;
+
+    g_string_free(client->in, true);
+    g_string_free(client->out, true);
+    g_free(client);
+}/*}}}*/
+
+/* control_client_close(ControlClient *) {{{*/
+static void
+control_client_close(ControlClient *client)
+{
+    if (client->closed)
+        return;
+
+    client->closed = true;
+    if (client->in_source > 0)
+        g_source_remove(client->in_source);
+    if (client->out_source > 0)
+        g_source_remove(client->out_source);
+    g_io_channel_unref(client->channel);
+    close(client->fd);
+
+    s_clients = g_slist_remove(s_clients, client);
+    control_update_signals();
+    control_client_unref(client);
+}/*}}}*/
+
+/* control_client_flush(ControlClient *) {{{
+ * Sends as much as possible without blocking, returns false if the client has
+ * been closed
+ * */
+static gboolean
+control_client_flush(ControlClient *client)
+{
+    ssize_t n;
+
+    while (client->sent < client->out->len)
+    {
+        n = send(client->fd, client->out->str + client->sent, client->out->len - client->sent, MSG_NOSIGNAL);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+            {
+                if (client->out->len - client->sent > CONTROL_MAX_PENDING)
+                {
+                    fprintf(stderr, "Control client doesn't read, disconnecting\n");
+                    break;
+                }
+                if (client->out_source == 0)
+                    client->out_source = g_io_add_watch(client->channel, G_IO_OUT, (GIOFunc)control_client_write_cb, client);
+                return true;
+            }
+            break;
+        }
+        client->sent += n;
+    }
+    if (client->sent < client->out->len || (client->eof && !client->busy))
+    {
+        control_client_close(client);
+        return false;
+    }
+    g_string_truncate(client->out, 0);
+    client->sent = 0;
+    return true;
+}/*}}}*/
+
+/* control_client_write_cb(GIOChannel *, GIOCondition, ControlClient *) {{{*/
+static gboolean
+control_client_write_cb(GIOChannel *channel, GIOCondition condition, ControlClient *client)
+{
+    client->out_source = 0;
+    control_client_flush(client);
+    return false;
+}/*}}}*/
+
+/* control_reply(ControlClient *, const char *id, const char *error) {{{*/
+static void
+control_reply(ControlClient *client, const char *id, const char *error)
+{
+    if (error == NULL)
+        g_string_append_printf(client->out, "%s ok\n", id);
+    else
+        g_string_append_printf(client->out, "%s error %s\n", id, error);
+}/*}}}*/
+
+/* control_subscribe(ControlClient *, char **names, gboolean subscribe) {{{
+ * Returns an error message or NULL
+ * */
+static const char *
+control_subscribe(ControlClient *client, char **names, gboolean subscribe)
+{
+    int signals = 0, signal;
+
+    for (int i=0; names[i] != NULL; i++)
+    {
+        if (*names[i] == '\0')
+            continue;
+        if (!strcmp(names[i], "*"))
+            signals = (1<<SCRIPTS_SIG_LAST) - 1;
+        else if ((signal = scripts_signal_lookup(names[i])) != -1)
+            signals |= 1<<signal;
+        else 
+            return "unknown signal";
+    }
+    if (subscribe)
+    {
+        if (signals == 0)
+            return "missing signal";
+        client->signals |= signals;
+    }
+    else if (signals == 0)
+        client->signals = 0;
+    else 
+        client->signals &= ~signals;
+
+    control_update_signals();
+    return NULL;
+}/*}}}*/
+
+/* control_execute(ControlClient *, char *line) {{{*/
+static void
+control_execute(ControlClient *client, char *line)
+{
+    char **token, **words, **commands;
+    const char *command, *error = NULL;
+    DwbStatus status = STATUS_OK;
+
+    token = g_strsplit_set(g_strstrip(line), " \t", 2);
+    if (token[0] == NULL || *token[0] == '\0')
+        goto clean;
+
+    command = util_str_chug(token[1]);
+    if (command == NULL || *command == '\0')
+    {
+        control_reply(client, token[0], "missing command");
+        goto clean;
+    }
+
+    words = g_strsplit_set(command, " \t", -1);
+    if (!strcmp(words[0], "subscribe"))
+        error = control_subscribe(client, words + 1, true);
+    else if (!strcmp(words[0], "unsubscribe"))
+        error = control_subscribe(client, words + 1, false);
+    else 
+    {
+        commands = g_strsplit(command, ";;", -1);
+        for (int i=0; commands[i] != NULL && status != STATUS_ERROR && status != STATUS_END; i++)
+            status = dwb_parse_command_line(commands[i]);
+        g_strfreev(commands);
+        if (status == STATUS_ERROR)
+            error = "command failed";
+    }
+    g_strfreev(words);
+    control_reply(client, token[0], error);
+clean:
+    g_strfreev(token);
+}/*}}}*/
+
+/* control_client_read_cb(GIOChannel *, GIOCondition, ControlClient *) {{{*/
+static gboolean
+control_client_read_cb(GIOChannel *channel, GIOCondition condition, ControlClient *client)
+{
+    char buffer[CONTROL_READ_SIZE];
+    char *line, *end;
+    ssize_t n;
+    gboolean ret = true;
+
+    n = recv(client->fd, buffer, sizeof(buffer), 0);
+    if (n < 0)
+    {
+        if (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK)
+            return true;
+        client->in_source = 0;
+        control_client_close(client);
+        return false;
+    }
+    if (n == 0)
+    {
+        /* the last request doesn't need a newline */
+        if (client->in->len > 0)
+            g_string_append_c(client->in, '\n');
+        client->in_source = 0;
+        client->eof = true;
+        ret = false;
+    }
+    else 
+        g_string_append_len(client->in, buffer, n);
+
+    client->ref++;
+    client->busy = true;
+    line = client->in->str;
+    while (!client->closed && (end = memchr(line, '\n', client->in->len - (line - client->in->str))) != NULL)
+    {
+        *end = '\0';
+        control_execute(client, line);
+        line = end + 1;
+    }
+    client->busy = false;
+
+    if (!client->closed)
+    {
+        g_string_erase(client->in, 0, line - client->in->str);
+        if (client->in->len > CONTROL_MAX_LINE)
+        {
+            g_string_append(client->out, "* error request too long\n");
+            if (client->in_source > 0)
+            {
+                g_source_remove(client->in_source);
+                client->in_source = 0;
+            }
+            client->eof = true;
+            ret = false;
+        }
+        control_client_flush(client);
+    }
+    if (client->closed)
+        ret = false;
+    control_client_unref(client);
+    return ret;
+}/*}}}*/
+
+/* control_accept_cb(GIOChannel *, GIOCondition, void *) {{{*/
+static gboolean
+control_accept_cb(GIOChannel *channel, GIOCondition condition, void *unused)
+{
+    ControlClient *client;
+    int fd = accept(s_fd, NULL, NULL);
+
+    if (fd < 0)
+    {
+        if (errno != EINTR && errno != EAGAIN && errno != EWOULDBLOCK && errno != ECONNABORTED)
+            perror("accept");
+        return true;
+    }
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+    client = dwb_malloc(sizeof(ControlClient));
+    client->fd = fd;
+    client->in = g_string_new(NULL);
+    client->out = g_string_new(NULL);
+    client->sent = 0;
+    client->signals = 0;
+    client->ref = 1;
+    client->busy = false;
+    client->eof = false;
+    client->closed = false;
+    client->out_source = 0;
+    client->channel = g_io_channel_unix_new(fd);
+    client->in_source = g_io_add_watch(client->channel, G_IO_IN | G_IO_HUP | G_IO_ERR, (GIOFunc)control_client_read_cb, client);
+
+    s_clients = g_slist_prepend(s_clients, client);
+    return true;
+}/*}}}*/
+
+/* control_address(const char *path, struct sockaddr_un *) {{{*/
+static gboolean
+control_address(const char *path, struct sockaddr_un *addr)
+{
+    if (path == NULL)
+        return false;
+    if (strlen(path) >= sizeof(addr->sun_path))
+    {
+        fprintf(stderr, "Path of the control socket is too long: %s\n", path);
+        return false;
+    }
+    memset(addr, 0, sizeof(struct sockaddr_un));
+    addr->sun_family = AF_UNIX;
+    strcpy(addr->sun_path, path);
+    return true;
+}/*}}}*/
+
+/* control_connect(const char *path) {{{
+ * Returns a connected socket or -1 if no instance is listening
+ * */
+static int
+control_connect(const char *path)
+{
+    struct sockaddr_un addr;
+    int fd;
+
+    if (!control_address(path, &addr))
+        return -1;
+    if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+        return -1;
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0)
+    {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}/*}}}*/
+
+/* control_init() {{{
+ * Listens on the control socket unless another instance is already
+ * listening
+ * */
+gboolean
+control_init()
+{
+    struct sockaddr_un addr;
+    const char *path = dwb.files[FILES_CONTROL];
+    mode_t mask;
+    int fd;
+    gboolean success;
+
+    if (s_fd != -1 || !control_address(path, &addr))
+        return false;
+
+    if ((fd = control_connect(path)) != -1)
+    {
+        close(fd);
+        return false;
+    }
+    /* left behind by an instance that crashed */
+    unlink(path);
+
+    if ((s_fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+    {
+        perror("socket");
+        return false;
+    }
+    mask = umask(0077);
+    success = bind(s_fd, (struct sockaddr *)&addr, sizeof(addr)) == 0 && listen(s_fd, CONTROL_BACKLOG) == 0;
+    umask(mask);
+    if (!success)
+    {
+        perror(path);
+        close(s_fd);
+        s_fd = -1;
+        return false;
+    }
+    fcntl(s_fd, F_SETFD, FD_CLOEXEC);
+    fcntl(s_fd, F_SETFL, fcntl(s_fd, F_GETFL) | O_NONBLOCK);
+
+    s_path = g_strdup(path);
+    s_channel = g_io_channel_unix_new(s_fd);
+    s_source = g_io_add_watch(s_channel, G_IO_IN, (GIOFunc)control_accept_cb, NULL);
+    return true;
+}/*}}}*/
+
+/* control_send(char **commands) {{{
+ * Sends commands to the instance that listens on the control socket and waits
+ * for the replies, returns the number of failed commands or -1 if no instance
+ * is listening
+ * */
+int
+control_send(char **commands)
+{
+    GString *buffer;
+    char chunk[CONTROL_READ_SIZE];
+    char *line, *end, *error, *request;
+    ssize_t n;
+    long id;
+    int fd, failed = 0, count = 0;
+
+    if ((fd = control_connect(dwb.files[FILES_CONTROL])) == -1)
+        return -1;
+
+    buffer = g_string_new(NULL);
+    for (; commands != NULL && commands[count] != NULL; count++)
+    {
+        request = g_strdelimit(g_strdup(commands[count]), "\r\n", ' ');
+        g_string_append_printf(buffer, "%d %s\n", count, request);
+        g_free(request);
+    }
+    for (gsize sent = 0; sent < buffer->len; sent += n)
+    {
+        if ((n = send(fd, buffer->str + sent, buffer->len - sent, MSG_NOSIGNAL)) < 0)
+        {
+            if (errno == EINTR)
+            {
+                n = 0;
+                continue;
+            }
+            perror("send");
+            failed = count;
+            goto clean;
+        }
+    }
+    shutdown(fd, SHUT_WR);
+
+    g_string_truncate(buffer, 0);
+    while ((n = recv(fd, chunk, sizeof(chunk), 0)) != 0)
+    {
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            perror("recv");
+            break;
+        }
+        g_string_append_len(buffer, chunk, n);
+    }
+
+    for (line = buffer->str; (end = strchr(line, '\n')) != NULL; line = end + 1)
+    {
+        *end = '\0';
+        id = strtol(line, &error, 10);
+        if (id < 0 || id >= count || !g_str_has_prefix(error, " error "))
+            continue;
+        fprintf(stderr, "%s: %s\n", commands[id], error + 7);
+        failed++;
+    }
+clean:
+    g_string_free(buffer, true);
+    close(fd);
+    return failed;
+}/*}}}*/
+
+/* control_append_string(GString *, const char *) {{{*/
+static void
+control_append_string(GString *buffer, const char *str)
+{
+    if (str == NULL)
+    {
+        g_string_append(buffer, "null");
+        return;
+    }
+    g_string_append_c(buffer, '"');
+    for (; *str; str++)
+    {
+        if (*str == '"' || *str == '\\')
+        {
+            g_string_append_c(buffer, '\\');
+            g_string_append_c(buffer, *str);
+        }
+        else if ((guchar)*str < 0x20)
+            g_string_append_printf(buffer, "\\u%04x", (guchar)*str);
+        else 
+            g_string_append_c(buffer, *str);
+    }
+    g_string_append_c(buffer, '"');
+}/*}}}*/
+
+/* control_append_object(GString *, GObject *) {{{*/
+static void
+control_append_object(GString *buffer, GObject *object)
+{
+    GParamSpec *pspec;
+    char *uri = NULL;
+
+    if (object == NULL)
+    {
+        g_string_append(buffer, "null");
+        return;
+    }
+    g_string_append(buffer, "{\"type\":");
+    control_append_string(buffer, G_OBJECT_TYPE_NAME(object));
+
+    pspec = g_object_class_find_property(G_OBJECT_GET_CLASS(object), "uri");
+    if (pspec != NULL && pspec->value_type == G_TYPE_STRING)
+    {
+        g_object_get(object, "uri", &uri, NULL);
+        g_string_append(buffer, ",\"uri\":");
+        control_append_string(buffer, uri);
+        g_free(uri);
+    }
+    g_string_append_c(buffer, '}');
+}/*}}}*/
+
+/* control_emit(int signal, const char *name, const char *json, GObject *wv, GObject **objects, int numobj) {{{
+ * Queues a signal for all clients that subscribed to it
+ * */
+void
+control_emit(int signal, const char *name, const char *json, GObject *wv, GObject **objects, int numobj)
+{
+    GString *event = NULL;
+    ControlClient *client;
+    GSList *next;
+
+    for (GSList *l = s_clients; l; l = next)
+    {
+        next = l->next;
+        client = l->data;
+        if (!(client->signals & (1<<signal)))
+            continue;
+
+        if (event == NULL)
+        {
+            event = g_string_new("* ");
+            g_string_append_printf(event, "%s {\"data\":", name);
+            /* util_create_json escapes control characters, so the json
+             * never contains a newline */
+            g_string_append(event, json != NULL ? json : "null");
+            g_string_append(event, ",\"webview\":");
+            control_append_object(event, wv);
+            g_string_append(event, ",\"objects\":[");
+            for (int i=0; i<numobj; i++)
+            {
+                if (i > 0)
+                    g_string_append_c(event, ',');
+                control_append_object(event, objects[i]);
+            }
+            g_string_append(event, "]}\n");
+        }
+        g_string_append_len(client->out, event->str, event->len);
+        if (client->out->len - client->sent > CONTROL_MAX_PENDING)
+        {
+            fprintf(stderr, "Control client doesn't read, disconnecting\n");
+            control_client_close(client);
+        }
+        else if (client->out_source == 0)
+            client->out_source = g_io_add_watch(client->channel, G_IO_OUT, (GIOFunc)control_client_write_cb, client);
+    }
+    if (event != NULL)
+        g_string_free(event, true);
+}/*}}}*/
+
+/* control_end() {{{*/
+void
+control_end()
+{
+    ControlClient *client;
+
+    if (s_fd == -1)
+        return;
+
+    while (s_clients != NULL)
+    {
+        client = s_clients->data;
+        client->ref++;
+        /* replies that are still waiting, without blocking */
+        client->eof = false;
+        control_client_flush(client);
+        control_client_close(client);
+        control_client_unref(client);
+    }
+    g_source_remove(s_source);
+    g_io_channel_unref(s_channel);
+    close(s_fd);
+    s_fd = -1;
+
+    unlink(s_path);
+    g_free(s_path);
+    s_path = NULL;
+}/*}}}*/
@@ -0,0 +1,514 @@
+/*
+ * Copyright (c) 2010-2013 Stefan Bolte <portix@gmx.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include "dwb.h"
+#include "sync.h"
+#include "cookiejar.h"
+
+/*
+ * Cookie jar for persistent cookies. The cookies are kept by SoupCookieJar
+ * which indexes them by domain, changes are not written to the cookies file
+ * but appended to <file>.journal
+ *
+ *   +<cookie>                  adds or replaces a cookie
+ *   -<domain>\t<path>\t<name>  removes a cookie
+ *
+ * where <cookie> is a line of the cookies file in the format of
+ * SoupCookieJarText. The journal is folded into the file when it has more than
+ * COOKIE_JAR_COMPACT_RECORDS records. The file might be shared with other
+ * instances, appending and compacting is done under a lock on <file>.lock and
+ * compacting merges what is on disk, not the cookies of this instance. The
+ * lock file is never replaced, the cookies file is replaced by compacting so a
+ * lock on it would be lost. All writes are done on the sync thread.
+ */
+#define COOKIE_JAR_COMPACT_RECORDS 1000
+#define COOKIE_JAR_HTTP_ONLY "#HttpOnly_"
+
+/* DwbCookieJar derived from SoupCookieJar {{{*/
+#define DWB_TYPE_COOKIE_JAR            (dwb_cookie_jar_get_type ())
+#define DWB_COOKIE_JAR(obj)            (G_TYPE_CHECK_INSTANCE_CAST ((obj), DWB_TYPE_COOKIE_JAR, DwbCookieJar))
+#define DWB_IS_COOKIE_JAR(obj)         (G_TYPE_CHECK_INSTANCE_TYPE ((obj), DWB_TYPE_COOKIE_JAR))
+
+typedef struct _DwbCookieJar        DwbCookieJar;
+typedef struct _DwbCookieJarClass   DwbCookieJarClass;
+
+struct _DwbCookieJar
+{
+    SoupCookieJar parent;
+    char *filename;
+    char *journal;
+    char *lock;
+    /* records that haven't been queued yet */
+    GString *pending;
+    /* number of records in the journal */
+    guint records;
+    /* changes aren't journaled while the jar is loaded or cleared */
+    gboolean quiet;
+    guint idle;
+};
+
+struct _DwbCookieJarClass
+{
+    SoupCookieJarClass parent_class;
+};
+G_DEFINE_TYPE(DwbCookieJar, dwb_cookie_jar, SOUP_TYPE_COOKIE_JAR);
+/*}}}*/
+
+typedef struct _CookieJarJob {
+    char *filename;
+    char *journal;
+    char *lock;
+    GString *pending;
+    gboolean compact;
+    gboolean remove;
+} CookieJarJob;
+
+/* dwb_cookie_jar_key(const char *domain, const char *path, const char *name)  return: char * (alloc) {{{*/
+static char * 
+dwb_cookie_jar_key(const char *domain, const char *path, const char *name) 
+{
+    return g_strdup_printf("%s\t%s\t%s", domain, path, name);
+}/*}}}*/
+
+/* dwb_cookie_jar_line_key(const char *line, time_t now)  return: char * (alloc) {{{
+ * Returns the key of a line of the cookies file or NULL if the line isn't a
+ * cookie or the cookie has expired
+ * */
+static char *
+dwb_cookie_jar_line_key(const char *line, time_t now) 
+{
+    char **fields;
+    char *key = NULL;
+
+    if (g_str_has_prefix(line, COOKIE_JAR_HTTP_ONLY))
+        line += strlen(COOKIE_JAR_HTTP_ONLY);
+    if (*line == '#' || *line == '\0')
+        return NULL;
+
+    fields = g_strsplit(line, "\t", 7);
+    if (g_strv_length(fields) == 7 && strtoul(fields[4], NULL, 10) > (gulong)now) 
+        key = dwb_cookie_jar_key(fields[0], fields[2], fields[5]);
+    g_strfreev(fields);
+    return key;
+}/*}}}*/
+
+/* dwb_cookie_jar_read_lines(const char *filename, GHashTable *, gboolean journal) {{{
+ * Reads the cookies file or replays the journal into a table that maps keys
+ * to lines, returns the number of records
+ * */
+static guint
+dwb_cookie_jar_read_lines(const char *filename, GHashTable *lines, gboolean journal) 
+{
+    char *content, *line, *end, *next, *key;
+    time_t now = time(NULL);
+    guint records = 0;
+
+    if (!g_file_get_contents(filename, &content, NULL, NULL))
+        return 0;
+
+    for (line = content; *line; line = next) 
+    {
+        if ((end = strchr(line, '\n')) != NULL) 
+        {
+            *end = '\0';
+            next = end + 1;
+        }
+        /* an incomplete last line of the journal is the result of an
+         * interrupted write and ignored */
+        else if (journal)
+            break;
+        else 
+            next = line + strlen(line);
+
+        if (!journal) 
+        {
+            if ((key = dwb_cookie_jar_line_key(line, now)) != NULL)
+                g_hash_table_insert(lines, key, g_strdup(line));
+            continue;
+        }
+        if (*line == '+' && (key = dwb_cookie_jar_line_key(line + 1, now)) != NULL) 
+            g_hash_table_insert(lines, key, g_strdup(line + 1));
+        else if (*line == '-') 
+            g_hash_table_remove(lines, line + 1);
+        records++;
+    }
+    g_free(content);
+    return records;
+}/*}}}*/
+
+/* dwb_cookie_jar_lock(const char *lock, int operation)  return: int {{{
+ * Locks the lock file, returns the file descriptor or -1
+ * */
+static int
+dwb_cookie_jar_lock(const char *lock, int operation) 
+{
+    int fd;
+
+    if ((fd = open(lock, O_RDONLY | O_CREAT, 0600)) == -1) 
+    {
+        perror(lock);
+        return -1;
+    }
+    while (flock(fd, operation) != 0 && errno == EINTR)
+        ;
+    return fd;
+}/*}}}*/
+
+/* dwb_cookie_jar_unlock(int fd) {{{*/
+static void
+dwb_cookie_jar_unlock(int fd) 
+{
+    if (fd == -1)
+        return;
+    flock(fd, LOCK_UN);
+    close(fd);
+}/*}}}*/
+
+/* dwb_cookie_jar_parse(const char *line)  return: SoupCookie * {{{*/
+static SoupCookie *
+dwb_cookie_jar_parse(const char *line) 
+{
+    SoupCookie *cookie = NULL;
+    SoupDate *expires;
+    gboolean http_only = g_str_has_prefix(line, COOKIE_JAR_HTTP_ONLY);
+    char **fields = g_strsplit(http_only ? line + strlen(COOKIE_JAR_HTTP_ONLY) : line, "\t", 7);
+
+    if (g_strv_length(fields) == 7) 
+    {
+        cookie = soup_cookie_new(fields[5], fields[6], fields[0], fields[2], -1);
+        expires = soup_date_new_from_time_t(strtoul(fields[4], NULL, 10));
+        soup_cookie_set_expires(cookie, expires);
+        soup_date_free(expires);
+        soup_cookie_set_secure(cookie, !strcmp(fields[3], "TRUE"));
+        soup_cookie_set_http_only(cookie, http_only);
+    }
+    g_strfreev(fields);
+    return cookie;
+}/*}}}*/
+
+/* dwb_cookie_jar_job_free(CookieJarJob *) {{{*/
+static void
+dwb_cookie_jar_job_free(CookieJarJob *job) 
+{
+    g_free(job->filename);
+    g_free(job->journal);
+    g_free(job->lock);
+    if (job->pending != NULL)
+        g_string_free(job->pending, true);
+    g_free(job);
+}/*}}}*/
+
+/* dwb_cookie_jar_append(CookieJarJob *) {{{*/
+static gboolean
+dwb_cookie_jar_append(CookieJarJob *job) 
+{
+    FILE *f;
+    gboolean ret = true;
+
+    if ((f = fopen(job->journal, "a")) == NULL)
+    {
+        perror(job->journal);
+        return false;
+    }
+    if (fwrite(job->pending->str, 1, job->pending->len, f) != job->pending->len
+            || fflush(f) != 0 || fsync(fileno(f)) != 0)
+    {
+        perror(job->journal);
+        ret = false;
+    }
+    fclose(f);
+    return ret;
+}/*}}}*/
+
+/* dwb_cookie_jar_compact(CookieJarJob *) {{{
+ * Folds the journal into the cookies file, returns the size of the file or -1
+ * */
+static gssize
+dwb_cookie_jar_compact(CookieJarJob *job) 
+{
+    GHashTable *lines = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+    GString *buffer = g_string_new(NULL);
+    GHashTableIter iter;
+    GError *error = NULL;
+    gpointer line;
+    gssize ret = -1;
+
+    dwb_cookie_jar_read_lines(job->filename, lines, false);
+    dwb_cookie_jar_read_lines(job->journal, lines, true);
+
+    g_hash_table_iter_init(&iter, lines);
+    while (g_hash_table_iter_next(&iter, NULL, &line)) 
+    {
+        g_string_append(buffer, line);
+        g_string_append_c(buffer, '\n');
+    }
+    if (g_file_set_contents(job->filename, buffer->str, buffer->len, &error)) 
+    {
+        unlink(job->journal);
+        ret = buffer->len;
+    }
+    else 
+    {
+        fprintf(stderr, "Cannot write %s: %s\n", job->filename, error->message);
+        g_clear_error(&error);
+    }
+    g_string_free(buffer, true);
+    g_hash_table_unref(lines);
+    return ret;
+}/*}}}*/
+
+/* dwb_cookie_jar_job_run(CookieJarJob *) {{{
+ * Runs on the sync thread
+ * */
+static gssize
+dwb_cookie_jar_job_run(CookieJarJob *job) 
+{
+    gssize ret = 0, size;
+    int fd;
+
+    if ((fd = dwb_cookie_jar_lock(job->lock, LOCK_EX)) == -1) 
+        return -1;
+
+    if (job->remove) 
+    {
+        if ((unlink(job->journal) != 0 && errno != ENOENT) || (unlink(job->filename) != 0 && errno != ENOENT)) 
+        {
+            perror(job->filename);
+            ret = -1;
+        }
+    }
+    else 
+    {
+        if (job->pending != NULL) 
+        {
+            if (dwb_cookie_jar_append(job))
+                ret += job->pending->len;
+            else 
+                ret = -1;
+        }
+        if (ret >= 0 && job->compact) 
+            ret = (size = dwb_cookie_jar_compact(job)) >= 0 ? ret + size : -1;
+    }
+
+    dwb_cookie_jar_unlock(fd);
+    return ret;
+}/*}}}*/
+
+/* dwb_cookie_jar_queue(DwbCookieJar *, gboolean remove) {{{*/
+static void
+dwb_cookie_jar_queue(DwbCookieJar *cj, gboolean remove) 
+{
+    CookieJarJob *job = dwb_malloc(sizeof(CookieJarJob));
+    job->filename = g_strdup(cj->filename);
+    job->journal = g_strdup(cj->journal);
+    job->lock = g_strdup(cj->lock);
+    job->pending = NULL;
+    job->remove = remove;
+    job->compact = !remove && cj->records >= COOKIE_JAR_COMPACT_RECORDS;
+
+    if (job->compact || remove) 
+        cj->records = 0;
+    if (!remove && cj->pending->len > 0) 
+    {
+        job->pending = cj->pending;
+        cj->pending = g_string_new(NULL);
+    }
+    else 
+        g_string_truncate(cj->pending, 0);
+
+    sync_run(SYNC_COOKIES, (SyncFunc)dwb_cookie_jar_job_run, job, (GDestroyNotify)dwb_cookie_jar_job_free);
+}/*}}}*/
+
+/* dwb_cookie_jar_idle_flush(DwbCookieJar *) {{{*/
+static gboolean
+dwb_cookie_jar_idle_flush(DwbCookieJar *cj) 
+{
+    cj->idle = 0;
+    dwb_cookie_jar_flush(SOUP_COOKIE_JAR(cj));
+    return false;
+}/*}}}*/
+
+/* dwb_cookie_jar_changed(SoupCookieJar *, SoupCookie *old, SoupCookie *new) {{{
+ * Journals changes of persistent cookies, session cookies are never written
+ * */
+static void
+dwb_cookie_jar_changed(SoupCookieJar *jar, SoupCookie *old, SoupCookie *new) 
+{
+    DwbCookieJar *cj = DWB_COOKIE_JAR(jar);
+
+    if (cj->quiet)
+        return;
+
+    if (new != NULL && new->expires != NULL) 
+    {
+        g_string_append_printf(cj->pending, "+%s%s\t%s\t%s\t%s\t%lu\t%s\t%s\n",
+                new->http_only ? COOKIE_JAR_HTTP_ONLY : "", new->domain, *new->domain == '.' ? "TRUE" : "FALSE", 
+                new->path, new->secure ? "TRUE" : "FALSE", (gulong)soup_date_to_time_t(new->expires), 
+                new->name, new->value);
+    }
+    else if (old != NULL && old->expires != NULL) 
+        g_string_append_printf(cj->pending, "-%s\t%s\t%s\n", old->domain, old->path, old->name);
+    else 
+        return;
+
+    cj->records++;
+    sync_set_dirty(SYNC_COOKIES);
+    /* changes of a page load are written together */
+    if ((dwb.misc.sync_interval <= 0 || !(dwb.misc.sync_files & SYNC_COOKIES)) && cj->idle == 0)
+        cj->idle = g_idle_add((GSourceFunc)dwb_cookie_jar_idle_flush, cj);
+}/*}}}*/
+
+/* dwb_cookie_jar_load(DwbCookieJar *) {{{*/
+static void
+dwb_cookie_jar_load(DwbCookieJar *cj) 
+{
+    GHashTable *lines = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+    GHashTableIter iter;
+    SoupCookie *cookie;
+    gpointer line;
+    int fd = dwb_cookie_jar_lock(cj->lock, LOCK_SH);
+
+    dwb_cookie_jar_read_lines(cj->filename, lines, false);
+    cj->records = dwb_cookie_jar_read_lines(cj->journal, lines, true);
+    dwb_cookie_jar_unlock(fd);
+
+    cj->quiet = true;
+    g_hash_table_iter_init(&iter, lines);
+    while (g_hash_table_iter_next(&iter, NULL, &line)) 
+    {
+        if ((cookie = dwb_cookie_jar_parse(line)) != NULL)
+            soup_cookie_jar_add_cookie(SOUP_COOKIE_JAR(cj), cookie);
+    }
+    cj->quiet = false;
+    g_hash_table_unref(lines);
+}/*}}}*/
+
+/* dwb_cookie_jar_finalize(GObject *) {{{*/
+static void
+dwb_cookie_jar_finalize(GObject *object) 
+{
+    DwbCookieJar *cj = DWB_COOKIE_JAR(object);
+
+    dwb_cookie_jar_flush(SOUP_COOKIE_JAR(cj));
+    g_free(cj->filename);
+    g_free(cj->journal);
+    g_free(cj->lock);
+    g_string_free(cj->pending, true);
+
+    G_OBJECT_CLASS(dwb_cookie_jar_parent_class)->finalize(object);
+}/*}}}*/
+
+static void
+dwb_cookie_jar_class_init(DwbCookieJarClass *class)
+{
+    GObjectClass *object_class = G_OBJECT_CLASS(class);
+    SoupCookieJarClass *jar_class = SOUP_COOKIE_JAR_CLASS(class);
+
+    object_class->finalize = dwb_cookie_jar_finalize;
+    jar_class->changed = dwb_cookie_jar_changed;
+}
+static void
+dwb_cookie_jar_init(DwbCookieJar *cj) 
+{
+    cj->filename = NULL;
+    cj->journal = NULL;
+    cj->lock = NULL;
+    cj->pending = g_string_new(NULL);
+    cj->records = 0;
+    cj->quiet = false;
+    cj->idle = 0;
+}
+
+/* dwb_cookie_jar_new(const char *filename) {{{
+ * Creates a jar with the cookies of the cookies file and its journal
+ * */
+SoupCookieJar *
+dwb_cookie_jar_new(const char *filename) 
+{
+    g_return_val_if_fail(filename != NULL, NULL);
+
+    DwbCookieJar *cj = g_object_new(DWB_TYPE_COOKIE_JAR, NULL);
+    cj->filename = g_strdup(filename);
+    cj->journal = g_strconcat(filename, ".journal", NULL);
+    cj->lock = g_strconcat(filename, ".lock", NULL);
+    dwb_cookie_jar_load(cj);
+    return SOUP_COOKIE_JAR(cj);
+}/*}}}*/
+
+/* dwb_cookie_jar_flush(SoupCookieJar *) {{{
+ * Queues the pending changes and compacts the journal if it has grown too
+ * large
+ * */
+void 
+dwb_cookie_jar_flush(SoupCookieJar *jar) 
+{
+    g_return_if_fail(DWB_IS_COOKIE_JAR(jar));
+
+    DwbCookieJar *cj = DWB_COOKIE_JAR(jar);
+    if (cj->idle != 0) 
+    {
+        g_source_remove(cj->idle);
+        cj->idle = 0;
+    }
+    if (cj->pending->len > 0 || cj->records >= COOKIE_JAR_COMPACT_RECORDS)
+        dwb_cookie_jar_queue(cj, false);
+}/*}}}*/
+
+/* dwb_cookie_jar_clear(SoupCookieJar *) {{{
+ * Removes all cookies from the jar, the files aren't changed
+ * */
+void 
+dwb_cookie_jar_clear(SoupCookieJar *jar) 
+{
+    g_return_if_fail(DWB_IS_COOKIE_JAR(jar));
+
+    DwbCookieJar *cj = DWB_COOKIE_JAR(jar);
+    GSList *cookies = soup_cookie_jar_all_cookies(jar);
+
+    dwb_cookie_jar_flush(jar);
+    cj->quiet = true;
+    for (GSList *l = cookies; l; l=l->next) 
+        soup_cookie_jar_delete_cookie(jar, l->data);
+    cj->quiet = false;
+    soup_cookies_free(cookies);
+}/*}}}*/
+
+/* dwb_cookie_jar_remove_files(SoupCookieJar *) {{{
+ * Removes the cookies file and the journal, pending changes are dropped
+ * */
+void 
+dwb_cookie_jar_remove_files(SoupCookieJar *jar) 
+{
+    g_return_if_fail(DWB_IS_COOKIE_JAR(jar));
+
+    DwbCookieJar *cj = DWB_COOKIE_JAR(jar);
+    if (cj->idle != 0) 
+    {
+        g_source_remove(cj->idle);
+        cj->idle = 0;
+    }
+    dwb_cookie_jar_queue(cj, true);
+}/*}}}*/
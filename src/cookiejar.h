@@ -0,0 +1,27 @@
+/*
+ * Copyright (c) 2010-2013 Stefan Bolte <portix@gmx.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef COOKIEJAR_H
+#define COOKIEJAR_H
+
+SoupCookieJar * dwb_cookie_jar_new(const char *filename);
+void dwb_cookie_jar_flush(SoupCookieJar *jar);
+void dwb_cookie_jar_clear(SoupCookieJar *jar);
+void dwb_cookie_jar_remove_files(SoupCookieJar *jar);
+
+#endif
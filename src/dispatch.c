@@ -0,0 +1,209 @@
+/*
+ * Copyright (c) 2010-2013 Stefan Bolte <portix@gmx.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <string.h>
+#include "dwb.h"
+#include "dispatch.h"
+
+/*
+ * Key bindings and custom commands are compiled into a trie over the bytes of
+ * their key, every node maps a modifier mask to the bindings below the node.
+ * The node of the key buffer is kept between keystrokes, so a keystroke only
+ * follows one edge. Command names and aliases are kept in a hash table, if a
+ * name is used more than once the first keymap in list order wins like it did
+ * when the keymap was searched.
+ *
+ * The trie is compiled on first use and dropped whenever the keymap or the
+ * custom commands change.
+ */
+typedef struct _DispatchNode DispatchNode;
+
+struct _DispatchNode {
+    /* maps bytes to child nodes */
+    GHashTable *children;
+    /* maps modifier masks to DispatchBindings */
+    GHashTable *bindings;
+};
+
+static DispatchNode *s_trie;
+static GHashTable *s_commands;
+/* node of the first s_length bytes of the key buffer, NULL if unknown */
+static DispatchNode *s_node;
+static gsize s_length;
+
+/* dispatch_bindings_free(DispatchBindings *) {{{*/
+static void
+dispatch_bindings_free(DispatchBindings *b)
+{
+    g_ptr_array_free(b->keymaps, true);
+    g_ptr_array_free(b->commands, true);
+    g_free(b);
+}/*}}}*/
+
+/* dispatch_node_free(DispatchNode *) {{{*/
+static void
+dispatch_node_free(DispatchNode *node)
+{
+    g_hash_table_unref(node->children);
+    g_hash_table_unref(node->bindings);
+    g_free(node);
+}/*}}}*/
+
+/* dispatch_node_new() {{{*/
+static DispatchNode *
+dispatch_node_new()
+{
+    DispatchNode *node = dwb_malloc(sizeof(DispatchNode));
+    node->children = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, (GDestroyNotify)dispatch_node_free);
+    node->bindings = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, (GDestroyNotify)dispatch_bindings_free);
+    return node;
+}/*}}}*/
+
+/* dispatch_insert(const char *key, guint mod, KeyMap *, CustomCommand *) {{{*/
+static void
+dispatch_insert(const char *key, guint mod, KeyMap *km, CustomCommand *command)
+{
+    DispatchNode *node = s_trie, *child;
+    DispatchBindings *b;
+
+    for (; *key; key++)
+    {
+        child = g_hash_table_lookup(node->children, GINT_TO_POINTER((guchar)*key));
+        if (child == NULL)
+        {
+            child = dispatch_node_new();
+            g_hash_table_insert(node->children, GINT_TO_POINTER((guchar)*key), child);
+        }
+        node = child;
+
+        b = g_hash_table_lookup(node->bindings, GUINT_TO_POINTER(mod));
+        if (b == NULL)
+        {
+            b = dwb_malloc(sizeof(DispatchBindings));
+            b->keymaps = g_ptr_array_new();
+            b->commands = g_ptr_array_new();
+            g_hash_table_insert(node->bindings, GUINT_TO_POINTER(mod), b);
+        }
+        if (km != NULL)
+            g_ptr_array_add(b->keymaps, km);
+        else
+            g_ptr_array_add(b->commands, command);
+    }
+}/*}}}*/
+
+/* dispatch_add_name(const char *name, KeyMap *) {{{*/
+static void
+dispatch_add_name(const char *name, KeyMap *km)
+{
+    if (name != NULL && g_hash_table_lookup(s_commands, name) == NULL)
+        g_hash_table_insert(s_commands, (char*)name, km);
+}/*}}}*/
+
+/* dispatch_compile() {{{*/
+static void
+dispatch_compile()
+{
+    KeyMap *km;
+    CustomCommand *c;
+
+    s_trie = dispatch_node_new();
+    s_commands = g_hash_table_new(g_str_hash, g_str_equal);
+
+    for (GSList *l = dwb.custom_commands; l; l=l->next)
+    {
+        c = l->data;
+        if (c->key->str != NULL)
+            dispatch_insert(c->key->str, c->key->mod, NULL, c);
+    }
+    for (GList *l = dwb.keymap; l; l=l->next)
+    {
+        km = l->data;
+        dispatch_add_name(km->map->n.first, km);
+        for (int i=0; km->map->alias[i]; i++)
+            dispatch_add_name(km->map->alias[i], km);
+
+        if (!(km->map->prop & CP_OVERRIDE_ENTRY) && km->key != NULL)
+            dispatch_insert(km->key, km->mod, km, NULL);
+    }
+}/*}}}*/
+
+/* dispatch_key(GString *buffer, guint mod) {{{
+ * Returns the bindings whose key starts with the key buffer and whose
+ * modifier mask is mod, NULL if there are none. The buffer is expected to have
+ * only grown since the last call unless dispatch_reset was called.
+ * */
+const DispatchBindings *
+dispatch_key(GString *buffer, guint mod)
+{
+    if (s_trie == NULL)
+        dispatch_compile();
+
+    if (s_node == NULL || s_length > buffer->len)
+    {
+        s_node = s_trie;
+        s_length = 0;
+    }
+    for (; s_node != NULL && s_length < buffer->len; s_length++)
+        s_node = g_hash_table_lookup(s_node->children, GINT_TO_POINTER((guchar)buffer->str[s_length]));
+
+    if (s_node == NULL)
+        return NULL;
+    return g_hash_table_lookup(s_node->bindings, GUINT_TO_POINTER(mod));
+}/*}}}*/
+
+/* dispatch_lookup_command(const char *name) {{{
+ * Returns the keymap with the given name or alias
+ * */
+KeyMap *
+dispatch_lookup_command(const char *name)
+{
+    if (name == NULL)
+        return NULL;
+    if (s_trie == NULL)
+        dispatch_compile();
+    return g_hash_table_lookup(s_commands, name);
+}/*}}}*/
+
+/* dispatch_reset() {{{
+ * Must be called if the key buffer was truncated
+ * */
+void
+dispatch_reset()
+{
+    s_node = NULL;
+    s_length = 0;
+}/*}}}*/
+
+/* dispatch_invalidate() {{{
+ * Must be called if the keymap or the custom commands have changed
+ * */
+void
+dispatch_invalidate()
+{
+    dispatch_reset();
+    if (s_trie != NULL)
+    {
+        dispatch_node_free(s_trie);
+        s_trie = NULL;
+    }
+    if (s_commands != NULL)
+    {
+        g_hash_table_unref(s_commands);
+        s_commands = NULL;
+    }
+}/*}}}*/
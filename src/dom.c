@@ -119,3 +119,56 @@ dom_remove_from_parent(WebKitDOMNode *node, GError **error)
     }
     return false;
 }/*}}}*/
+
+/* dom_has_active_media(WebKitDOMDocument *doc) {{{
+ * Whether a document or one of its frames plays audio or video or contains a
+ * plugin
+ * */
+gboolean 
+dom_has_active_media(WebKitDOMDocument *doc) 
+{
+    WebKitDOMNodeList *list;
+    WebKitDOMNode *node;
+    WebKitDOMDocument *content;
+    gboolean ret = false;
+    char *tagname;
+
+    if (doc == NULL)
+        return false;
+
+    list = webkit_dom_document_query_selector_all(doc, "video, audio, embed, object", NULL);
+    if (list != NULL) 
+    {
+        for (guint i=0; i<webkit_dom_node_list_get_length(list) && ret == false; i++) 
+        {
+            node = webkit_dom_node_list_item(list, i);
+            tagname = webkit_dom_node_get_node_name(node);
+            if (!g_ascii_strcasecmp(tagname, "video") || !g_ascii_strcasecmp(tagname, "audio")) 
+                ret = !webkit_dom_html_media_element_get_paused(WEBKIT_DOM_HTML_MEDIA_ELEMENT(node));
+            else 
+                ret = true;
+            g_free(tagname);
+        }
+        g_object_unref(list);
+    }
+    if (ret)
+        return true;
+
+    list = webkit_dom_document_query_selector_all(doc, "iframe, frame", NULL);
+    if (list != NULL) 
+    {
+        for (guint i=0; i<webkit_dom_node_list_get_length(list) && ret == false; i++) 
+        {
+            node = webkit_dom_node_list_item(list, i);
+            tagname = webkit_dom_node_get_node_name(node);
+            if (!g_ascii_strcasecmp(tagname, "iframe")) 
+                content = webkit_dom_html_iframe_element_get_content_document(WEBKIT_DOM_HTML_IFRAME_ELEMENT(node));
+            else 
+                content = webkit_dom_html_frame_element_get_content_document(WEBKIT_DOM_HTML_FRAME_ELEMENT(node));
+            ret = dom_has_active_media(content);
+            g_free(tagname);
+        }
+        g_object_unref(list);
+    }
+    return ret;
+}/*}}}*/
@@ -23,4 +23,5 @@ gboolean dom_add_frame_listener(WebKitWebFrame *frame, const char *signal, GCall
 gboolean dom_get_editable(WebKitDOMElement *element);
 WebKitDOMElement * dom_get_active_element(WebKitDOMDocument *doc);
 gboolean dom_remove_from_parent(WebKitDOMNode *node, GError **error);
+gboolean dom_has_active_media(WebKitDOMDocument *doc);
 #endif
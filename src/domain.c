@@ -22,8 +22,6 @@
 #include "domain.h"
 #include "tlds.h"
 
-static GHashTable *s_tld_table;
-
 GSList *
 domain_get_cookie_domains(WebKitWebView *wv) 
 {
@@ -62,16 +60,15 @@ domain_get_cookie_domains(WebKitWebView *wv)
     return ret;
 }
 
+/* domain_match(char **domains, const DomainInfo *info) {{{
+ * Checks if the host described by info or one of its parent domains matches
+ * a list of domains, domains prefixed with '~' are exceptions
+ * */
 gboolean 
-domain_match(char **domains, const char *host, const char *base_domain) 
+domain_match(char **domains, const DomainInfo *info) 
 {
     g_return_val_if_fail(domains != NULL, false);
-    g_return_val_if_fail(host != NULL, false);
-    g_return_val_if_fail(base_domain != NULL, false);
-    g_return_val_if_fail(g_str_has_suffix(host, base_domain), false);
-
-    const char *subdomains[SUBDOMAIN_MAX];
-    int sdc = 0;
+    g_return_val_if_fail(info != NULL, false);
 
     gboolean domain_exc = false;
     gboolean has_positive = false;
@@ -80,37 +77,24 @@ domain_match(char **domains, const char *host, const char *base_domain)
     gboolean found_exception = false;
 
     char *real_domain;
-    char *nextdot;
-    /* extract subdomains */
-    subdomains[sdc++] = host;
-    while (g_strcmp0(host, base_domain)) 
-    {
-        nextdot = strchr(host, '.');
-        host = nextdot + 1;
-        subdomains[sdc++] = host;
-        if (sdc == SUBDOMAIN_MAX-1)
-            break;
-    }
-    subdomains[sdc++] = NULL;
 
     for (int k=0; domains[k]; k++) 
     {
-        for (int j=0; subdomains[j]; j++) 
+        real_domain = domains[k];
+        if (*real_domain == '~') 
         {
-            real_domain = domains[k];
-            if (*real_domain == '~') 
-            {
-                domain_exc = true;
-                real_domain++;
-                has_exception = true;
-            }
-            else 
-            {
-                domain_exc = false;
-                has_positive = true;
-            }
-
-            if (!g_strcmp0(subdomains[j], real_domain)) 
+            domain_exc = true;
+            real_domain++;
+            has_exception = true;
+        }
+        else 
+        {
+            domain_exc = false;
+            has_positive = true;
+        }
+        for (int j=0; info->subdomains[j] >= 0; j++) 
+        {
+            if (!strcmp(info->host + info->subdomains[j], real_domain)) 
             {
                 if (domain_exc) 
                     found_exception = true;
@@ -125,123 +109,180 @@ domain_match(char **domains, const char *host, const char *base_domain)
     return false;
 }/*}}}*/
 
-int
-count_char(const char *str, char ch)
+/* domain_find_label(const TldNode *node, const char *label, size_t length) {{{
+ * Binary search for a label in the children of node
+ * */
+static const TldNode *
+domain_find_label(const TldNode *node, const char *label, size_t length)
 {
-    int count = 0;
-
-    if (str == NULL) 
-        return 0;
+    int low = node->children;
+    int high = node->children + node->n_children - 1;
+    int mid, cmp;
 
-    for (; *str != '\0'; str++)
-        if (*str == ch)
-            count ++;
-    return count;
-}
+    while (low <= high) 
+    {
+        mid = (low + high) / 2;
+        cmp = strncmp(TLD_NODES[mid].label, label, length);
+        if (cmp == 0 && TLD_NODES[mid].label[length] != '\0')
+            cmp = 1;
+        if (cmp == 0)
+            return &TLD_NODES[mid];
+        else if (cmp < 0)
+            low = mid + 1;
+        else 
+            high = mid - 1;
+    }
+    return NULL;
+}/*}}}*/
 
+/* domain_get_tld(const char *host) {{{
+ * Returns the registrable part of host, i.e. the public suffix and one more
+ * label, or NULL if host is invalid or a public suffix itself. The labels are
+ * matched from the right against the public suffix trie.
+ * */
 const char *
 domain_get_tld(const char *host)
 {
-    if (host == NULL)
-        return NULL;
-    g_return_val_if_fail(s_tld_table != NULL, NULL);
-
-    const char *cur_domain = host;
-    const char *prev_domain = host;
-    const char *pprev_domain = host;
-    const char *ret = NULL;
-    char *nextdot = strchr(cur_domain, '.');
-    char *entry = NULL;
-
-    /* check if hostname is valid
-     * - cannot start with .
-     * - must only contain A-Za-z0-9.-_
-     */
-    if (nextdot == cur_domain ||
-        strspn(cur_domain, "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
-                    "abcdefghijklmnopqrustuvwxyz"
-                    "0123456789._-") != strlen(cur_domain)) {
+    if (host == NULL || *host == '.' || *host == '\0')
         return NULL;
-    }
 
-    while (1) 
+    const TldNode *node = &TLD_NODES[0], *child;
+    const char *end = host + strlen(host);
+    const char *start;
+    const char *suffix = NULL;
+
+    while (node != NULL) 
     {
-        entry = g_hash_table_lookup(s_tld_table, cur_domain);
-        if (entry != NULL) 
+        /* check if hostname is valid, must only contain A-Za-z0-9.-_ */
+        for (start = end; start > host && start[-1] != '.'; start--) 
         {
-            if (*entry == '*') 
-            {
-                /* check that we have enough to build
-                 * a domain that satisfies the rule
-                 */
-                if (count_char(pprev_domain, '.') >=
-                    count_char(entry, '.') + 1) {
-                    ret = pprev_domain;
-                }
-                break;
-            }
-            else if (*entry == '!') 
-            {
-                ret = cur_domain;
-                break;
-            }
-            else if(strcmp(entry, prev_domain) == 0)
-                break;
-            else if(strcmp(entry, prev_domain) != 0)
-            {
-                ret = prev_domain;
-                break;
-            }
+            if (!g_ascii_isalnum(start[-1]) && start[-1] != '-' && start[-1] != '_')
+                return NULL;
         }
-        if (nextdot == NULL)
+        if (start == end)
+            return NULL;
+
+        child = domain_find_label(node, start, end - start);
+        if (child != NULL && (child->flags & TLD_EXCEPTION)) 
+            return start;
+        if ((child != NULL && (child->flags & TLD_RULE)) || (node->flags & TLD_WILDCARD)) 
+            suffix = start;
+        if (start == host) 
             break;
-
-        pprev_domain = prev_domain;
-        prev_domain = cur_domain;
-        cur_domain = nextdot + 1;
-
-        PRINT_DEBUG(nextdot);
-
-        nextdot = strchr(cur_domain, '.');
+        node = child;
+        end = start - 1;
     }
-    return ret;
-}
+    /* validate the labels that weren't visited */
+    for (const char *c = host; c < start; c++) 
+    {
+        if (!g_ascii_isalnum(*c) && *c != '-' && *c != '_' && *c != '.')
+            return NULL;
+    }
+    if (suffix == NULL || suffix == host)
+        return NULL;
 
+    for (start = suffix - 1; start > host && start[-1] != '.'; start--)
+        ;
+    return start;
+}/*}}}*/
 
-const char *
-domain_get_base_for_host(const char *host) 
+/* Cache of recently used hosts, every thread has its own cache. If the
+ * current generation is full it replaces the previous one, so a DomainInfo
+ * stays valid for at least DOMAIN_CACHE_MAX lookups of the same thread. */
+typedef struct _DomainCache {
+    GHashTable *current;
+    GHashTable *previous;
+} DomainCache;
+#define DOMAIN_CACHE_MAX 512
+
+/* domain_cache_free(DomainCache *) {{{*/
+static void
+domain_cache_free(DomainCache *cache) 
 {
-    const char *base;
-    base = domain_get_tld(host);
-    if (base == NULL)
-        return host;
-    return base;
-}
+    g_hash_table_unref(cache->current);
+    if (cache->previous != NULL)
+        g_hash_table_unref(cache->previous);
+    g_free(cache);
+}/*}}}*/
 
-void
-domain_end() 
+static GPrivate s_domain_cache = G_PRIVATE_INIT((GDestroyNotify)domain_cache_free);
+
+/* domain_info_new(const char *host) {{{
+ * The host is interned in the same allocation */
+static DomainInfo *
+domain_info_new(const char *host) 
 {
-    if (s_tld_table) 
+    size_t length = strlen(host);
+    DomainInfo *info = g_malloc(sizeof(DomainInfo) + length + 1);
+    char *interned = (char *)(info + 1);
+    const char *base, *cur;
+    int sdc = 0;
+
+    memcpy(interned, host, length + 1);
+    info->host = interned;
+
+    base = domain_get_tld(interned);
+    info->base = base != NULL ? base : interned;
+
+    /* offsets of all subdomains */
+    cur = interned;
+    info->subdomains[sdc++] = 0;
+    while (cur != info->base && sdc < SUBDOMAIN_MAX - 1) 
     {
-        g_hash_table_unref(s_tld_table);
-        s_tld_table = NULL;
+        cur = strchr(cur, '.') + 1;
+        info->subdomains[sdc++] = cur - interned;
     }
+    info->subdomains[sdc] = -1;
+    return info;
+}/*}}}*/
 
-}
-
-void 
-domain_init() 
+/* domain_get_info(const char *host) {{{
+ * Returns the base domain and the subdomains of host, the result must not be
+ * freed or kept, see DOMAIN_CACHE_MAX
+ * */
+const DomainInfo *
+domain_get_info(const char *host) 
 {
-    s_tld_table = g_hash_table_new((GHashFunc)g_str_hash, (GEqualFunc)g_str_equal);
-    char *eff_tld;
-    for (int i=0; (eff_tld = TLDS_EFFECTIVE[i]); i++) 
+    g_return_val_if_fail(host != NULL, NULL);
+
+    DomainCache *cache = g_private_get(&s_domain_cache);
+    DomainInfo *info;
+
+    if (cache == NULL) 
     {
-        if (*eff_tld == '*' || *eff_tld == '!') 
-            eff_tld++;
+        cache = g_malloc0(sizeof(DomainCache));
+        cache->current = g_hash_table_new_full((GHashFunc)g_str_hash, (GEqualFunc)g_str_equal, NULL, g_free);
+        g_private_set(&s_domain_cache, cache);
+    }
+
+    info = g_hash_table_lookup(cache->current, host);
+    if (info != NULL)
+        return info;
 
-        if (*eff_tld == '.')
-            eff_tld++;
+    if (cache->previous != NULL && (info = g_hash_table_lookup(cache->previous, host)) != NULL) 
+        g_hash_table_steal(cache->previous, host);
+    else 
+        info = domain_info_new(host);
 
-        g_hash_table_insert(s_tld_table, eff_tld, TLDS_EFFECTIVE[i]);
+    if (g_hash_table_size(cache->current) >= DOMAIN_CACHE_MAX) 
+    {
+        if (cache->previous != NULL)
+            g_hash_table_unref(cache->previous);
+        cache->previous = cache->current;
+        cache->current = g_hash_table_new_full((GHashFunc)g_str_hash, (GEqualFunc)g_str_equal, NULL, g_free);
     }
-}
+    g_hash_table_insert(cache->current, (char *)info->host, info);
+    return info;
+}/*}}}*/
+
+/* domain_get_base_for_host(const char *host) {{{
+ * Returns a pointer to the base domain in host
+ * */
+const char *
+domain_get_base_for_host(const char *host) 
+{
+    if (host == NULL)
+        return NULL;
+    const DomainInfo *info = domain_get_info(host);
+    return host + (info->base - info->host);
+}/*}}}*/
@@ -23,11 +23,17 @@
 
 #define SUBDOMAIN_MAX 32
 
-void domain_init(void);
-void domain_end(void);
+/* A host and its base domain, subdomains are the offsets of the host and all
+ * parent domains down to the base domain in host, terminated by -1 */
+typedef struct _DomainInfo {
+    const char *host;
+    const char *base;
+    int subdomains[SUBDOMAIN_MAX];
+} DomainInfo;
 
 GSList * domain_get_cookie_domains(WebKitWebView *wv);
-gboolean domain_match(char **, const char *, const char *);
+gboolean domain_match(char **, const DomainInfo *);
 const char * domain_get_base_for_host(const char *host);
 const char * domain_get_tld(const char *domain);
+const DomainInfo * domain_get_info(const char *host);
 #endif
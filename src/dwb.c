@@ -48,6 +48,12 @@
 #include "application.h"
 #include "scripts.h"
 #include "dom.h"
+#include "history.h"
+#include "journal.h"
+#include "trigram.h"
+#include "dispatch.h"
+#include "hibernate.h"
+#include "sync.h"
 
 /* DECLARATIONS {{{*/
 static DwbStatus dwb_webkit_setting(GList *, WebSettings *);
@@ -62,6 +68,8 @@ static DwbStatus dwb_set_history_length(GList *, WebSettings *);
 static DwbStatus dwb_set_plugin_blocker(GList *, WebSettings *);
 static DwbStatus dwb_set_sync_interval(GList *, WebSettings *);
 static DwbStatus dwb_set_sync_files(GList *, WebSettings *);
+static DwbStatus dwb_set_hibernate_timeout(GList *, WebSettings *);
+static DwbStatus dwb_set_hibernate_memory(GList *, WebSettings *);
 static DwbStatus dwb_set_scroll_step(GList *, WebSettings *);
 static DwbStatus dwb_set_private_browsing(GList *, WebSettings *);
 static DwbStatus dwb_set_new_tab_position_policy(GList *, WebSettings *);
@@ -161,12 +169,18 @@ dwb_set_adblock(GList *gl, WebSettings *s)
     if (s->arg_local.b) 
     {
         for (GList *l = dwb.state.views; l; l=l->next) 
-            adblock_connect(l);
+        {
+            if (VIEW(l)->status->placeholder == NULL)
+                adblock_connect(l);
+        }
     }
     else 
     {
         for (GList *l = dwb.state.views; l; l=l->next) 
-            adblock_disconnect(l);
+        {
+            if (VIEW(l)->status->placeholder == NULL)
+                adblock_disconnect(l);
+        }
     }
 }/*}}}*/
 
@@ -358,6 +372,10 @@ dwb_set_sync_files(GList *gl, WebSettings *s)
             flags |= SYNC_COOKIES;
         else if (!strcmp("session", token[i])) 
             flags |= SYNC_SESSION;
+        else if (!strcmp("bookmarks", token[i])) 
+            flags |= SYNC_BOOKMARKS;
+        else if (!strcmp("quickmarks", token[i])) 
+            flags |= SYNC_QUICKMARKS;
         else 
             ret = STATUS_ERROR;
     }
@@ -368,6 +386,22 @@ dwb_set_sync_files(GList *gl, WebSettings *s)
     return ret;
 }/*}}}*/
 
+/* dwb_set_hibernate_timeout{{{*/
+static DwbStatus
+dwb_set_hibernate_timeout(GList *gl, WebSettings *s) 
+{
+    hibernate_set_timeout(s->arg_local.i);
+    return STATUS_OK;
+}/*}}}*/
+
+/* dwb_set_hibernate_memory{{{*/
+static DwbStatus
+dwb_set_hibernate_memory(GList *gl, WebSettings *s) 
+{
+    hibernate_set_memory(s->arg_local.i);
+    return STATUS_OK;
+}/*}}}*/
+
 /* dwb_set_scroll_step {{{*/
 static DwbStatus
 dwb_set_scroll_step(GList *gl, WebSettings *s) 
@@ -432,14 +466,18 @@ dwb_set_favicon(GList *l, WebSettings *s)
     {
         for (GList *l = dwb.state.views; l; l=l->next) 
         {
-            g_signal_handler_disconnect(WEBVIEW(l), VIEW(l)->status->signals[SIG_ICON_LOADED]);
+            if (VIEW(l)->status->placeholder == NULL)
+                g_signal_handler_disconnect(WEBVIEW(l), VIEW(l)->status->signals[SIG_ICON_LOADED]);
             view_set_favicon(l, false);
         }
     }
     else 
     {
         for (GList *l = dwb.state.views; l; l=l->next) 
-            VIEW(l)->status->signals[SIG_ICON_LOADED] = g_signal_connect(VIEW(l)->web, "icon-loaded", G_CALLBACK(view_icon_loaded), l);
+        {
+            if (VIEW(l)->status->placeholder == NULL)
+                VIEW(l)->status->signals[SIG_ICON_LOADED] = g_signal_connect(VIEW(l)->web, "icon-loaded", G_CALLBACK(view_icon_loaded), l);
+        }
     }
     return STATUS_OK;
 }/*}}}*/
@@ -1095,15 +1133,18 @@ dwb_check_auto_insert(GList *gl)
 
 /* remove history, bookmark, quickmark {{{*/
 static int
-dwb_remove_navigation_item(GList **content, const char *line, const char *filename) 
+dwb_remove_navigation_item(GList **content, const char *line, Journal *journal, TrigramIndex *index) 
 {
     Navigation *n = dwb_navigation_new_from_line(line);
-    GList *item = g_list_find_custom(*content, n, (GCompareFunc)util_navigation_compare_first);
+    GList *item = n != NULL ? g_list_find_custom(*content, n, (GCompareFunc)util_navigation_compare_first) : NULL;
     dwb_navigation_free(n);
     if (item) 
     {
-        if (filename != NULL) 
-            util_file_remove_line(filename, line);
+        if (journal != NULL) 
+            journal_append(journal, JOURNAL_REMOVE, NAVIGATION(item)->first);
+        if (index != NULL)
+            trigram_index_remove(index, item->data);
+        dwb_navigation_free(item->data);
         *content = g_list_delete_link(*content, item);
         return 1;
     }
@@ -1112,17 +1153,22 @@ dwb_remove_navigation_item(GList **content, const char *line, const char *filena
 void
 dwb_remove_bookmark(const char *line) 
 {
-    dwb_remove_navigation_item(&dwb.fc.bookmarks, line, dwb.files[FILES_BOOKMARKS]);
+    dwb_remove_navigation_item(&dwb.fc.bookmarks, line, dwb.misc.bookmarks_journal, dwb.comps.bookmarks);
 }
 void
 dwb_remove_download(const char *line) 
 {
-    dwb_remove_navigation_item(&dwb.fc.downloads, line, dwb.files[FILES_BOOKMARKS]);
+    dwb_remove_navigation_item(&dwb.fc.downloads, line, NULL, NULL);
 }
 void
 dwb_remove_history(const char *line) 
 {
-    dwb_remove_navigation_item(&dwb.fc.history, line, dwb.misc.synctimer <= 0 ? dwb.files[FILES_HISTORY] : NULL);
+    Navigation *n = dwb_navigation_new_from_line(line);
+    if (n != NULL) 
+    {
+        history_remove(n->first);
+        dwb_navigation_free(n);
+    }
 }
 void
 dwb_remove_search_engine(const char *line) 
@@ -1150,35 +1196,33 @@ void
 dwb_remove_quickmark(const char *line) 
 {
     Quickmark *q = dwb_quickmark_new_from_line(line);
-    GList *item = g_list_find_custom(dwb.fc.quickmarks, q, (GCompareFunc)util_quickmark_compare);
+    GList *item = q != NULL ? g_list_find_custom(dwb.fc.quickmarks, q, (GCompareFunc)util_quickmark_compare) : NULL;
     dwb_quickmark_free(q);
     if (item) {
-        util_file_remove_line(dwb.files[FILES_QUICKMARKS], line);
+        journal_append(dwb.misc.quickmarks_journal, JOURNAL_REMOVE, ((Quickmark*)item->data)->key);
+        dwb_quickmark_free(item->data);
         dwb.fc.quickmarks = g_list_delete_link(dwb.fc.quickmarks, item);
     }
 }/*}}}*/
 
-/* dwb_sync_history {{{*/
+/* dwb_sync_files {{{
+ * Writes the stores that have changed since the last sync, the files are
+ * written on the sync thread
+ * */
 static gboolean
 dwb_sync_files(gpointer data) 
 {
-    if (dwb.misc.sync_files & SYNC_HISTORY) 
-    {
-        GString *buffer = g_string_new(NULL);
-        int i=0;
-        for (GList *gl = dwb.fc.history; gl && (dwb.misc.history_length < 0 || i < dwb.misc.history_length); gl=gl->next, i++) 
-        {
-            Navigation *n = gl->data;
-            g_string_append_printf(buffer, "%s %s\n", n->first, n->second);
-        }
-        g_file_set_contents(dwb.files[FILES_HISTORY], buffer->str, -1, NULL);
-        g_string_free(buffer, true);
-    }
-    if (dwb.misc.sync_files & SYNC_COOKIES) 
+    if (sync_clear_dirty(SYNC_HISTORY))
+        history_flush();
+    if (sync_clear_dirty(SYNC_BOOKMARKS))
+        journal_flush(dwb.misc.bookmarks_journal);
+    if (sync_clear_dirty(SYNC_QUICKMARKS))
+        journal_flush(dwb.misc.quickmarks_journal);
+    if ((dwb.misc.sync_files & SYNC_COOKIES) && sync_clear_dirty(SYNC_COOKIES)) 
     {
         dwb_soup_sync_cookies();
     }
-    if ((dwb.misc.sync_files & SYNC_SESSION) && GET_BOOL("save-session")) 
+    if ((dwb.misc.sync_files & SYNC_SESSION) && GET_BOOL("save-session") && sync_clear_dirty(SYNC_SESSION)) 
     {
         session_save(NULL, SESSION_SYNC | SESSION_FORCE);
     }
@@ -1239,9 +1283,10 @@ dwb_apply_settings(WebSettings *s, const char *key, const char *value, int scope
     }
     else 
     {
+        /* placeholders apply the settings when their webview is created */
         for (GList *l = dwb.state.views; l; l=l->next) 
         {
-            if (s->func) 
+            if (s->func && VIEW(l)->status->placeholder == NULL) 
                 s->func(l, s);
         }
     }
@@ -1355,6 +1400,7 @@ dwb_set_key(const char *prop, char *val)
 
     dwb.keymap = dwb_keymap_add(dwb.keymap, value);
     dwb.keymap = g_list_sort(dwb.keymap, (GCompareFunc)util_keymap_sort_second);
+    dispatch_invalidate();
     dwb_save_key_value(dwb.files[FILES_KEYS], prop, val);
     return STATUS_OK;
 }/*}}}*/
@@ -1392,6 +1438,7 @@ dwb_focus_view(GList *gl, const char *event)
     static int running;
     if (gl != dwb.state.fview) 
     {
+        view_materialize(gl, false);
         if (EMIT_SCRIPT(TAB_FOCUS)) 
         {
             char *json = util_create_json(1, CHAR, "event", event);
@@ -1404,6 +1451,7 @@ dwb_focus_view(GList *gl, const char *event)
 
         if (! (CURRENT_VIEW()->status->lockprotect & LP_VISIBLE) )
             gtk_widget_hide(VIEW(dwb.state.fview)->scroll);
+        CURRENT_VIEW()->status->last_focus = g_get_monotonic_time();
 
         dwb_change_mode(NORMAL_MODE, true);
         dwb_unfocus();
@@ -1871,9 +1919,12 @@ dwb_evaluate_hints(const char *buffer)
 gboolean
 dwb_update_hints(GdkEventKey *e) 
 {
-    char *buffer;
+    char *buffer = NULL;
     char *com = NULL;
-    char *val;
+    char *val, *text;
+    const char *keep, *last;
+    glong kept;
+    GString *append;
     gboolean ret = false;
     char json[BUFFER_LENGTH] = {0};
 
@@ -1897,8 +1948,34 @@ dwb_update_hints(GdkEventKey *e)
     else 
     {
         val = util_keyval_to_char(e->keyval, true);
-        snprintf(json, sizeof(json), "{ \"input\" : \"%s%s\", \"type\" : %d }", GET_TEXT(), val ? val : "", hint_map[dwb.state.hint_type].arg);
+        text = g_strconcat(GET_TEXT(), val, NULL);
+
+        /* Only send the part of the input that changed since the last update,
+         * the script keeps the hints of every prefix of the input */
+        last = dwb.state.hint_input != NULL ? dwb.state.hint_input : "";
+        for (keep = text; *keep && *keep == *last; keep++, last++)
+            ;
+        while (keep > text && (*keep & 0xc0) == 0x80)
+            keep--;
+        /* the script applies keep with substring, i.e. in utf-16 code units */
+        kept = 0;
+        for (const char *c = text; c < keep; c = g_utf8_next_char(c))
+            kept += g_utf8_get_char(c) > 0xffff ? 2 : 1;
+
+        append = g_string_new(NULL);
+        for (const char *c = keep; *c; c++) 
+        {
+            if (*c == '"' || *c == '\\')
+                g_string_append_c(append, '\\');
+            g_string_append_c(append, *c);
+        }
+        snprintf(json, sizeof(json), "{ \"keep\" : %ld, \"append\" : \"%s\", \"type\" : %d }", 
+                kept, append->str, hint_map[dwb.state.hint_type].arg);
         com = "updateHints";
+
+        g_free(dwb.state.hint_input);
+        dwb.state.hint_input = text;
+        g_string_free(append, true);
         g_free(val);
     }
     if (com) 
@@ -1927,6 +2004,7 @@ dwb_show_hints(Arg *arg)
     {
         char json[64];
         gtk_entry_set_text(GTK_ENTRY(dwb.gui.entry), "");
+        FREE0(dwb.state.hint_input);
 
         snprintf(json, sizeof(json), "{ \"newTab\" : \"%d\", \"type\" : \"%d\" }",
                 (dwb.state.nv & (OPEN_NEW_WINDOW|OPEN_NEW_VIEW)), 
@@ -2172,7 +2250,7 @@ dwb_save_quickmark(const char *key)
         }
         dwb.fc.quickmarks = g_list_prepend(dwb.fc.quickmarks, dwb_quickmark_new(uri, title, key));
         text = g_strdup_printf("%s %s %s", key, uri, title);
-        util_file_add(dwb.files[FILES_QUICKMARKS], text, true, -1);
+        journal_append(dwb.misc.quickmarks_journal, JOURNAL_ADD, text);
         g_free(text);
 
         dwb_set_normal_message(dwb.state.fview, true, "Added quickmark: %s - %s", key, uri);
@@ -2245,10 +2323,12 @@ dwb_tab_label_set_text(GList *gl, const char *text)
     char progress[11] = { 0 };
     char *escaped;
 
-    if (text == NULL) 
-        title = webkit_web_view_get_title(WEBVIEW(gl));
-    else 
+    if (text != NULL) 
         title = text;
+    else if (v->status->placeholder != NULL) 
+        title = v->status->placeholder->title;
+    else 
+        title = webkit_web_view_get_title(WEBVIEW(gl));
 
     if (v->status->progress != 0) 
         snprintf(progress, sizeof(progress), "[%2d%%] ", v->status->progress);
@@ -2300,7 +2380,9 @@ dwb_update_layout()
 {
     for (GList *gl = dwb.state.views; gl; gl = gl->next) 
     {
-        if (!VIEW(gl)->status->deferred) 
+        if (VIEW(gl)->status->placeholder != NULL) 
+            dwb_tab_label_set_text(gl, NULL);
+        else if (!VIEW(gl)->status->deferred) 
         {
             View *v = gl->data;
             const char *title = webkit_web_view_get_title(WEBKIT_WEB_VIEW(v->web));
@@ -2319,6 +2401,7 @@ dwb_focus(GList *gl)
         gtk_widget_hide(dwb.gui.entry);
 
     dwb.state.fview = gl;
+    view_materialize(gl, false);
     view_set_active_style(gl);
     dwb_focus_scroll(gl);
     if (!VIEW(gl)->status->deferred)
@@ -2506,6 +2589,7 @@ dwb_clean_key_buffer()
 {
     dwb.state.nummod = -1;
     g_string_truncate(dwb.state.buffer, 0);
+    dispatch_reset();
 }/*}}}*/
 
 const char * /* dwb_parse_nummod {{{*/
@@ -2621,9 +2705,10 @@ dwb_eval_key(GdkEventKey *e)
     unsigned int mod_mask = 0;
     int keynum = -1;
     char *key;
-    const char *buf;
     guint longest;
     KeyMap *tmp = NULL;
+    CustomCommand *command = NULL;
+    const DispatchBindings *bindings;
     GList *coms = NULL;
 
     if (dwb.state.scriptlock) 
@@ -2640,6 +2725,7 @@ dwb_eval_key(GdkEventKey *e)
         if (dwb.state.buffer->len > 0) 
         {
             g_string_erase(dwb.state.buffer, dwb.state.buffer->len - 1, 1);
+            dispatch_reset();
             dwb_set_status_bar_text(dwb.gui.lstatus, dwb.state.buffer->str, &dwb.color.active_fg, dwb.font.fd_active, false);
         }
         return false;
@@ -2702,51 +2788,49 @@ dwb_eval_key(GdkEventKey *e)
             dwb_set_status_bar_text(dwb.gui.lstatus, dwb.state.buffer->str, &dwb.color.active_fg, dwb.font.fd_active, false);
         }
 
-        buf = dwb.state.buffer->str;
         longest = 0;
+        bindings = dispatch_key(dwb.state.buffer, mod_mask);
+        if (bindings == NULL) 
+            goto done;
 
-        for (GSList *l = dwb.custom_commands; l; l=l->next) 
+        for (guint i=0; i<bindings->commands->len; i++) 
         {
-            CustomCommand *c = l->data;
-            if (c->key->num == dwb.state.nummod  && c->key->mod == mod_mask) 
+            CustomCommand *c = g_ptr_array_index(bindings->commands, i);
+            if (c->key->num == dwb.state.nummod) 
             {
-                if (!g_strcmp0(c->key->str, buf)) 
+                if (strlen(c->key->str) == dwb.state.buffer->len) 
                 {
-                    for (int i=0; c->commands[i]; i++) 
-                    {
-                        if (dwb_parse_command_line(c->commands[i]) == STATUS_END) 
-                            return true;
-                    }
-                    return true;
+                    command = c;
+                    break;
                 }
-                else if (g_str_has_prefix(c->key->str, buf)) 
-                    longest = 1;
+                longest = 1;
             }
         }
-
-        for (GList *l = dwb.keymap; l; l=l->next) 
+        if (command != NULL) 
         {
-            KeyMap *km = l->data;
-            if (km->map->prop & CP_OVERRIDE_ENTRY || km->key == NULL) 
-                continue;
+            g_free(key);
+            for (int i=0; command->commands[i]; i++) 
+            {
+                if (dwb_parse_command_line(command->commands[i]) == STATUS_END) 
+                    return true;
+            }
+            return true;
+        }
 
+        for (guint i=0; i<bindings->keymaps->len; i++) 
+        {
+            KeyMap *km = g_ptr_array_index(bindings->keymaps, i);
             gsize kl = strlen(km->key);
-            if (!km->key || !kl ) 
-                continue;
-
-            if (g_str_has_prefix(km->key, buf) && (mod_mask == km->mod) ) 
+            if  (!longest || kl > longest) 
             {
-                if  (!longest || kl > longest) 
-                {
-                    longest = kl;
-                    tmp = km;
-                }
-                if (dwb.comps.autocompletion) 
-                {
-                    coms = g_list_append(coms, km);
-                }
+                longest = kl;
+                tmp = km;
             }
+            if (dwb.comps.autocompletion) 
+                coms = g_list_prepend(coms, km);
         }
+        coms = g_list_reverse(coms);
+done:
         /* autocompletion */
         if (dwb.state.mode & AUTO_COMPLETE) 
             completion_clean_autocompletion();
@@ -2829,7 +2913,10 @@ dwb_normal_mode(gboolean clean)
         return STATUS_OK;
 
     if (mode == HINT_MODE || mode == SEARCH_FIELD_MODE) 
+    {
         js_call_as_function(MAIN_FRAME(), CURRENT_VIEW()->js_base, "clear", NULL, kJSTypeUndefined, NULL);
+        FREE0(dwb.state.hint_input);
+    }
     else if (mode == DOWNLOAD_GET_PATH) 
         completion_clean_path_completion();
     
@@ -3215,6 +3302,7 @@ dwb_reload_userscripts(void)
     
     g_slist_free(delete);
     dwb.keymap = g_list_concat(dwb.keymap, dwb_get_scripts());
+    dispatch_invalidate();
     dwb_set_normal_message(dwb.state.fview, true, "Userscripts reloaded");
 }/*}}}*/
 
@@ -3260,12 +3348,14 @@ dwb_free_custom_keys()
     }
     g_slist_free(dwb.custom_commands);
     dwb.custom_commands = NULL;
+    dispatch_invalidate();
 }
 
 /* dwb_clean_up() {{{*/
 gboolean
 dwb_clean_up() 
 {
+    hibernate_end();
     for (GList *gl = dwb.state.views; gl; gl=gl->next) 
         view_clean(gl);
     // needs to be ended before anything else is freed, otherwise pending
@@ -3289,10 +3379,15 @@ dwb_clean_up()
     g_string_free(dwb.state.buffer, true);
     g_free(dwb.misc.hints);
     g_free(dwb.misc.hint_style);
+    g_free(dwb.state.hint_input);
 
+    trigram_index_free(dwb.comps.bookmarks);
+    dwb.comps.bookmarks = NULL;
+    journal_free(dwb.misc.bookmarks_journal);
+    journal_free(dwb.misc.quickmarks_journal);
+    dwb.misc.bookmarks_journal = dwb.misc.quickmarks_journal = NULL;
     dwb_free_list(dwb.fc.bookmarks, (void_func)dwb_navigation_free);
-    /*  TODO sqlite */
-    dwb_free_list(dwb.fc.history, (void_func)dwb_navigation_free);
+    history_end();
     dwb_free_list(dwb.fc.searchengines, (void_func)dwb_navigation_free);
     dwb_free_list(dwb.fc.se_completion, (void_func)dwb_navigation_free);
     dwb_free_list(dwb.fc.mimetypes, (void_func)dwb_navigation_free);
@@ -3308,9 +3403,11 @@ dwb_clean_up()
 
     dwb_soup_end();
     adblock_end();
-    domain_end();
+    sync_end();
 
-    util_rmdir(dwb.files[FILES_CACHEDIR], true, true);
+    /* Only remove temporary files, subdirectories like the adblock cache are
+     * persistent */
+    util_rmdir(dwb.files[FILES_CACHEDIR], true, false);
 
     for (int i=FILES_FIRST; i<FILES_LAST; i++) 
         g_free(dwb.files[i]);
@@ -3659,6 +3756,7 @@ dwb_init_key_map()
 
     dwb.keymap = g_list_concat(dwb.keymap, dwb_get_scripts());
     dwb.keymap = g_list_sort(dwb.keymap, (GCompareFunc)util_keymap_sort_second);
+    dispatch_invalidate();
 
     g_key_file_free(keyfile);
 }/*}}}*/
@@ -4130,16 +4228,109 @@ dwb_get_simple_list(GList *gl, const char *filename)
     return gl;
 }
 
+/* bookmark and quickmark journals {{{*/
+static GString *
+dwb_bookmarks_snapshot(void *data) 
+{
+    GString *buffer = g_string_new(NULL);
+    for (GList *l = dwb.fc.bookmarks; l; l=l->next) 
+        g_string_append_printf(buffer, "%s %s\n", NAVIGATION(l)->first, NAVIGATION(l)->second ? NAVIGATION(l)->second : "");
+    return buffer;
+}
+static void
+dwb_bookmarks_replay(JournalOp op, char *line, void *data) 
+{
+    Navigation *n = dwb_navigation_new_from_line(line);
+    GList *item;
+
+    if (n == NULL)
+        return;
+    if ((item = g_list_find_custom(dwb.fc.bookmarks, n, (GCompareFunc)util_navigation_compare_first)) != NULL) 
+    {
+        dwb_navigation_free(item->data);
+        dwb.fc.bookmarks = g_list_delete_link(dwb.fc.bookmarks, item);
+    }
+    if (op == JOURNAL_ADD)
+        dwb.fc.bookmarks = g_list_append(dwb.fc.bookmarks, n);
+    else 
+        dwb_navigation_free(n);
+}
+static GString *
+dwb_quickmarks_snapshot(void *data) 
+{
+    GString *buffer = g_string_new(NULL);
+    Quickmark *q;
+    for (GList *l = dwb.fc.quickmarks; l; l=l->next) 
+    {
+        q = l->data;
+        g_string_append_printf(buffer, "%s %s %s\n", q->key, q->nav->first, q->nav->second ? q->nav->second : "");
+    }
+    return buffer;
+}
+static void
+dwb_quickmarks_replay(JournalOp op, char *line, void *data) 
+{
+    Quickmark *q = dwb_quickmark_new_from_line(line);
+    GList *item;
+
+    if (q == NULL)
+        return;
+    if ((item = g_list_find_custom(dwb.fc.quickmarks, q, (GCompareFunc)util_quickmark_compare)) != NULL) 
+    {
+        dwb_quickmark_free(item->data);
+        dwb.fc.quickmarks = g_list_delete_link(dwb.fc.quickmarks, item);
+    }
+    if (op == JOURNAL_ADD)
+        dwb.fc.quickmarks = g_list_prepend(dwb.fc.quickmarks, q);
+    else 
+        dwb_quickmark_free(q);
+}
+/* number of journal records of bookmarks and quickmarks that trigger a
+ * compaction */
+#define DWB_JOURNAL_COMPACT_RECORDS 100
+/* Creates the journals and replays them on top of the bookmark and quickmark
+ * files, a journal is only left behind by an instance that didn't exit
+ * cleanly */
+static void
+dwb_init_journals() 
+{
+    dwb.misc.bookmarks_journal = journal_new(dwb.files[FILES_BOOKMARKS], SYNC_BOOKMARKS, DWB_JOURNAL_COMPACT_RECORDS, dwb_bookmarks_snapshot, NULL);
+    if (journal_replay(dwb.misc.bookmarks_journal, dwb_bookmarks_replay, NULL) > 0)
+        journal_compact(dwb.misc.bookmarks_journal);
+
+    dwb.misc.quickmarks_journal = journal_new(dwb.files[FILES_QUICKMARKS], SYNC_QUICKMARKS, DWB_JOURNAL_COMPACT_RECORDS, dwb_quickmarks_snapshot, NULL);
+    if (journal_replay(dwb.misc.quickmarks_journal, dwb_quickmarks_replay, NULL) > 0)
+        journal_compact(dwb.misc.quickmarks_journal);
+}/*}}}*/
+
+/* Rebuilds the completion index of the bookmarks */
+void
+dwb_index_bookmarks() 
+{
+    if (dwb.comps.bookmarks == NULL)
+        dwb.comps.bookmarks = trigram_index_new();
+    else 
+        trigram_index_clear(dwb.comps.bookmarks);
+
+    for (GList *l = dwb.fc.bookmarks; l; l=l->next) 
+        trigram_index_add(dwb.comps.bookmarks, l->data);
+}
+
+/* The files have been edited by the user, operations in the journal that have
+ * not been folded into the file yet are dropped */
 void 
 dwb_reload_bookmarks()
 {
+    journal_discard(dwb.misc.bookmarks_journal);
     dwb_free_list(dwb.fc.bookmarks, (void_func)dwb_navigation_free);
     dwb.fc.bookmarks = NULL;
     dwb.fc.bookmarks = dwb_init_file_content(dwb.fc.bookmarks, dwb.files[FILES_BOOKMARKS], (Content_Func)dwb_navigation_new_from_line); 
+    dwb_index_bookmarks();
 }
 void 
 dwb_reload_quickmarks()
 {
+    journal_discard(dwb.misc.quickmarks_journal);
     dwb_free_list(dwb.fc.quickmarks, (void_func)dwb_quickmark_free);
     dwb.fc.quickmarks = NULL;
     dwb.fc.quickmarks = dwb_init_file_content(dwb.fc.quickmarks, dwb.files[FILES_QUICKMARKS], (Content_Func)dwb_quickmark_new_from_line); 
@@ -4172,8 +4363,7 @@ dwb_init_files()
     dwb_check_create(dwb.files[FILES_HISTORY]);
     dwb.files[FILES_QUICKMARKS]      = g_build_filename(profile_path, "quickmarks",    NULL);
     dwb_check_create(dwb.files[FILES_QUICKMARKS]);
-    dwb.files[FILES_SESSION]         = g_build_filename(profile_path, "session",       NULL);
-    dwb_check_create(dwb.files[FILES_SESSION]);
+    dwb.files[FILES_SESSION]         = util_check_directory(g_build_filename(profile_path, "sessions",       NULL));
     dwb.files[FILES_NAVIGATION_HISTORY] = g_build_filename(profile_path, "navigate.history",       NULL);
     dwb_check_create(dwb.files[FILES_NAVIGATION_HISTORY]);
     dwb.files[FILES_COMMAND_HISTORY] = g_build_filename(profile_path, "commands.history",       NULL);
@@ -4196,13 +4386,15 @@ dwb_init_files()
     dwb_check_create(dwb.files[FILES_PLUGINS_ALLOW]);
     dwb.files[FILES_CUSTOM_KEYS]     = g_build_filename(profile_path, "custom_keys",      NULL);
     dwb_check_create(dwb.files[FILES_CUSTOM_KEYS]);
+    dwb.files[FILES_CONTROL]         = g_build_filename(profile_path, "control",      NULL);
 
     userscripts               = g_build_filename(path, "userscripts",   NULL);
     dwb.files[FILES_USERSCRIPTS]     = util_check_directory(userscripts);
 
     dwb.fc.bookmarks = dwb_init_file_content(dwb.fc.bookmarks, dwb.files[FILES_BOOKMARKS], (Content_Func)dwb_navigation_new_from_line); 
-    dwb.fc.history = dwb_init_file_content(dwb.fc.history, dwb.files[FILES_HISTORY], (Content_Func)dwb_navigation_new_from_line); 
     dwb.fc.quickmarks = dwb_init_file_content(dwb.fc.quickmarks, dwb.files[FILES_QUICKMARKS], (Content_Func)dwb_quickmark_new_from_line); 
+    dwb_init_journals();
+    dwb_index_bookmarks();
     dwb.fc.searchengines = dwb_init_file_content(dwb.fc.searchengines, dwb.files[FILES_SEARCHENGINES], (Content_Func)dwb_navigation_new_from_line); 
     dwb.fc.se_completion = dwb_init_file_content(dwb.fc.se_completion, dwb.files[FILES_SEARCHENGINES], (Content_Func)dwb_get_search_completion);
     dwb.fc.mimetypes = dwb_init_file_content(dwb.fc.mimetypes, dwb.files[FILES_MIMETYPES], (Content_Func)dwb_navigation_new_from_line);
@@ -4344,6 +4536,7 @@ dwb_init_custom_keys(gboolean reload)
         g_string_free(keybuf, true);
     }
     g_strfreev(lines);
+    dispatch_invalidate();
 }
 
 void
@@ -4358,7 +4551,8 @@ dwb_init_vars(void)
     dwb.state.bar_visible = BAR_VIS_TOP | BAR_VIS_STATUS;
 
     dwb.comps.completions = NULL; 
-    dwb.comps.active_comp = NULL;
+    dwb.comps.rows = NULL;
+    dwb.comps.active = 0;
     dwb.comps.view = NULL;
 
     dwb.misc.max_c_items = MAX_COMPLETIONS;
@@ -4366,6 +4560,7 @@ dwb_init_vars(void)
     dwb.misc.proxyuri = NULL;
 
     dwb.misc.hints = NULL;
+    dwb.state.hint_input = NULL;
     dwb.misc.hint_style = NULL;
 
     dwb.misc.sync_interval = 0;
@@ -4396,7 +4591,7 @@ dwb_init()
     dwb_init_style();
     dwb_init_gui();
     dwb_init_custom_keys(false);
-    domain_init();
+    history_init();
     adblock_init();
     dwb_init_hints(NULL, NULL);
 
@@ -4419,7 +4614,6 @@ dwb_parse_command_line(const char *line)
     nummod = dwb.state.nummod;
     char **token = g_strsplit(bak, " ", 2);
     KeyMap *m = NULL;
-    gboolean found;
     gboolean has_arg = false;
 
     if (!token[0]) 
@@ -4428,42 +4622,22 @@ dwb_parse_command_line(const char *line)
     if (token[1])
         has_arg = true;
 
-    for (GList *l = dwb.keymap; l; l=l->next) 
+    m = dispatch_lookup_command(token[0]);
+    if (m != NULL) 
     {
-        bak = token[0];
-        found = false;
-        m = l->data;
-        if (!g_strcmp0(m->map->n.first, bak)) 
-            found = true;
-        else 
-        {
-            for (int i=0; m->map->alias[i]; i++) 
-            {
-                if (!g_strcmp0(m->map->alias[i], bak)) 
-                {
-                    found = true;
-                    break;
-                }
-            }
-        }
-        if (found) 
-        {
-            if (m->map->prop & CP_HAS_MODE) 
-                dwb_change_mode(NORMAL_MODE, true);
+        if (m->map->prop & CP_HAS_MODE) 
+            dwb_change_mode(NORMAL_MODE, true);
 
-            dwb.state.nummod = nummod;
-            if (token[1] && ! m->map->arg.ro) 
-            {
-                g_strstrip(token[1]);
-                m->map->arg.p = token[1];
-            }
-            if (gtk_widget_has_focus(dwb.gui.entry) && (m->map->prop & CP_OVERRIDE_ENTRY)) 
-                m->map->func(&m, &m->map->arg);
-            else 
-                ret = commands_simple_command(m);
-            
-            break;
+        dwb.state.nummod = nummod;
+        if (token[1] && ! m->map->arg.ro) 
+        {
+            g_strstrip(token[1]);
+            m->map->arg.p = token[1];
         }
+        if (gtk_widget_has_focus(dwb.gui.entry) && (m->map->prop & CP_OVERRIDE_ENTRY)) 
+            m->map->func(&m, &m->map->arg);
+        else 
+            ret = commands_simple_command(m);
     }
     g_strfreev(token);
     if (ret == STATUS_END)
@@ -4473,9 +4647,16 @@ dwb_parse_command_line(const char *line)
     dwb.state.nummod = -1;
 
     /* Check for dwb.keymap is necessary for commands that quit dwb. */
-    if (dwb.keymap == NULL || m == NULL)
+    if (dwb.keymap == NULL)
         return ret;
 
+    /* Unknown commands switch back to normal mode and return STATUS_ERROR */
+    if (m == NULL) 
+    {
+        dwb_change_mode(NORMAL_MODE, dwb.state.message_id == 0);
+        return STATUS_ERROR;
+    }
+
     if (m->map->prop & CP_HAS_MODE)
         return STATUS_OK;
 
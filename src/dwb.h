@@ -103,14 +103,14 @@
 #define GET_TEXT()                  (gtk_entry_get_text(GTK_ENTRY(dwb.gui.entry)))
 #define CURRENT_VIEW()              ((View*)dwb.state.fview->data)
 #define VIEW(X)                     ((View*)X->data)
-#define WEBVIEW(X)                  (WEBKIT_WEB_VIEW(((View*)X->data)->web))
-#define CURRENT_WEBVIEW_WIDGET()    (((View*)dwb.state.fview->data)->web)
-#define CURRENT_WEBVIEW()           (WEBKIT_WEB_VIEW(((View*)dwb.state.fview->data)->web))
+#define WEBVIEW(X)                  (WEBKIT_WEB_VIEW(view_get_web((View*)X->data)))
+#define CURRENT_WEBVIEW_WIDGET()    (view_get_web((View*)dwb.state.fview->data))
+#define CURRENT_WEBVIEW()           (WEBKIT_WEB_VIEW(view_get_web((View*)dwb.state.fview->data)))
 #define MAIN_FRAME()                (webkit_web_view_get_main_frame(CURRENT_WEBVIEW()))  
 #define MAIN_FRAME_CAST(X)                (webkit_web_view_get_main_frame(WEBKIT_WEB_VIEW(X)))  
 #define FOCUSED_FRAME()             (webkit_web_view_get_focused_frame(CURRENT_WEBVIEW()))  
 #define VIEW_FROM_ARG(X)            (X && X->p ? ((GSList*)X->p)->data : dwb.state.fview->data)
-#define WEBVIEW_FROM_ARG(arg)       (WEBKIT_WEB_VIEW(((View*)(arg && arg->p ? ((GSList*)arg->p)->data : dwb.state.fview->data))->web))
+#define WEBVIEW_FROM_ARG(arg)       (WEBKIT_WEB_VIEW(view_get_web((View*)(arg && arg->p ? ((GSList*)arg->p)->data : dwb.state.fview->data))))
 #define CLEAR_COMMAND_TEXT()        dwb_set_status_bar_text(dwb.gui.lstatus, NULL, NULL, NULL, false)
 #define BOOLEAN(X)                  (!(!(X)))
 #define NAVIGATION(X)               ((Navigation*)((X)->data))
@@ -196,15 +196,20 @@ typedef struct _FileContent FileContent;
 typedef struct _Font DwbFont;
 typedef struct _FunctionMap FunctionMap;
 typedef struct _Gui Gui;
+typedef struct _Journal Journal;
 typedef struct _Key Key;
 typedef struct _KeyMap KeyMap;
 typedef struct _KeyValue KeyValue;
+typedef struct _LocalListing LocalListing;
 typedef struct _Misc Misc;
 typedef struct _Navigation Navigation;
+typedef struct _Placeholder Placeholder;
 typedef struct _Plugins Plugins;
 typedef struct _Quickmark Quickmark;
+typedef struct _RequestFilter RequestFilter;
 typedef struct _Settings Settings;
 typedef struct _State State;
+typedef struct _TrigramIndex TrigramIndex;
 typedef struct _View View;
 typedef struct _ViewStatus ViewStatus;
 typedef struct _WebSettings WebSettings;
@@ -299,9 +304,11 @@ typedef enum {
 enum {
   SYNC_HISTORY = 1<<0, 
   SYNC_COOKIES = 1<<1,
-  SYNC_SESSION = 1<<2
+  SYNC_SESSION = 1<<2,
+  SYNC_BOOKMARKS = 1<<3,
+  SYNC_QUICKMARKS = 1<<4
 };
-#define SYNC_ALL (SYNC_HISTORY | SYNC_COOKIES | SYNC_SESSION)
+#define SYNC_ALL (SYNC_HISTORY | SYNC_COOKIES | SYNC_SESSION | SYNC_BOOKMARKS | SYNC_QUICKMARKS)
 
 typedef enum {
   HINT_T_ALL        = 0,
@@ -561,14 +568,20 @@ struct _Quickmark {
   Navigation *nav;
 };
 struct _Completions {
-  GList *active_comp;
-  GList *completions;
+  /* CompletionItem, the candidates */
+  GPtrArray *completions;
+  /* Completion, the rows that are reused while scrolling */
+  GPtrArray *rows;
+  int active;
+  int offset;
   GList *auto_c;
   GList *active_auto_c;
   gboolean autocompletion;
   GList *path_completion;
   GList *active_path;
   GList *view;
+  TrigramIndex *bookmarks;
+  TrigramIndex *history;
 };
 struct _State {
   GList *views;
@@ -580,6 +593,7 @@ struct _State {
   Open nv;
   DwbType type;
   HintType hint_type;
+  char *hint_input;
   guint scriptlock;
   GHashTable *settings_hash;
   int search_flags;
@@ -653,12 +667,27 @@ struct _ViewStatus {
 #endif
   GSList *allowed_plugins;
   unsigned int lockprotect;
-  GSList *styles;
   GSList *frames;
-  WebKitDOMElement *exc_style;
+  WebKitDOMElement *hider_style;
   guint group;
   gboolean deferred;
   char *deferred_uri;
+  LocalListing *listing;
+  Placeholder *placeholder;
+  /* monotonic time the tab was created or lost focus */
+  gint64 last_focus;
+  /* id of the tab in the session and number of changes of its history */
+  guint session_id;
+  guint generation;
+};
+/* restored tab that doesn't have a webview yet */
+struct _Placeholder {
+  /* session lines of the tab, the current item is saved without lock */
+  char *history;
+  char *uri;
+  char *title;
+  /* object returned by tabs.nth, NULL if scripts haven't asked for it */
+  void *script_object;
 };
 struct _View {
   GtkWidget *web;
@@ -778,10 +807,14 @@ struct _Misc {
   int synctimer;
   int sync_interval;
   int sync_files;
+  Journal *bookmarks_journal;
+  Journal *quickmarks_journal;
   int bar_height;
   TabPosition tab_position;
   char *hint_style;
   int script_signals;
+  /* signals that clients of the control socket subscribed to */
+  int control_signals;
   CloseLastTabPolicy clt_policy;
   ProgressBarStyle progress_bar_style;
 };
@@ -806,6 +839,7 @@ enum Files {
   FILES_PLUGINS_ALLOW,
   FILES_CACHEDIR,
   FILES_CUSTOM_KEYS,
+  FILES_CONTROL,
   FILES_LAST
 };
 // TODO implement plugins blocker, script blocker with File struct
@@ -979,6 +1013,8 @@ void dwb_init_files(void);
 void dwb_init_settings(void);
 void dwb_reload_bookmarks(void);
 void dwb_reload_quickmarks(void);
+void dwb_index_bookmarks(void);
+GtkWidget * view_get_web(View *v);
 #if 0
 void dwb_hide_tab(GList *gl);
 void dwb_show_tab(GList *gl);
@@ -0,0 +1,389 @@
+/*
+ * Copyright (c) 2010-2013 Stefan Bolte <portix@gmx.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <string.h>
+#include <gio/gio.h>
+#include "dwb.h"
+#include "fileio.h"
+
+/*
+ * File operations of scripts that don't block the main loop.
+ *
+ * Files are loaded by mapping them on a worker thread and converting them to
+ * utf-16 there, the main thread only creates the string from the converted
+ * text. Files that can't be mapped or report a length of 0, e.g. pipes or
+ * files in /proc, are read with g_file_get_contents. Lines are read in chunks
+ * with GIO and split on the main thread, only the incomplete last line of a
+ * chunk is copied. Files are written with g_file_replace_contents_async, i.e.
+ * to a temporary file that replaces the file when it has been written
+ * completely.
+ *
+ * Writes to the same file are serialized. If a file is written again while an
+ * earlier write is waiting for a running write, the waiting write is skipped
+ * and its callbacks are called when the newer content has been written.
+ */
+#define FILEIO_MAX_THREADS 2
+
+typedef struct _FileioLoad {
+    char *path;
+    FileioLoadFunc func;
+    void *data;
+    gunichar2 *text;
+    glong length;
+    GError *error;
+} FileioLoad;
+
+typedef struct _FileioLines {
+    GInputStream *stream;
+    /* incomplete last line of the previous chunk */
+    GString *partial;
+    char chunk[FILEIO_CHUNK_SIZE];
+    guint64 count;
+    /* set when the line callback returned true */
+    gboolean stopped;
+    FileioLineFunc line;
+    FileioDoneFunc done;
+    void *data;
+} FileioLines;
+
+typedef struct _FileioCallback {
+    FileioDoneFunc done;
+    void *data;
+} FileioCallback;
+
+typedef struct _FileioReplace {
+    char *path;
+    char *content;
+    gsize length;
+    /* FileioCallbacks of this write and of the writes it superseded */
+    GSList *callbacks;
+} FileioReplace;
+
+static GThreadPool *s_pool;
+/* maps paths that are being written to the next FileioReplace or NULL */
+static GHashTable *s_replacing;
+
+/* fileio_utf8_to_utf16(const char *text, gsize size, glong *length, GError **) {{{
+ * Converts text to utf-16, invalid sequences are replaced with U+FFFD
+ * */
+static gunichar2 *
+fileio_utf8_to_utf16(const char *text, gsize size, glong *length, GError **error)
+{
+    const char *end;
+    GString *valid;
+    gunichar2 *ret;
+
+    if (g_utf8_validate(text, size, &end))
+        return g_utf8_to_utf16(text, size, NULL, length, error);
+
+    valid = g_string_sized_new(size + 2);
+    do
+    {
+        g_string_append_len(valid, text, end - text);
+        g_string_append(valid, "\357\277\275");
+        size -= end - text + 1;
+        text = end + 1;
+    } while (!g_utf8_validate(text, size, &end));
+    g_string_append_len(valid, text, size);
+
+    ret = g_utf8_to_utf16(valid->str, valid->len, NULL, length, error);
+    g_string_free(valid, true);
+    return ret;
+}/*}}}*/
+
+/* fileio_map_utf16(const char *path, glong *length, GError **) {{{
+ * Maps a file and converts it to utf-16, the file is never copied as utf-8
+ * unless it can't be mapped
+ * */
+gunichar2 *
+fileio_map_utf16(const char *path, glong *length, GError **error)
+{
+    g_return_val_if_fail(path != NULL, NULL);
+    g_return_val_if_fail(length != NULL, NULL);
+
+    gunichar2 *text;
+    GMappedFile *file = NULL;
+    char *content;
+    gsize size;
+
+    if (g_file_test(path, G_FILE_TEST_IS_REGULAR))
+        file = g_mapped_file_new(path, false, NULL);
+
+    if (file != NULL && g_mapped_file_get_length(file) > 0)
+    {
+        text = fileio_utf8_to_utf16(g_mapped_file_get_contents(file), g_mapped_file_get_length(file), length, error);
+        g_mapped_file_unref(file);
+        return text;
+    }
+    if (file != NULL)
+        g_mapped_file_unref(file);
+
+    if (!g_file_get_contents(path, &content, &size, error))
+        return NULL;
+    text = fileio_utf8_to_utf16(content, size, length, error);
+    g_free(content);
+    return text;
+}/*}}}*/
+
+/* fileio_load_finish(FileioLoad *) {{{*/
+static gboolean
+fileio_load_finish(FileioLoad *load)
+{
+    load->func(load->text, load->length, load->error, load->data);
+    if (load->error != NULL)
+        g_error_free(load->error);
+    g_free(load->path);
+    g_free(load);
+    return false;
+}/*}}}*/
+
+/* fileio_load_run(FileioLoad *) {{{
+ * Runs on a worker thread
+ * */
+static void
+fileio_load_run(FileioLoad *load, gpointer unused)
+{
+    load->text = fileio_map_utf16(load->path, &load->length, &load->error);
+    g_idle_add((GSourceFunc)fileio_load_finish, load);
+}/*}}}*/
+
+/* fileio_load(const char *path, FileioLoadFunc, void *data) {{{*/
+void
+fileio_load(const char *path, FileioLoadFunc func, void *data)
+{
+    g_return_if_fail(path != NULL);
+    g_return_if_fail(func != NULL);
+
+    FileioLoad *load = dwb_malloc(sizeof(FileioLoad));
+    load->path = g_strdup(path);
+    load->func = func;
+    load->data = data;
+    load->text = NULL;
+    load->length = 0;
+    load->error = NULL;
+
+    if (s_pool == NULL)
+        s_pool = g_thread_pool_new((GFunc)fileio_load_run, NULL, FILEIO_MAX_THREADS, false, NULL);
+    g_thread_pool_push(s_pool, load, NULL);
+}/*}}}*/
+
+/* fileio_lines_finish(FileioLines *, GError *) {{{*/
+static void
+fileio_lines_finish(FileioLines *lines, GError *error)
+{
+    if (lines->done != NULL)
+        lines->done(lines->count, error, lines->data);
+    if (error != NULL)
+        g_error_free(error);
+    if (lines->stream != NULL)
+        g_object_unref(lines->stream);
+    g_string_free(lines->partial, true);
+    g_free(lines);
+}/*}}}*/
+
+/* fileio_lines_emit(FileioLines *, char *line, gsize length) {{{*/
+static gboolean
+fileio_lines_emit(FileioLines *lines, char *line, gsize length)
+{
+    if (length > 0 && line[length-1] == '\r')
+        line[length-1] = '\0';
+    lines->count++;
+    lines->stopped = lines->line(line, lines->data);
+    return lines->stopped;
+}/*}}}*/
+
+static void fileio_lines_read_cb(GInputStream *, GAsyncResult *, FileioLines *);
+
+/* fileio_lines_read(FileioLines *) {{{*/
+static void
+fileio_lines_read(FileioLines *lines)
+{
+    /* one byte is kept free to terminate the last line */
+    g_input_stream_read_async(lines->stream, lines->chunk, FILEIO_CHUNK_SIZE - 1, G_PRIORITY_DEFAULT, NULL, 
+            (GAsyncReadyCallback)fileio_lines_read_cb, lines);
+}/*}}}*/
+
+/* fileio_lines_read_cb(GInputStream *, GAsyncResult *, FileioLines *) {{{*/
+static void
+fileio_lines_read_cb(GInputStream *stream, GAsyncResult *result, FileioLines *lines)
+{
+    GError *error = NULL;
+    gssize n = g_input_stream_read_finish(stream, result, &error);
+    char *start = lines->chunk, *end, *nl;
+
+    if (n < 0)
+    {
+        fileio_lines_finish(lines, error);
+        return;
+    }
+
+    end = start + n;
+    *end = '\0';
+    while (!lines->stopped && (nl = memchr(start, '\n', end - start)) != NULL)
+    {
+        *nl = '\0';
+        if (lines->partial->len > 0)
+        {
+            g_string_append_len(lines->partial, start, nl - start);
+            fileio_lines_emit(lines, lines->partial->str, lines->partial->len);
+            g_string_truncate(lines->partial, 0);
+        }
+        else
+            fileio_lines_emit(lines, start, nl - start);
+        start = nl + 1;
+    }
+    if (!lines->stopped)
+        g_string_append_len(lines->partial, start, end - start);
+
+    /* the unterminated last line is emitted like any other line, reading
+     * stops after it either way */
+    if (n == 0 && !lines->stopped && lines->partial->len > 0)
+        fileio_lines_emit(lines, lines->partial->str, lines->partial->len);
+
+    if (n == 0 || lines->stopped)
+        fileio_lines_finish(lines, NULL);
+    else
+        fileio_lines_read(lines);
+}/*}}}*/
+
+/* fileio_lines_open_cb(GFile *, GAsyncResult *, FileioLines *) {{{*/
+static void
+fileio_lines_open_cb(GFile *file, GAsyncResult *result, FileioLines *lines)
+{
+    GError *error = NULL;
+    GFileInputStream *stream = g_file_read_finish(file, result, &error);
+
+    g_object_unref(file);
+    if (stream == NULL)
+    {
+        fileio_lines_finish(lines, error);
+        return;
+    }
+    lines->stream = G_INPUT_STREAM(stream);
+    fileio_lines_read(lines);
+}/*}}}*/
+
+/* fileio_read_lines(const char *path, FileioLineFunc, FileioDoneFunc, void *data) {{{
+ * Calls line for every line of a file, done is called with the number of lines
+ * */
+void
+fileio_read_lines(const char *path, FileioLineFunc line, FileioDoneFunc done, void *data)
+{
+    g_return_if_fail(path != NULL);
+    g_return_if_fail(line != NULL);
+
+    FileioLines *lines = dwb_malloc(sizeof(FileioLines));
+    lines->stream = NULL;
+    lines->partial = g_string_new(NULL);
+    lines->count = 0;
+    lines->stopped = false;
+    lines->line = line;
+    lines->done = done;
+    lines->data = data;
+
+    g_file_read_async(g_file_new_for_path(path), G_PRIORITY_DEFAULT, NULL, (GAsyncReadyCallback)fileio_lines_open_cb, lines);
+}/*}}}*/
+
+/* fileio_replace_free(FileioReplace *) {{{*/
+static void
+fileio_replace_free(FileioReplace *replace)
+{
+    g_slist_free_full(replace->callbacks, g_free);
+    g_free(replace->path);
+    g_free(replace->content);
+    g_free(replace);
+}/*}}}*/
+
+static void fileio_replace_cb(GFile *, GAsyncResult *, FileioReplace *);
+
+/* fileio_replace_start(FileioReplace *) {{{*/
+static void
+fileio_replace_start(FileioReplace *replace)
+{
+    g_file_replace_contents_async(g_file_new_for_path(replace->path), replace->content, replace->length, NULL, false, G_FILE_CREATE_NONE, NULL, 
+            (GAsyncReadyCallback)fileio_replace_cb, replace);
+}/*}}}*/
+
+/* fileio_replace_cb(GFile *, GAsyncResult *, FileioReplace *) {{{*/
+static void
+fileio_replace_cb(GFile *file, GAsyncResult *result, FileioReplace *replace)
+{
+    GError *error = NULL;
+    FileioCallback *callback;
+    FileioReplace *next;
+
+    g_file_replace_contents_finish(file, result, NULL, &error);
+    g_object_unref(file);
+
+    next = g_hash_table_lookup(s_replacing, replace->path);
+    if (next != NULL)
+    {
+        g_hash_table_insert(s_replacing, g_strdup(replace->path), NULL);
+        fileio_replace_start(next);
+    }
+    else
+        g_hash_table_remove(s_replacing, replace->path);
+
+    for (GSList *l = replace->callbacks; l; l=l->next)
+    {
+        callback = l->data;
+        if (callback->done != NULL)
+            callback->done(error == NULL ? replace->length : 0, error, callback->data);
+    }
+    if (error != NULL)
+        g_error_free(error);
+    fileio_replace_free(replace);
+}/*}}}*/
+
+/* fileio_replace(const char *path, char *content, gsize length, FileioDoneFunc, void *data) {{{
+ * Atomically replaces a file, takes ownership of content. done is called with
+ * the number of bytes written.
+ * */
+void
+fileio_replace(const char *path, char *content, gsize length, FileioDoneFunc done, void *data)
+{
+    g_return_if_fail(path != NULL);
+    g_return_if_fail(content != NULL);
+
+    FileioReplace *replace = dwb_malloc(sizeof(FileioReplace)), *next;
+    FileioCallback *callback = dwb_malloc(sizeof(FileioCallback));
+
+    callback->done = done;
+    callback->data = data;
+    replace->path = g_strdup(path);
+    replace->content = content;
+    replace->length = length;
+    replace->callbacks = g_slist_prepend(NULL, callback);
+
+    if (s_replacing == NULL)
+        s_replacing = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+
+    if (!g_hash_table_lookup_extended(s_replacing, path, NULL, (gpointer*)&next))
+    {
+        g_hash_table_insert(s_replacing, g_strdup(path), NULL);
+        fileio_replace_start(replace);
+        return;
+    }
+    if (next != NULL)
+    {
+        replace->callbacks = g_slist_concat(next->callbacks, replace->callbacks);
+        next->callbacks = NULL;
+        fileio_replace_free(next);
+    }
+    g_hash_table_insert(s_replacing, g_strdup(path), replace);
+}/*}}}*/
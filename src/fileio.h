@@ -0,0 +1,37 @@
+/*
+ * Copyright (c) 2010-2013 Stefan Bolte <portix@gmx.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef FILEIO_H
+#define FILEIO_H
+
+#define FILEIO_CHUNK_SIZE 65536
+
+/* Called with the content of a file as utf-16, the text must be freed by the
+ * callee */
+typedef void (*FileioLoadFunc)(gunichar2 *text, glong length, GError *error, void *data);
+/* Called for every line of a file, returns true to stop reading */
+typedef gboolean (*FileioLineFunc)(const char *line, void *data);
+/* Called when an operation has finished, count is the number of lines or bytes */
+typedef void (*FileioDoneFunc)(guint64 count, GError *error, void *data);
+
+gunichar2 * fileio_map_utf16(const char *path, glong *length, GError **error);
+void fileio_load(const char *path, FileioLoadFunc func, void *data);
+void fileio_read_lines(const char *path, FileioLineFunc line, FileioDoneFunc done, void *data);
+void fileio_replace(const char *path, char *content, gsize length, FileioDoneFunc done, void *data);
+
+#endif
@@ -0,0 +1,476 @@
+/*
+ * Copyright (c) 2010-2013 Stefan Bolte <portix@gmx.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <string.h>
+#include "dwb.h"
+#include "domain.h"
+#include "filter.h"
+
+/*
+ * Request filters are evaluated natively for every resource request, scripts
+ * are only called for requests that a filter marks FILTER_ASK.
+ *
+ * Rules map a first party and a domain to an action, both may be "*". A rule
+ * domain matches the host of a request and all of its parent domains down to
+ * the base domain, a rule first party matches the base domain of the first
+ * party. Patterns are regular expressions matched against the uri, the
+ * patterns of an action are compiled into a single alternation when they are
+ * needed. If no rule or pattern matches the fallback action is used.
+ *
+ * Every filter keeps a log of the base domains it has seen and the number of
+ * requests it has blocked per webview since the last committed load.
+ */
+#define FILTER_ACTIONS (FILTER_BLOCK + 1)
+
+typedef struct _FilterLog {
+    GPtrArray *domains;
+    GHashTable *seen;
+    guint blocked;
+} FilterLog;
+
+struct _RequestFilter {
+    /* maps first parties to tables that map domains to actions */
+    GHashTable *rules;
+    /* pattern sources and the compiled alternation per action */
+    GPtrArray *patterns[FILTER_ACTIONS];
+    GRegex *regex[FILTER_ACTIONS];
+    gboolean dirty[FILTER_ACTIONS];
+    /* only evaluate requests to other base domains than the first party */
+    gboolean third_party;
+    FilterAction fallback;
+    FilterAskFunc ask;
+    void *data;
+    GQuark log;
+    gboolean attached;
+    guint ref;
+};
+
+static GSList *s_filters;
+static guint s_filter_count;
+
+/* filter_log_free(FilterLog *) {{{*/
+static void
+filter_log_free(FilterLog *log)
+{
+    g_hash_table_unref(log->seen);
+    g_ptr_array_free(log->domains, true);
+    g_free(log);
+}/*}}}*/
+
+/* filter_get_log(RequestFilter *, WebKitWebView *, gboolean create) {{{
+ * Placeholder and hibernated tabs don't have a webview and no log
+ * */
+static FilterLog *
+filter_get_log(RequestFilter *filter, WebKitWebView *wv, gboolean create)
+{
+    if (wv == NULL)
+        return NULL;
+
+    FilterLog *log = g_object_get_qdata(G_OBJECT(wv), filter->log);
+    if (log == NULL && create)
+    {
+        log = dwb_malloc(sizeof(FilterLog));
+        log->domains = g_ptr_array_new_with_free_func(g_free);
+        log->seen = g_hash_table_new(g_str_hash, g_str_equal);
+        log->blocked = 0;
+        g_object_set_qdata_full(G_OBJECT(wv), filter->log, log, (GDestroyNotify)filter_log_free);
+    }
+    return log;
+}/*}}}*/
+
+/* filter_log_domain(FilterLog *, const char *domain) {{{*/
+static void
+filter_log_domain(FilterLog *log, const char *domain)
+{
+    char *copy;
+    if (g_hash_table_lookup(log->seen, domain) == NULL)
+    {
+        copy = g_strdup(domain);
+        g_ptr_array_add(log->domains, copy);
+        g_hash_table_insert(log->seen, copy, copy);
+    }
+}/*}}}*/
+
+/* filter_new(gboolean third_party, FilterAction fallback, FilterAskFunc, void *data) {{{*/
+RequestFilter *
+filter_new(gboolean third_party, FilterAction fallback, FilterAskFunc ask, void *data)
+{
+    char *name;
+    RequestFilter *filter = dwb_malloc(sizeof(RequestFilter));
+
+    filter->rules = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, (GDestroyNotify)g_hash_table_unref);
+    for (int i=0; i<FILTER_ACTIONS; i++)
+    {
+        filter->patterns[i] = g_ptr_array_new_with_free_func(g_free);
+        filter->regex[i] = NULL;
+        filter->dirty[i] = false;
+    }
+    filter->third_party = third_party;
+    filter->fallback = fallback;
+    filter->ask = ask;
+    filter->data = data;
+
+    name = g_strdup_printf("dwb-request-filter-%u", ++s_filter_count);
+    filter->log = g_quark_from_string(name);
+    g_free(name);
+
+    filter->attached = false;
+    filter->ref = 1;
+    return filter;
+}/*}}}*/
+
+/* filter_unref(RequestFilter *) {{{*/
+static void
+filter_unref(RequestFilter *filter)
+{
+    if (--filter->ref > 0)
+        return;
+
+    g_hash_table_unref(filter->rules);
+    for (int i=0; i<FILTER_ACTIONS; i++)
+    {
+        g_ptr_array_free(filter->patterns[i], true);
+        if (filter->regex[i] != NULL)
+            g_regex_unref(filter->regex[i]);
+    }
+    g_free(filter);
+}/*}}}*/
+
+/* filter_free(RequestFilter *) {{{
+ * Detaches and frees the filter, a filter that is currently asking is freed
+ * after the ask function has returned
+ * */
+void
+filter_free(RequestFilter *filter)
+{
+    if (filter == NULL)
+        return;
+
+    filter_detach(filter);
+    filter_unref(filter);
+}/*}}}*/
+
+/* filter_set_rule(RequestFilter *, const char *first_party, const char *domain, FilterAction) {{{
+ * Sets the action for requests to domain from first_party, FILTER_NONE removes
+ * the rule
+ * */
+void
+filter_set_rule(RequestFilter *filter, const char *first_party, const char *domain, FilterAction action)
+{
+    g_return_if_fail(filter != NULL);
+    g_return_if_fail(first_party != NULL && domain != NULL);
+
+    GHashTable *domains = g_hash_table_lookup(filter->rules, first_party);
+    if (action == FILTER_NONE)
+    {
+        if (domains != NULL)
+        {
+            g_hash_table_remove(domains, domain);
+            if (g_hash_table_size(domains) == 0)
+                g_hash_table_remove(filter->rules, first_party);
+        }
+        return;
+    }
+    if (domains == NULL)
+    {
+        domains = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+        g_hash_table_insert(filter->rules, g_strdup(first_party), domains);
+    }
+    g_hash_table_insert(domains, g_strdup(domain), GINT_TO_POINTER(action));
+}/*}}}*/
+
+/* filter_add_pattern(RequestFilter *, const char *pattern, FilterAction, GError **) {{{*/
+gboolean
+filter_add_pattern(RequestFilter *filter, const char *pattern, FilterAction action, GError **error)
+{
+    g_return_val_if_fail(filter != NULL, false);
+    g_return_val_if_fail(pattern != NULL, false);
+    g_return_val_if_fail(action > FILTER_NONE && action < FILTER_ACTIONS, false);
+
+    GRegex *regex = g_regex_new(pattern, 0, 0, error);
+    if (regex == NULL)
+        return false;
+    g_regex_unref(regex);
+
+    filter_remove_pattern(filter, pattern);
+    g_ptr_array_add(filter->patterns[action], g_strdup(pattern));
+    filter->dirty[action] = true;
+    return true;
+}/*}}}*/
+
+/* filter_remove_pattern(RequestFilter *, const char *pattern) {{{*/
+gboolean
+filter_remove_pattern(RequestFilter *filter, const char *pattern)
+{
+    g_return_val_if_fail(filter != NULL, false);
+    g_return_val_if_fail(pattern != NULL, false);
+
+    for (int i=0; i<FILTER_ACTIONS; i++)
+    {
+        for (guint j=0; j<filter->patterns[i]->len; j++)
+        {
+            if (!strcmp(filter->patterns[i]->pdata[j], pattern))
+            {
+                g_ptr_array_remove_index(filter->patterns[i], j);
+                filter->dirty[i] = true;
+                return true;
+            }
+        }
+    }
+    return false;
+}/*}}}*/
+
+/* filter_clear(RequestFilter *) {{{
+ * Removes all rules and patterns
+ * */
+void
+filter_clear(RequestFilter *filter)
+{
+    g_return_if_fail(filter != NULL);
+
+    g_hash_table_remove_all(filter->rules);
+    for (int i=0; i<FILTER_ACTIONS; i++)
+    {
+        g_ptr_array_set_size(filter->patterns[i], 0);
+        filter->dirty[i] = true;
+    }
+}/*}}}*/
+
+/* filter_get_regex(RequestFilter *, FilterAction) {{{
+ * Returns the alternation of all patterns of an action, NULL if there are none
+ * */
+static GRegex *
+filter_get_regex(RequestFilter *filter, FilterAction action)
+{
+    GString *buffer;
+
+    if (!filter->dirty[action])
+        return filter->regex[action];
+
+    filter->dirty[action] = false;
+    if (filter->regex[action] != NULL)
+    {
+        g_regex_unref(filter->regex[action]);
+        filter->regex[action] = NULL;
+    }
+    if (filter->patterns[action]->len == 0)
+        return NULL;
+
+    buffer = g_string_new(NULL);
+    for (guint i=0; i<filter->patterns[action]->len; i++)
+    {
+        if (i > 0)
+            g_string_append_c(buffer, '|');
+        g_string_append_printf(buffer, "(?:%s)", (char*)filter->patterns[action]->pdata[i]);
+    }
+    filter->regex[action] = g_regex_new(buffer->str, G_REGEX_OPTIMIZE, 0, NULL);
+    g_string_free(buffer, true);
+    return filter->regex[action];
+}/*}}}*/
+
+/* filter_lookup(RequestFilter *, const char *first_party, const DomainInfo *) {{{*/
+static FilterAction
+filter_lookup(RequestFilter *filter, const char *first_party, const DomainInfo *info)
+{
+    FilterAction action;
+    GHashTable *domains = g_hash_table_lookup(filter->rules, first_party);
+
+    if (domains == NULL)
+        return FILTER_NONE;
+
+    action = GPOINTER_TO_INT(g_hash_table_lookup(domains, "*"));
+    for (int i=0; info->subdomains[i] != -1 && action != FILTER_BLOCK; i++)
+        action = MAX(action, GPOINTER_TO_INT(g_hash_table_lookup(domains, info->host + info->subdomains[i])));
+    return action;
+}/*}}}*/
+
+/* filter_evaluate(RequestFilter *, const char *uri, const char *first_party, const DomainInfo *) {{{*/
+static FilterAction
+filter_evaluate(RequestFilter *filter, const char *uri, const char *first_party, const DomainInfo *info)
+{
+    FilterAction action = FILTER_NONE;
+    GRegex *regex;
+
+    if (first_party != NULL)
+        action = filter_lookup(filter, first_party, info);
+    if (action != FILTER_BLOCK)
+        action = MAX(action, filter_lookup(filter, "*", info));
+
+    for (int i=FILTER_BLOCK; i>action; i--)
+    {
+        if ((regex = filter_get_regex(filter, i)) != NULL && g_regex_match(regex, uri, 0, NULL))
+        {
+            action = i;
+            break;
+        }
+    }
+    return action == FILTER_NONE ? filter->fallback : action;
+}/*}}}*/
+
+/* filter_attach(RequestFilter *) {{{*/
+void
+filter_attach(RequestFilter *filter)
+{
+    g_return_if_fail(filter != NULL);
+
+    if (!filter->attached)
+    {
+        s_filters = g_slist_append(s_filters, filter);
+        filter->attached = true;
+    }
+}/*}}}*/
+
+/* filter_detach(RequestFilter *) {{{
+ * Detaches the filter and drops its logs
+ * */
+void
+filter_detach(RequestFilter *filter)
+{
+    g_return_if_fail(filter != NULL);
+
+    if (!filter->attached)
+        return;
+
+    s_filters = g_slist_remove(s_filters, filter);
+    filter->attached = false;
+    for (GList *gl = dwb.state.views; gl; gl=gl->next)
+    {
+        if (VIEW(gl)->web != NULL)
+            g_object_set_qdata(G_OBJECT(VIEW(gl)->web), filter->log, NULL);
+    }
+}/*}}}*/
+
+/* filter_is_attached(RequestFilter *) {{{*/
+gboolean
+filter_is_attached(RequestFilter *filter)
+{
+    g_return_val_if_fail(filter != NULL, false);
+    return filter->attached;
+}/*}}}*/
+
+/* filter_get_domains(RequestFilter *, WebKitWebView *) {{{
+ * Returns the base domains of the requests the filter has evaluated in wv, the
+ * array is owned by the filter
+ * */
+GPtrArray *
+filter_get_domains(RequestFilter *filter, WebKitWebView *wv)
+{
+    g_return_val_if_fail(filter != NULL, NULL);
+
+    FilterLog *log = filter_get_log(filter, wv, false);
+    return log != NULL ? log->domains : NULL;
+}/*}}}*/
+
+/* filter_get_blocked(RequestFilter *, WebKitWebView *) {{{*/
+guint
+filter_get_blocked(RequestFilter *filter, WebKitWebView *wv)
+{
+    g_return_val_if_fail(filter != NULL, 0);
+
+    FilterLog *log = filter_get_log(filter, wv, false);
+    return log != NULL ? log->blocked : 0;
+}/*}}}*/
+
+/* filter_request(WebKitWebView *, WebKitWebFrame *, WebKitNetworkRequest *, WebKitNetworkResponse *) {{{
+ * Evaluates all attached filters for a request, blocked requests are
+ * redirected to about:blank. Returns whether the request has been blocked.
+ * */
+gboolean
+filter_request(WebKitWebView *wv, WebKitWebFrame *frame, WebKitNetworkRequest *request, WebKitNetworkResponse *response)
+{
+    SoupMessage *msg;
+    SoupURI *suri, *sfirst_party;
+    RequestFilter *filter;
+    const DomainInfo *info;
+    const char *first_party = NULL;
+    char *uri = NULL;
+    GSList *filters;
+    FilterAction action;
+    gboolean block = false;
+
+    if (s_filters == NULL || wv == NULL)
+        return false;
+
+    msg = webkit_network_request_get_message(request);
+    if (msg == NULL || (suri = soup_message_get_uri(msg)) == NULL || suri->host == NULL || *suri->host == '\0')
+        return false;
+
+    sfirst_party = soup_message_get_first_party(msg);
+    if (sfirst_party != NULL && sfirst_party->host != NULL && *sfirst_party->host != '\0')
+        first_party = domain_get_base_for_host(sfirst_party->host);
+
+    /* ask functions may attach, detach or free filters */
+    filters = g_slist_copy(s_filters);
+    for (GSList *l = filters; l; l=l->next)
+        ((RequestFilter*)l->data)->ref++;
+
+    for (GSList *l = filters; l && !block; l=l->next)
+    {
+        filter = l->data;
+        if (!filter->attached)
+            continue;
+
+        /* ask functions may invalidate the domain info */
+        info = domain_get_info(suri->host);
+        if (filter->third_party && (first_party == NULL || !strcmp(first_party, info->base)))
+            continue;
+
+        filter_log_domain(filter_get_log(filter, wv, true), info->base);
+
+        if (uri == NULL)
+            uri = soup_uri_to_string(suri, false);
+        action = filter_evaluate(filter, uri, first_party, info);
+        if (action == FILTER_BLOCK)
+            block = true;
+        else if (action == FILTER_ASK && filter->ask != NULL)
+            block = filter->ask(filter, wv, frame, request, response, filter->data);
+
+        if (block && filter->attached)
+            filter_get_log(filter, wv, true)->blocked++;
+    }
+    for (GSList *l = filters; l; l=l->next)
+        filter_unref(l->data);
+    g_slist_free(filters);
+    g_free(uri);
+
+    if (block)
+        webkit_network_request_set_uri(request, "about:blank");
+    return block;
+}/*}}}*/
+
+/* filter_reset_view(WebKitWebView *) {{{
+ * Drops the logs of a webview, called when a new load has been committed
+ * */
+void
+filter_reset_view(WebKitWebView *wv)
+{
+    if (wv == NULL)
+        return;
+    for (GSList *l = s_filters; l; l=l->next)
+        g_object_set_qdata(G_OBJECT(wv), ((RequestFilter*)l->data)->log, NULL);
+}/*}}}*/
+
+/* filter_end() {{{
+ * Detaches all filters, the owners are responsible for freeing them
+ * */
+void
+filter_end()
+{
+    while (s_filters != NULL)
+        filter_detach(s_filters->data);
+}/*}}}*/
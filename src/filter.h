@@ -0,0 +1,50 @@
+/*
+ * Copyright (c) 2010-2013 Stefan Bolte <portix@gmx.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef FILTER_H
+#define FILTER_H
+
+/* Ordered by precedence, if rules with different actions match a request the
+ * greatest action wins */
+typedef enum {
+    FILTER_NONE = 0,
+    FILTER_ASK,
+    FILTER_ALLOW,
+    FILTER_BLOCK,
+} FilterAction;
+
+/* Called for requests that are marked FILTER_ASK, returns whether the request
+ * should be blocked */
+typedef gboolean (*FilterAskFunc)(RequestFilter *, WebKitWebView *, WebKitWebFrame *, WebKitNetworkRequest *, WebKitNetworkResponse *, void *data);
+
+RequestFilter * filter_new(gboolean third_party, FilterAction fallback, FilterAskFunc ask, void *data);
+void filter_free(RequestFilter *filter);
+void filter_set_rule(RequestFilter *filter, const char *first_party, const char *domain, FilterAction action);
+gboolean filter_add_pattern(RequestFilter *filter, const char *pattern, FilterAction action, GError **error);
+gboolean filter_remove_pattern(RequestFilter *filter, const char *pattern);
+void filter_clear(RequestFilter *filter);
+void filter_attach(RequestFilter *filter);
+void filter_detach(RequestFilter *filter);
+gboolean filter_is_attached(RequestFilter *filter);
+GPtrArray * filter_get_domains(RequestFilter *filter, WebKitWebView *wv);
+guint filter_get_blocked(RequestFilter *filter, WebKitWebView *wv);
+gboolean filter_request(WebKitWebView *wv, WebKitWebFrame *frame, WebKitNetworkRequest *request, WebKitNetworkResponse *response);
+void filter_reset_view(WebKitWebView *wv);
+void filter_end(void);
+
+#endif
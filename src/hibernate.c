@@ -0,0 +1,206 @@
+/*
+ * Copyright (c) 2010-2013 Stefan Bolte <portix@gmx.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <stdio.h>
+#include <unistd.h>
+#include "dwb.h"
+#include "util.h"
+#include "view.h"
+#include "dom.h"
+#include "scripts.h"
+#include "local.h"
+#include "hibernate.h"
+
+/*
+ * A hibernated tab only keeps its history in a placeholder, the webview is
+ * destroyed and created again when the tab gets focus. A tab is hibernated
+ * if it hasn't had focus for hibernate-timeout minutes. If the resident set
+ * size exceeds hibernate-memory megabytes the tab that has been unfocused
+ * the longest is hibernated, one tab per check because the memory isn't
+ * released immediately. Locked tabs and tabs that play media or contain
+ * plugins are never hibernated.
+ */
+#define HIBERNATE_INTERVAL 30
+
+static guint s_timer;
+static gint64 s_timeout;
+static gsize s_memory;
+
+/* hibernate_get_rss() {{{
+ * Resident set size in bytes or 0 if it is unknown
+ * */
+static gsize
+hibernate_get_rss()
+{
+    FILE *f;
+    unsigned long size, resident;
+    gsize ret = 0;
+
+    if ((f = fopen("/proc/self/statm", "r")) == NULL)
+        return 0;
+    if (fscanf(f, "%lu %lu", &size, &resident) == 2)
+        ret = (gsize)resident * sysconf(_SC_PAGESIZE);
+    fclose(f);
+    return ret;
+}/*}}}*/
+
+/* hibernate_is_candidate(GList *) {{{*/
+static gboolean
+hibernate_is_candidate(GList *gl)
+{
+    View *v = VIEW(gl);
+    return gl != dwb.state.fview 
+        && v->status->placeholder == NULL 
+        && !v->status->deferred 
+        && v->status->lockprotect == 0 
+        && v->status->progress == 0 
+        && v->inspector_window == NULL 
+        && !local_is_running(gl);
+}/*}}}*/
+
+/* hibernate_tab(GList *, const char *reason) {{{
+ * Returns false if the tab plays media or a script prevented hibernation
+ * */
+static gboolean
+hibernate_tab(GList *gl, const char *reason)
+{
+    if (dom_has_active_media(webkit_web_view_get_dom_document(WEBVIEW(gl))))
+        return false;
+
+    if (EMIT_SCRIPT(HIBERNATE)) 
+    {
+        char *json = util_create_json(2, 
+                CHAR, "uri", webkit_web_view_get_uri(WEBVIEW(gl)), 
+                CHAR, "reason", reason);
+        ScriptSignal signal = { SCRIPTS_WV(gl), SCRIPTS_SIG_META(json, HIBERNATE, 0) };
+        gboolean prevented = scripts_emit(&signal);
+        g_free(json);
+        if (prevented)
+            return false;
+    }
+    view_hibernate(gl);
+    return true;
+}/*}}}*/
+
+/* hibernate_compare_focus(View *, View *) {{{*/
+static int
+hibernate_compare_focus(View *a, View *b)
+{
+    gint64 diff = a->status->last_focus - b->status->last_focus;
+    return diff < 0 ? -1 : diff > 0 ? 1 : 0;
+}/*}}}*/
+
+/* hibernate_find(View *) {{{
+ * Looks a view up again, a script handler of an earlier hibernation may have
+ * closed it or other tabs
+ * */
+static GList *
+hibernate_find(View *v)
+{
+    GList *gl = g_list_find(dwb.state.views, v);
+    return gl != NULL && hibernate_is_candidate(gl) ? gl : NULL;
+}/*}}}*/
+
+/* hibernate_check() {{{
+ * If the memory limit is exceeded the longest unfocused tab that can be
+ * hibernated is hibernated, tabs that play media are skipped
+ * */
+static gboolean
+hibernate_check(void *unused)
+{
+    gint64 now = g_get_monotonic_time();
+    GSList *expired = NULL, *candidates = NULL;
+    GList *gl;
+    View *v;
+
+    /* hibernate_tab emits a signal, so the views are collected first */
+    for (gl = dwb.state.views; gl; gl=gl->next) 
+    {
+        if (!hibernate_is_candidate(gl))
+            continue;
+
+        v = gl->data;
+        if (s_timeout > 0 && now - v->status->last_focus >= s_timeout) 
+            expired = g_slist_prepend(expired, v);
+        else 
+            candidates = g_slist_prepend(candidates, v);
+    }
+    for (GSList *l = expired; l; l=l->next) 
+    {
+        if ((gl = hibernate_find(l->data)) != NULL)
+            hibernate_tab(gl, "timeout");
+    }
+    g_slist_free(expired);
+
+    if (candidates != NULL && s_memory > 0 && hibernate_get_rss() > s_memory)
+    {
+        candidates = g_slist_sort(candidates, (GCompareFunc)hibernate_compare_focus);
+        for (GSList *l = candidates; l; l=l->next) 
+        {
+            if ((gl = hibernate_find(l->data)) != NULL && hibernate_tab(gl, "memory"))
+                break;
+        }
+    }
+    g_slist_free(candidates);
+
+    return true;
+}/*}}}*/
+
+/* hibernate_update_timer() {{{*/
+static void
+hibernate_update_timer()
+{
+    if (s_timeout > 0 || s_memory > 0) 
+    {
+        if (s_timer == 0)
+            s_timer = g_timeout_add_seconds(HIBERNATE_INTERVAL, (GSourceFunc)hibernate_check, NULL);
+    }
+    else 
+        hibernate_end();
+}/*}}}*/
+
+/* hibernate_set_timeout(int minutes) {{{
+ * Minutes after which unfocused tabs are hibernated, 0 disables the timeout
+ * */
+void
+hibernate_set_timeout(int minutes)
+{
+    s_timeout = (gint64)MAX(minutes, 0) * 60 * G_USEC_PER_SEC;
+    hibernate_update_timer();
+}/*}}}*/
+
+/* hibernate_set_memory(int megabytes) {{{
+ * Resident memory above which tabs are hibernated, 0 disables the limit
+ * */
+void
+hibernate_set_memory(int megabytes)
+{
+    s_memory = (gsize)MAX(megabytes, 0) * 1024 * 1024;
+    hibernate_update_timer();
+}/*}}}*/
+
+/* hibernate_end() {{{*/
+void
+hibernate_end()
+{
+    if (s_timer > 0) 
+    {
+        g_source_remove(s_timer);
+        s_timer = 0;
+    }
+}/*}}}*/
@@ -0,0 +1,377 @@
+/*
+ * Copyright (c) 2010-2013 Stefan Bolte <portix@gmx.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+#include "dwb.h"
+#include "util.h"
+#include "journal.h"
+#include "trigram.h"
+#include "history.h"
+
+/* 
+ * The history file contains a record 
+ *
+ *   uri visits last-visit title
+ *
+ * for every entry, oldest entries first. Visits and removals are appended to
+ * the journal of the history file which is compacted in the background when
+ * the journal has more records than there are entries, i.e. when most records
+ * on disk are stale, and after entries have been removed or trimmed.
+ */
+#define HISTORY_HEADER "# dwb history 2"
+/* minimum number of journal records that trigger a compaction */
+#define HISTORY_COMPACT_RECORDS 1000
+/* number of entries exceeding history-length before the list is trimmed */
+#define HISTORY_TRIM_SLACK 100
+
+/* maps uris to links of dwb.fc.history */
+static GHashTable *s_index;
+static Journal *s_journal;
+
+/* history_entry_free(HistoryEntry *) {{{*/
+static void
+history_entry_free(HistoryEntry *entry) 
+{
+    if (dwb.comps.history != NULL)
+        trigram_index_remove(dwb.comps.history, &entry->navigation);
+    g_free(entry->navigation.first);
+    g_free(entry->navigation.second);
+    g_free(entry);
+}/*}}}*/
+
+/* history_record(const char *uri, const char *title, guint visits, gint64 last_visit) {{{
+ * Inserts or updates an entry and moves it to the front
+ * */
+static HistoryEntry *
+history_record(const char *uri, const char *title, guint visits, gint64 last_visit) 
+{
+    GList *link = g_hash_table_lookup(s_index, uri);
+    HistoryEntry *entry;
+
+    if (link != NULL) 
+    {
+        entry = link->data;
+        if (g_strcmp0(entry->navigation.second, title)) 
+        {
+            g_free(entry->navigation.second);
+            entry->navigation.second = g_strdup(title);
+            trigram_index_add(dwb.comps.history, &entry->navigation);
+        }
+        if (link != dwb.fc.history) 
+        {
+            dwb.fc.history = g_list_remove_link(dwb.fc.history, link);
+            dwb.fc.history = g_list_concat(link, dwb.fc.history);
+        }
+    }
+    else 
+    {
+        entry = dwb_malloc(sizeof(HistoryEntry));
+        entry->navigation.first = g_strdup(uri);
+        entry->navigation.second = g_strdup(title);
+        dwb.fc.history = g_list_prepend(dwb.fc.history, entry);
+        g_hash_table_insert(s_index, entry->navigation.first, dwb.fc.history);
+        trigram_index_add(dwb.comps.history, &entry->navigation);
+    }
+    entry->visits = visits;
+    entry->last_visit = last_visit;
+    return entry;
+}/*}}}*/
+
+/* history_unlink(GList *link) {{{*/
+static void
+history_unlink(GList *link) 
+{
+    HistoryEntry *entry = link->data;
+    g_hash_table_remove(s_index, entry->navigation.first);
+    history_entry_free(entry);
+    dwb.fc.history = g_list_delete_link(dwb.fc.history, link);
+}/*}}}*/
+
+/* history_update_compaction() {{{
+ * Every journal record of an entry makes its earlier record stale, so the
+ * journal is compacted when it outgrows the number of entries
+ * */
+static void
+history_update_compaction() 
+{
+    journal_set_compact_after(s_journal, MAX(HISTORY_COMPACT_RECORDS, g_hash_table_size(s_index)));
+}/*}}}*/
+
+/* history_trim() {{{
+ * Drops the oldest entries that exceed history-length
+ * */
+static void
+history_trim() 
+{
+    GList *last, *next;
+
+    if (dwb.misc.history_length < 0 || g_hash_table_size(s_index) <= (guint)dwb.misc.history_length)
+        return;
+
+    if (dwb.misc.history_length == 0) 
+    {
+        last = dwb.fc.history;
+        dwb.fc.history = NULL;
+    }
+    else 
+    {
+        last = g_list_nth(dwb.fc.history, dwb.misc.history_length - 1);
+        next = last->next;
+        last->next = NULL;
+        last = next;
+        last->prev = NULL;
+    }
+    for (GList *l = last; l; l=l->next) 
+    {
+        g_hash_table_remove(s_index, ((HistoryEntry*)l->data)->navigation.first);
+        history_entry_free(l->data);
+    }
+    g_list_free(last);
+    history_update_compaction();
+    journal_compact(s_journal);
+}/*}}}*/
+
+/* history_format_record(GString *, const HistoryEntry *) {{{*/
+static void
+history_format_record(GString *buffer, const HistoryEntry *entry) 
+{
+    g_string_append_printf(buffer, "%s %u %" G_GINT64_FORMAT " %s", entry->navigation.first, 
+            entry->visits, entry->last_visit, entry->navigation.second != NULL ? entry->navigation.second : "");
+}/*}}}*/
+
+/* history_snapshot() {{{
+ * Content of the history file, one record per entry
+ * */
+static GString *
+history_snapshot(void *data) 
+{
+    GString *buffer = g_string_new(HISTORY_HEADER "\n");
+
+    for (GList *l = g_list_last(dwb.fc.history); l; l=l->prev) 
+    {
+        history_format_record(buffer, l->data);
+        g_string_append_c(buffer, '\n');
+    }
+    return buffer;
+}/*}}}*/
+
+/* history_flush() {{{
+ * Writes pending records to the journal
+ * */
+void
+history_flush() 
+{
+    if (s_journal != NULL)
+        journal_flush(s_journal);
+}/*}}}*/
+
+/* history_add(const char *uri, const char *title) {{{*/
+void
+history_add(const char *uri, const char *title) 
+{
+    g_return_if_fail(s_index != NULL);
+    g_return_if_fail(uri != NULL && *uri != '\0');
+
+    HistoryEntry *entry = history_lookup(uri);
+    GString *record = g_string_new(NULL);
+
+    entry = history_record(uri, title, entry != NULL ? entry->visits + 1 : 1, time(NULL));
+    history_format_record(record, entry);
+    journal_append(s_journal, JOURNAL_ADD, record->str);
+    g_string_free(record, true);
+
+    if (dwb.misc.history_length >= 0 && g_hash_table_size(s_index) > (guint)dwb.misc.history_length + HISTORY_TRIM_SLACK)
+        history_trim();
+    else if (entry->visits == 1)
+        history_update_compaction();
+}/*}}}*/
+
+/* history_lookup(const char *uri) {{{*/
+HistoryEntry *
+history_lookup(const char *uri) 
+{
+    GList *link = s_index != NULL ? g_hash_table_lookup(s_index, uri) : NULL;
+    return link != NULL ? link->data : NULL;
+}/*}}}*/
+
+/* history_remove(const char *uri) {{{*/
+void
+history_remove(const char *uri) 
+{
+    GList *link = s_index != NULL ? g_hash_table_lookup(s_index, uri) : NULL;
+    if (link == NULL)
+        return;
+
+    journal_append(s_journal, JOURNAL_REMOVE, ((HistoryEntry*)link->data)->navigation.first);
+    history_unlink(link);
+    history_update_compaction();
+    /* removed uris shouldn't stay on disk */
+    journal_compact(s_journal);
+}/*}}}*/
+
+/* history_clear() {{{*/
+void
+history_clear() 
+{
+    if (s_index == NULL)
+        return;
+    g_hash_table_remove_all(s_index);
+    trigram_index_clear(dwb.comps.history);
+    dwb_free_list(dwb.fc.history, (void_func)history_entry_free);
+    dwb.fc.history = NULL;
+    journal_discard(s_journal);
+    history_update_compaction();
+    journal_compact(s_journal);
+}/*}}}*/
+
+/* history_frecency(const HistoryEntry *, gint64 now) {{{
+ * Number of visits weighted by the age of the last visit
+ * */
+int
+history_frecency(const HistoryEntry *entry, gint64 now) 
+{
+    gint64 age = (now - entry->last_visit) / (24*60*60);
+    int weight;
+    if (age < 4)
+        weight = 100;
+    else if (age < 14)
+        weight = 70;
+    else if (age < 31)
+        weight = 50;
+    else if (age < 90)
+        weight = 30;
+    else 
+        weight = 10;
+    return entry->visits * weight;
+}/*}}}*/
+
+/* history_parse_record(char *line, char **uri, guint *visits, gint64 *last_visit, char **title) {{{*/
+static gboolean
+history_parse_record(char *line, char **uri, guint *visits, gint64 *last_visit, char **title) 
+{
+    char *end;
+
+    *uri = line;
+    if ((line = strchr(line, ' ')) == NULL)
+        return false;
+    *line++ = '\0';
+
+    *visits = strtoul(line, &end, 10);
+    if (end == line || *end != ' ')
+        return false;
+    line = end + 1;
+
+    *last_visit = g_ascii_strtoll(line, &end, 10);
+    if (end == line || (*end != ' ' && *end != '\0'))
+        return false;
+    *title = *end == ' ' ? end + 1 : end;
+    return true;
+}/*}}}*/
+
+/* history_replay(JournalOp, char *line, void *) {{{*/
+static void
+history_replay(JournalOp op, char *line, void *data) 
+{
+    char *uri, *title;
+    guint visits;
+    gint64 last_visit;
+    GList *link;
+
+    if (op == JOURNAL_ADD) 
+    {
+        if (history_parse_record(line, &uri, &visits, &last_visit, &title)) 
+            history_record(uri, title, visits, last_visit);
+    }
+    else if ((link = g_hash_table_lookup(s_index, line)) != NULL) 
+        history_unlink(link);
+}/*}}}*/
+
+/* history_init() {{{*/
+void
+history_init() 
+{
+    char **lines;
+    char *line, *uri, *title;
+    guint visits;
+    gint64 last_visit;
+    int length;
+    gboolean compact = false;
+
+    s_index = g_hash_table_new((GHashFunc)g_str_hash, (GEqualFunc)g_str_equal);
+    dwb.comps.history = trigram_index_new();
+    s_journal = journal_new(dwb.files[FILES_HISTORY], SYNC_HISTORY, HISTORY_COMPACT_RECORDS, history_snapshot, NULL);
+
+    lines = util_get_lines(dwb.files[FILES_HISTORY]);
+    length = lines != NULL ? g_strv_length(lines) : 0;
+    if (length > 0 && !strcmp(lines[0], HISTORY_HEADER)) 
+    {
+        /* oldest records first */
+        for (int i=1; i<length; i++) 
+        {
+            line = lines[i];
+            if (*line == '\0' || *line == '#')
+                continue;
+            if (history_parse_record(line, &uri, &visits, &last_visit, &title)) 
+                history_record(uri, title, visits, last_visit);
+        }
+    }
+    else 
+    {
+        /* old format, "uri title" per line, most recent first */
+        for (int i=length-1; i>=0; i--) 
+        {
+            line = lines[i];
+            while (g_ascii_isspace(*line))
+                line++;
+            if (*line == '\0' || *line == '#')
+                continue;
+            title = strchr(line, ' ');
+            if (title != NULL)
+                *title++ = '\0';
+            history_record(line, title, 1, 0);
+        }
+        compact = true;
+    }
+    g_strfreev(lines);
+
+    if (journal_replay(s_journal, history_replay, NULL) > 0)
+        compact = true;
+
+    history_update_compaction();
+    if (compact)
+        journal_compact(s_journal);
+    history_trim();
+}/*}}}*/
+
+/* history_end() {{{*/
+void
+history_end() 
+{
+    if (s_index == NULL)
+        return;
+    journal_free(s_journal);
+    s_journal = NULL;
+    g_hash_table_unref(s_index);
+    s_index = NULL;
+    trigram_index_free(dwb.comps.history);
+    dwb.comps.history = NULL;
+    dwb_free_list(dwb.fc.history, (void_func)history_entry_free);
+    dwb.fc.history = NULL;
+}/*}}}*/
@@ -0,0 +1,39 @@
+/*
+ * Copyright (c) 2010-2013 Stefan Bolte <portix@gmx.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef HISTORY_H
+#define HISTORY_H
+
+/* Entries of dwb.fc.history, most recently visited first. The navigation
+ * must be the first member, entries are also used as Navigation. */
+typedef struct _HistoryEntry {
+    Navigation navigation;
+    guint visits;
+    gint64 last_visit;
+} HistoryEntry;
+
+void history_init(void);
+void history_end(void);
+void history_add(const char *uri, const char *title);
+void history_remove(const char *uri);
+void history_clear(void);
+void history_flush(void);
+HistoryEntry * history_lookup(const char *uri);
+int history_frecency(const HistoryEntry *entry, gint64 now);
+
+#endif
@@ -0,0 +1,397 @@
+/*
+ * Copyright (c) 2010-2013 Stefan Bolte <portix@gmx.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <unistd.h>
+#include "dwb.h"
+#include "journal.h"
+#include "sync.h"
+
+/*
+ * Changes to a file are not written to the file itself but appended to
+ * <file>.journal, one operation per line
+ *
+ *   +line      adds or replaces the line with the same first word
+ *   -key       removes the line with first word key
+ *
+ * Operations are buffered and appended with a single fsync on the sync thread
+ * when the journal is flushed. Compaction moves the journal to
+ * <file>.journal.old and writes the snapshot on the sync thread, the old
+ * journal is removed after the snapshot has been written. The file is
+ * restored by reading the snapshot and replaying <file>.journal.old and
+ * <file>.journal.
+ */
+struct _Journal {
+    char *filename;
+    char *journal;
+    char *compacting;
+    /* SYNC_* flag, if it isn't set in sync-files operations are written immediately */
+    int sync;
+    /* number of records in the journal that trigger a compaction on flush */
+    guint compact_after;
+    JournalSnapshotFunc snapshot;
+    void *data;
+    /* operations that haven't been written yet */
+    GString *pending;
+    /* number of records in the journal files */
+    guint records;
+    /* whether a compaction has been queued on the sync thread */
+    gboolean compacting_queued;
+    /* snapshot that is written on the sync thread */
+    GString *content;
+    volatile gint compacted;
+    gboolean compact_again;
+    /* set on the sync thread if an append or a compaction failed, the next
+     * flush writes a new snapshot */
+    volatile gint failed;
+};
+
+typedef struct _JournalAppend {
+    Journal *journal;
+    GString *pending;
+} JournalAppend;
+
+/* journal_new(const char *filename, int sync, guint compact_after, JournalSnapshotFunc, void *data) {{{*/
+Journal *
+journal_new(const char *filename, int sync, guint compact_after, JournalSnapshotFunc snapshot, void *data)
+{
+    g_return_val_if_fail(filename != NULL, NULL);
+    g_return_val_if_fail(snapshot != NULL, NULL);
+
+    Journal *journal = dwb_malloc(sizeof(Journal));
+    journal->filename = g_strdup(filename);
+    journal->journal = g_strconcat(filename, ".journal", NULL);
+    journal->compacting = g_strconcat(filename, ".journal.old", NULL);
+    journal->sync = sync;
+    journal->compact_after = MAX(compact_after, 1);
+    journal->snapshot = snapshot;
+    journal->data = data;
+    journal->pending = g_string_new(NULL);
+    journal->records = 0;
+    journal->compacting_queued = false;
+    journal->content = NULL;
+    journal->compacted = 0;
+    journal->compact_again = false;
+    journal->failed = 0;
+    return journal;
+}/*}}}*/
+
+/* journal_wait(Journal *) {{{
+ * Waits for a running compaction
+ * */
+static void
+journal_wait(Journal *journal)
+{
+    if (journal->compacting_queued)
+    {
+        sync_wait();
+        journal->compacting_queued = false;
+        g_string_free(journal->content, true);
+        journal->content = NULL;
+    }
+}/*}}}*/
+
+/* journal_append_free(JournalAppend *) {{{*/
+static void
+journal_append_free(JournalAppend *append)
+{
+    g_string_free(append->pending, true);
+    g_free(append);
+}/*}}}*/
+
+/* journal_append_run(JournalAppend *) {{{
+ * Runs on the sync thread
+ * */
+static gssize
+journal_append_run(JournalAppend *append)
+{
+    Journal *journal = append->journal;
+    FILE *f;
+    gssize ret = append->pending->len;
+
+    if ((f = fopen(journal->journal, "a")) == NULL)
+    {
+        perror(journal->journal);
+        g_atomic_int_set(&journal->failed, 1);
+        return -1;
+    }
+    if (fwrite(append->pending->str, 1, append->pending->len, f) != append->pending->len
+            || fflush(f) != 0 || fsync(fileno(f)) != 0)
+    {
+        perror(journal->journal);
+        g_atomic_int_set(&journal->failed, 1);
+        ret = -1;
+    }
+    fclose(f);
+    return ret;
+}/*}}}*/
+
+/* journal_write_pending(Journal *) {{{
+ * Queues the pending operations, if appending fails the operations are
+ * covered by the snapshot of the next compaction
+ * */
+static void
+journal_write_pending(Journal *journal)
+{
+    JournalAppend *append;
+
+    if (journal->pending->len == 0)
+        return;
+
+    append = dwb_malloc(sizeof(JournalAppend));
+    append->journal = journal;
+    append->pending = journal->pending;
+    journal->pending = g_string_new(NULL);
+    sync_run(journal->sync, (SyncFunc)journal_append_run, append, (GDestroyNotify)journal_append_free);
+}/*}}}*/
+
+/* journal_rotate(Journal *) {{{
+ * Moves the journal out of the way, if an earlier compaction failed the
+ * journal is appended to the old journal, runs on the sync thread
+ * */
+static gboolean
+journal_rotate(Journal *journal)
+{
+    char *content;
+    gsize length;
+    FILE *f;
+    gboolean ret = true;
+
+    if (!g_file_test(journal->compacting, G_FILE_TEST_EXISTS))
+    {
+        if (rename(journal->journal, journal->compacting) != 0 && errno != ENOENT)
+        {
+            perror(journal->journal);
+            return false;
+        }
+        return true;
+    }
+    if (!g_file_get_contents(journal->journal, &content, &length, NULL))
+        return true;
+
+    if ((f = fopen(journal->compacting, "a")) == NULL)
+    {
+        perror(journal->compacting);
+        g_free(content);
+        return false;
+    }
+    if (fwrite(content, 1, length, f) != length || fflush(f) != 0 || fsync(fileno(f)) != 0)
+    {
+        perror(journal->compacting);
+        ret = false;
+    }
+    fclose(f);
+    if (ret)
+        unlink(journal->journal);
+
+    g_free(content);
+    return ret;
+}/*}}}*/
+
+/* journal_compact_run(Journal *) {{{
+ * Runs on the sync thread
+ * */
+static gssize
+journal_compact_run(Journal *journal)
+{
+    char *tmp;
+    gboolean success = false;
+    FILE *f;
+
+    if (!journal_rotate(journal))
+    {
+        g_atomic_int_set(&journal->failed, 1);
+        g_atomic_int_set(&journal->compacted, 1);
+        return -1;
+    }
+    tmp = g_strconcat(journal->filename, ".tmp", NULL);
+    if ((f = fopen(tmp, "w")) != NULL)
+    {
+        success = fwrite(journal->content->str, 1, journal->content->len, f) == journal->content->len
+            && fflush(f) == 0 && fsync(fileno(f)) == 0;
+        fclose(f);
+    }
+    if (success && rename(tmp, journal->filename) == 0)
+        unlink(journal->compacting);
+    else
+    {
+        fprintf(stderr, "Cannot write %s: %s\n", journal->filename, g_strerror(errno));
+        unlink(tmp);
+        g_atomic_int_set(&journal->failed, 1);
+        success = false;
+    }
+    g_free(tmp);
+    g_atomic_int_set(&journal->compacted, 1);
+    return success ? (gssize)journal->content->len : -1;
+}/*}}}*/
+
+/* journal_compact(Journal *) {{{
+ * Folds the journal into the file in the background
+ * */
+void
+journal_compact(Journal *journal)
+{
+    g_return_if_fail(journal != NULL);
+
+    if (journal->compacting_queued)
+    {
+        if (!g_atomic_int_get(&journal->compacted))
+        {
+            journal_write_pending(journal);
+            journal->compact_again = true;
+            sync_set_dirty(journal->sync);
+            return;
+        }
+        journal_wait(journal);
+    }
+    journal->compact_again = false;
+    g_atomic_int_set(&journal->failed, 0);
+
+    /* the appends are done before the journal is rotated on the sync thread */
+    journal_write_pending(journal);
+
+    journal->records = 0;
+    journal->content = journal->snapshot(journal->data);
+    journal->compacted = 0;
+    journal->compacting_queued = true;
+    sync_run(journal->sync, (SyncFunc)journal_compact_run, journal, NULL);
+}/*}}}*/
+
+/* journal_set_compact_after(Journal *, guint compact_after) {{{
+ * Changes the number of records that trigger a compaction on flush
+ * */
+void
+journal_set_compact_after(Journal *journal, guint compact_after)
+{
+    g_return_if_fail(journal != NULL);
+
+    journal->compact_after = MAX(compact_after, 1);
+}/*}}}*/
+
+/* journal_flush(Journal *) {{{
+ * Writes pending operations to the journal
+ * */
+void
+journal_flush(Journal *journal)
+{
+    g_return_if_fail(journal != NULL);
+
+    if (journal->records >= journal->compact_after || journal->compact_again || g_atomic_int_get(&journal->failed))
+        journal_compact(journal);
+    else
+        journal_write_pending(journal);
+}/*}}}*/
+
+/* journal_append(Journal *, JournalOp, const char *line) {{{*/
+void
+journal_append(Journal *journal, JournalOp op, const char *line)
+{
+    g_return_if_fail(journal != NULL);
+    g_return_if_fail(line != NULL && strchr(line, '\n') == NULL);
+
+    g_string_append_c(journal->pending, op);
+    g_string_append(journal->pending, line);
+    g_string_append_c(journal->pending, '\n');
+    journal->records++;
+    sync_set_dirty(journal->sync);
+
+    if (dwb.misc.sync_interval <= 0 || !(dwb.misc.sync_files & journal->sync))
+        journal_flush(journal);
+}/*}}}*/
+
+/* journal_replay_file(const char *, JournalReplayFunc, void *) {{{*/
+static guint
+journal_replay_file(const char *filename, JournalReplayFunc func, void *data)
+{
+    char *content, *line, *end;
+    guint records = 0;
+
+    if (!g_file_get_contents(filename, &content, NULL, NULL))
+        return 0;
+
+    /* an incomplete last line is the result of an interrupted write and
+     * ignored */
+    for (line = content; (end = strchr(line, '\n')) != NULL; line = end + 1)
+    {
+        *end = '\0';
+        if (*line == JOURNAL_ADD || *line == JOURNAL_REMOVE)
+        {
+            func(*line, line + 1, data);
+            records++;
+        }
+    }
+    g_free(content);
+    return records;
+}/*}}}*/
+
+/* journal_replay(Journal *, JournalReplayFunc, void *) {{{
+ * Replays the journal on top of the snapshot that has been read by the
+ * caller, returns the number of replayed operations
+ * */
+guint
+journal_replay(Journal *journal, JournalReplayFunc func, void *data)
+{
+    g_return_val_if_fail(journal != NULL, 0);
+
+    journal->records += journal_replay_file(journal->compacting, func, data);
+    journal->records += journal_replay_file(journal->journal, func, data);
+    return journal->records;
+}/*}}}*/
+
+/* journal_discard(Journal *) {{{
+ * Drops all operations, used if the file was changed by someone else
+ * */
+void
+journal_discard(Journal *journal)
+{
+    g_return_if_fail(journal != NULL);
+
+    journal_wait(journal);
+    sync_wait();
+    g_string_truncate(journal->pending, 0);
+    journal->records = 0;
+    journal->compact_again = false;
+    journal->failed = 0;
+    unlink(journal->compacting);
+    unlink(journal->journal);
+}/*}}}*/
+
+/* journal_free(Journal *) {{{
+ * Folds the journal into the file and waits for the compaction
+ * */
+void
+journal_free(Journal *journal)
+{
+    if (journal == NULL)
+        return;
+
+    journal_wait(journal);
+    if (journal->records > 0 || journal->pending->len > 0 || journal->compact_again)
+        journal_compact(journal);
+    journal_wait(journal);
+    /* queued appends refer to the journal */
+    sync_wait();
+
+    g_free(journal->filename);
+    g_free(journal->journal);
+    g_free(journal->compacting);
+    g_string_free(journal->pending, true);
+    g_free(journal);
+}/*}}}*/
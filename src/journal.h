@@ -0,0 +1,42 @@
+/*
+ * Copyright (c) 2010-2013 Stefan Bolte <portix@gmx.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+typedef enum {
+    JOURNAL_ADD     = '+',
+    JOURNAL_REMOVE  = '-',
+} JournalOp;
+
+/* Applies a replayed operation, line is the added line or the key of the
+ * removed line */
+typedef void (*JournalReplayFunc)(JournalOp op, char *line, void *data);
+/* Returns the current content of the file, called on the main thread */
+typedef GString * (*JournalSnapshotFunc)(void *data);
+
+Journal * journal_new(const char *filename, int sync, guint compact_after, JournalSnapshotFunc snapshot, void *data);
+void journal_free(Journal *journal);
+guint journal_replay(Journal *journal, JournalReplayFunc func, void *data);
+void journal_append(Journal *journal, JournalOp op, const char *line);
+void journal_flush(Journal *journal);
+void journal_compact(Journal *journal);
+void journal_set_compact_after(Journal *journal, guint compact_after);
+void journal_discard(Journal *journal);
+
+#endif
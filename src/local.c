@@ -17,6 +17,8 @@
  */
 
 #include <string.h>
+#include <strings.h>
+#include <stdlib.h>
 #include <sys/stat.h>
 #include <pwd.h>
 #include <grp.h>
@@ -27,6 +29,442 @@
 #include "commands.h"
 
 
+/*
+ * Directories are listed asynchronously, the page is loaded with an empty
+ * table and the entries are enumerated in batches. Every batch is sorted and
+ * appended to the table, when the directory is completely read the table is
+ * sorted if it isn't too large or if sorting was requested by clicking on the
+ * name column. The rows are dropped when the sorted table has been rendered,
+ * the listing itself is freed when the view commits another uri.
+ */
+#define LOCAL_FIRST_BATCH   64
+#define LOCAL_BATCH         1024
+#define LOCAL_SORT_MAX      4096
+#define LOCAL_ATTRIBUTES    "standard::name,standard::size,standard::symlink-target,time::modified,unix::mode,unix::nlink,unix::uid,unix::gid"
+
+typedef struct _LocalEntry {
+    char *name;
+    char *row;
+} LocalEntry;
+
+struct _LocalListing {
+    GList *gl;
+    char *path;
+    char *uri;
+    GCancellable *cancellable;
+    GFileEnumerator *enumerator;
+    /* LocalEntry, in the order they were enumerated */
+    GPtrArray *entries;
+    char *parent_row;
+    /* rows that haven't been inserted into the page */
+    GString *pending;
+    /* uid and gid to name caches */
+    GHashTable *users;
+    GHashTable *groups;
+    /* an asynchronous operation is running */
+    gboolean busy;
+    gboolean loaded;
+    gboolean done;
+    gboolean sort;
+    /* the complete table has been rendered sorted, entries are dropped */
+    gboolean sorted;
+};
+
+static void local_next_files(LocalListing *listing, int n);
+
+/* local_entry_free(LocalEntry *) {{{*/
+static void
+local_entry_free(LocalEntry *entry)
+{
+    g_free(entry->name);
+    g_free(entry->row);
+    g_free(entry);
+}/*}}}*/
+
+/* local_listing_free(LocalListing *) {{{*/
+static void
+local_listing_free(LocalListing *listing)
+{
+    g_free(listing->path);
+    g_free(listing->uri);
+    g_object_unref(listing->cancellable);
+    if (listing->enumerator != NULL)
+        g_object_unref(listing->enumerator);
+    g_ptr_array_free(listing->entries, true);
+    g_free(listing->parent_row);
+    g_string_free(listing->pending, true);
+    g_hash_table_unref(listing->users);
+    g_hash_table_unref(listing->groups);
+    g_free(listing);
+}/*}}}*/
+
+/* local_cancel(GList *gl) {{{
+ * Stops the listing of a view, a running operation frees the listing when it
+ * has been cancelled
+ * */
+void
+local_cancel(GList *gl)
+{
+    LocalListing *listing = VIEW(gl)->status->listing;
+    if (listing == NULL)
+        return;
+
+    VIEW(gl)->status->listing = NULL;
+    listing->gl = NULL;
+    if (listing->busy)
+        g_cancellable_cancel(listing->cancellable);
+    else 
+        local_listing_free(listing);
+}/*}}}*/
+
+/* local_load_committed(GList *gl, const char *uri) {{{
+ * Frees the listing if the view has navigated away from the directory
+ * */
+void
+local_load_committed(GList *gl, const char *uri)
+{
+    LocalListing *listing = VIEW(gl)->status->listing;
+    if (listing != NULL && g_strcmp0(uri, listing->uri))
+        local_cancel(gl);
+}/*}}}*/
+
+/* local_is_running(GList *gl) {{{
+ * Whether the directory of the view is still being read
+ * */
+gboolean
+local_is_running(GList *gl)
+{
+    LocalListing *listing = VIEW(gl)->status->listing;
+    return listing != NULL && !listing->done;
+}/*}}}*/
+
+/* local_get_rows(LocalListing *) {{{*/
+static WebKitDOMElement *
+local_get_rows(LocalListing *listing)
+{
+    WebKitWebView *web = WEBVIEW(listing->gl);
+
+    /* the view has loaded something else */
+    if (g_strcmp0(webkit_web_view_get_uri(web), listing->uri))
+        return NULL;
+    return webkit_dom_document_get_element_by_id(webkit_web_view_get_dom_document(web), "dwb_local_rows");
+}/*}}}*/
+
+/* local_flush_rows(LocalListing *) {{{
+ * Appends pending rows to the table
+ * */
+static void
+local_flush_rows(LocalListing *listing)
+{
+    WebKitDOMElement *rows;
+
+    if (!listing->loaded || listing->pending->len == 0)
+        return;
+    if ((rows = local_get_rows(listing)) == NULL)
+        return;
+
+    webkit_dom_html_element_insert_adjacent_html(WEBKIT_DOM_HTML_ELEMENT(rows), "beforeend", listing->pending->str, NULL);
+    g_string_truncate(listing->pending, 0);
+}/*}}}*/
+
+/* local_compare_entry(LocalEntry **, LocalEntry **) {{{*/
+static int
+local_compare_entry(LocalEntry **a, LocalEntry **b)
+{
+    return strcasecmp((*a)->name, (*b)->name);
+}/*}}}*/
+
+/* local_render_sorted(LocalListing *) {{{
+ * Replaces the table with all entries in sorted order
+ * */
+static void
+local_render_sorted(LocalListing *listing)
+{
+    WebKitDOMElement *rows;
+    GString *buffer;
+
+    if (listing->sorted || !listing->loaded || (rows = local_get_rows(listing)) == NULL)
+        return;
+
+    g_ptr_array_sort(listing->entries, (GCompareFunc)local_compare_entry);
+
+    buffer = g_string_new(listing->parent_row);
+    for (guint i=0; i<listing->entries->len; i++)
+        g_string_append(buffer, ((LocalEntry*)listing->entries->pdata[i])->row);
+
+    webkit_dom_html_element_set_inner_html(WEBKIT_DOM_HTML_ELEMENT(rows), buffer->str, NULL);
+    g_string_truncate(listing->pending, 0);
+    g_string_free(buffer, true);
+
+    /* the rows are only needed for sorting */
+    if (listing->done)
+    {
+        listing->sorted = true;
+        g_ptr_array_set_size(listing->entries, 0);
+    }
+}/*}}}*/
+
+/* local_lookup_name(GHashTable *, guint id, gboolean user) {{{*/
+static const char *
+local_lookup_name(GHashTable *cache, guint id, gboolean user)
+{
+    char *name = g_hash_table_lookup(cache, GUINT_TO_POINTER(id));
+    if (name == NULL)
+    {
+        if (user)
+        {
+            struct passwd *pwd = getpwuid(id);
+            name = g_strdup(pwd && pwd->pw_name ? pwd->pw_name : "");
+        }
+        else 
+        {
+            struct group *grp = getgrgid(id);
+            name = g_strdup(grp && grp->gr_name ? grp->gr_name : "");
+        }
+        g_hash_table_insert(cache, GUINT_TO_POINTER(id), name);
+    }
+    return name;
+}/*}}}*/
+
+/* local_render_row(LocalListing *, const char *filename, struct stat *, const char *link) {{{
+ * Returns the table row of a file, link is the target of a symbolic link
+ * */
+static char *
+local_render_row(LocalListing *listing, const char *filename, struct stat *st, const char *link)
+{
+    char date[50];
+    char time[50];
+    char size[50];
+    char class[30] = { 0 };
+    char *printname = NULL;
+    char *fullpath;
+    char *row;
+    char perm[11];
+    int bits = 0;
+
+    strftime(date, sizeof(date), "%x", localtime(&st->st_mtime));
+    strftime(time, sizeof(time), "%X", localtime(&st->st_mtime));
+
+    if (st->st_size > BPGB) 
+        snprintf(size, sizeof(size), "%.1fG", (double)st->st_size / BPGB);
+    else if (st->st_size > BPMB) 
+        snprintf(size, sizeof(size), "%.1fM", (double)st->st_size / BPMB);
+    else if (st->st_size > BPKB) 
+        snprintf(size, sizeof(size), "%.1fK", (double)st->st_size / BPKB);
+    else 
+        snprintf(size, sizeof(size), "%lu", st->st_size);
+
+    if (S_ISREG(st->st_mode))
+        perm[bits++] = '-';
+    else if (S_ISCHR(st->st_mode)) 
+    {
+        perm[bits++] = 'c';
+        strcpy(class, "dwb_local_character_device");
+    }
+    else if (S_ISDIR(st->st_mode)) 
+    {
+        perm[bits++] = 'd';
+        strcpy(class, "dwb_local_directory");
+    }
+    else if (S_ISBLK(st->st_mode)) 
+    {
+        perm[bits++] = 'b';
+        strcpy(class, "dwb_local_blockdevice");
+    }
+    else if (S_ISFIFO(st->st_mode)) 
+    {
+        perm[bits++] = 'f';
+        strcpy(class, "dwb_local_fifo");
+    }
+    else if (S_ISLNK(st->st_mode)) 
+    {
+        perm[bits++] = 'l';
+        strcpy(class, "dwb_local_link");
+    }
+    /* user permissions */
+    perm[bits++] = st->st_mode & S_IRUSR ? 'r' : '-';
+    perm[bits++] = st->st_mode & S_IWUSR ? 'w' : '-';
+    if (st->st_mode & S_ISUID) 
+    {
+        perm[bits++] = st->st_mode & S_IXUSR ? 's' : 'S';
+        strcpy(class, "dwb_local_setuid");
+    }
+    else
+        perm[bits++] = st->st_mode & S_IXUSR ? 'x' : '-';
+
+    if (st->st_mode & S_IXUSR && *class == 0) 
+        strcpy(class, "dwb_local_executable");
+
+    /*  group permissons */
+    perm[bits++] = st->st_mode & S_IRGRP ? 'r' : '-';
+    perm[bits++] = st->st_mode & S_IWGRP ? 'w' : '-';
+    if (st->st_mode & S_ISGID) 
+    {
+        perm[bits++] = st->st_mode & S_IXGRP ? 's' : 'S';
+        strcpy(class, "dwb_local_setuid");
+    }
+    else
+        perm[bits++] = st->st_mode & S_IXGRP ? 'x' : '-';
+
+    /*  other */
+    perm[bits++] = st->st_mode & S_IROTH ? 'r' : '-';
+    perm[bits++] = st->st_mode & S_IWOTH ? 'w' : '-';
+    if (st->st_mode & S_ISVTX) 
+    {
+        perm[bits++] = st->st_mode & S_IXOTH ? 't' : 'T';
+        strcpy(class, "dwb_local_sticky");
+    }
+    else
+        perm[bits++] = st->st_mode & S_IXOTH ? 'x' : '-';
+
+    perm[bits] = '\0';
+
+    if (*class == 0)
+        strcpy(class, "dwb_local_regular");
+
+    if (S_ISLNK(st->st_mode) && link != NULL) 
+    {
+        printname = g_strdup_printf("%s -> %s", filename, link);
+        fullpath = g_path_is_absolute(link) ? g_strdup(link) : g_build_filename(listing->path, link, NULL);
+    }
+    else 
+        fullpath = g_build_filename(listing->path, filename, NULL);
+
+    row = g_strdup_printf("<div class='dwb_local_table_row'>\
+            <div class='dwb_local_header_permission'>%s</div>\
+            <div class='dwb_local_header_link'>%"PRId64"</div>\
+            <div class='dwb_local_header_user'>%s</div>\
+            <div class='dwb_local_header_group'>%s</div>\
+            <div class='dwb_local_header_size'>%s</div>\
+            <div class='dwb_local_header_date'>%s</div>\
+            <div class='dwb_local_header_time'>%s</div>\
+            <div class='%s'><a href='%s'>%s</a></div></div>", 
+            perm, (int64_t)st->st_nlink, 
+            local_lookup_name(listing->users, st->st_uid, true), 
+            local_lookup_name(listing->groups, st->st_gid, false), 
+            size, date, time, class, fullpath, printname == NULL ? filename: printname);
+
+    g_free(printname);
+    g_free(fullpath);
+    return row;
+}/*}}}*/
+
+/* local_finish(LocalListing *) {{{*/
+static void
+local_finish(LocalListing *listing)
+{
+    listing->done = true;
+    g_object_unref(listing->enumerator);
+    listing->enumerator = NULL;
+
+    if (listing->sort || (listing->entries->len > LOCAL_FIRST_BATCH && listing->entries->len <= LOCAL_SORT_MAX))
+        local_render_sorted(listing);
+    else 
+        local_flush_rows(listing);
+}/*}}}*/
+
+/* local_next_files_cb(GFileEnumerator *, GAsyncResult *, LocalListing *) {{{*/
+static void
+local_next_files_cb(GFileEnumerator *enumerator, GAsyncResult *result, LocalListing *listing)
+{
+    GError *error = NULL;
+    GList *files = g_file_enumerator_next_files_finish(enumerator, result, &error);
+    GFileInfo *info;
+    LocalEntry *entry;
+    struct stat st;
+    guint first = listing->entries->len;
+
+    listing->busy = false;
+    if (listing->gl == NULL || error != NULL) 
+    {
+        if (error != NULL && !g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+            fprintf(stderr, "dwb error: %s\n", error->message);
+        g_clear_error(&error);
+        if (listing->gl == NULL)
+            local_listing_free(listing);
+        else 
+            local_finish(listing);
+        return;
+    }
+    if (files == NULL) 
+    {
+        local_finish(listing);
+        return;
+    }
+
+    for (GList *l = files; l; l=l->next) 
+    {
+        info = l->data;
+        const char *filename = g_file_info_get_name(info);
+        if (dwb.state.hidden_files || filename[0] != '.')
+        {
+            memset(&st, 0, sizeof(st));
+            st.st_mode = g_file_info_get_attribute_uint32(info, G_FILE_ATTRIBUTE_UNIX_MODE);
+            st.st_nlink = g_file_info_get_attribute_uint32(info, G_FILE_ATTRIBUTE_UNIX_NLINK);
+            st.st_uid = g_file_info_get_attribute_uint32(info, G_FILE_ATTRIBUTE_UNIX_UID);
+            st.st_gid = g_file_info_get_attribute_uint32(info, G_FILE_ATTRIBUTE_UNIX_GID);
+            st.st_size = g_file_info_get_size(info);
+            st.st_mtime = g_file_info_get_attribute_uint64(info, G_FILE_ATTRIBUTE_TIME_MODIFIED);
+
+            entry = dwb_malloc(sizeof(LocalEntry));
+            entry->name = g_strdup(filename);
+            entry->row = local_render_row(listing, filename, &st, g_file_info_get_symlink_target(info));
+            g_ptr_array_add(listing->entries, entry);
+        }
+        g_object_unref(info);
+    }
+    g_list_free(files);
+
+    /* a batch is appended in sorted order */
+    if (listing->entries->len > first) 
+    {
+        qsort(listing->entries->pdata + first, listing->entries->len - first, sizeof(gpointer), 
+                (int (*)(const void *, const void *))local_compare_entry);
+        for (guint i=first; i<listing->entries->len; i++)
+            g_string_append(listing->pending, ((LocalEntry*)listing->entries->pdata[i])->row);
+    }
+    if (listing->loaded && local_get_rows(listing) == NULL) 
+    {
+        local_cancel(listing->gl);
+        return;
+    }
+    local_flush_rows(listing);
+    local_next_files(listing, LOCAL_BATCH);
+}/*}}}*/
+
+/* local_next_files(LocalListing *, int n) {{{*/
+static void
+local_next_files(LocalListing *listing, int n)
+{
+    listing->busy = true;
+    g_file_enumerator_next_files_async(listing->enumerator, n, G_PRIORITY_LOW, listing->cancellable, 
+            (GAsyncReadyCallback)local_next_files_cb, listing);
+}/*}}}*/
+
+/* local_enumerate_cb(GFile *, GAsyncResult *, LocalListing *) {{{*/
+static void
+local_enumerate_cb(GFile *dir, GAsyncResult *result, LocalListing *listing)
+{
+    GError *error = NULL;
+
+    listing->busy = false;
+    listing->enumerator = g_file_enumerate_children_finish(dir, result, &error);
+    g_object_unref(dir);
+
+    if (listing->gl == NULL || listing->enumerator == NULL) 
+    {
+        if (error != NULL && !g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+            fprintf(stderr, "dwb error: %s\n", error->message);
+        g_clear_error(&error);
+        if (listing->gl == NULL)
+            local_listing_free(listing);
+        else 
+            listing->done = true;
+        return;
+    }
+    local_next_files(listing, LOCAL_FIRST_BATCH);
+}/*}}}*/
+
 /* local_toggle_hidden_cb {{{*/
 gboolean
 local_toggle_hidden_cb(WebKitDOMElement *el, WebKitDOMEvent *ev, GList *gl) 
@@ -36,6 +474,23 @@ local_toggle_hidden_cb(WebKitDOMElement *el, WebKitDOMEvent *ev, GList *gl)
     return true;
 }/*}}}*/
 
+/* local_sort_cb {{{
+ * Sorts the whole table, a listing that is still running is sorted when it
+ * is finished
+ * */
+gboolean
+local_sort_cb(WebKitDOMElement *el, WebKitDOMEvent *ev, GList *gl) 
+{
+    LocalListing *listing = VIEW(gl)->status->listing;
+    if (listing == NULL)
+        return true;
+
+    listing->sort = true;
+    if (listing->done)
+        local_render_sorted(listing);
+    return true;
+}/*}}}*/
+
 /* local_load_directory_cb {{{*/
 void
 local_load_directory_cb(WebKitWebView *wv, GParamSpec *p, GList *gl) 
@@ -45,10 +500,25 @@ local_load_directory_cb(WebKitWebView *wv, GParamSpec *p, GList *gl)
 
     WebKitDOMDocument *doc = webkit_web_view_get_dom_document(wv);
     WebKitDOMElement *e = webkit_dom_document_get_element_by_id(doc, "dwb_local_checkbox");
+    LocalListing *listing = VIEW(gl)->status->listing;
 
     webkit_dom_html_input_element_set_checked(WEBKIT_DOM_HTML_INPUT_ELEMENT(e), dwb.state.hidden_files);
     webkit_dom_event_target_add_event_listener(WEBKIT_DOM_EVENT_TARGET(e), "change", G_CALLBACK(local_toggle_hidden_cb), false, gl);
+
+    e = webkit_dom_document_query_selector(doc, "#dwb_local_table_header .dwb_local_header_name", NULL);
+    if (e != NULL)
+        webkit_dom_event_target_add_event_listener(WEBKIT_DOM_EVENT_TARGET(e), "click", G_CALLBACK(local_sort_cb), false, gl);
+
     g_signal_handlers_disconnect_by_func(wv, local_load_directory_cb, gl);
+
+    if (listing != NULL) 
+    {
+        listing->loaded = true;
+        if (listing->done && listing->sort)
+            local_render_sorted(listing);
+        else 
+            local_flush_rows(listing);
+    }
 }/*}}}*/
 
 /* local_show_directory(WebKitWebView *, const char *path, gboolean add_to_history) 
@@ -64,15 +534,13 @@ local_show_directory(GList *gl, const char *path, gboolean add_to_history)
     /* TODO needs fix: when opening local files close commandline  */
     char *fullpath; 
     char *match;
-    const char *filename;
     char *newpath = NULL;
     const char *tmp;
     const char *orig_path;
-    GSList *content = NULL;
-    GDir *dir = NULL;
     GString *buffer;
-    GError *error = NULL;
     char *local_file, *filecontent, *favicon, *page;
+    struct stat st;
+    LocalListing *listing;
 
     if (g_path_is_absolute(path)) 
         orig_path = path;
@@ -108,154 +576,36 @@ local_show_directory(GList *gl, const char *path, gboolean add_to_history)
         g_strfreev(components);
     }
 
-    if (! (dir = g_dir_open(orig_path, 0, &error))) 
-    {
-        fprintf(stderr, "dwb error: %s\n", error->message);
-        g_clear_error(&error);
-        return;
-    }
+    local_cancel(gl);
+
+    listing = dwb_malloc(sizeof(LocalListing));
+    listing->gl = gl;
+    listing->path = g_strdup(orig_path);
+    listing->uri = g_strdup_printf("file://%s", orig_path);
+    listing->cancellable = g_cancellable_new();
+    listing->enumerator = NULL;
+    listing->entries = g_ptr_array_new_with_free_func((GDestroyNotify)local_entry_free);
+    listing->parent_row = NULL;
+    listing->pending = g_string_new(NULL);
+    listing->users = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, g_free);
+    listing->groups = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, g_free);
+    listing->busy = true;
+    listing->loaded = false;
+    listing->done = false;
+    listing->sort = false;
+    listing->sorted = false;
+    VIEW(gl)->status->listing = listing;
 
     fullpath = g_build_filename(orig_path, "..", NULL);
-    content = g_slist_prepend(content, fullpath);
-
-    while ( (filename = g_dir_read_name(dir)) ) 
-    {
-        fullpath = g_build_filename(orig_path, filename, NULL);
-        content = g_slist_prepend(content, fullpath);
-    }
-    content = g_slist_sort(content, (GCompareFunc)util_compare_path);
-    g_dir_close(dir);
-
-    buffer = g_string_new(NULL);
-    for (GSList *l = content; l; l=l->next) 
-    {
-        fullpath = l->data;
-        filename = g_strrstr(fullpath, "/") + 1;
-        if (!dwb.state.hidden_files && filename[0] == '.' && filename[1] != '.')
-            continue;
-        struct stat st;
-        char date[50];
-        char time[50];
-        char size[50];
-        char class[30] = { 0 };
-        char *link = NULL;
-        char *printname = NULL;
-        char perm[11];
-        int bits = 0;
-        char *tmp_path;
-
-        if (lstat(fullpath, &st) != 0) 
-        {
-            fprintf(stderr, "stat failed for %s\n", fullpath);
-            continue;
-        }
-        strftime(date, sizeof(date), "%x", localtime(&st.st_mtime));
-        strftime(time, sizeof(time), "%X", localtime(&st.st_mtime));
-
-        if (st.st_size > BPGB) 
-            snprintf(size, sizeof(size), "%.1fG", (double)st.st_size / BPGB);
-        else if (st.st_size > BPMB) 
-            snprintf(size, sizeof(size), "%.1fM", (double)st.st_size / BPMB);
-        else if (st.st_size > BPKB) 
-            snprintf(size, sizeof(size), "%.1fK", (double)st.st_size / BPKB);
-        else 
-            snprintf(size, sizeof(size), "%lu", st.st_size);
-
-        if (S_ISREG(st.st_mode))
-            perm[bits++] = '-';
-        else if (S_ISCHR(st.st_mode)) 
-        {
-            perm[bits++] = 'c';
-            strcpy(class, "dwb_local_character_device");
-        }
-        else if (S_ISDIR(st.st_mode)) 
-        {
-            perm[bits++] = 'd';
-            strcpy(class, "dwb_local_directory");
-        }
-        else if (S_ISBLK(st.st_mode)) 
-        {
-            perm[bits++] = 'b';
-            strcpy(class, "dwb_local_blockdevice");
-        }
-        else if (S_ISFIFO(st.st_mode)) 
-        {
-            perm[bits++] = 'f';
-            strcpy(class, "dwb_local_fifo");
-        }
-        else if (S_ISLNK(st.st_mode)) 
-        {
-            perm[bits++] = 'l';
-            strcpy(class, "dwb_local_link");
-            link = g_file_read_link(fullpath, NULL);
-            if (link != NULL) 
-            {
-                tmp_path = fullpath;
-                printname = g_strdup_printf("%s -> %s", filename, link);
-                l->data = fullpath = g_build_filename(orig_path, link, NULL);
-                g_free(tmp_path);
-                g_free(link);
-            }
-        }
-        /* user permissions */
-        perm[bits++] = st.st_mode & S_IRUSR ? 'r' : '-';
-        perm[bits++] = st.st_mode & S_IWUSR ? 'w' : '-';
-        if (st.st_mode & S_ISUID) 
-        {
-            perm[bits++] = st.st_mode & S_IXUSR ? 's' : 'S';
-            strcpy(class, "dwb_local_setuid");
-        }
-        else
-            perm[bits++] = st.st_mode & S_IXUSR ? 'x' : '-';
-
-        if (st.st_mode & S_IXUSR && *class == 0) 
-            strcpy(class, "dwb_local_executable");
-
-        /*  group permissons */
-        perm[bits++] = st.st_mode & S_IRGRP ? 'r' : '-';
-        perm[bits++] = st.st_mode & S_IWGRP ? 'w' : '-';
-        if (st.st_mode & S_ISGID) 
-        {
-            perm[bits++] = st.st_mode & S_IXGRP ? 's' : 'S';
-            strcpy(class, "dwb_local_setuid");
-        }
-        else
-            perm[bits++] = st.st_mode & S_IXGRP ? 'x' : '-';
+    if (lstat(fullpath, &st) == 0)
+        listing->parent_row = local_render_row(listing, "..", &st, NULL);
+    else 
+        listing->parent_row = g_strdup("");
+    g_free(fullpath);
 
-        /*  other */
-        perm[bits++] = st.st_mode & S_IROTH ? 'r' : '-';
-        perm[bits++] = st.st_mode & S_IWOTH ? 'w' : '-';
-        if (st.st_mode & S_ISVTX) 
-        {
-            perm[bits++] = st.st_mode & S_IXOTH ? 't' : 'T';
-            strcpy(class, "dwb_local_sticky");
-        }
-        else
-            perm[bits++] = st.st_mode & S_IXOTH ? 'x' : '-';
-
-        perm[bits] = '\0';
-
-        struct passwd *pwd = getpwuid(st.st_uid);
-        char *user = pwd && pwd->pw_name ? pwd->pw_name : "";
-        struct group *grp = getgrgid(st.st_gid);
-        char *group = grp && grp->gr_name ? grp->gr_name : "";
-
-        if (*class == 0)
-            strcpy(class, "dwb_local_regular");
-
-        g_string_append_printf(buffer, "<div class='dwb_local_table_row'>\
-                <div class='dwb_local_header_permission'>%s</div>\
-                <div class='dwb_local_header_link'>%"PRId64"</div>\
-                <div class='dwb_local_header_user'>%s</div>\
-                <div class='dwb_local_header_group'>%s</div>\
-                <div class='dwb_local_header_size'>%s</div>\
-                <div class='dwb_local_header_date'>%s</div>\
-                <div class='dwb_local_header_time'>%s</div>\
-                <div class='%s'><a href='%s'>%s</a></div></div>", 
-                perm, (int64_t)st.st_nlink, user, group, size, date, time, class, fullpath, printname == NULL ? filename: printname);
-        g_free(printname);
+    g_file_enumerate_children_async(g_file_new_for_path(orig_path), LOCAL_ATTRIBUTES, G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS, 
+            G_PRIORITY_LOW, listing->cancellable, (GAsyncReadyCallback)local_enumerate_cb, listing);
 
-    }
     tmp = orig_path+1;
     GString *path_buffer = g_string_new("/<a class='dwb_local_headline' href='");
     while ((match = strchr(tmp, '/'))) 
@@ -274,10 +624,18 @@ local_show_directory(GList *gl, const char *path, gboolean add_to_history)
     local_file = util_get_data_file(LOCAL_FILE, "lib");
     filecontent = util_get_file_content(local_file, NULL);
     if (filecontent == NULL) /* File doesn't exist or is a directory */
+    {
+        local_cancel(gl);
+        g_free(local_file);
+        g_string_free(path_buffer, true);
+        g_free(newpath);
         return;
+    }
 
     favicon = dwb_get_stock_item_base64_encoded("gtk-harddisk");
-    /*  title, favicon, toppath, content */
+    /*  title, favicon, toppath, content, the other rows are inserted when
+     *  they have been read */
+    buffer = g_string_new(listing->parent_row);
     page = g_strdup_printf(filecontent, orig_path, favicon, path_buffer->str, buffer->str);
 
     g_free(favicon);
@@ -286,28 +644,20 @@ local_show_directory(GList *gl, const char *path, gboolean add_to_history)
     g_string_free(buffer, true);
     g_string_free(path_buffer, true);
 
-    fullpath = g_strdup_printf("file://%s", orig_path);
-
     /* add a history item */
     WebKitWebView *web = WEBVIEW(gl);
     if (add_to_history) 
     {
         WebKitWebBackForwardList *bf_list = webkit_web_view_get_back_forward_list(web);
-        WebKitWebHistoryItem *item = webkit_web_history_item_new_with_data(fullpath, fullpath);
+        WebKitWebHistoryItem *item = webkit_web_history_item_new_with_data(listing->uri, listing->uri);
         webkit_web_back_forward_list_add_item(bf_list, item);
     }
 
     g_signal_connect(web, "notify::load-status", G_CALLBACK(local_load_directory_cb), gl);
-    webkit_web_view_load_string(web, page, NULL, NULL, fullpath);
+    webkit_web_view_load_string(web, page, NULL, NULL, listing->uri);
 
-    g_free(fullpath);
     g_free(page);
     g_free(newpath);
-
-    for (GSList *l = content; l; l=l->next) 
-        g_free(l->data);
-
-    g_slist_free(content);
 }/*}}}*/
 
 /* dwb_check_directory(const char *) {{{*/
@@ -21,5 +21,11 @@
 
 gboolean 
 local_check_directory(GList *, const char *, gboolean add_to_history, GError **);
+void 
+local_cancel(GList *);
+void 
+local_load_committed(GList *, const char *uri);
+gboolean 
+local_is_running(GList *);
 
 #endif
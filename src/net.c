@@ -0,0 +1,295 @@
+/*
+ * Copyright (c) 2010-2013 Stefan Bolte <portix@gmx.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <string.h>
+#include "dwb.h"
+#include "net.h"
+
+/*
+ * Requests of scripts are sent with the default session, so they share the
+ * persistent connections, cookies and proxy of webkit. At most
+ * s_max_connections requests are running at a time and at most
+ * s_max_connections_per_host to the same host, the other requests are queued
+ * in order.
+ *
+ * GET and HEAD requests without custom headers are coalesced, a request that
+ * is identical to a queued or running request doesn't send a message but
+ * gets the response of the other request. Streamed requests can only join
+ * requests that haven't been started yet, otherwise they would miss chunks.
+ */
+typedef struct _NetWaiter {
+    NetChunkFunc chunk;
+    NetFinishedFunc finished;
+    void *data;
+    GDestroyNotify notify;
+} NetWaiter;
+
+typedef struct _NetJob {
+    SoupMessage *msg;
+    /* coalescing key, NULL if the request cannot be shared */
+    char *key;
+    char *host;
+    gboolean stream;
+    gboolean running;
+    /* NetWaiters, last added first */
+    GSList *waiters;
+} NetJob;
+
+static GQueue s_queue = G_QUEUE_INIT;
+static GSList *s_running;
+/* maps coalescing keys to jobs */
+static GHashTable *s_jobs;
+/* maps hosts to the number of running requests */
+static GHashTable *s_hosts;
+static guint s_max_connections = NET_MAX_CONNECTIONS;
+static guint s_max_connections_per_host = NET_MAX_CONNECTIONS_PER_HOST;
+
+static void net_dispatch(void);
+
+/* net_get_key(SoupMessage *, gboolean stream) {{{*/
+static char *
+net_get_key(SoupMessage *msg, gboolean stream)
+{
+    SoupMessageHeadersIter iter;
+    const char *name, *value;
+    char *uri, *key;
+
+    if (msg->method != SOUP_METHOD_GET && msg->method != SOUP_METHOD_HEAD)
+        return NULL;
+
+    soup_message_headers_iter_init(&iter, msg->request_headers);
+    if (soup_message_headers_iter_next(&iter, &name, &value))
+        return NULL;
+
+    uri = soup_uri_to_string(soup_message_get_uri(msg), false);
+    key = g_strdup_printf("%c %s %s", stream ? 's' : 'b', msg->method, uri);
+    g_free(uri);
+    return key;
+}/*}}}*/
+
+/* net_waiter_free(NetWaiter *) {{{*/
+static void
+net_waiter_free(NetWaiter *waiter)
+{
+    if (waiter->notify != NULL)
+        waiter->notify(waiter->data);
+    g_free(waiter);
+}/*}}}*/
+
+/* net_job_free(NetJob *) {{{*/
+static void
+net_job_free(NetJob *job)
+{
+    g_slist_free_full(job->waiters, (GDestroyNotify)net_waiter_free);
+    g_free(job->key);
+    g_free(job->host);
+    g_free(job);
+}/*}}}*/
+
+/* net_job_forget(NetJob *) {{{
+ * Removes a job from the coalescing table, new requests won't join it
+ * */
+static void
+net_job_forget(NetJob *job)
+{
+    if (job->key != NULL && g_hash_table_lookup(s_jobs, job->key) == job)
+        g_hash_table_remove(s_jobs, job->key);
+}/*}}}*/
+
+/* net_got_chunk_cb(SoupMessage *, SoupBuffer *, NetJob *) {{{*/
+static void
+net_got_chunk_cb(SoupMessage *msg, SoupBuffer *chunk, NetJob *job)
+{
+    NetWaiter *waiter;
+
+    for (GSList *l = job->waiters; l; l=l->next)
+    {
+        waiter = l->data;
+        if (waiter->chunk != NULL)
+            waiter->chunk(msg, chunk, waiter->data);
+    }
+}/*}}}*/
+
+/* net_finished_cb(SoupSession *, SoupMessage *, NetJob *) {{{*/
+static void
+net_finished_cb(SoupSession *session, SoupMessage *msg, NetJob *job)
+{
+    NetWaiter *waiter;
+    guint count = GPOINTER_TO_UINT(g_hash_table_lookup(s_hosts, job->host));
+
+    if (count > 1)
+        g_hash_table_insert(s_hosts, g_strdup(job->host), GUINT_TO_POINTER(count - 1));
+    else
+        g_hash_table_remove(s_hosts, job->host);
+    s_running = g_slist_remove(s_running, job);
+    net_job_forget(job);
+
+    job->waiters = g_slist_reverse(job->waiters);
+    for (GSList *l = job->waiters; l; l=l->next)
+    {
+        waiter = l->data;
+        if (waiter->finished != NULL)
+            waiter->finished(msg, waiter->data);
+    }
+    net_job_free(job);
+    net_dispatch();
+}/*}}}*/
+
+/* net_dispatch() {{{
+ * Starts queued requests while the limits allow it
+ * */
+static void
+net_dispatch()
+{
+    NetJob *job;
+    GList *next;
+    guint count;
+
+    for (GList *l = s_queue.head; l && g_slist_length(s_running) < s_max_connections; l = next)
+    {
+        next = l->next;
+        job = l->data;
+        count = GPOINTER_TO_UINT(g_hash_table_lookup(s_hosts, job->host));
+        if (count >= s_max_connections_per_host)
+            continue;
+
+        g_queue_delete_link(&s_queue, l);
+        g_hash_table_insert(s_hosts, g_strdup(job->host), GUINT_TO_POINTER(count + 1));
+        s_running = g_slist_prepend(s_running, job);
+        job->running = true;
+
+        if (job->stream)
+        {
+            soup_message_body_set_accumulate(job->msg->response_body, false);
+            g_signal_connect(job->msg, "got-chunk", G_CALLBACK(net_got_chunk_cb), job);
+        }
+        soup_session_queue_message(webkit_get_default_session(), job->msg, (SoupSessionCallback)net_finished_cb, job);
+    }
+}/*}}}*/
+
+/* net_send(SoupMessage *, gboolean stream, NetChunkFunc, NetFinishedFunc, void *data, GDestroyNotify) {{{
+ * Queues a request, takes ownership of msg. If stream is true the body isn't
+ * accumulated and chunk is called for every chunk of the body.
+ * */
+void
+net_send(SoupMessage *msg, gboolean stream, NetChunkFunc chunk, NetFinishedFunc finished, void *data, GDestroyNotify notify)
+{
+    g_return_if_fail(msg != NULL);
+
+    NetJob *job = NULL;
+    NetWaiter *waiter = dwb_malloc(sizeof(NetWaiter));
+    SoupURI *uri = soup_message_get_uri(msg);
+    char *key = net_get_key(msg, stream);
+
+    waiter->chunk = chunk;
+    waiter->finished = finished;
+    waiter->data = data;
+    waiter->notify = notify;
+
+    if (s_jobs == NULL)
+    {
+        s_jobs = g_hash_table_new(g_str_hash, g_str_equal);
+        s_hosts = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    }
+
+    if (key != NULL)
+    {
+        job = g_hash_table_lookup(s_jobs, key);
+        if (job != NULL && job->stream && job->running)
+            job = NULL;
+    }
+    if (job != NULL)
+    {
+        job->waiters = g_slist_prepend(job->waiters, waiter);
+        g_object_unref(msg);
+        g_free(key);
+        return;
+    }
+
+    job = dwb_malloc(sizeof(NetJob));
+    job->msg = msg;
+    job->key = key;
+    job->host = g_strdup(uri->host != NULL ? uri->host : "");
+    job->stream = stream;
+    job->running = false;
+    job->waiters = g_slist_prepend(NULL, waiter);
+    /* a running streamed job keeps its own key, the table must not refer to
+     * it any longer */
+    if (key != NULL)
+        g_hash_table_replace(s_jobs, key, job);
+
+    g_queue_push_tail(&s_queue, job);
+    net_dispatch();
+}/*}}}*/
+
+/* net_set_max_connections(guint) {{{*/
+void
+net_set_max_connections(guint max)
+{
+    s_max_connections = MAX(max, 1);
+    net_dispatch();
+}/*}}}*/
+
+/* net_get_max_connections() {{{*/
+guint
+net_get_max_connections()
+{
+    return s_max_connections;
+}/*}}}*/
+
+/* net_set_max_connections_per_host(guint) {{{*/
+void
+net_set_max_connections_per_host(guint max)
+{
+    s_max_connections_per_host = MAX(max, 1);
+    net_dispatch();
+}/*}}}*/
+
+/* net_get_max_connections_per_host() {{{*/
+guint
+net_get_max_connections_per_host()
+{
+    return s_max_connections_per_host;
+}/*}}}*/
+
+/* net_end() {{{
+ * Drops all queued requests and cancels running requests, the finished
+ * functions aren't called
+ * */
+void
+net_end()
+{
+    NetJob *job;
+    GSList *running;
+
+    while ((job = g_queue_pop_head(&s_queue)) != NULL)
+    {
+        net_job_forget(job);
+        g_object_unref(job->msg);
+        net_job_free(job);
+    }
+    running = g_slist_copy(s_running);
+    for (GSList *l = running; l; l=l->next)
+    {
+        job = l->data;
+        g_slist_free_full(job->waiters, (GDestroyNotify)net_waiter_free);
+        job->waiters = NULL;
+        soup_session_cancel_message(webkit_get_default_session(), job->msg, SOUP_STATUS_CANCELLED);
+    }
+    g_slist_free(running);
+}/*}}}*/
@@ -0,0 +1,37 @@
+/*
+ * Copyright (c) 2010-2013 Stefan Bolte <portix@gmx.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef NET_H
+#define NET_H
+
+#define NET_MAX_CONNECTIONS 8
+#define NET_MAX_CONNECTIONS_PER_HOST 4
+
+/* Called for every chunk of a streamed response */
+typedef void (*NetChunkFunc)(SoupMessage *, SoupBuffer *chunk, void *data);
+/* Called when a request has finished, the message must not be unreferenced */
+typedef void (*NetFinishedFunc)(SoupMessage *, void *data);
+
+void net_send(SoupMessage *msg, gboolean stream, NetChunkFunc chunk, NetFinishedFunc finished, void *data, GDestroyNotify notify);
+void net_set_max_connections(guint max);
+guint net_get_max_connections(void);
+void net_set_max_connections_per_host(guint max);
+guint net_get_max_connections_per_host(void);
+void net_end(void);
+
+#endif
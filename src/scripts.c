@@ -32,6 +32,12 @@
 #include "application.h" 
 #include "completion.h" 
 #include "entry.h" 
+#include "dispatch.h"
+#include "view.h"
+#include "filter.h"
+#include "net.h"
+#include "fileio.h"
+#include "control.h"
 //#define kJSDefaultFunction  (kJSPropertyAttributeReadOnly | kJSPropertyAttributeDontDelete )
 #define kJSDefaultProperty  (kJSPropertyAttributeDontDelete | kJSPropertyAttributeReadOnly )
 #define kJSDefaultAttributes  (kJSPropertyAttributeDontDelete | kJSPropertyAttributeReadOnly )
@@ -98,6 +104,7 @@ static Sigmap s_sigmap[] = {
     { SCRIPTS_SIG_TAB_BUTTON_PRESS, "tabButtonPress" },
     { SCRIPTS_SIG_CHANGE_MODE, "changeMode" },
     { SCRIPTS_SIG_EXECUTE_COMMAND, "executeCommand" },
+    { SCRIPTS_SIG_HIBERNATE, "hibernate" },
     { 0, NULL },
 };
 
@@ -111,6 +118,7 @@ enum {
     CONSTRUCTOR_FRAME,
     CONSTRUCTOR_SOUP_MESSAGE,
     CONSTRUCTOR_DEFERRED,
+    CONSTRUCTOR_REQUEST_FILTER,
     CONSTRUCTOR_LAST,
 };
 
@@ -120,9 +128,18 @@ static JSObjectRef make_object(JSContextRef ctx, GObject *o);
 
 /* Static variables */
 static JSObjectRef s_sig_objects[SCRIPTS_SIG_LAST];
+/* number of emissions and microseconds spent in the callbacks per signal */
+static struct {
+    guint emitted;
+    gint64 time;
+} s_sig_stats[SCRIPTS_SIG_LAST];
+static JSClassRef s_json_class;
+/* lazily read response headers of net.request */
+static JSClassRef s_headers_class;
 static JSGlobalContextRef s_global_context;
 static GSList *s_script_list;
-static JSClassRef s_gobject_class, s_webview_class, s_frame_class, s_download_class, s_download_class, s_message_class, s_deferred_class;
+static JSClassRef s_placeholder_class;
+static JSClassRef s_gobject_class, s_webview_class, s_frame_class, s_download_class, s_download_class, s_message_class, s_deferred_class, s_filter_class;
 static gboolean s_commandline = false;
 static JSObjectRef s_array_contructor;
 static JSObjectRef s_completion_callback;
@@ -340,6 +357,147 @@ tabs_length(JSContextRef ctx, JSObjectRef this, JSStringRef name, JSValueRef* ex
     return JSValueMakeNumber(ctx, g_list_length(dwb.state.views));
 }/*}}}*/
 
+/* PLACEHOLDER {{{
+ * tabs.nth returns a placeholder object for tabs that haven't been restored.
+ * uri, title and number are answered by the placeholder, any other property
+ * creates the webview, without loading it before the tab is focused, and is
+ * read from the webview. Methods are bound to the webview.
+ * */
+#define PLACEHOLDER_TARGET "__webview__"
+
+typedef struct _PlaceholderPriv {
+    Placeholder *placeholder;
+    /* the webview that replaced the placeholder, kept alive by the property
+     * PLACEHOLDER_TARGET */
+    JSObjectRef target;
+} PlaceholderPriv;
+
+/* placeholder_find {{{*/
+static GList *
+placeholder_find(Placeholder *p)
+{
+    for (GList *gl = dwb.state.views; gl; gl=gl->next) 
+    {
+        if (VIEW(gl)->status->placeholder == p)
+            return gl;
+    }
+    return NULL;
+}/*}}}*/
+
+/* placeholder_get_target {{{
+ * Returns the webview of a placeholder object, creates it if name isn't
+ * answered by the placeholder itself
+ * */
+static JSObjectRef
+placeholder_get_target(JSContextRef ctx, JSObjectRef object, JSStringRef name, JSValueRef *value)
+{
+    PlaceholderPriv *priv = JSObjectGetPrivate(object);
+    Placeholder *p;
+    GList *gl;
+
+    *value = NULL;
+    if (priv == NULL || JSStringIsEqualToUTF8CString(name, PLACEHOLDER_TARGET))
+        return NULL;
+
+    if ((p = priv->placeholder) != NULL && (gl = placeholder_find(p)) != NULL) 
+    {
+        if (JSStringIsEqualToUTF8CString(name, "uri")) 
+            *value = p->uri != NULL ? js_char_to_value(ctx, p->uri) : NIL;
+        else if (JSStringIsEqualToUTF8CString(name, "title")) 
+            *value = p->title != NULL ? js_char_to_value(ctx, p->title) : NIL;
+        else if (JSStringIsEqualToUTF8CString(name, "number")) 
+            *value = JSValueMakeNumber(ctx, g_list_position(dwb.state.views, gl));
+        else 
+            view_materialize(gl, true);
+        if (*value != NULL)
+            return NULL;
+    }
+    return priv->target;
+}/*}}}*/
+
+/* placeholder_get_property {{{*/
+static JSValueRef 
+placeholder_get_property(JSContextRef ctx, JSObjectRef object, JSStringRef name, JSValueRef* exception) 
+{
+    JSValueRef value;
+    JSObjectRef target = placeholder_get_target(ctx, object, name, &value), function, bind;
+
+    if (target == NULL)
+        return value;
+
+    value = JSObjectGetProperty(ctx, target, name, exception);
+    if (value != NULL && JSValueIsObject(ctx, value) && JSObjectIsFunction(ctx, (function = JSValueToObject(ctx, value, NULL)))) 
+    {
+        /* methods of the webview must be called on the webview */
+        bind = js_get_object_property(ctx, function, "bind");
+        if (bind != NULL && JSObjectIsFunction(ctx, bind))
+            value = JSObjectCallAsFunction(ctx, bind, function, 1, (JSValueRef*)&target, exception);
+    }
+    return value;
+}/*}}}*/
+
+/* placeholder_set_property {{{*/
+static bool
+placeholder_set_property(JSContextRef ctx, JSObjectRef object, JSStringRef name, JSValueRef value, JSValueRef* exception) 
+{
+    JSValueRef unused;
+    JSObjectRef target = placeholder_get_target(ctx, object, name, &unused);
+
+    if (target == NULL)
+        return false;
+    JSObjectSetProperty(ctx, target, name, value, kJSPropertyAttributeNone, exception);
+    return true;
+}/*}}}*/
+
+/* placeholder_finalize {{{*/
+static void
+placeholder_finalize(JSObjectRef object)
+{
+    g_free(JSObjectGetPrivate(object));
+}/*}}}*/
+
+/* placeholder_get_object {{{*/
+static JSObjectRef
+placeholder_get_object(JSContextRef ctx, Placeholder *p)
+{
+    PlaceholderPriv *priv;
+
+    if (p->script_object == NULL) 
+    {
+        priv = dwb_malloc(sizeof(PlaceholderPriv));
+        priv->placeholder = p;
+        priv->target = NULL;
+        p->script_object = JSObjectMake(ctx, s_placeholder_class, priv);
+        JSValueProtect(s_global_context, p->script_object);
+    }
+    return p->script_object;
+}/*}}}*/
+
+/* scripts_release_placeholder(Placeholder *, JSObjectRef wv) {{{
+ * Called when a placeholder is freed, wv is the webview that replaces it or
+ * NULL if the tab is closed
+ * */
+void
+scripts_release_placeholder(Placeholder *p, JSObjectRef wv)
+{
+    JSObjectRef object = p->script_object;
+    PlaceholderPriv *priv;
+
+    p->script_object = NULL;
+    if (object == NULL || s_global_context == NULL)
+        return;
+
+    priv = JSObjectGetPrivate(object);
+    priv->placeholder = NULL;
+    if (wv != NULL) 
+    {
+        priv->target = wv;
+        js_set_property(s_global_context, object, PLACEHOLDER_TARGET, wv, kJSPropertyAttributeDontEnum | kJSPropertyAttributeReadOnly, NULL);
+    }
+    JSValueUnprotect(s_global_context, object);
+}/*}}}*/
+/*}}}*/
+
 /* tabs_get_nth {{{*/
 static JSValueRef 
 tabs_get_nth(JSContextRef ctx, JSObjectRef function, JSObjectRef thisObject, size_t argc, const JSValueRef argv[], JSValueRef* exc) 
@@ -353,6 +511,8 @@ tabs_get_nth(JSContextRef ctx, JSObjectRef function, JSObjectRef thisObject, siz
     GList *nth = g_list_nth(dwb.state.views, (int)n);
     if (nth == NULL)
         return NIL;
+    if (VIEW(nth)->status->placeholder != NULL)
+        return placeholder_get_object(ctx, VIEW(nth)->status->placeholder);
     return VIEW(nth)->script_wv;
 }/*}}}*/
 /*}}}*/
@@ -819,6 +979,7 @@ global_unbind(JSContextRef ctx, JSObjectRef function, JSObjectRef thisObject, si
         g_free(m->map);
         g_free(m);
         dwb.keymap = g_list_delete_link(dwb.keymap, l);
+        dispatch_invalidate();
         return JSValueMakeBoolean(ctx, true);
     }
     return JSValueMakeBoolean(ctx, false);
@@ -869,6 +1030,7 @@ global_bind(JSContextRef ctx, JSObjectRef function, JSObjectRef thisObject, size
     map->map = fmap;
 
     dwb.keymap = g_list_prepend(dwb.keymap, map);
+    dispatch_invalidate();
 
     ret = true;
 error_out:
@@ -995,7 +1157,7 @@ get_message_data(SoupMessage *msg)
     return o;
 }
 static void
-request_callback(SoupSession *session, SoupMessage *message, JSObjectRef function) 
+request_callback(SoupMessage *message, JSObjectRef function) 
 {
     if (message->response_body->data != NULL) 
     {
@@ -1052,7 +1214,7 @@ global_send_request(JSContextRef ctx, JSObjectRef f, JSObjectRef thisObject, siz
         set_request(ctx, msg, argv[3], exc);
 
     JSValueProtect(ctx, function);
-    soup_session_queue_message(webkit_get_default_session(), msg, (SoupSessionCallback)request_callback, function);
+    net_send(msg, false, NULL, (NetFinishedFunc)request_callback, function, NULL);
     ret = 0;
 
 error_out: 
@@ -1376,6 +1538,267 @@ deferred_reject(JSContextRef ctx, JSObjectRef f, JSObjectRef this, size_t argc,
     return UNDEFINED;
 }
 
+/* NET {{{*/
+typedef struct _NetPriv {
+    JSObjectRef deferred;
+    /* chunk callback, NULL if the body isn't streamed */
+    JSObjectRef chunk;
+    /* incomplete utf-8 sequence at the end of the last chunk */
+    GString *partial;
+} NetPriv;
+
+/* net_headers_get_property {{{*/
+static JSValueRef 
+net_headers_get_property(JSContextRef ctx, JSObjectRef this, JSStringRef js_name, JSValueRef* exc) 
+{
+    SoupMessage *msg = JSObjectGetPrivate(this);
+    char *name, *value;
+    JSValueRef ret = NULL;
+
+    if (msg == NULL)
+        return NULL;
+
+    name = js_string_to_char(ctx, js_name, -1);
+    if ((value = soup_message_headers_get_list(msg->response_headers, name)) != NULL)
+    {
+        ret = js_char_to_value(ctx, value);
+        g_free(value);
+    }
+    g_free(name);
+    return ret;
+}/*}}}*/
+
+/* net_headers_get_property_names {{{*/
+static void 
+net_headers_get_property_names(JSContextRef ctx, JSObjectRef this, JSPropertyNameAccumulatorRef names) 
+{
+    SoupMessage *msg = JSObjectGetPrivate(this);
+    SoupMessageHeadersIter iter;
+    const char *name, *value;
+    JSStringRef js_name;
+
+    if (msg == NULL)
+        return;
+
+    soup_message_headers_iter_init(&iter, msg->response_headers);
+    while (soup_message_headers_iter_next(&iter, &name, &value)) 
+    {
+        js_name = JSStringCreateWithUTF8CString(name);
+        JSPropertyNameAccumulatorAddName(names, js_name);
+        JSStringRelease(js_name);
+    }
+}/*}}}*/
+
+/* net_headers_finalize {{{*/
+static void 
+net_headers_finalize(JSObjectRef this) 
+{
+    SoupMessage *msg = JSObjectGetPrivate(this);
+    if (msg != NULL)
+        g_object_unref(msg);
+}/*}}}*/
+
+/* net_make_response(SoupMessage *, gboolean body) {{{
+ * Headers are only read when they are accessed
+ * */
+static JSObjectRef 
+net_make_response(SoupMessage *msg, gboolean body) 
+{
+    SoupBuffer *buffer;
+    JSObjectRef o = JSObjectMake(s_global_context, NULL, NULL);
+
+    js_set_object_number_property(s_global_context, o, "status", msg->status_code, NULL);
+    js_set_property(s_global_context, o, "headers", JSObjectMake(s_global_context, s_headers_class, g_object_ref(msg)), 
+            kJSPropertyAttributeDontDelete | kJSPropertyAttributeReadOnly, NULL);
+    if (body)
+    {
+        buffer = soup_message_body_flatten(msg->response_body);
+        js_set_object_property(s_global_context, o, "body", buffer->data, NULL);
+        soup_buffer_free(buffer);
+    }
+    return o;
+}/*}}}*/
+
+/* net_priv_free(NetPriv *) {{{*/
+static void 
+net_priv_free(NetPriv *priv) 
+{
+    if (s_global_context != NULL)
+    {
+        if (priv->deferred != NULL)
+            deferred_destroy(s_global_context, priv->deferred, NULL);
+        if (priv->chunk != NULL)
+            JSValueUnprotect(s_global_context, priv->chunk);
+    }
+    g_string_free(priv->partial, true);
+    g_free(priv);
+}/*}}}*/
+
+/* net_chunk_cb(SoupMessage *, SoupBuffer *, NetPriv *) {{{
+ * Passes the valid utf-8 of a chunk to the chunk callback, an incomplete
+ * sequence at the end is kept for the next chunk and invalid bytes are
+ * skipped
+ * */
+static void 
+net_chunk_cb(SoupMessage *msg, SoupBuffer *chunk, NetPriv *priv) 
+{
+    GString *buffer = priv->partial;
+    GString *text = g_string_sized_new(buffer->len + chunk->length);
+    const char *data, *end, *valid, *rest;
+
+    g_string_append_len(buffer, chunk->data, chunk->length);
+    end = rest = buffer->str + buffer->len;
+    for (data = buffer->str; data < end; data = valid + 1)
+    {
+        if (g_utf8_validate(data, end - data, &valid))
+        {
+            g_string_append_len(text, data, end - data);
+            break;
+        }
+        g_string_append_len(text, data, valid - data);
+        if (g_utf8_get_char_validated(valid, end - valid) == (gunichar)-2)
+        {
+            rest = valid;
+            break;
+        }
+    }
+    g_string_erase(buffer, 0, rest - buffer->str);
+
+    if (text->len > 0)
+    {
+        JSValueRef argv[] = { js_char_to_value(s_global_context, text->str), make_object(s_global_context, G_OBJECT(msg)) };
+        JSObjectCallAsFunction(s_global_context, priv->chunk, NULL, 2, argv, NULL);
+    }
+    g_string_free(text, true);
+}/*}}}*/
+
+/* net_finished_cb(SoupMessage *, NetPriv *) {{{*/
+static void 
+net_finished_cb(SoupMessage *msg, NetPriv *priv) 
+{
+    JSObjectRef deferred = priv->deferred;
+    JSValueRef argv[] = { net_make_response(msg, priv->chunk == NULL), make_object(s_global_context, G_OBJECT(msg)) };
+
+    /* the deferred is destroyed when it is resolved or rejected */
+    priv->deferred = NULL;
+    if (SOUP_STATUS_IS_SUCCESSFUL(msg->status_code))
+        deferred_resolve(s_global_context, NULL, deferred, 2, argv, NULL);
+    else 
+        deferred_reject(s_global_context, NULL, deferred, 2, argv, NULL);
+}/*}}}*/
+
+/* net_set_headers(JSContextRef, SoupMessage *, JSObjectRef) {{{*/
+static void 
+net_set_headers(JSContextRef ctx, SoupMessage *msg, JSObjectRef headers) 
+{
+    JSPropertyNameArrayRef names = JSObjectCopyPropertyNames(ctx, headers);
+    size_t count = JSPropertyNameArrayGetCount(names);
+    char *name, *value;
+
+    for (size_t i=0; i<count; i++) 
+    {
+        name = js_string_to_char(ctx, JSPropertyNameArrayGetNameAtIndex(names, i), JS_STRING_MAX);
+        if (name != NULL && (value = js_get_string_property(ctx, headers, name)) != NULL)
+        {
+            soup_message_headers_replace(msg->request_headers, name, value);
+            g_free(value);
+        }
+        g_free(name);
+    }
+    JSPropertyNameArrayRelease(names);
+}/*}}}*/
+
+/* net_request {{{*/
+static JSValueRef 
+net_request(JSContextRef ctx, JSObjectRef f, JSObjectRef this, size_t argc, const JSValueRef argv[], JSValueRef* exc) 
+{
+    JSObjectRef options = NULL, headers, chunk = NULL;
+    char *uri, *method = NULL, *body, *content_type;
+    SoupMessage *msg;
+    NetPriv *priv;
+
+    if (argc < 1) 
+    {
+        js_make_exception(ctx, exc, EXCEPTION("net.request: missing argument."));
+        return NIL;
+    }
+    if ((uri = js_value_to_char(ctx, argv[0], -1, exc)) == NULL)
+        return NIL;
+
+    if (argc > 1 && JSValueIsObject(ctx, argv[1]))
+    {
+        options = JSValueToObject(ctx, argv[1], exc);
+        method = js_get_string_property(ctx, options, "method");
+    }
+    msg = soup_message_new(method != NULL ? method : "GET", uri);
+    g_free(method);
+    if (msg == NULL)
+    {
+        js_make_exception(ctx, exc, EXCEPTION("net.request: invalid uri %s."), uri);
+        g_free(uri);
+        return NIL;
+    }
+    g_free(uri);
+
+    if (options != NULL)
+    {
+        if ((headers = js_get_object_property(ctx, options, "headers")) != NULL)
+            net_set_headers(ctx, msg, headers);
+        if ((body = js_get_string_property(ctx, options, "body")) != NULL)
+        {
+            content_type = js_get_string_property(ctx, options, "contentType");
+            soup_message_set_request(msg, content_type != NULL ? content_type : "text/plain", SOUP_MEMORY_TAKE, body, strlen(body));
+            g_free(content_type);
+        }
+        if ((chunk = js_get_object_property(ctx, options, "onChunk")) != NULL && JSObjectIsFunction(ctx, chunk))
+            JSValueProtect(ctx, chunk);
+        else 
+            chunk = NULL;
+    }
+
+    priv = g_malloc(sizeof(NetPriv));
+    priv->deferred = deferred_new(ctx);
+    priv->chunk = chunk;
+    priv->partial = g_string_new(NULL);
+    net_send(msg, chunk != NULL, (NetChunkFunc)net_chunk_cb, (NetFinishedFunc)net_finished_cb, priv, (GDestroyNotify)net_priv_free);
+    return priv->deferred;
+}/*}}}*/
+
+/* net_get_max_connections_cb {{{*/
+static JSValueRef 
+net_get_max_connections_cb(JSContextRef ctx, JSObjectRef this, JSStringRef js_name, JSValueRef* exc) 
+{
+    return JSValueMakeNumber(ctx, net_get_max_connections());
+}/*}}}*/
+
+/* net_set_max_connections_cb {{{*/
+static bool 
+net_set_max_connections_cb(JSContextRef ctx, JSObjectRef this, JSStringRef js_name, JSValueRef value, JSValueRef* exc) 
+{
+    double max = JSValueToNumber(ctx, value, exc);
+    if (!isnan(max) && max >= 1)
+        net_set_max_connections((guint)max);
+    return true;
+}/*}}}*/
+
+/* net_get_max_connections_per_host_cb {{{*/
+static JSValueRef 
+net_get_max_connections_per_host_cb(JSContextRef ctx, JSObjectRef this, JSStringRef js_name, JSValueRef* exc) 
+{
+    return JSValueMakeNumber(ctx, net_get_max_connections_per_host());
+}/*}}}*/
+
+/* net_set_max_connections_per_host_cb {{{*/
+static bool 
+net_set_max_connections_per_host_cb(JSContextRef ctx, JSObjectRef this, JSStringRef js_name, JSValueRef value, JSValueRef* exc) 
+{
+    double max = JSValueToNumber(ctx, value, exc);
+    if (!isnan(max) && max >= 1)
+        net_set_max_connections_per_host((guint)max);
+    return true;
+}/*}}}*/
+/*}}}*/
+
 /* DATA {{{*/
 /* data_get_profile {{{*/
 static JSValueRef 
@@ -1662,12 +2085,163 @@ io_prompt(JSContextRef ctx, JSObjectRef function, JSObjectRef thisObject, size_t
     return result;
 }/*}}}*/
 
+/* io_utf16_to_value(JSContextRef, const gunichar2 *, glong) {{{*/
+static JSValueRef 
+io_utf16_to_value(JSContextRef ctx, const gunichar2 *text, glong length) 
+{
+    JSStringRef string = JSStringCreateWithCharacters(text, length);
+    JSValueRef ret = JSValueMakeString(ctx, string);
+    JSStringRelease(string);
+    return ret;
+}/*}}}*/
+
+/* io_settle(JSObjectRef deferred, JSValueRef value, GError *) {{{
+ * Resolves a deferred with value or rejects it with the error message
+ * */
+static void 
+io_settle(JSObjectRef deferred, JSValueRef value, GError *error) 
+{
+    JSValueRef argv[1];
+    if (error == NULL)
+    {
+        argv[0] = value;
+        deferred_resolve(s_global_context, NULL, deferred, 1, argv, NULL);
+    }
+    else 
+    {
+        argv[0] = js_char_to_value(s_global_context, error->message);
+        deferred_reject(s_global_context, NULL, deferred, 1, argv, NULL);
+    }
+}/*}}}*/
+
+/* io_load_cb(gunichar2 *, glong, GError *, JSObjectRef) {{{*/
+static void 
+io_load_cb(gunichar2 *text, glong length, GError *error, JSObjectRef deferred) 
+{
+    if (s_global_context != NULL)
+        io_settle(deferred, text != NULL ? io_utf16_to_value(s_global_context, text, length) : NIL, error);
+    g_free(text);
+}/*}}}*/
+
+/* io_load {{{*/
+static JSValueRef 
+io_load(JSContextRef ctx, JSObjectRef function, JSObjectRef thisObject, size_t argc, const JSValueRef argv[], JSValueRef* exc) 
+{
+    char *path;
+    JSObjectRef deferred;
+
+    if (argc < 1) 
+    {
+        js_make_exception(ctx, exc, EXCEPTION("io.load needs an argument."));
+        return NIL;
+    }
+    if ( (path = js_value_to_char(ctx, argv[0], PATH_MAX, exc)) == NULL )
+        return NIL;
+
+    deferred = deferred_new(ctx);
+    fileio_load(path, (FileioLoadFunc)io_load_cb, deferred);
+    g_free(path);
+    return deferred;
+}/*}}}*/
+
+typedef struct _IOLines {
+    JSObjectRef deferred;
+    JSObjectRef callback;
+} IOLines;
+
+/* io_read_lines_line_cb(const char *, IOLines *) {{{*/
+static gboolean 
+io_read_lines_line_cb(const char *line, IOLines *lines) 
+{
+    if (s_global_context == NULL)
+        return true;
+
+    JSValueRef argv[] = { js_char_to_value(s_global_context, line) };
+    JSValueRef ret = JSObjectCallAsFunction(s_global_context, lines->callback, NULL, 1, argv, NULL);
+    return ret != NULL && JSValueIsBoolean(s_global_context, ret) && JSValueToBoolean(s_global_context, ret);
+}/*}}}*/
+
+/* io_read_lines_done_cb(guint64, GError *, IOLines *) {{{*/
+static void 
+io_read_lines_done_cb(guint64 count, GError *error, IOLines *lines) 
+{
+    if (s_global_context != NULL)
+    {
+        io_settle(lines->deferred, JSValueMakeNumber(s_global_context, count), error);
+        JSValueUnprotect(s_global_context, lines->callback);
+    }
+    g_free(lines);
+}/*}}}*/
+
+/* io_read_lines {{{*/
+static JSValueRef 
+io_read_lines(JSContextRef ctx, JSObjectRef function, JSObjectRef thisObject, size_t argc, const JSValueRef argv[], JSValueRef* exc) 
+{
+    char *path;
+    JSObjectRef callback;
+    IOLines *lines;
+
+    if (argc < 2) 
+    {
+        js_make_exception(ctx, exc, EXCEPTION("io.readLines needs 2 arguments."));
+        return NIL;
+    }
+    if ( (callback = js_value_to_function(ctx, argv[1], exc)) == NULL )
+        return NIL;
+    if ( (path = js_value_to_char(ctx, argv[0], PATH_MAX, exc)) == NULL )
+        return NIL;
+
+    JSValueProtect(ctx, callback);
+    lines = g_malloc(sizeof(IOLines));
+    lines->deferred = deferred_new(ctx);
+    lines->callback = callback;
+    fileio_read_lines(path, (FileioLineFunc)io_read_lines_line_cb, (FileioDoneFunc)io_read_lines_done_cb, lines);
+    g_free(path);
+    return lines->deferred;
+}/*}}}*/
+
+/* io_save_cb(guint64, GError *, JSObjectRef) {{{*/
+static void 
+io_save_cb(guint64 count, GError *error, JSObjectRef deferred) 
+{
+    if (s_global_context != NULL)
+        io_settle(deferred, JSValueMakeNumber(s_global_context, count), error);
+}/*}}}*/
+
+/* io_save {{{*/
+static JSValueRef 
+io_save(JSContextRef ctx, JSObjectRef function, JSObjectRef thisObject, size_t argc, const JSValueRef argv[], JSValueRef* exc) 
+{
+    char *path, *content;
+    JSObjectRef deferred;
+
+    if (argc < 2) 
+    {
+        js_make_exception(ctx, exc, EXCEPTION("io.save needs 2 arguments."));
+        return NIL;
+    }
+    if ( (path = js_value_to_char(ctx, argv[0], PATH_MAX, exc)) == NULL )
+        return NIL;
+    if ( (content = js_value_to_char(ctx, argv[1], -1, exc)) == NULL ) 
+    {
+        g_free(path);
+        return NIL;
+    }
+
+    deferred = deferred_new(ctx);
+    fileio_replace(path, content, strlen(content), (FileioDoneFunc)io_save_cb, deferred);
+    g_free(path);
+    return deferred;
+}/*}}}*/
+
 /* io_read {{{*/
 static JSValueRef 
 io_read(JSContextRef ctx, JSObjectRef function, JSObjectRef thisObject, size_t argc, const JSValueRef argv[], JSValueRef* exc) 
 {
     JSValueRef ret = NULL;
-    char *path = NULL, *content = NULL;
+    char *path = NULL;
+    gunichar2 *content = NULL;
+    glong length;
     if (argc < 1) 
     {
         js_make_exception(ctx, exc, EXCEPTION("io.read needs an argument."));
@@ -1676,10 +2250,10 @@ io_read(JSContextRef ctx, JSObjectRef function, JSObjectRef thisObject, size_t a
     if ( (path = js_value_to_char(ctx, argv[0], PATH_MAX, exc) ) == NULL )
         goto error_out;
 
-    if ( (content = util_get_file_content(path, NULL) ) == NULL ) 
+    if ( (content = fileio_map_utf16(path, &length, NULL) ) == NULL ) 
         goto error_out;
 
-    ret = js_char_to_value(ctx, content);
+    ret = io_utf16_to_value(ctx, content, length);
 
 error_out:
     g_free(path);
@@ -1738,21 +2312,13 @@ io_dir_names(JSContextRef ctx, JSObjectRef function, JSObjectRef thisObject, siz
 
     if ((dir = g_dir_open(dir_name, 0, NULL)) != NULL) 
     {
-        GSList *list = NULL;
-        while ((name = g_dir_read_name(dir)) != NULL) 
-        {
-            list = g_slist_prepend(list, (gpointer)js_char_to_value(ctx, name));
-        }
+        /* names are added to the array directly, values in an intermediate
+         * list wouldn't be protected from the garbage collector */
+        JSObjectRef array = JSObjectMakeArray(ctx, 0, NULL, exc);
+        for (unsigned int i=0; array != NULL && (name = g_dir_read_name(dir)) != NULL; i++) 
+            JSObjectSetPropertyAtIndex(ctx, array, i, js_char_to_value(ctx, name), exc);
         g_dir_close(dir);
-
-        JSValueRef args[g_slist_length(list)];
-
-        int i=0;
-        for (GSList *l = list; l; l=l->next, i++) 
-            args[i] = l->data;
-
-        ret = JSObjectMakeArray(ctx, i, args, exc);
-        g_slist_free(list);
+        ret = array != NULL ? array : NIL;
     }
     else 
         ret = NIL;
@@ -1866,6 +2432,288 @@ io_print(JSContextRef ctx, JSObjectRef function, JSObjectRef thisObject, size_t
 }/*}}}*/
 /*}}}*/
 
+/* REQUEST_FILTER {{{*/
+typedef struct _FilterPriv {
+    RequestFilter *filter;
+    JSObjectRef ask;
+} FilterPriv;
+
+/* request_filter_action(JSContextRef, const char *name, JSValueRef *) {{{*/
+static FilterAction
+request_filter_action(JSContextRef ctx, const char *name, JSValueRef *exc)
+{
+    if (!g_strcmp0(name, "allow"))
+        return FILTER_ALLOW;
+    else if (!g_strcmp0(name, "block"))
+        return FILTER_BLOCK;
+    else if (!g_strcmp0(name, "ask"))
+        return FILTER_ASK;
+
+    js_make_exception(ctx, exc, EXCEPTION("RequestFilter: unknown action %s."), name);
+    return FILTER_NONE;
+}/*}}}*/
+
+/* request_filter_ask_cb {{{*/
+static gboolean
+request_filter_ask_cb(RequestFilter *filter, WebKitWebView *wv, WebKitWebFrame *frame, WebKitNetworkRequest *request, WebKitNetworkResponse *response, FilterPriv *priv)
+{
+    if (s_global_context == NULL || priv->ask == NULL)
+        return false;
+
+    JSValueRef argv[] = { 
+        make_object(s_global_context, G_OBJECT(wv)), make_object(s_global_context, G_OBJECT(frame)), 
+        make_object(s_global_context, G_OBJECT(request)), make_object(s_global_context, G_OBJECT(response)) 
+    };
+    JSValueRef ret = JSObjectCallAsFunction(s_global_context, priv->ask, NULL, 4, argv, NULL);
+    return ret != NULL && JSValueIsBoolean(s_global_context, ret) && JSValueToBoolean(s_global_context, ret);
+}/*}}}*/
+
+/* request_filter_set_rule {{{*/
+static JSValueRef 
+request_filter_set_rule(JSContextRef ctx, JSObjectRef this, size_t argc, const JSValueRef argv[], JSValueRef* exc, FilterAction action) 
+{
+    FilterPriv *priv = JSObjectGetPrivate(this);
+    char *domain, *first_party = NULL;
+
+    if (priv == NULL)
+        return JSValueMakeBoolean(ctx, false);
+    if (argc < 1) 
+    {
+        js_make_exception(ctx, exc, EXCEPTION("RequestFilter: missing argument."));
+        return JSValueMakeBoolean(ctx, false);
+    }
+    if ((domain = js_value_to_char(ctx, argv[0], JS_STRING_MAX, exc)) == NULL)
+        return JSValueMakeBoolean(ctx, false);
+    if (argc > 1 && !JSValueIsUndefined(ctx, argv[1]) && !JSValueIsNull(ctx, argv[1]))
+        first_party = js_value_to_char(ctx, argv[1], JS_STRING_MAX, exc);
+
+    filter_set_rule(priv->filter, first_party != NULL ? first_party : "*", domain, action);
+
+    g_free(domain);
+    g_free(first_party);
+    return JSValueMakeBoolean(ctx, true);
+}/*}}}*/
+
+/* request_filter_allow {{{*/
+static JSValueRef 
+request_filter_allow(JSContextRef ctx, JSObjectRef f, JSObjectRef this, size_t argc, const JSValueRef argv[], JSValueRef* exc) 
+{
+    return request_filter_set_rule(ctx, this, argc, argv, exc, FILTER_ALLOW);
+}/*}}}*/
+
+/* request_filter_block {{{*/
+static JSValueRef 
+request_filter_block(JSContextRef ctx, JSObjectRef f, JSObjectRef this, size_t argc, const JSValueRef argv[], JSValueRef* exc) 
+{
+    return request_filter_set_rule(ctx, this, argc, argv, exc, FILTER_BLOCK);
+}/*}}}*/
+
+/* request_filter_ask {{{*/
+static JSValueRef 
+request_filter_ask(JSContextRef ctx, JSObjectRef f, JSObjectRef this, size_t argc, const JSValueRef argv[], JSValueRef* exc) 
+{
+    return request_filter_set_rule(ctx, this, argc, argv, exc, FILTER_ASK);
+}/*}}}*/
+
+/* request_filter_remove {{{*/
+static JSValueRef 
+request_filter_remove(JSContextRef ctx, JSObjectRef f, JSObjectRef this, size_t argc, const JSValueRef argv[], JSValueRef* exc) 
+{
+    return request_filter_set_rule(ctx, this, argc, argv, exc, FILTER_NONE);
+}/*}}}*/
+
+/* request_filter_add_pattern {{{*/
+static JSValueRef 
+request_filter_add_pattern(JSContextRef ctx, JSObjectRef f, JSObjectRef this, size_t argc, const JSValueRef argv[], JSValueRef* exc) 
+{
+    FilterPriv *priv = JSObjectGetPrivate(this);
+    FilterAction action;
+    GError *error = NULL;
+    gboolean ret = false;
+    char *pattern, *name;
+
+    if (priv == NULL)
+        return JSValueMakeBoolean(ctx, false);
+    if (argc < 2) 
+    {
+        js_make_exception(ctx, exc, EXCEPTION("RequestFilter.addPattern: missing argument."));
+        return JSValueMakeBoolean(ctx, false);
+    }
+    if ((name = js_value_to_char(ctx, argv[1], JS_STRING_MAX, exc)) == NULL)
+        return JSValueMakeBoolean(ctx, false);
+    action = request_filter_action(ctx, name, exc);
+    g_free(name);
+    if (action == FILTER_NONE || (pattern = js_value_to_char(ctx, argv[0], -1, exc)) == NULL)
+        return JSValueMakeBoolean(ctx, false);
+
+    ret = filter_add_pattern(priv->filter, pattern, action, &error);
+    if (error != NULL) 
+    {
+        js_make_exception(ctx, exc, EXCEPTION("RequestFilter.addPattern: %s"), error->message);
+        g_error_free(error);
+    }
+    g_free(pattern);
+    return JSValueMakeBoolean(ctx, ret);
+}/*}}}*/
+
+/* request_filter_remove_pattern {{{*/
+static JSValueRef 
+request_filter_remove_pattern(JSContextRef ctx, JSObjectRef f, JSObjectRef this, size_t argc, const JSValueRef argv[], JSValueRef* exc) 
+{
+    FilterPriv *priv = JSObjectGetPrivate(this);
+    gboolean ret = false;
+    char *pattern;
+
+    if (priv == NULL || argc < 1)
+        return JSValueMakeBoolean(ctx, false);
+    if ((pattern = js_value_to_char(ctx, argv[0], -1, exc)) != NULL)
+    {
+        ret = filter_remove_pattern(priv->filter, pattern);
+        g_free(pattern);
+    }
+    return JSValueMakeBoolean(ctx, ret);
+}/*}}}*/
+
+/* request_filter_clear {{{*/
+static JSValueRef 
+request_filter_clear(JSContextRef ctx, JSObjectRef f, JSObjectRef this, size_t argc, const JSValueRef argv[], JSValueRef* exc) 
+{
+    FilterPriv *priv = JSObjectGetPrivate(this);
+    if (priv != NULL)
+        filter_clear(priv->filter);
+    return UNDEFINED;
+}/*}}}*/
+
+/* request_filter_enable {{{
+ * An enabled filter is protected, it is kept alive until it is disabled
+ * */
+static JSValueRef 
+request_filter_enable(JSContextRef ctx, JSObjectRef f, JSObjectRef this, size_t argc, const JSValueRef argv[], JSValueRef* exc) 
+{
+    FilterPriv *priv = JSObjectGetPrivate(this);
+    if (priv != NULL && !filter_is_attached(priv->filter))
+    {
+        filter_attach(priv->filter);
+        JSValueProtect(ctx, this);
+    }
+    return UNDEFINED;
+}/*}}}*/
+
+/* request_filter_disable {{{*/
+static JSValueRef 
+request_filter_disable(JSContextRef ctx, JSObjectRef f, JSObjectRef this, size_t argc, const JSValueRef argv[], JSValueRef* exc) 
+{
+    FilterPriv *priv = JSObjectGetPrivate(this);
+    if (priv != NULL && filter_is_attached(priv->filter))
+    {
+        filter_detach(priv->filter);
+        JSValueUnprotect(ctx, this);
+    }
+    return UNDEFINED;
+}/*}}}*/
+
+/* request_filter_get_webview {{{*/
+static WebKitWebView *
+request_filter_get_webview(JSContextRef ctx, size_t argc, const JSValueRef argv[], JSValueRef *exc)
+{
+    if (argc < 1 || !JSValueIsObjectOfClass(ctx, argv[0], s_webview_class))
+    {
+        js_make_exception(ctx, exc, EXCEPTION("RequestFilter: argument is not a webview."));
+        return NULL;
+    }
+    return JSObjectGetPrivate(JSValueToObject(ctx, argv[0], NULL));
+}/*}}}*/
+
+/* request_filter_domains {{{*/
+static JSValueRef 
+request_filter_domains(JSContextRef ctx, JSObjectRef f, JSObjectRef this, size_t argc, const JSValueRef argv[], JSValueRef* exc) 
+{
+    FilterPriv *priv = JSObjectGetPrivate(this);
+    WebKitWebView *wv;
+    GPtrArray *domains;
+
+    if (priv == NULL || (wv = request_filter_get_webview(ctx, argc, argv, exc)) == NULL)
+        return NIL;
+
+    domains = filter_get_domains(priv->filter, wv);
+    if (domains == NULL)
+        return JSObjectMakeArray(ctx, 0, NULL, exc);
+
+    JSValueRef values[domains->len];
+    for (guint i=0; i<domains->len; i++)
+        values[i] = js_char_to_value(ctx, domains->pdata[i]);
+    return JSObjectMakeArray(ctx, domains->len, values, exc);
+}/*}}}*/
+
+/* request_filter_blocked {{{*/
+static JSValueRef 
+request_filter_blocked(JSContextRef ctx, JSObjectRef f, JSObjectRef this, size_t argc, const JSValueRef argv[], JSValueRef* exc) 
+{
+    FilterPriv *priv = JSObjectGetPrivate(this);
+    WebKitWebView *wv;
+
+    if (priv == NULL || (wv = request_filter_get_webview(ctx, argc, argv, exc)) == NULL)
+        return JSValueMakeNumber(ctx, 0);
+    return JSValueMakeNumber(ctx, filter_get_blocked(priv->filter, wv));
+}/*}}}*/
+
+/* request_filter_get_enabled {{{*/
+static JSValueRef 
+request_filter_get_enabled(JSContextRef ctx, JSObjectRef this, JSStringRef js_name, JSValueRef* exception) 
+{
+    FilterPriv *priv = JSObjectGetPrivate(this);
+    return JSValueMakeBoolean(ctx, priv != NULL && filter_is_attached(priv->filter));
+}/*}}}*/
+
+/* request_filter_finalize {{{*/
+static void 
+request_filter_finalize(JSObjectRef this) 
+{
+    FilterPriv *priv = JSObjectGetPrivate(this);
+    if (priv == NULL)
+        return;
+
+    filter_free(priv->filter);
+    if (priv->ask != NULL && s_global_context != NULL)
+        JSValueUnprotect(s_global_context, priv->ask);
+    g_free(priv);
+}/*}}}*/
+
+/* request_filter_constructor_cb {{{*/
+static JSObjectRef 
+request_filter_constructor_cb(JSContextRef ctx, JSObjectRef constructor, size_t argc, const JSValueRef argv[], JSValueRef* exc) 
+{
+    JSObjectRef options = NULL, ask;
+    JSStringRef js_name;
+    FilterAction fallback = FILTER_NONE;
+    gboolean third_party = false;
+    char *name;
+    FilterPriv *priv = g_malloc0(sizeof(FilterPriv));
+
+    if (argc > 0 && JSValueIsObject(ctx, argv[0]))
+        options = JSValueToObject(ctx, argv[0], exc);
+    if (options != NULL)
+    {
+        js_name = JSStringCreateWithUTF8CString("thirdParty");
+        third_party = JSValueToBoolean(ctx, JSObjectGetProperty(ctx, options, js_name, NULL));
+        JSStringRelease(js_name);
+
+        if ((name = js_get_string_property(ctx, options, "fallback")) != NULL)
+        {
+            fallback = request_filter_action(ctx, name, exc);
+            g_free(name);
+        }
+        if ((ask = js_get_object_property(ctx, options, "onAsk")) != NULL && JSObjectIsFunction(ctx, ask))
+        {
+            JSValueProtect(ctx, ask);
+            priv->ask = ask;
+        }
+    }
+    priv->filter = filter_new(third_party, fallback, (FilterAskFunc)request_filter_ask_cb, priv);
+    return JSObjectMake(ctx, s_filter_class, priv);
+}/*}}}*/
+/*}}}*/
+
 /* DOWNLOAD {{{*/
 /* download_constructor_cb {{{*/
 static JSObjectRef 
@@ -2032,39 +2880,175 @@ signal_set(JSContextRef ctx, JSObjectRef object, JSStringRef js_name, JSValueRef
     return false;
 }/*}}}*/
 
-/* scripts_emit {{{*/
+/* scripts_signal_lookup(const char *name) {{{
+ * Returns the signal with the given name or -1
+ * */
+int
+scripts_signal_lookup(const char *name)
+{
+    for (int i = SCRIPTS_SIG_FIRST; i<SCRIPTS_SIG_LAST; i++) 
+    {
+        if (!g_strcmp0(name, s_sigmap[i].name))
+            return i;
+    }
+    return -1;
+}/*}}}*/
+
+/* signal_get_statistics {{{*/
+static JSValueRef 
+signal_get_statistics(JSContextRef ctx, JSObjectRef object, JSStringRef property, JSValueRef* exception) 
+{
+    JSObjectRef ret = JSObjectMake(ctx, NULL, NULL);
+    JSObjectRef stats;
+
+    for (int i = SCRIPTS_SIG_FIRST; i<SCRIPTS_SIG_LAST; i++) 
+    {
+        stats = JSObjectMake(ctx, NULL, NULL);
+        js_set_object_number_property(ctx, stats, "emitted", s_sig_stats[i].emitted, exception);
+        js_set_object_number_property(ctx, stats, "time", s_sig_stats[i].time / 1000.0, exception);
+        js_set_property(ctx, ret, s_sigmap[i].name, stats, kJSDefaultProperty, exception);
+    }
+    return ret;
+}/*}}}*/
+
+/* signal_json_parse {{{
+ * The json argument of a signal is only parsed when a callback accesses it,
+ * the properties of the parsed object are copied to the argument which is a
+ * plain object afterwards
+ * */
+static void 
+signal_json_parse(JSContextRef ctx, JSObjectRef object) 
+{
+    char *json = JSObjectGetPrivate(object);
+    JSValueRef value;
+    JSObjectRef parsed;
+    JSPropertyNameArrayRef names;
+    JSStringRef name;
+
+    if (json == NULL)
+        return;
+    JSObjectSetPrivate(object, NULL);
+
+    value = js_json_to_value(ctx, json);
+    if (value != NULL && (parsed = JSValueToObject(ctx, value, NULL)) != NULL) 
+    {
+        names = JSObjectCopyPropertyNames(ctx, parsed);
+        for (size_t i=0, n=JSPropertyNameArrayGetCount(names); i<n; i++) 
+        {
+            name = JSPropertyNameArrayGetNameAtIndex(names, i);
+            JSObjectSetProperty(ctx, object, name, JSObjectGetProperty(ctx, parsed, name, NULL), kJSPropertyAttributeNone, NULL);
+        }
+        JSPropertyNameArrayRelease(names);
+    }
+    g_free(json);
+}/*}}}*/
+
+/* signal_json_has_property {{{*/
+static bool 
+signal_json_has_property(JSContextRef ctx, JSObjectRef object, JSStringRef name) 
+{
+    signal_json_parse(ctx, object);
+    return false;
+}/*}}}*/
+
+/* signal_json_get_property {{{*/
+static JSValueRef 
+signal_json_get_property(JSContextRef ctx, JSObjectRef object, JSStringRef name, JSValueRef *exception) 
+{
+    signal_json_parse(ctx, object);
+    return NULL;
+}/*}}}*/
+
+/* signal_json_set_property {{{*/
+static bool 
+signal_json_set_property(JSContextRef ctx, JSObjectRef object, JSStringRef name, JSValueRef value, JSValueRef *exception) 
+{
+    signal_json_parse(ctx, object);
+    return false;
+}/*}}}*/
+
+/* signal_json_delete_property {{{*/
+static bool 
+signal_json_delete_property(JSContextRef ctx, JSObjectRef object, JSStringRef name, JSValueRef *exception) 
+{
+    signal_json_parse(ctx, object);
+    return false;
+}/*}}}*/
+
+/* signal_json_get_property_names {{{*/
+static void 
+signal_json_get_property_names(JSContextRef ctx, JSObjectRef object, JSPropertyNameAccumulatorRef names) 
+{
+    signal_json_parse(ctx, object);
+}/*}}}*/
+
+/* signal_json_finalize {{{*/
+static void 
+signal_json_finalize(JSObjectRef object) 
+{
+    g_free(JSObjectGetPrivate(object));
+}/*}}}*/
+
+/* scripts_emit {{{
+ * Only arguments that a callback can see are created, the dispatcher that is
+ * created by signals.connect has a property argc with the largest number of
+ * parameters of the connected callbacks or 0 if a callback might use its
+ * arguments object. The json argument is parsed when it is accessed.
+ * */
 gboolean
 scripts_emit(ScriptSignal *sig) 
 {
     JSObjectRef function = s_sig_objects[sig->signal];
+    GObject *wv;
+
+    if (dwb.misc.control_signals & (1<<sig->signal))
+    {
+        wv = sig->jsobj != NULL ? JSObjectGetPrivate(sig->jsobj) : NULL;
+        control_emit(sig->signal, s_sigmap[sig->signal].name, sig->json, wv, sig->objects, MIN(sig->numobj, SCRIPT_MAX_SIG_OBJECTS));
+    }
     if (function == NULL)
         return false;
 
     int additional = sig->jsobj != NULL ? 2 : 1;
     int numargs = MIN(sig->numobj, SCRIPT_MAX_SIG_OBJECTS)+additional;
+    int argc = js_get_double_property(s_global_context, function, "argc");
     JSValueRef val[numargs];
     int i = 0;
+    gint64 start;
+    gboolean ret = false;
+
+    if (argc <= 0 || argc > numargs)
+        argc = numargs;
 
     if (sig->jsobj != NULL) 
         val[i++] = sig->jsobj;
 
-    for (int j=0; j<sig->numobj; j++) 
+    for (int j=0; j<sig->numobj; j++, i++) 
     {
-        if (sig->objects[j] != NULL) 
-            val[i++] = make_object(s_global_context, G_OBJECT(sig->objects[j]));
+        if (i >= argc)
+            val[i] = UNDEFINED;
+        else if (sig->objects[j] != NULL) 
+            val[i] = make_object(s_global_context, G_OBJECT(sig->objects[j]));
         else 
-            val[i++] = NIL;
+            val[i] = NIL;
     }
 
-    JSValueRef vson = js_json_to_value(s_global_context, sig->json);
-    val[i++] = vson == NULL ? NIL : vson;
+    if (i < argc) 
+        val[i++] = JSObjectMake(s_global_context, s_json_class, g_strdup(sig->json));
+    else 
+        val[i++] = UNDEFINED;
+
+    s_sig_stats[sig->signal].emitted++;
+    start = g_get_monotonic_time();
 
     JSValueRef js_ret = JSObjectCallAsFunction(s_global_context, function, NULL, numargs, val, NULL);
 
-    if (JSValueIsBoolean(s_global_context, js_ret)) 
-        return JSValueToBoolean(s_global_context, js_ret);
+    s_sig_stats[sig->signal].time += g_get_monotonic_time() - start;
 
-    return false;
+    if (js_ret != NULL && JSValueIsBoolean(s_global_context, js_ret)) 
+        ret = JSValueToBoolean(s_global_context, js_ret);
+
+    return ret;
 }/*}}}*/
 /*}}}*/
 
@@ -2541,6 +3525,9 @@ create_global_object()
         { "print",     io_print,            kJSDefaultAttributes },
         { "prompt",    io_prompt,           kJSDefaultAttributes },
         { "read",      io_read,             kJSDefaultAttributes },
+        { "load",      io_load,             kJSDefaultAttributes },
+        { "readLines", io_read_lines,       kJSDefaultAttributes },
+        { "save",      io_save,             kJSDefaultAttributes },
         { "write",     io_write,            kJSDefaultAttributes },
         { "dirNames",  io_dir_names,        kJSDefaultAttributes },
         { "notify",    io_notify,           kJSDefaultAttributes },
@@ -2577,14 +3564,30 @@ create_global_object()
     create_object(s_global_context, class, global_object, kJSDefaultAttributes, "tabs", NULL);
     JSClassRelease(class);
 
+    JSStaticValue signal_values[] = {
+        { "statistics",     signal_get_statistics, NULL, kJSDefaultAttributes }, 
+        { 0, 0, 0, 0 }, 
+    };
     JSClassDefinition cd = kJSClassDefinitionEmpty;
     cd.className = "signals";
+    cd.staticValues = signal_values;
     cd.setProperty = signal_set;
     class = JSClassCreate(&cd);
 
     create_object(s_global_context, class, global_object, kJSDefaultAttributes, "signals", NULL);
     JSClassRelease(class);
 
+    /* Lazily parsed json argument of signals */
+    cd = kJSClassDefinitionEmpty;
+    cd.className = "Object";
+    cd.hasProperty = signal_json_has_property;
+    cd.getProperty = signal_json_get_property;
+    cd.setProperty = signal_json_set_property;
+    cd.deleteProperty = signal_json_delete_property;
+    cd.getPropertyNames = signal_json_get_property_names;
+    cd.finalize = signal_json_finalize;
+    s_json_class = JSClassCreate(&cd);
+
     class = create_class("extensions", NULL, NULL);
     create_object(s_global_context, class, global_object, kJSDefaultAttributes, "extensions", NULL);
     JSClassRelease(class);
@@ -2599,6 +3602,31 @@ create_global_object()
     create_object(s_global_context, class, global_object, kJSDefaultAttributes, "util", NULL);
     JSClassRelease(class);
 
+    JSStaticFunction net_functions[] = { 
+        { "request",          net_request,         kJSDefaultAttributes },
+        { 0, 0, 0 }, 
+    };
+    JSStaticValue net_values[] = {
+        { "maxConnections",          net_get_max_connections_cb, net_set_max_connections_cb, kJSPropertyAttributeDontDelete }, 
+        { "maxConnectionsPerHost",   net_get_max_connections_per_host_cb, net_set_max_connections_per_host_cb, kJSPropertyAttributeDontDelete }, 
+        { 0, 0, 0, 0 }, 
+    };
+    /* not created with create_class, the limits must be settable */
+    cd = kJSClassDefinitionEmpty;
+    cd.className = "net";
+    cd.staticFunctions = net_functions;
+    cd.staticValues = net_values;
+    class = JSClassCreate(&cd);
+    create_object(s_global_context, class, global_object, kJSDefaultAttributes, "net", NULL);
+    JSClassRelease(class);
+
+    cd = kJSClassDefinitionEmpty;
+    cd.className = "Object";
+    cd.getProperty = net_headers_get_property;
+    cd.getPropertyNames = net_headers_get_property_names;
+    cd.finalize = net_headers_finalize;
+    s_headers_class = JSClassCreate(&cd);
+
     /* Default gobject class */
     JSStaticFunction default_functions[] = { 
         { "connect",            gobject_connect,                kJSDefaultAttributes },
@@ -2649,6 +3677,13 @@ create_global_object()
 
     s_constructors[CONSTRUCTOR_WEBVIEW] = create_constructor(s_global_context, "WebKitWebView", s_webview_class, NULL, NULL);
 
+    cd = kJSClassDefinitionEmpty;
+    cd.className = "Placeholder";
+    cd.getProperty = placeholder_get_property;
+    cd.setProperty = placeholder_set_property;
+    cd.finalize = placeholder_finalize;
+    s_placeholder_class = JSClassCreate(&cd);
+
 
     /* Frame */
     JSStaticFunction frame_functions[] = { 
@@ -2696,6 +3731,33 @@ create_global_object()
     s_deferred_class = JSClassCreate(&cd);
     s_constructors[CONSTRUCTOR_DEFERRED] = create_constructor(s_global_context, "Deferred", s_deferred_class, deferred_constructor_cb, NULL);
 
+    /* RequestFilter */
+    JSStaticFunction filter_functions[] = { 
+        { "allow",            request_filter_allow,         kJSDefaultAttributes },
+        { "block",            request_filter_block,         kJSDefaultAttributes },
+        { "ask",              request_filter_ask,         kJSDefaultAttributes },
+        { "remove",           request_filter_remove,         kJSDefaultAttributes },
+        { "addPattern",       request_filter_add_pattern,         kJSDefaultAttributes },
+        { "removePattern",    request_filter_remove_pattern,         kJSDefaultAttributes },
+        { "clear",            request_filter_clear,         kJSDefaultAttributes },
+        { "enable",           request_filter_enable,         kJSDefaultAttributes },
+        { "disable",          request_filter_disable,         kJSDefaultAttributes },
+        { "domains",          request_filter_domains,         kJSDefaultAttributes },
+        { "blocked",          request_filter_blocked,         kJSDefaultAttributes },
+        { 0, 0, 0 }, 
+    };
+    JSStaticValue filter_values[] = {
+        { "enabled",          request_filter_get_enabled, NULL, kJSDefaultAttributes }, 
+        { 0, 0, 0, 0 }, 
+    };
+    cd = kJSClassDefinitionEmpty;
+    cd.className = "RequestFilter"; 
+    cd.staticFunctions = filter_functions;
+    cd.staticValues = filter_values;
+    cd.finalize = request_filter_finalize;
+    s_filter_class = JSClassCreate(&cd);
+    s_constructors[CONSTRUCTOR_REQUEST_FILTER] = create_constructor(s_global_context, "RequestFilter", s_filter_class, request_filter_constructor_cb, NULL);
+
     JSStaticValue gui_values[] = {
         { "window",           gui_get_window, NULL, kJSDefaultAttributes }, 
         { "mainBox",          gui_get_main_box, NULL, kJSDefaultAttributes }, 
@@ -2814,10 +3876,21 @@ scripts_remove_tab(JSObjectRef obj)
             ScriptSignal signal = { obj, SCRIPTS_SIG_META(NULL, CLOSE_TAB, 0) };
             scripts_emit(&signal);
         }
-        JSValueUnprotect(s_global_context, obj);
+        scripts_release_tab(obj);
     }
 }/*}}}*/
 
+/* scripts_release_tab {{{
+ * Releases the object of a tab whose webview is destroyed without closing the
+ * tab
+ * */
+void 
+scripts_release_tab(JSObjectRef obj) 
+{
+    if (obj != NULL) 
+        JSValueUnprotect(s_global_context, obj);
+}/*}}}*/
+
 /* scripts_init_script {{{*/
 void
 scripts_init_script(const char *path, const char *script) 
@@ -2931,6 +4004,8 @@ scripts_end()
 {
     if (s_global_context != NULL) 
     {
+        filter_end();
+        net_end();
         for (int i=0; i<CONSTRUCTOR_LAST; i++) 
             JSValueUnprotect(s_global_context, s_constructors[i]);
         JSValueUnprotect(s_global_context, s_array_contructor);
@@ -2939,9 +4014,13 @@ scripts_end()
         JSValueUnprotect(s_global_context, s_soup_session);
         JSClassRelease(s_gobject_class);
         JSClassRelease(s_webview_class);
+        JSClassRelease(s_placeholder_class);
         JSClassRelease(s_frame_class);
         JSClassRelease(s_download_class);
         JSClassRelease(s_message_class);
+        JSClassRelease(s_json_class);
+        JSClassRelease(s_filter_class);
+        JSClassRelease(s_headers_class);
         JSGlobalContextRelease(s_global_context);
         s_global_context = NULL;
     }
@@ -48,6 +48,7 @@ enum SIGNALS {
   SCRIPTS_SIG_TAB_BUTTON_PRESS,
   SCRIPTS_SIG_CHANGE_MODE,
   SCRIPTS_SIG_EXECUTE_COMMAND,
+  SCRIPTS_SIG_HIBERNATE,
   SCRIPTS_SIG_LAST, 
 } ;
 
@@ -64,6 +65,8 @@ typedef struct _ScriptSignal {
 gboolean scripts_emit(ScriptSignal *);
 void scripts_create_tab(GList *gl);
 void scripts_remove_tab(JSObjectRef );
+void scripts_release_tab(JSObjectRef );
+void scripts_release_placeholder(Placeholder *p, JSObjectRef wv);
 void scripts_end(void);
 void scripts_init_script(const char *, const char *);
 void scripts_init(gboolean);
@@ -72,8 +75,9 @@ void scripts_unbind(JSObjectRef);
 DwbStatus scripts_eval_key(KeyMap *m, Arg *arg);
 gboolean scripts_execute_one(const char *script);
 void scripts_completion_activate(void);
+int scripts_signal_lookup(const char *name);
 
-#define EMIT_SCRIPT(sig)  ((dwb.misc.script_signals & (1<<SCRIPTS_SIG_##sig)))
+#define EMIT_SCRIPT(sig)  (((dwb.misc.script_signals | dwb.misc.control_signals) & (1<<SCRIPTS_SIG_##sig)))
 #define SCRIPTS_EMIT_RETURN(signal, json, val) G_STMT_START  \
   if (scripts_emit(&signal)) { \
     g_free(json); \
@@ -18,107 +18,242 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include <stdio.h>
+#include <unistd.h>
 #include "dwb.h"
 #include "util.h"
 #include "view.h"
 #include "session.h"
+#include "sync.h"
+
+/*
+ * Every session group is a directory in the sessions directory that is named
+ * after the escaped group name. A group has one file per tab, named after the
+ * id of the tab, and the file "tabs" that lists the tabs in order
+ *
+ *   session <version> <marked>
+ *   <id> <generation> <lock>
+ *
+ * A tab file starts with the generation of the tab followed by its
+ * back-forward list, one item per line
+ *
+ *   <position> <uri> <title>
+ *
+ * The generation of a tab is increased whenever its history changes, a tab
+ * file is only written if the tab has another generation than the one that
+ * was written last. Files are written on the sync thread by renaming a
+ * temporary file, "tabs" is replaced after the tab files so that it never
+ * lists a tab that hasn't been written. Tab files that aren't listed anymore
+ * are removed afterwards.
+ */
+#define SESSION_VERSION 1
+#define SESSION_TABS "tabs"
 
 static char *s_session_name;
 static gboolean s_has_marked = true;
+/* group the tabs have been written to */
+static char *s_saved_group;
+/* maps tab ids to the generation in s_saved_group */
+static GHashTable *s_saved;
+/* content of the tabs file in s_saved_group */
+static char *s_saved_tabs;
+/* failed writes when s_saved was last updated */
+static guint s_failures;
+static guint s_next_id = 1;
 
 typedef struct _SessionTab {
     GList *gl;
     unsigned int lock;
 } SessionTab;
 
-/* session_get_groups()                 return  char  ** (alloc){{{*/
-static char **
-session_get_groups() 
+/* session_get_group_path(const char *name)        return: char * (alloc) {{{*/
+static char *
+session_get_group_path(const char *name) 
 {
-    char **groups = NULL;
-    char *content = util_get_file_content(dwb.files[FILES_SESSION], NULL);
-    if (content) 
-    {
-        groups = g_regex_split_simple("^g:", content, G_REGEX_MULTILINE, G_REGEX_MATCH_NOTEMPTY);
-        g_free(content);
-    }
-    return groups;
+    char *escaped = g_uri_escape_string(name, NULL, true);
+    char *path;
+    /* don't let "." or ".." escape the sessions directory */
+    if (*escaped == '.') 
+        path = g_strdup_printf("%s/%%2E%s", dwb.files[FILES_SESSION], escaped + 1);
+    else 
+        path = g_build_filename(dwb.files[FILES_SESSION], escaped, NULL);
+    g_free(escaped);
+    return path;
 }/*}}}*/
 
-/* session_get_group(const char *)     return char* (alloc){{{*/
+/* session_get_tabs(const char *path, gboolean *marked)     return: char * (alloc) {{{
+ * Returns the content of the tabs file of a group or NULL if the group doesn't
+ * exist
+ * */
 static char *
-session_get_group(const char *name, gboolean *is_marked) 
+session_get_tabs(const char *path, gboolean *marked) 
 {
+    char *filename = g_build_filename(path, SESSION_TABS, NULL);
     char *content = NULL;
-    gboolean mark;
-    guint l = strlen (name);
-    const char *group = NULL;
-
-    char **groups = session_get_groups();
-    if (groups) {
-        int i=1;
-        while (groups[i]) {
-            group = groups[i];
-            mark = false;
-            if (*groups[i] == '*') 
-            {
-                group++;
-                mark = true;
-            }
-            if (strlen(group) > l+1 && !strncmp(group, name, l) && group[l] == '\n') 
+    int version = 0, mark = 0;
+
+    sync_wait();
+    if (g_file_get_contents(filename, &content, NULL, NULL) 
+            && (sscanf(content, "session %d %d", &version, &mark) != 2 || version != SESSION_VERSION)) 
+    {
+        fprintf(stderr, "Unknown session format in %s\n", filename);
+        FREE0(content);
+    }
+    if (marked != NULL)
+        *marked = mark != 0;
+    g_free(filename);
+    return content;
+}/*}}}*/
+
+/* session_commit(const char *path, const char *tabs, GHashTable *ids) {{{
+ * Replaces the tabs file and removes the tab files that aren't in ids
+ * */
+static void
+session_commit(const char *path, const char *tabs, GHashTable *ids) 
+{
+    GDir *dir;
+    const char *name;
+    char *filename, *end;
+    guint id;
+
+    filename = g_build_filename(path, SESSION_TABS, NULL);
+    sync_write(SYNC_SESSION, filename, g_string_new(tabs));
+    g_free(filename);
+
+    if ((dir = g_dir_open(path, 0, NULL)) != NULL) 
+    {
+        while ((name = g_dir_read_name(dir)) != NULL) 
+        {
+            id = strtoul(name, &end, 10);
+            if (id > 0 && *end == '\0' && !g_hash_table_contains(ids, GUINT_TO_POINTER(id))) 
             {
-                content = g_strdup(groups[i]);
-                *is_marked = mark;
+                filename = g_build_filename(path, name, NULL);
+                sync_remove(SYNC_SESSION, filename);
+                g_free(filename);
             }
-            i++;
         }
-        g_strfreev(groups);
+        g_dir_close(dir);
     }
-    return content;
 }/*}}}*/
 
-/* session_save_file (const char *group, const char *content, gboolean * mark_group) {{{*/
+/* session_set_saved(const char *name) {{{
+ * Sets the group that is tracked by s_saved
+ * */
 static void
-session_save_file(const char *groupname, const char *content, gboolean mark) 
+session_set_saved(const char *name) 
 {
-    if (groupname == NULL || content == NULL)
-        return;
+    if (s_saved == NULL)
+        s_saved = g_hash_table_new(g_direct_hash, g_direct_equal);
+    if (g_strcmp0(name, s_saved_group)) 
+    {
+        g_free(s_saved_group);
+        s_saved_group = g_strdup(name);
+        g_hash_table_remove_all(s_saved);
+        FREE0(s_saved_tabs);
+    }
+}/*}}}*/
 
-    gboolean set = false;
-    GString *buffer = g_string_new(NULL);
-    char *group = NULL;
+/* session_import_tab(const char *path, GString *tabs, guint id, GString *history, unsigned int lock) {{{*/
+static void
+session_import_tab(const char *path, GString *tabs, guint id, GString *history, unsigned int lock) 
+{
+    char *filename = g_strdup_printf("%s/%u", path, id);
+    sync_write(SYNC_SESSION, filename, history);
+    g_string_append_printf(tabs, "%u 0 %u\n", id, lock);
+    g_free(filename);
+}/*}}}*/
 
-    char **groups = session_get_groups();
-    if (groups) 
+/* session_import_group(char *group, gboolean marked) {{{
+ * Converts a group of the old session file
+ * */
+static void
+session_import_group(char *group, gboolean marked) 
+{
+    char **lines = g_strsplit(group, "\n", -1);
+    GString *tabs, *history = NULL;
+    char *path, *filename, *end;
+    int last = 1, current;
+    unsigned int lock = 0;
+    guint id = 0;
+
+    path = session_get_group_path(lines[0]);
+    g_mkdir_with_parents(path, 0700);
+    tabs = g_string_new(NULL);
+    g_string_append_printf(tabs, "session %d %d\n", SESSION_VERSION, marked);
+
+    for (int i=1; lines[i]; i++) 
     {
-        int i=1;
-        group = g_strconcat(groupname,  "\n", NULL);
-        int l = strlen(group);
-        while(groups[i]) 
+        char **line = g_strsplit(lines[i], " ", 3);
+        if (line[0] && line[1] && line[2]) 
         {
-            if (*groups[i] == '*') 
+            current = strtol(line[0], &end, 10);
+            if (current <= last) 
             {
-                if (!strncmp(groups[i]+1, group, l-1)) 
-                {
-                    g_string_append_printf(buffer, "g:%s%s\n%s", mark ? "*" : "", groupname, content);
-                    set = true;
-                }
-                else 
-                    g_string_append_printf(buffer, "g:%s", groups[i]+1);
-
+                if (history != NULL) 
+                    session_import_tab(path, tabs, ++id, history, lock);
+                history = g_string_new("0\n");
+                lock = 0;
             }
-            else if (strncmp(groups[i], group, l)) 
-                g_string_append_printf(buffer, "g:%s", groups[i]);
-            i++;
+            if (current == 0 && *end == '|') 
+                lock = strtol(end+1, NULL, 10);
+            g_string_append_printf(history, "%d %s %s\n", current, line[1], line[2]);
+            last = current;
         }
+        g_strfreev(line);
     }
-    if (!set) 
-        g_string_append_printf(buffer, "g:%s%s\n%s", mark ? "*" : "", groupname, content);
+    if (history != NULL) 
+        session_import_tab(path, tabs, ++id, history, lock);
+
+    filename = g_build_filename(path, SESSION_TABS, NULL);
+    sync_write(SYNC_SESSION, filename, tabs);
 
-    util_set_file_content(dwb.files[FILES_SESSION], buffer->str);
-    g_string_free(buffer, true);
-    g_free(group);
-    g_strfreev(groups);
+    g_free(filename);
+    g_free(path);
+    g_strfreev(lines);
+}/*}}}*/
+
+/* session_init_store() {{{
+ * Converts the old session file that kept all groups in one file
+ * */
+static void
+session_init_store() 
+{
+    static gboolean initialized;
+    char *dir, *old, *backup, *content;
+    char **groups;
+    gboolean marked;
+    guint failures;
+
+    if (initialized)
+        return;
+    initialized = true;
+
+    dir = g_path_get_dirname(dwb.files[FILES_SESSION]);
+    old = g_build_filename(dir, "session", NULL);
+    content = util_get_file_content(old, NULL);
+    if (content != NULL && *content != '\0') 
+    {
+        failures = sync_get_failures(SYNC_SESSION);
+        groups = g_regex_split_simple("^g:", content, G_REGEX_MULTILINE, G_REGEX_MATCH_NOTEMPTY);
+        for (int i=1; groups[i]; i++) 
+        {
+            marked = *groups[i] == '*';
+            session_import_group(groups[i] + marked, marked);
+        }
+        g_strfreev(groups);
+
+        /* keep the old file until the groups have been written */
+        sync_wait();
+        if (sync_get_failures(SYNC_SESSION) == failures) 
+        {
+            backup = g_strconcat(old, ".bak", NULL);
+            rename(old, backup);
+            g_free(backup);
+        }
+    }
+    g_free(content);
+    g_free(old);
+    g_free(dir);
 }/*}}}*/
 
 void
@@ -127,6 +262,7 @@ session_load_status_callback(WebKitWebView *wv, GParamSpec *p, SessionTab *tab)
     WebKitLoadStatus status = webkit_web_view_get_load_status(wv);
     switch (status) {
         case WEBKIT_LOAD_FINISHED:  VIEW(tab->gl)->status->lockprotect = tab->lock;
+                                    sync_set_dirty(SYNC_SESSION);
                                     dwb_tab_label_set_text(tab->gl, NULL);
         case WEBKIT_LOAD_FAILED:    g_signal_handlers_disconnect_by_func(wv, (GFunc)session_load_status_callback, tab);
                                     g_free(tab);
@@ -134,11 +270,68 @@ session_load_status_callback(WebKitWebView *wv, GParamSpec *p, SessionTab *tab)
         default: return;
     }
 }
+
+/* session_clear_session() {{{
+ * Removes all tabs from the current group
+ * */
 void
 session_clear_session() 
 {
-    session_save_file(s_session_name ? s_session_name : "default", "", true);
-}
+    const char *name = s_session_name ? s_session_name : "default";
+    char *path, *tabs;
+    GHashTable *ids;
+
+    session_init_store();
+    path = session_get_group_path(name);
+    g_mkdir_with_parents(path, 0700);
+    tabs = g_strdup_printf("session %d 1\n", SESSION_VERSION);
+    ids = g_hash_table_new(g_direct_hash, g_direct_equal);
+
+    session_commit(path, tabs, ids);
+    if (!g_strcmp0(name, s_saved_group)) 
+    {
+        g_hash_table_remove_all(s_saved);
+        g_free(s_saved_tabs);
+        s_saved_tabs = g_strdup(tabs);
+    }
+    g_hash_table_unref(ids);
+    g_free(tabs);
+    g_free(path);
+}/*}}}*/
+
+/* session_remove_all() {{{
+ * Removes all groups
+ * */
+void
+session_remove_all() 
+{
+    GDir *dir, *group;
+    const char *name, *file;
+    char *path, *filename;
+
+    session_init_store();
+    sync_wait();
+    if ((dir = g_dir_open(dwb.files[FILES_SESSION], 0, NULL)) == NULL)
+        return;
+    while ((name = g_dir_read_name(dir)) != NULL) 
+    {
+        path = g_build_filename(dwb.files[FILES_SESSION], name, NULL);
+        if ((group = g_dir_open(path, 0, NULL)) != NULL) 
+        {
+            while ((file = g_dir_read_name(group)) != NULL) 
+            {
+                filename = g_build_filename(path, file, NULL);
+                unlink(filename);
+                g_free(filename);
+            }
+            g_dir_close(group);
+        }
+        rmdir(path);
+        g_free(path);
+    }
+    g_dir_close(dir);
+    session_set_saved(NULL);
+}/*}}}*/
 
 /* session_load_webview(WebKitWebView *, char *, int *){{{*/
 static void
@@ -159,27 +352,130 @@ session_load_webview(GList *gl, char *uri, int last, int lock_status) \
         g_signal_connect(WEBVIEW(gl), "notify::load-status", G_CALLBACK(session_load_status_callback), tab);
     }
 }/*}}}*/
+/* session_restore_tab(GList *, const char *history, unsigned int lock) {{{
+ * Restores the history of a placeholder into its webview
+ * */
+void
+session_restore_tab(GList *gl, const char *history, unsigned int lock) 
+{
+    WebKitWebBackForwardList *bf_list = webkit_web_view_get_back_forward_list(WEBVIEW(gl));
+    char **lines = g_strsplit(history, "\n", -1);
+    int last = 0;
+
+    for (int i=0; lines[i]; i++) 
+    {
+        char **line = g_strsplit(lines[i], " ", 3);
+        if (line[0] && line[1] && line[2]) 
+        {
+            WebKitWebHistoryItem *item = webkit_web_history_item_new_with_data(line[1], line[2]);
+            webkit_web_back_forward_list_add_item(bf_list, item);
+            last = strtol(line[0], NULL, 10);
+        }
+        g_strfreev(line);
+    }
+    g_strfreev(lines);
+    session_load_webview(gl, NULL, last, lock);
+}/*}}}*/
+
+/* session_get_back_history(Placeholder *)     return: GList * (alloc) {{{
+ * Returns the navigations of a placeholder up to the current item
+ * */
+GList *
+session_get_back_history(Placeholder *p) 
+{
+    GList *store = NULL;
+    char **lines = g_strsplit(p->history, "\n", -1);
+
+    for (int i=0; lines[i]; i++) 
+    {
+        char **line = g_strsplit(lines[i], " ", 3);
+        if (line[0] && line[1] && line[2] && strtol(line[0], NULL, 10) <= 0) 
+            store = g_list_append(store, dwb_navigation_new(line[1], line[2]));
+        g_strfreev(line);
+    }
+    g_strfreev(lines);
+    return store;
+}/*}}}*/
+
+/* session_add_tab(char *history, guint id, guint generation, unsigned int lock) {{{
+ * Adds a placeholder for a tab of a group, history is owned by the
+ * placeholder
+ * */
+static void
+session_add_tab(char *history, guint id, guint generation, unsigned int lock) 
+{
+    Placeholder *p = dwb_malloc(sizeof(Placeholder));
+    GList *gl;
+
+    p->history = history;
+    p->uri = NULL;
+    p->title = NULL;
+    p->script_object = NULL;
+    for (char *line = history, *end; (end = strchr(line, '\n')) != NULL; line = end + 1) 
+    {
+        if (line[0] == '0' && line[1] == ' ') 
+        {
+            char *current = g_strndup(line, end - line);
+            char **token = g_strsplit(current, " ", 3);
+            p->uri = g_strdup(token[1]);
+            p->title = g_strdup(token[1] ? token[2] : NULL);
+            g_strfreev(token);
+            g_free(current);
+            break;
+        }
+    }
+    if (!dwb.misc.tabbed_browsing && dwb.state.views) 
+    {
+        dwb_new_window(p->uri);
+        g_free(p->history);
+        g_free(p->uri);
+        g_free(p->title);
+        g_free(p);
+        return;
+    }
+    gl = view_add_placeholder(p, lock);
+    VIEW(gl)->status->session_id = id;
+    VIEW(gl)->status->generation = generation;
+    g_hash_table_insert(s_saved, GUINT_TO_POINTER(id), GUINT_TO_POINTER(generation));
+    s_next_id = MAX(s_next_id, id + 1);
+}/*}}}*/
+
+/* session_compare_name(char **, char **) {{{*/
+static int
+session_compare_name(char **a, char **b) 
+{
+    return g_strcmp0(*a, *b);
+}/*}}}*/
 
 /* session_list {{{*/
 void
 session_list() 
 {
     char *path = util_build_path();
-    dwb.files[FILES_SESSION] = util_check_directory(g_build_filename(path, dwb.misc.profile, "session", NULL));
-    char **content = session_get_groups();
-    if (content == NULL) 
+    GDir *dir;
+    GPtrArray *names;
+    const char *name;
+
+    dwb.files[FILES_SESSION] = util_check_directory(g_build_filename(path, dwb.misc.profile, "sessions", NULL));
+    session_init_store();
+
+    names = g_ptr_array_new_with_free_func(g_free);
+    if ((dir = g_dir_open(dwb.files[FILES_SESSION], 0, NULL)) != NULL) 
     {
-        fprintf(stderr, "No sessions found for profile: %s\n", dwb.misc.profile);
-        exit(EXIT_SUCCESS);
+        while ((name = g_dir_read_name(dir)) != NULL) 
+            g_ptr_array_add(names, g_uri_unescape_string(name, NULL));
+        g_dir_close(dir);
     }
-    int i=1;
-    while (content[i]) 
+    if (names->len == 0) 
     {
-        char **group = g_strsplit(content[i], "\n", -1);
-        fprintf(stdout, "%d: %s\n", i++, group[0]);
-        g_strfreev(group);
+        fprintf(stderr, "No sessions found for profile: %s\n", dwb.misc.profile);
+        exit(EXIT_SUCCESS);
     }
-    g_strfreev(content);
+    g_ptr_array_sort(names, (GCompareFunc)session_compare_name);
+    for (guint i=0; i<names->len; i++) 
+        fprintf(stdout, "%d: %s\n", i+1, (char*)names->pdata[i]);
+
+    g_ptr_array_free(names, true);
     g_free(path);
 
     exit(EXIT_SUCCESS);
@@ -190,19 +486,21 @@ gboolean
 session_restore(char *name, int flags) 
 {
     gboolean is_marked = false;
-    char *uri = NULL;
-    GList *currentview = NULL, *lastview = NULL;
-    WebKitWebBackForwardList *bf_list = NULL;
-    int last = 1;
-    char *end;
+    GList *last_tab;
+    char *path, *tabs, *filename, *content, *history, *end;
+    char **lines;
+    guint id, generation;
+    unsigned int lock;
     gboolean ret = false;
-    int locked_state = 0;
+
     if (name == NULL) 
         s_session_name = g_strdup("default");
     else 
         s_session_name = name;
 
-    char *group = session_get_group(s_session_name, &is_marked);
+    session_init_store();
+    path = session_get_group_path(s_session_name);
+    tabs = session_get_tabs(path, &is_marked);
     if (is_marked && (flags & SESSION_FORCE) == 0) 
     {
         fprintf(stderr, "Warning: Session '%s' will not be restored.\n", s_session_name);
@@ -211,49 +509,39 @@ session_restore(char *name, int flags)
         s_has_marked = false;
         goto clean;
     }
-    if (group == NULL) 
-        return false;
+    if (tabs == NULL) 
+        goto clean;
 
-    char *group_begin = strchr(group, '\n');
-    session_save_file(s_session_name, group_begin+1, true);
+    /* mark the group */
+    end = strchr(tabs, '\n');
+    content = g_strdup_printf("session %d 1\n%s", SESSION_VERSION, end ? end + 1 : "");
+    filename = g_build_filename(path, SESSION_TABS, NULL);
+    session_set_saved(s_session_name);
+    g_free(s_saved_tabs);
+    s_saved_tabs = content;
+    sync_write(SYNC_SESSION, filename, g_string_new(content));
+    g_free(filename);
     if (flags & SESSION_ONLY_MARK) 
         goto clean;
 
-    char  **lines = g_strsplit(group, "\n", -1);
-    int length = g_strv_length(lines) - 1;
-    for (int i=1; i<=length; i++) 
+    /* Tabs are only restored as placeholders, the webview of a tab is created
+     * when it is needed */
+    session_set_saved(s_session_name);
+    lines = g_strsplit(tabs, "\n", -1);
+    for (int i=1; lines[i]; i++) 
     {
-        char **line = g_strsplit(lines[i], " ", 4);
-        if (line[0] && line[1] && line[2]) 
-        {
-            int current = strtol(line[0], &end, 10);
+        if (sscanf(lines[i], "%u %u %u", &id, &generation, &lock) != 3 || id == 0)
+            continue;
 
-            if (current <= last) 
-            {
-                currentview = view_add(NULL, false);
-                bf_list = webkit_web_view_get_back_forward_list(WEBVIEW(currentview));
-                if (lastview) 
-                {
-                    session_load_webview(lastview, uri, last, locked_state);
-                    locked_state = 0;
-                }
-                lastview = currentview;
-            }
-            if (current == 0 && *end == '|') 
-                locked_state = strtol(end+1, NULL, 10);
-            if (bf_list != NULL) 
-            {
-                WebKitWebHistoryItem *item = webkit_web_history_item_new_with_data(line[1], line[2]);
-                webkit_web_back_forward_list_add_item(bf_list, item);
-            }
-            last = current;
-            g_free(uri);
-            uri = g_strdup(line[1]);
+        filename = g_strdup_printf("%s/%u", path, id);
+        if (g_file_get_contents(filename, &content, NULL, NULL)) 
+        {
+            /* the first line is the generation */
+            if ((history = strchr(content, '\n')) != NULL) 
+                session_add_tab(g_strdup(history + 1), id, generation, lock);
+            g_free(content);
         }
-        if (i == length && lastview)
-            session_load_webview(lastview, uri, last, locked_state);
-
-        g_strfreev(line);
+        g_free(filename);
     }
     g_strfreev(lines);
 
@@ -262,19 +550,95 @@ session_restore(char *name, int flags)
         view_add(NULL, false);
         dwb_open_startpage(dwb.state.fview);
     }
-    dwb_focus(dwb.state.fview);
-    g_free(uri);
+    else if (dwb.state.fview == NULL) 
+    {
+        last_tab = g_list_last(dwb.state.views);
+        gtk_widget_show(VIEW(last_tab)->scroll);
+        dwb_focus(last_tab);
+    }
+    else 
+        dwb_focus_view(g_list_last(dwb.state.views), "new_tab");
     ret = true;
 
 clean:
-    g_free(group);
+    g_free(tabs);
+    g_free(path);
     return ret;
 }/*}}}*/
 
-/* session_save(const char *) {{{*/
+/* session_append_history(GString *, GList *) {{{
+ * Appends the back-forward list of a tab
+ * */
+static void
+session_append_history(GString *buffer, GList *gl) 
+{
+    WebKitWebBackForwardList *bf_list = webkit_web_view_get_back_forward_list(WEBVIEW(gl));
+    for (int i= -webkit_web_back_forward_list_get_back_length(bf_list); i<=webkit_web_back_forward_list_get_forward_length(bf_list); i++) 
+    {
+        WebKitWebHistoryItem *item = webkit_web_back_forward_list_get_nth_item(bf_list, i);
+        if (item) 
+        {
+            g_string_append_printf(buffer, "%d %s %s\n", i,
+                    webkit_web_history_item_get_uri(item), webkit_web_history_item_get_title(item));
+        }
+    }
+}/*}}}*/
+
+/* session_get_history(GList *)      return: char * (alloc) {{{
+ * Returns the back-forward list of a tab in the format of a placeholder
+ * */
+char *
+session_get_history(GList *gl) 
+{
+    GString *buffer = g_string_new(NULL);
+    session_append_history(buffer, gl);
+    return g_string_free(buffer, false);
+}/*}}}*/
+
+/* session_write_tab(const char *path, GList *gl) {{{*/
+static void
+session_write_tab(const char *path, GList *gl) 
+{
+    ViewStatus *status = VIEW(gl)->status;
+    GString *buffer = g_string_new(NULL);
+    char *filename;
+
+    g_string_append_printf(buffer, "%u\n", status->generation);
+    if (status->placeholder != NULL) 
+        g_string_append(buffer, status->placeholder->history);
+    else if (status->deferred) 
+    {
+        if (status->deferred_uri != NULL)
+            g_string_append_printf(buffer, "0 %s unknown\n", status->deferred_uri);
+    }
+    else 
+        session_append_history(buffer, gl);
+
+    filename = g_strdup_printf("%s/%u", path, status->session_id);
+    sync_write(SYNC_SESSION, filename, buffer);
+    g_free(filename);
+}/*}}}*/
+
+/* session_is_removed(gpointer id, gpointer generation, GHashTable *ids) {{{*/
+static gboolean
+session_is_removed(gpointer id, gpointer generation, GHashTable *ids) 
+{
+    return !g_hash_table_contains(ids, id);
+}/*}}}*/
+
+/* session_save(const char *) {{{
+ * Writes the tabs that have changed since they were written to the group
+ * */
 gboolean  
 session_save(const char *name, int flags) 
 {
+    ViewStatus *status;
+    GString *tabs;
+    GHashTable *ids;
+    gpointer generation;
+    guint failures;
+    char *path;
+
     if (!name) 
     {
         if (s_session_name) 
@@ -284,36 +648,53 @@ session_save(const char *name, int flags)
     }
     if (!s_has_marked && (flags & SESSION_FORCE) == 0) 
         return false;
-    GString *buffer = g_string_new(NULL);
+    if (name == NULL)
+        return false;
+
+    session_init_store();
+    path = session_get_group_path(name);
+    g_mkdir_with_parents(path, 0700);
+    session_set_saved(name);
+    /* after a failed write the state of the group is unknown */
+    if ((failures = sync_get_failures(SYNC_SESSION)) != s_failures) 
+    {
+        s_failures = failures;
+        g_hash_table_remove_all(s_saved);
+        FREE0(s_saved_tabs);
+    }
+
+    tabs = g_string_new(NULL);
+    g_string_append_printf(tabs, "session %d %d\n", SESSION_VERSION, (flags & SESSION_SYNC) != 0);
+    ids = g_hash_table_new(g_direct_hash, g_direct_equal);
 
     for (GList *l = g_list_first(dwb.state.views); l; l=l->next) 
     {
-        WebKitWebView *web = WEBVIEW(l);
-        WebKitWebBackForwardList *bf_list = webkit_web_view_get_back_forward_list(web);
-        if (VIEW(l)->status->deferred) 
-        {
-            g_string_append_printf(buffer, "0|%d %s unknown\n", VIEW(l)->status->lockprotect, VIEW(l)->status->deferred_uri);
-            continue;
-        }
-        for (int i= -webkit_web_back_forward_list_get_back_length(bf_list); i<=webkit_web_back_forward_list_get_forward_length(bf_list); i++) 
-        {
-            WebKitWebHistoryItem *item = webkit_web_back_forward_list_get_nth_item(bf_list, i);
-            if (item) 
-            {
-                g_string_append_printf(buffer, "%d", i);
-                if (i == 0) 
-                    g_string_append_printf(buffer, "|%d", VIEW(l)->status->lockprotect);
+        status = VIEW(l)->status;
+        if (status->session_id == 0) 
+            status->session_id = s_next_id++;
+        g_hash_table_insert(ids, GUINT_TO_POINTER(status->session_id), NULL);
 
-                g_string_append_printf(buffer, " %s %s\n", 
-                        webkit_web_history_item_get_uri(item), webkit_web_history_item_get_title(item));
-            }
+        if (!g_hash_table_lookup_extended(s_saved, GUINT_TO_POINTER(status->session_id), NULL, &generation) 
+                || GPOINTER_TO_UINT(generation) != status->generation) 
+        {
+            session_write_tab(path, l);
+            g_hash_table_insert(s_saved, GUINT_TO_POINTER(status->session_id), GUINT_TO_POINTER(status->generation));
         }
+        g_string_append_printf(tabs, "%u %u %u\n", status->session_id, status->generation, status->lockprotect);
+    }
+    if (g_strcmp0(tabs->str, s_saved_tabs)) 
+    {
+        session_commit(path, tabs->str, ids);
+        g_free(s_saved_tabs);
+        s_saved_tabs = g_strdup(tabs->str);
+        g_hash_table_foreach_remove(s_saved, (GHRFunc)session_is_removed, ids);
     }
-    session_save_file(name, buffer->str, (flags & SESSION_SYNC) != 0);
 
     if (! (flags & SESSION_SYNC))
         g_free(s_session_name);
 
-    g_string_free(buffer, true);
+    g_hash_table_unref(ids);
+    g_string_free(tabs, true);
+    g_free(path);
     return true;
 }/*}}}*/
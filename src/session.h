@@ -29,5 +29,9 @@ gboolean session_save(const char *, int);
 gboolean session_restore(char *, int);
 void session_list(void);
 void session_clear_session(void);
+void session_remove_all(void);
+void session_restore_tab(GList *gl, const char *history, unsigned int lock);
+GList * session_get_back_history(Placeholder *p);
+char * session_get_history(GList *gl);
 
 #endif
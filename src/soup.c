@@ -16,12 +16,11 @@
  * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
  */
 
-#include <fcntl.h>
-#include <sys/file.h>
 #include "dwb.h"
 #include "util.h"
 #include "domain.h"
 #include "soup.h"
+#include "cookiejar.h"
 static SoupCookieJar *s_jar;
 static guint s_changed_id;
 static SoupCookieJar *s_tmp_jar;
@@ -205,17 +204,9 @@ dwb_soup_get_host_from_request(WebKitNetworkRequest *request)
 void 
 dwb_soup_save_cookies(GSList *cookies) 
 {
-    int fd = open(dwb.files[FILES_COOKIES], 0);
-    SoupCookieJar *jar;
-
-    flock(fd, LOCK_EX);
-    jar = soup_cookie_jar_text_new(dwb.files[FILES_COOKIES], false);
     for (GSList *l=cookies; l; l=l->next) 
-        soup_cookie_jar_add_cookie(jar, soup_cookie_copy(l->data));
-    g_object_unref(jar);
-
-    flock(fd, LOCK_UN);
-    close(fd);
+        soup_cookie_jar_add_cookie(s_pers_jar, soup_cookie_copy(l->data));
+    dwb_cookie_jar_flush(s_pers_jar);
 }/*}}}*/
 
 /* dwb_test_cookie_allowed(const char *)     return:  gboolean{{{*/
@@ -309,29 +300,29 @@ dwb_soup_cookie_changed_cb(SoupCookieJar *jar, SoupCookie *old, SoupCookie *new,
     }
 }/*}}}*/
 
+/* dwb_soup_sync_cookies() {{{
+ * Writes the changes of persistent cookies to the journal
+ * */
 void
 dwb_soup_sync_cookies() 
 {
-    int fd = open(dwb.files[FILES_COOKIES], 0);
-    flock(fd, LOCK_EX);
-
-    GSList *all_cookies = soup_cookie_jar_all_cookies(s_pers_jar);
-    SoupCookieJar *j = soup_cookie_jar_text_new(dwb.files[FILES_COOKIES], false);
-    for (GSList *l = all_cookies; l; l=l->next) 
-        soup_cookie_jar_add_cookie(j, l->data);
-
-    g_slist_free(all_cookies);
-    g_object_unref(j);
+    dwb_cookie_jar_flush(s_pers_jar);
+}/*}}}*/
 
-    flock(fd, LOCK_UN);
-    close(fd);
-}
+/* dwb_soup_remove_cookies() {{{
+ * Removes the cookies file
+ * */
+void
+dwb_soup_remove_cookies() 
+{
+    dwb_cookie_jar_remove_files(s_pers_jar);
+}/*}}}*/
 
 void 
 dwb_soup_clear_cookies() 
 {
     dwb_soup_clear_jar(s_tmp_jar);
-    dwb_soup_clear_jar(s_pers_jar);
+    dwb_cookie_jar_clear(s_pers_jar);
     dwb_soup_clear_jar(s_jar);
 }
 
@@ -341,18 +332,15 @@ dwb_soup_init_cookies(SoupSession *s)
 {
     s_jar = soup_cookie_jar_new(); 
     s_tmp_jar = soup_cookie_jar_new();
-    //s_pers_jar = soup_cookie_jar_new();
-    s_pers_jar = soup_cookie_jar_new();
+    s_pers_jar = dwb_cookie_jar_new(dwb.files[FILES_COOKIES]);
 
     dwb_soup_set_cookie_accept_policy(GET_CHAR("cookies-accept-policy"));
-    SoupCookieJar *old_cookies = soup_cookie_jar_text_new(dwb.files[FILES_COOKIES], true);
-
-    GSList *l = soup_cookie_jar_all_cookies(old_cookies);
-    for (; l; l=l->next ) 
-        soup_cookie_jar_add_cookie(s_jar, soup_cookie_copy(l->data)); 
 
-    soup_cookies_free(l);
-    g_object_unref(old_cookies);
+    /* soup_cookie_jar_add_cookie steals the copies */
+    GSList *cookies = soup_cookie_jar_all_cookies(s_pers_jar);
+    for (GSList *l = cookies; l; l=l->next ) 
+        soup_cookie_jar_add_cookie(s_jar, l->data); 
+    g_slist_free(cookies);
 
     soup_session_add_feature(s, SOUP_SESSION_FEATURE(s_jar));
     s_changed_id = g_signal_connect(s_jar, "changed", G_CALLBACK(dwb_soup_cookie_changed_cb), NULL);
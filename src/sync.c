@@ -0,0 +1,292 @@
+/*
+ * Copyright (c) 2010-2013 Stefan Bolte <portix@gmx.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <stdio.h>
+#include <errno.h>
+#include <unistd.h>
+#include "dwb.h"
+#include "sync.h"
+
+/*
+ * Stores are written on a single sync thread in the order the writes were
+ * queued. The caller passes an immutable snapshot of the store, the main
+ * thread never waits for the disk except in sync_wait.
+ *
+ * Every store has a dirty flag that is set when the store changes and cleared
+ * when it is queued for writing, a store that failed to be written is marked
+ * dirty again.
+ */
+#define SYNC_STORES 5
+
+typedef struct _SyncJob {
+    int store;
+    SyncFunc func;
+    gpointer data;
+    GDestroyNotify notify;
+} SyncJob;
+
+typedef struct _SyncWrite {
+    char *filename;
+    GString *content;
+} SyncWrite;
+
+typedef struct _SyncStats {
+    guint syncs;
+    guint skipped;
+    guint failures;
+    guint64 bytes;
+    /* microseconds */
+    gint64 time;
+} SyncStats;
+
+static const char *s_names[SYNC_STORES] = { "history", "cookies", "session", "bookmarks", "quickmarks" };
+static GThreadPool *s_pool;
+/* protects s_pending and s_stats */
+static GMutex s_mutex;
+static GCond s_cond;
+static guint s_pending;
+static SyncStats s_stats[SYNC_STORES];
+static volatile guint s_dirty;
+
+/* sync_index(int store) {{{*/
+static int
+sync_index(int store) 
+{
+    int index = g_bit_nth_lsf(store, -1);
+    g_return_val_if_fail(index >= 0 && index < SYNC_STORES, 0);
+    return index;
+}/*}}}*/
+
+/* sync_set_dirty(int stores) {{{
+ * Marks stores as changed, stores is a combination of SYNC_* flags
+ * */
+void 
+sync_set_dirty(int stores) 
+{
+    g_atomic_int_or(&s_dirty, stores);
+}/*}}}*/
+
+/* sync_clear_dirty(int store) {{{
+ * Returns whether a store has changed since it was last cleared and clears
+ * the flag
+ * */
+gboolean 
+sync_clear_dirty(int store) 
+{
+    gboolean dirty = (g_atomic_int_and(&s_dirty, ~store) & store) != 0;
+    if (!dirty) 
+    {
+        g_mutex_lock(&s_mutex);
+        s_stats[sync_index(store)].skipped++;
+        g_mutex_unlock(&s_mutex);
+    }
+    return dirty;
+}/*}}}*/
+
+/* sync_account(int store, gssize bytes, gint64 time) {{{
+ * Records a write of a store that took time microseconds, bytes is -1 if the
+ * write failed
+ * */
+static void 
+sync_account(int store, gssize bytes, gint64 time) 
+{
+    SyncStats *stats = &s_stats[sync_index(store)];
+
+    g_mutex_lock(&s_mutex);
+    if (bytes < 0) 
+        stats->failures++;
+    else 
+    {
+        stats->syncs++;
+        stats->bytes += bytes;
+    }
+    stats->time += time;
+    g_mutex_unlock(&s_mutex);
+}/*}}}*/
+
+/* sync_job_run(SyncJob *) {{{
+ * Runs on the sync thread
+ * */
+static void
+sync_job_run(SyncJob *job) 
+{
+    gint64 start = g_get_monotonic_time();
+    gssize bytes = job->func(job->data);
+
+    sync_account(job->store, bytes, g_get_monotonic_time() - start);
+    if (bytes < 0)
+        sync_set_dirty(job->store);
+    if (job->notify != NULL)
+        job->notify(job->data);
+    g_free(job);
+
+    g_mutex_lock(&s_mutex);
+    s_pending--;
+    g_cond_broadcast(&s_cond);
+    g_mutex_unlock(&s_mutex);
+}/*}}}*/
+
+/* sync_run(int store, SyncFunc, gpointer data, GDestroyNotify) {{{
+ * Queues a write of a store, data must not be changed until notify is called
+ * on the sync thread
+ * */
+void 
+sync_run(int store, SyncFunc func, gpointer data, GDestroyNotify notify) 
+{
+    g_return_if_fail(func != NULL);
+
+    SyncJob *job = dwb_malloc(sizeof(SyncJob));
+    job->store = store;
+    job->func = func;
+    job->data = data;
+    job->notify = notify;
+
+    if (s_pool == NULL)
+        s_pool = g_thread_pool_new((GFunc)sync_job_run, NULL, 1, false, NULL);
+
+    g_mutex_lock(&s_mutex);
+    s_pending++;
+    g_mutex_unlock(&s_mutex);
+
+    g_thread_pool_push(s_pool, job, NULL);
+}/*}}}*/
+
+/* sync_write_free(SyncWrite *) {{{*/
+static void
+sync_write_free(SyncWrite *w) 
+{
+    g_free(w->filename);
+    if (w->content != NULL)
+        g_string_free(w->content, true);
+    g_free(w);
+}/*}}}*/
+
+/* sync_write_run(SyncWrite *) {{{*/
+static gssize
+sync_write_run(SyncWrite *w) 
+{
+    GError *error = NULL;
+
+    if (!g_file_set_contents(w->filename, w->content->str, w->content->len, &error)) 
+    {
+        fprintf(stderr, "Cannot write %s: %s\n", w->filename, error->message);
+        g_clear_error(&error);
+        return -1;
+    }
+    return w->content->len;
+}/*}}}*/
+
+/* sync_write(int store, const char *filename, GString *content) {{{
+ * Replaces a file atomically, takes ownership of content
+ * */
+void 
+sync_write(int store, const char *filename, GString *content) 
+{
+    g_return_if_fail(filename != NULL);
+    g_return_if_fail(content != NULL);
+
+    SyncWrite *w = dwb_malloc(sizeof(SyncWrite));
+    w->filename = g_strdup(filename);
+    w->content = content;
+    sync_run(store, (SyncFunc)sync_write_run, w, (GDestroyNotify)sync_write_free);
+}/*}}}*/
+
+/* sync_remove_run(SyncWrite *) {{{*/
+static gssize
+sync_remove_run(SyncWrite *w) 
+{
+    if (unlink(w->filename) != 0 && errno != ENOENT) 
+    {
+        perror(w->filename);
+        return -1;
+    }
+    return 0;
+}/*}}}*/
+
+/* sync_remove(int store, const char *filename) {{{
+ * Removes a file after the writes that have already been queued
+ * */
+void 
+sync_remove(int store, const char *filename) 
+{
+    g_return_if_fail(filename != NULL);
+
+    SyncWrite *w = dwb_malloc(sizeof(SyncWrite));
+    w->filename = g_strdup(filename);
+    w->content = NULL;
+    sync_run(store, (SyncFunc)sync_remove_run, w, (GDestroyNotify)sync_write_free);
+}/*}}}*/
+
+/* sync_get_failures(int store) {{{
+ * Returns the number of failed writes of a store
+ * */
+guint 
+sync_get_failures(int store) 
+{
+    guint failures;
+
+    g_mutex_lock(&s_mutex);
+    failures = s_stats[sync_index(store)].failures;
+    g_mutex_unlock(&s_mutex);
+    return failures;
+}/*}}}*/
+
+/* sync_get_stats()     return: char * (alloc) {{{
+ * Returns the number of writes, the bytes written and the time spent writing
+ * of every store
+ * */
+char * 
+sync_get_stats() 
+{
+    GString *buffer = g_string_new(NULL);
+    SyncStats *stats;
+
+    g_mutex_lock(&s_mutex);
+    for (int i=0; i<SYNC_STORES; i++) 
+    {
+        stats = &s_stats[i];
+        g_string_append_printf(buffer, "%s%s: %u written (%u skipped, %u failed), %"G_GUINT64_FORMAT" bytes, %.1f ms", 
+                i > 0 ? "; " : "", s_names[i], stats->syncs, stats->skipped, stats->failures, stats->bytes, stats->time / 1000.0);
+    }
+    g_mutex_unlock(&s_mutex);
+    return g_string_free(buffer, false);
+}/*}}}*/
+
+/* sync_wait() {{{
+ * Waits until all queued writes have finished
+ * */
+void 
+sync_wait() 
+{
+    g_mutex_lock(&s_mutex);
+    while (s_pending > 0)
+        g_cond_wait(&s_cond, &s_mutex);
+    g_mutex_unlock(&s_mutex);
+}/*}}}*/
+
+/* sync_end() {{{*/
+void 
+sync_end() 
+{
+    sync_wait();
+    if (s_pool != NULL) 
+    {
+        g_thread_pool_free(s_pool, false, true);
+        s_pool = NULL;
+    }
+}/*}}}*/
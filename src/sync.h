@@ -0,0 +1,36 @@
+/*
+ * Copyright (c) 2010-2013 Stefan Bolte <portix@gmx.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef SYNC_H
+#define SYNC_H
+
+/* Writes a store, called on the sync thread. Returns the number of bytes that
+ * have been written or -1 if writing failed. */
+typedef gssize (*SyncFunc)(gpointer data);
+
+void sync_set_dirty(int stores);
+gboolean sync_clear_dirty(int store);
+void sync_run(int store, SyncFunc func, gpointer data, GDestroyNotify notify);
+void sync_write(int store, const char *filename, GString *content);
+void sync_remove(int store, const char *filename);
+guint sync_get_failures(int store);
+char * sync_get_stats(void);
+void sync_wait(void);
+void sync_end(void);
+
+#endif
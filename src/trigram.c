@@ -0,0 +1,338 @@
+/*
+ * Copyright (c) 2010-2013 Stefan Bolte <portix@gmx.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <string.h>
+#include "dwb.h"
+#include "util.h"
+#include "trigram.h"
+
+/*
+ * Index of the lowercased trigrams of uri and title of navigations. Every
+ * navigation gets a new document id when it is added, the posting list of a
+ * trigram is the ascending list of document ids that contain it. Removed
+ * documents are only marked dead, the index is rebuilt when there are more
+ * dead than live documents.
+ *
+ * Trigrams only preselect candidates, every candidate is checked with
+ * util_strcasestr like the plain completion does. The result of the last query
+ * is kept, if the next query only extends it the last result is filtered
+ * instead of querying the index.
+ */
+#define TRIGRAM_REBUILD_MIN 1024
+
+#define TRIGRAM(a, b, c) GUINT_TO_POINTER(((guint)(guchar)g_ascii_tolower(a) << 16) \
+        | ((guint)(guchar)g_ascii_tolower(b) << 8) | (guint)(guchar)g_ascii_tolower(c))
+
+struct _TrigramIndex {
+    /* maps document ids to navigations, NULL for removed documents */
+    GPtrArray *docs;
+    /* maps navigations to document ids + 1 */
+    GHashTable *ids;
+    /* maps trigrams to GArray of document ids */
+    GHashTable *postings;
+    guint removed;
+    char *query;
+    GPtrArray *matches;
+};
+
+/* trigram_posting_free(GArray *) {{{*/
+static void
+trigram_posting_free(GArray *posting)
+{
+    g_array_free(posting, true);
+}/*}}}*/
+
+/* trigram_index_new() {{{*/
+TrigramIndex *
+trigram_index_new()
+{
+    TrigramIndex *index = dwb_malloc(sizeof(TrigramIndex));
+    index->docs = g_ptr_array_new();
+    index->ids = g_hash_table_new(g_direct_hash, g_direct_equal);
+    index->postings = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, (GDestroyNotify)trigram_posting_free);
+    index->removed = 0;
+    index->query = NULL;
+    index->matches = g_ptr_array_new();
+    return index;
+}/*}}}*/
+
+/* trigram_index_invalidate(TrigramIndex *) {{{
+ * Drops the last result, navigations in it may have been freed
+ * */
+static void
+trigram_index_invalidate(TrigramIndex *index)
+{
+    FREE0(index->query);
+    g_ptr_array_set_size(index->matches, 0);
+}/*}}}*/
+
+/* trigram_index_clear(TrigramIndex *) {{{*/
+void
+trigram_index_clear(TrigramIndex *index)
+{
+    g_return_if_fail(index != NULL);
+
+    g_ptr_array_set_size(index->docs, 0);
+    g_hash_table_remove_all(index->ids);
+    g_hash_table_remove_all(index->postings);
+    index->removed = 0;
+    trigram_index_invalidate(index);
+}/*}}}*/
+
+/* trigram_index_free(TrigramIndex *) {{{*/
+void
+trigram_index_free(TrigramIndex *index)
+{
+    if (index == NULL)
+        return;
+
+    g_ptr_array_free(index->docs, true);
+    g_hash_table_unref(index->ids);
+    g_hash_table_unref(index->postings);
+    g_free(index->query);
+    g_ptr_array_free(index->matches, true);
+    g_free(index);
+}/*}}}*/
+
+/* trigram_index_add_text(TrigramIndex *, guint id, const char *text) {{{*/
+static void
+trigram_index_add_text(TrigramIndex *index, guint id, const char *text)
+{
+    GArray *posting;
+    gpointer trigram;
+
+    if (text == NULL)
+        return;
+
+    for (; text[0] && text[1] && text[2]; text++)
+    {
+        trigram = TRIGRAM(text[0], text[1], text[2]);
+        posting = g_hash_table_lookup(index->postings, trigram);
+        if (posting == NULL)
+        {
+            posting = g_array_sized_new(false, false, sizeof(guint), 4);
+            g_hash_table_insert(index->postings, trigram, posting);
+        }
+        else if (g_array_index(posting, guint, posting->len - 1) == id)
+            continue;
+        g_array_append_val(posting, id);
+    }
+}/*}}}*/
+
+/* trigram_index_rebuild(TrigramIndex *) {{{*/
+static void
+trigram_index_rebuild(TrigramIndex *index)
+{
+    GPtrArray *docs = index->docs;
+
+    index->docs = g_ptr_array_sized_new(docs->len - index->removed);
+    trigram_index_clear(index);
+    for (guint i=0; i<docs->len; i++)
+    {
+        if (docs->pdata[i] != NULL)
+            trigram_index_add(index, docs->pdata[i]);
+    }
+    g_ptr_array_free(docs, true);
+}/*}}}*/
+
+/* trigram_index_remove(TrigramIndex *, Navigation *) {{{*/
+void
+trigram_index_remove(TrigramIndex *index, Navigation *n)
+{
+    g_return_if_fail(index != NULL);
+
+    guint id = GPOINTER_TO_UINT(g_hash_table_lookup(index->ids, n));
+    if (id == 0)
+        return;
+
+    index->docs->pdata[id - 1] = NULL;
+    g_hash_table_remove(index->ids, n);
+    index->removed++;
+    trigram_index_invalidate(index);
+
+    if (index->removed > TRIGRAM_REBUILD_MIN && index->removed > index->docs->len / 2)
+        trigram_index_rebuild(index);
+}/*}}}*/
+
+/* trigram_index_add(TrigramIndex *, Navigation *) {{{
+ * Adds a navigation or reindexes it if it is already indexed
+ * */
+void
+trigram_index_add(TrigramIndex *index, Navigation *n)
+{
+    g_return_if_fail(index != NULL);
+    g_return_if_fail(n != NULL);
+
+    guint id;
+
+    trigram_index_remove(index, n);
+    trigram_index_invalidate(index);
+
+    id = index->docs->len;
+    g_ptr_array_add(index->docs, n);
+    g_hash_table_insert(index->ids, n, GUINT_TO_POINTER(id + 1));
+
+    trigram_index_add_text(index, id, n->first);
+    trigram_index_add_text(index, id, n->second);
+}/*}}}*/
+
+/* trigram_index_matches(Navigation *, char **token) {{{*/
+static gboolean
+trigram_index_matches(Navigation *n, char **token)
+{
+    for (int i=0; token[i] != NULL; i++)
+    {
+        if (*token[i] == '\0')
+            continue;
+        if (!util_strcasestr(n->first, token[i]) && (n->second == NULL || !util_strcasestr(n->second, token[i])))
+            return false;
+    }
+    return true;
+}/*}}}*/
+
+/* trigram_compare_length(GArray **, GArray **) {{{*/
+static int
+trigram_compare_length(GArray **a, GArray **b)
+{
+    return (int)(*a)->len - (int)(*b)->len;
+}/*}}}*/
+
+/* trigram_intersect(GArray *candidates, GArray *posting) {{{
+ * Intersects candidates in place with a posting list, both are sorted
+ * */
+static void
+trigram_intersect(GArray *candidates, GArray *posting)
+{
+    guint i = 0, j = 0, k = 0, a, b;
+
+    while (i < candidates->len && j < posting->len)
+    {
+        a = g_array_index(candidates, guint, i);
+        b = g_array_index(posting, guint, j);
+        if (a < b)
+            i++;
+        else if (a > b)
+            j++;
+        else
+        {
+            g_array_index(candidates, guint, k++) = a;
+            i++; j++;
+        }
+    }
+    g_array_set_size(candidates, k);
+}/*}}}*/
+
+/* trigram_index_query(TrigramIndex *, char **token) {{{
+ * Matches all documents, newest first
+ * */
+static void
+trigram_index_query(TrigramIndex *index, char **token)
+{
+    GPtrArray *postings = g_ptr_array_new();
+    GArray *posting, *candidates = NULL;
+    Navigation *n;
+    const char *t;
+    gboolean empty = false;
+
+    for (int i=0; token[i] != NULL && !empty; i++)
+    {
+        for (t = token[i]; t[0] && t[1] && t[2]; t++)
+        {
+            posting = g_hash_table_lookup(index->postings, TRIGRAM(t[0], t[1], t[2]));
+            if (posting == NULL)
+            {
+                empty = true;
+                break;
+            }
+            g_ptr_array_add(postings, posting);
+        }
+    }
+    g_ptr_array_set_size(index->matches, 0);
+    if (empty)
+        goto clean;
+
+    if (postings->len > 0)
+    {
+        g_ptr_array_sort(postings, (GCompareFunc)trigram_compare_length);
+        posting = postings->pdata[0];
+        candidates = g_array_sized_new(false, false, sizeof(guint), posting->len);
+        g_array_append_vals(candidates, posting->data, posting->len);
+        for (guint i=1; i<postings->len && candidates->len > 0; i++)
+            trigram_intersect(candidates, postings->pdata[i]);
+
+        for (int i=candidates->len-1; i>=0; i--)
+        {
+            n = index->docs->pdata[g_array_index(candidates, guint, i)];
+            if (n != NULL && trigram_index_matches(n, token))
+                g_ptr_array_add(index->matches, n);
+        }
+        g_array_free(candidates, true);
+    }
+    else
+    {
+        for (int i=index->docs->len-1; i>=0; i--)
+        {
+            n = index->docs->pdata[i];
+            if (n != NULL && trigram_index_matches(n, token))
+                g_ptr_array_add(index->matches, n);
+        }
+    }
+clean:
+    g_ptr_array_free(postings, true);
+}/*}}}*/
+
+/* trigram_index_match(TrigramIndex *, const char *query) {{{
+ * Returns all navigations that contain every space separated token of query
+ * in their uri or title, newest first. The array is owned by the index and
+ * valid until the index is changed or queried again.
+ * */
+GPtrArray *
+trigram_index_match(TrigramIndex *index, const char *query)
+{
+    g_return_val_if_fail(index != NULL, NULL);
+
+    char **token;
+    guint k = 0;
+    Navigation *n;
+
+    if (query == NULL)
+        query = "";
+    token = g_strsplit(query, " ", -1);
+
+    if (index->query != NULL && g_str_has_prefix(query, index->query))
+    {
+        if (strcmp(query, index->query))
+        {
+            /* the query only grew, every match is one of the last matches */
+            for (guint i=0; i<index->matches->len; i++)
+            {
+                n = index->matches->pdata[i];
+                if (trigram_index_matches(n, token))
+                    index->matches->pdata[k++] = n;
+            }
+            g_ptr_array_set_size(index->matches, k);
+        }
+    }
+    else
+        trigram_index_query(index, token);
+
+    g_free(index->query);
+    index->query = g_strdup(query);
+    g_strfreev(token);
+    return index->matches;
+}/*}}}*/
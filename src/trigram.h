@@ -0,0 +1,29 @@
+/*
+ * Copyright (c) 2010-2013 Stefan Bolte <portix@gmx.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef TRIGRAM_H
+#define TRIGRAM_H
+
+TrigramIndex * trigram_index_new(void);
+void trigram_index_free(TrigramIndex *index);
+void trigram_index_add(TrigramIndex *index, Navigation *n);
+void trigram_index_remove(TrigramIndex *index, Navigation *n);
+void trigram_index_clear(TrigramIndex *index);
+GPtrArray * trigram_index_match(TrigramIndex *index, const char *query);
+
+#endif
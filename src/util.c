@@ -773,9 +773,14 @@ util_create_json(int n, ...) {
         else {
           g_string_append_c(string, '"');
           while (*cval) {
-            if (*cval == '"') 
+            if (*cval == '"' || *cval == '\\') {
               g_string_append_c(string, '\\');
-            g_string_append_c(string, *cval);
+              g_string_append_c(string, *cval);
+            }
+            else if ((guchar)*cval < 0x20) 
+              g_string_append_printf(string, "\\u%04x", (guchar)*cval);
+            else 
+              g_string_append_c(string, *cval);
             cval++;
           }
           g_string_append_c(string, '"');
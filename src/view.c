@@ -33,6 +33,9 @@
 #include "js.h"
 #include "scripts.h"
 #include "dom.h"
+#include "history.h"
+#include "sync.h"
+#include "filter.h"
 
 static void view_ssl_state(GList *);
 static unsigned long s_click_time;
@@ -78,6 +81,8 @@ view_main_frame_committed_cb(WebKitWebFrame *frame, GList *gl) {
 static void 
 view_resource_request_cb(WebKitWebView *wv, WebKitWebFrame *frame, WebKitWebResource *resource, WebKitNetworkRequest *request, WebKitNetworkResponse *response, GList *gl) 
 {
+    if (filter_request(wv, frame, request, response))
+        return;
     if (EMIT_SCRIPT(RESOURCE))  
     {
         ScriptSignal signal = {
@@ -495,6 +500,8 @@ view_navigation_policy_cb(WebKitWebView *web, WebKitWebFrame *frame, WebKitNetwo
             const char *stripped;
 
             VIEW(gl)->status->deferred_uri = g_strdup(uri);
+            VIEW(gl)->status->generation++;
+            sync_set_dirty(SYNC_SESSION);
 
             stripped = strstr(uri, "://");
             snprintf(buffer, sizeof(buffer), "*%s", stripped ? stripped + 3 : uri);
@@ -675,6 +682,8 @@ view_icon_loaded(WebKitWebView *web, char *icon_uri, GList *gl)
 static void 
 view_title_cb(WebKitWebView *web, GParamSpec *pspec, GList *gl) 
 {
+    VIEW(gl)->status->generation++;
+    sync_set_dirty(SYNC_SESSION);
     dwb_update_status(gl, NULL);
 }/*}}}*/
 
@@ -682,6 +691,8 @@ view_title_cb(WebKitWebView *web, GParamSpec *pspec, GList *gl)
 static void 
 view_uri_cb(WebKitWebView *web, GParamSpec *pspec, GList *gl) 
 {
+    VIEW(gl)->status->generation++;
+    sync_set_dirty(SYNC_SESSION);
     dwb_update_uri(gl);
 }/*}}}*/
 
@@ -782,6 +793,8 @@ view_load_status_cb(WebKitWebView *web, GParamSpec *pspec, GList *gl)
             js_call_as_function(webkit_web_view_get_main_frame(web), v->js_base, "createStyleSheet", NULL, kJSTypeUndefined, NULL);
             break;
         case WEBKIT_LOAD_COMMITTED: 
+            filter_reset_view(web);
+            local_load_committed(gl, uri);
             if (v->status->scripts & SCRIPTS_ALLOWED_TEMPORARY) 
             {
                 g_object_set(webkit_web_view_get_settings(web), "enable-scripts", false, NULL);
@@ -816,14 +829,12 @@ view_load_status_cb(WebKitWebView *web, GParamSpec *pspec, GList *gl)
             break;
         case WEBKIT_LOAD_FINISHED:
             dwb_update_status(gl, NULL);
-            /* TODO sqlite */
             if (!dwb.misc.private_browsing 
+                    && uri != NULL && *uri != '\0'
                     && g_strcmp0(uri, "about:blank")
-                    && !g_str_has_prefix(uri, "dwb:") 
-                    && (dwb_prepend_navigation(gl, &dwb.fc.history) == STATUS_OK)
-                    && dwb.misc.sync_interval <= 0) 
+                    && !g_str_has_prefix(uri, "dwb:")) 
             {
-                util_file_add_navigation(dwb.files[FILES_HISTORY], dwb.fc.history->data, false, dwb.misc.history_length);
+                history_add(uri, webkit_web_view_get_title(web));
             }
             if (dwb.state.auto_insert_mode) 
                 dwb_check_auto_insert(gl);
@@ -913,6 +924,7 @@ view_tab_button_press_cb(GtkWidget *tabevent, GdkEventButton *e, GList *gl)
 {
     if (EMIT_SCRIPT(TAB_BUTTON_PRESS)) 
     {
+        view_materialize(gl, true);
         char *json = util_create_json(8, 
                 UINTEGER, "time", e->time, UINTEGER,    "type", e->type, 
                 DOUBLE,   "x", e->x, DOUBLE,            "y", e->y, 
@@ -1039,7 +1051,6 @@ view_init_signals(GList *gl)
     /* v->status->signals[SIG_ENTRY_ACTIVATE]        = g_signal_connect(v->entry, "activate",                            G_CALLBACK(view_entry_activate_cb), gl); */
 
     v->status->signals[SIG_MOTION_NOTIFY] = g_signal_connect(v->web, "motion-notify-event", G_CALLBACK(view_motion_notify_cb), gl);
-    v->status->signals[SIG_TAB_BUTTON_PRESS]      = g_signal_connect(v->tabevent, "button-press-event",               G_CALLBACK(view_tab_button_press_cb), gl);
     //WebKitWebFrame *frame = webkit_web_view_get_main_frame(WEBKIT_WEB_VIEW(v->web));
     //v->status->signals[SIG_MAIN_FRAME_COMMITTED]  = g_signal_connect(frame, "load-committed", G_CALLBACK(view_main_frame_committed_cb), gl);
 
@@ -1048,9 +1059,11 @@ view_init_signals(GList *gl)
     g_signal_connect(inspector, "inspect-web-view", G_CALLBACK(view_inspect_web_view_cb), gl);
 } /*}}}*/
 
-/* view_create_web_view(View *v)         return: GList * {{{*/
+/* view_create_view()         return: View * {{{
+ * Creates a view without webview
+ * */
 static View * 
-view_create_web_view() 
+view_create_view() 
 {
     View *v = g_malloc(sizeof(View));
 
@@ -1063,14 +1076,24 @@ view_create_web_view()
 #endif
     status->progress = 0;
     status->allowed_plugins = NULL;
-    status->exc_style = NULL;
-    status->styles = NULL;
+    status->hider_style = NULL;
     status->lockprotect = 0;
     status->frames = NULL;
     status->group = 0;
     status->deferred = GET_BOOL("load-on-focus");
     status->deferred_uri = NULL;
-
+    status->listing = NULL;
+    status->placeholder = NULL;
+    status->last_focus = g_get_monotonic_time();
+    status->session_id = 0;
+    status->generation = 0;
+
+    v->web = NULL;
+    v->settings = NULL;
+    v->hover.element = NULL;
+    v->hover.anchor = NULL;
+    v->status_element = NULL;
+    v->script_wv = NULL;
     v->js_base = NULL;
     v->inspector_window = NULL;
     v->plugins = plugins_new();
@@ -1078,20 +1101,8 @@ view_create_web_view()
         status->signals[i] = 0;
     v->status = status;
 
-    v->web = webkit_web_view_new();
-
     /* Srolling */
     v->scroll = gtk_scrolled_window_new(NULL, NULL);
-    gtk_container_add(GTK_CONTAINER(v->scroll), v->web);
-
-#if !_HAS_GTK3
-    if (! GET_BOOL("scrollbars")) 
-    {
-        WebKitWebFrame *frame = webkit_web_view_get_main_frame(WEBKIT_WEB_VIEW(v->web));
-        g_signal_connect(frame, "scrollbars-policy-changed", G_CALLBACK(gtk_true), NULL);
-        gtk_scrolled_window_set_policy(GTK_SCROLLED_WINDOW(v->scroll), GTK_POLICY_NEVER, GTK_POLICY_NEVER);
-    }
-#endif
 
 
     /* Tabbar */
@@ -1126,6 +1137,27 @@ view_create_web_view()
     gtk_widget_set_can_focus(v->scroll, false);
     gtk_widget_show_all(v->scroll);
     gtk_widget_show_all(v->tabevent);
+    return v;
+}/*}}}*/
+
+/* view_create_web(View *v) {{{
+ * Creates the webview of a view
+ * */
+static void 
+view_create_web(View *v) 
+{
+    v->web = webkit_web_view_new();
+    gtk_container_add(GTK_CONTAINER(v->scroll), v->web);
+
+#if !_HAS_GTK3
+    if (! GET_BOOL("scrollbars")) 
+    {
+        WebKitWebFrame *frame = webkit_web_view_get_main_frame(WEBKIT_WEB_VIEW(v->web));
+        g_signal_connect(frame, "scrollbars-policy-changed", G_CALLBACK(gtk_true), NULL);
+        gtk_scrolled_window_set_policy(GTK_SCROLLED_WINDOW(v->scroll), GTK_POLICY_NEVER, GTK_POLICY_NEVER);
+    }
+#endif
+    gtk_widget_show(v->web);
 
     WebKitDOMDocument *doc = webkit_web_view_get_dom_document(WEBKIT_WEB_VIEW(v->web));
     v->hover.element = webkit_dom_document_create_element(doc, "div", NULL);
@@ -1161,9 +1193,149 @@ view_create_web_view()
             font);
     webkit_dom_element_set_attribute(v->status_element, "style", style, NULL);
     g_free(style);
-    return v;
 } /*}}}*/
 
+/* view_create_web_view()         return: View * {{{*/
+static View * 
+view_create_web_view() 
+{
+    View *v = view_create_view();
+    view_create_web(v);
+    return v;
+}/*}}}*/
+
+/* view_free_placeholder(Placeholder *, JSObjectRef wv) {{{
+ * wv is the script object of the webview that replaces the placeholder
+ * */
+static void
+view_free_placeholder(Placeholder *p, JSObjectRef wv)
+{
+    scripts_release_placeholder(p, wv);
+    g_free(p->history);
+    g_free(p->uri);
+    g_free(p->title);
+    g_free(p);
+}/*}}}*/
+
+/* view_materialize(GList *gl, gboolean deferred) {{{
+ * Creates the webview of a placeholder and restores its history, if deferred
+ * is set the current item isn't loaded before the tab is focused
+ * */
+void
+view_materialize(GList *gl, gboolean deferred)
+{
+    View *v = VIEW(gl);
+    Placeholder *p = v->status->placeholder;
+    unsigned int lock;
+
+    if (p == NULL)
+        return;
+
+    v->status->placeholder = NULL;
+    v->status->deferred = deferred;
+    /* the lock is restored when the current item has been loaded */
+    lock = v->status->lockprotect;
+    v->status->lockprotect = 0;
+
+    view_create_web(v);
+    scripts_create_tab(gl);
+    if (EMIT_SCRIPT(CREATE_TAB)) 
+    {
+        char *json = util_create_json(1, CHAR, "uri", p->uri);
+        ScriptSignal signal = { v->script_wv, SCRIPTS_SIG_META(json, CREATE_TAB, 0) };
+        scripts_emit(&signal);
+        g_free(json);
+    }
+    view_init_signals(gl);
+    view_init_settings(gl);
+    if (GET_BOOL("adblocker"))
+        adblock_connect(gl);
+
+    session_restore_tab(gl, p->history, lock);
+    view_free_placeholder(p, v->script_wv);
+}/*}}}*/
+
+/* view_hibernate(GList *gl) {{{
+ * Replaces the webview of a tab with a placeholder that keeps its history
+ * */
+void
+view_hibernate(GList *gl)
+{
+    View *v = VIEW(gl);
+    WebKitWebView *web;
+    Placeholder *p;
+    GtkAdjustment *a;
+
+    if (v->status->placeholder != NULL || gl == dwb.state.fview)
+        return;
+
+    web = WEBKIT_WEB_VIEW(v->web);
+    p = dwb_malloc(sizeof(Placeholder));
+    p->history = session_get_history(gl);
+    p->uri = g_strdup(webkit_web_view_get_uri(web));
+    p->title = g_strdup(webkit_web_view_get_title(web));
+    p->script_object = NULL;
+
+    local_cancel(gl);
+    scripts_release_tab(v->script_wv);
+    v->script_wv = NULL;
+    if (v->js_base != NULL) 
+    {
+        JSValueUnprotect(JS_CONTEXT_REF(gl), v->js_base);
+        v->js_base = NULL;
+    }
+
+    /* the adjustment belongs to the scrolled window and survives the webview */
+    a = gtk_scrolled_window_get_vadjustment(GTK_SCROLLED_WINDOW(v->scroll));
+    if (v->status->signals[SIG_VALUE_CHANGED] > 0)
+        g_signal_handler_disconnect(a, v->status->signals[SIG_VALUE_CHANGED]);
+    for (int i=0; i<SIG_LAST; i++) 
+    {
+        if (i != SIG_TAB_BUTTON_PRESS)
+            v->status->signals[i] = 0;
+    }
+
+    plugins_free(v->plugins);
+    v->plugins = plugins_new();
+    g_slist_free(v->status->frames);
+    v->status->frames = NULL;
+    if (v->status->hider_style) 
+    {
+        g_object_unref(v->status->hider_style);
+        v->status->hider_style = NULL;
+    }
+    g_object_unref(v->hover.anchor);
+    g_object_unref(v->hover.element);
+    g_object_unref(v->status_element);
+    g_object_unref(v->settings);
+    v->hover.anchor = v->hover.element = v->status_element = NULL;
+    v->settings = NULL;
+
+    gtk_widget_destroy(v->web);
+    v->web = NULL;
+
+    FREE0(v->status->hover_uri);
+    FREE0(v->status->deferred_uri);
+    v->status->deferred = false;
+    v->status->progress = 0;
+    v->status->ssl = SSL_NONE;
+    v->status->placeholder = p;
+
+    dwb_tab_label_set_text(gl, NULL);
+}/*}}}*/
+
+/* view_get_web(View *v) {{{
+ * Returns the webview of a view, placeholders get their webview first
+ * */
+GtkWidget *
+view_get_web(View *v)
+{
+    GList *gl;
+    if (v->web == NULL && (gl = g_list_find(dwb.state.views, v)) != NULL)
+        view_materialize(gl, gl != dwb.state.fview);
+    return v->web;
+}/*}}}*/
+
 /* view_clear_tab {{{*/
 void 
 view_clear_tab(GList *gl) 
@@ -1177,6 +1349,7 @@ void
 view_clean(GList *gl) 
 {
     View *v = VIEW(gl);
+    local_cancel(gl);
     /* Inspector */
     if (v->inspector_window != NULL) 
     {
@@ -1199,23 +1372,21 @@ view_clean(GList *gl)
 
     scripts_remove_tab(v->script_wv);
 
-    if (v->status->exc_style) 
-        g_object_unref(v->status->exc_style);
-    
-    if (v->status->styles) 
-    {
-        for (GSList *l = v->status->styles; l; l=l->next) 
-            g_object_unref(l->data);
-        g_slist_free(v->status->styles);
-    }
+    if (v->status->hider_style) 
+        g_object_unref(v->status->hider_style);
 
-    g_object_unref(v->hover.anchor);
-    g_object_unref(v->hover.element);
-    g_object_unref(v->status_element);
+    if (v->status->placeholder != NULL)
+        view_free_placeholder(v->status->placeholder, NULL);
+    else 
+    {
+        g_object_unref(v->hover.anchor);
+        g_object_unref(v->hover.element);
+        g_object_unref(v->status_element);
 
-    g_object_unref(v->settings);
-    /* Destroy widget */
-    gtk_widget_destroy(v->web);
+        g_object_unref(v->settings);
+        /* Destroy widget */
+        gtk_widget_destroy(v->web);
+    }
     gtk_widget_destroy(v->scroll);
 
     FREE0(v->status->deferred_uri);
@@ -1300,7 +1471,11 @@ view_remove(GList *gl)
     }
 
     /* Get History for the undo list */
-    WebKitWebBackForwardList *bflist = webkit_web_view_get_back_forward_list(WEBKIT_WEB_VIEW(v->web));
+    WebKitWebBackForwardList *bflist = NULL;
+    if (v->status->placeholder != NULL) 
+        dwb.state.undo_list = g_list_prepend(dwb.state.undo_list, session_get_back_history(v->status->placeholder));
+    else 
+        bflist = webkit_web_view_get_back_forward_list(WEBKIT_WEB_VIEW(v->web));
     if ( bflist != NULL ) 
     {
         GList *store = NULL;
@@ -1321,6 +1496,7 @@ view_remove(GList *gl)
     dwb_source_remove();
 
     dwb.state.views = g_list_delete_link(dwb.state.views, gl);
+    sync_set_dirty(SYNC_SESSION);
     if (!dwb.state.views->next && !dwb.misc.show_single_tab)
         gtk_widget_hide(dwb.gui.topbox);
 
@@ -1385,6 +1561,7 @@ view_add(const char *uri, gboolean background)
         gtk_box_reorder_child(GTK_BOX(dwb.gui.topbox), v->tabevent, length - p);
         gtk_box_insert(GTK_BOX(dwb.gui.mainbox), v->scroll, true, true, 0, p, GTK_PACK_START);
         dwb.state.views = g_list_insert(dwb.state.views, v, p);
+        sync_set_dirty(SYNC_SESSION);
         ret = g_list_nth(dwb.state.views, p);
         scripts_create_tab(ret);
 
@@ -1402,6 +1579,7 @@ view_add(const char *uri, gboolean background)
     {
         gtk_box_pack_start(GTK_BOX(dwb.gui.mainbox), v->scroll, true, true, 0);
         dwb.state.views = g_list_prepend(dwb.state.views, v);
+        sync_set_dirty(SYNC_SESSION);
         ret = dwb.state.views;
         scripts_create_tab(ret);
         dwb_focus(ret);
@@ -1422,6 +1600,7 @@ view_add(const char *uri, gboolean background)
     }
 
 
+    v->status->signals[SIG_TAB_BUTTON_PRESS] = g_signal_connect(v->tabevent, "button-press-event", G_CALLBACK(view_tab_button_press_cb), ret);
     view_init_signals(ret);
     view_init_settings(ret);
     if (GET_BOOL("adblocker"))
@@ -1435,4 +1614,51 @@ view_add(const char *uri, gboolean background)
     return ret;
 } /*}}}*/
 
+/* view_add_placeholder(Placeholder *, unsigned int lock)   return: GList * {{{
+ * Appends a tab without webview, the webview is created when the tab is
+ * focused or its webview is needed otherwise
+ * */
+GList *
+view_add_placeholder(Placeholder *p, unsigned int lock) 
+{
+    GList *ret;
+    View *v = view_create_view();
+    int length = g_list_length(dwb.state.views);
+
+    v->status->placeholder = p;
+    v->status->deferred = false;
+    v->status->lockprotect = lock;
+
+    gtk_box_pack_end(GTK_BOX(dwb.gui.topbox), v->tabevent, true, true, 0);
+    gtk_box_reorder_child(GTK_BOX(dwb.gui.topbox), v->tabevent, 0);
+    gtk_box_insert(GTK_BOX(dwb.gui.mainbox), v->scroll, true, true, 0, length, GTK_PACK_START);
+    gtk_widget_hide(v->scroll);
+
+    dwb.state.views = g_list_append(dwb.state.views, v);
+    sync_set_dirty(SYNC_SESSION);
+    ret = g_list_last(dwb.state.views);
+    v->status->signals[SIG_TAB_BUTTON_PRESS] = g_signal_connect(v->tabevent, "button-press-event", G_CALLBACK(view_tab_button_press_cb), ret);
+
+#if WEBKIT_CHECK_VERSION(1, 8, 0)
+    if (p->uri != NULL && GET_BOOL("enable-favicon")) 
+    {
+        GdkPixbuf *pb = webkit_favicon_database_try_get_favicon_pixbuf(webkit_get_favicon_database(), 
+                p->uri, dwb.misc.bar_height, dwb.misc.bar_height);
+        if (pb != NULL) 
+            gtk_image_set_from_pixbuf(GTK_IMAGE(v->tabicon), pb);
+    }
+#endif
+    view_set_normal_style(ret);
+    dwb_tab_label_set_text(ret, p->title);
+
+    if (!dwb.misc.show_single_tab) 
+    {
+        if (length == 0) 
+            gtk_widget_hide(dwb.gui.topbox);
+        else if (length == 1 && (dwb.state.bar_visible & BAR_VIS_TOP)) 
+            gtk_widget_show(dwb.gui.topbox);
+    }
+    return ret;
+}/*}}}*/
+
 /*}}}*/
@@ -20,6 +20,9 @@
 #define VIEW_H
 
 GList * view_add(const char *uri, gboolean background);
+GList * view_add_placeholder(Placeholder *p, unsigned int lock);
+void view_materialize(GList *gl, gboolean deferred);
+void view_hibernate(GList *gl);
 DwbStatus view_remove(GList *gl);
 void view_clean(GList *gl);
 DwbStatus view_push_master(Arg *);
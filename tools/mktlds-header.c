@@ -185,36 +185,150 @@ punycode_encode(const char *host)
     return g_strdup(enc_str);
 }
 
+/*
+ * The public suffix list is compiled into a trie of reversed labels, i.e. the
+ * rule 'co.uk' is stored as uk -> co. The children of every node are stored
+ * consecutively and sorted, so they can be searched with a binary search.
+ */
+#define TLD_RULE        (1<<0)
+#define TLD_WILDCARD    (1<<1)
+#define TLD_EXCEPTION   (1<<2)
+
+struct node {
+    char		*label;
+    int		flags;
+    int		index;
+    struct node	**children;
+    int		n_children;
+};
+
+struct node *
+node_new(const char *label)
+{
+    struct node	*node = g_malloc0(sizeof(struct node));
+
+    node->label = g_strdup(label);
+    return (node);
+}
+
+struct node *
+node_get_child(struct node *node, const char *label)
+{
+    int		i;
+
+    for (i=0; i<node->n_children; i++) {
+        if (strcmp(node->children[i]->label, label) == 0)
+            return (node->children[i]);
+    }
+    node->children = g_realloc(node->children,
+        (node->n_children + 1) * sizeof(struct node *));
+    node->children[node->n_children] = node_new(label);
+    return (node->children[node->n_children++]);
+}
+
+int
+node_compare(const void *a, const void *b)
+{
+    return strcmp((*(struct node **)a)->label, (*(struct node **)b)->label);
+}
+
+void
+add_rule(struct node *root, char *rule)
+{
+    char		*labels[128];
+    char		*encoded, *label;
+    int		flags = TLD_RULE;
+    int		n = 0, i;
+    struct node	*node = root;
+
+    if (*rule == '!') {
+        flags = TLD_EXCEPTION;
+        rule++;
+    }
+    if (rule[0] == '*' && rule[1] == '.') {
+        flags = TLD_WILDCARD;
+        rule += 2;
+    }
+
+    encoded = punycode_encode(rule);
+    for (label = strtok(encoded, "."); label != NULL && n < 128;
+        label = strtok(NULL, "."))
+        labels[n++] = label;
+
+    for (i=n-1; i>=0; i--)
+        node = node_get_child(node, labels[i]);
+    node->flags |= flags;
+    g_free(encoded);
+}
+
 int main()
 {
     char buf[512];
     char *ptr;
-
-    printf("#ifndef TLDS_H\n");
-    printf("#define TLDS_H\n");
-    printf("static char *TLDS_EFFECTIVE[] = {\n");
+    struct node *root = node_new("");
+    struct node **queue;
+    struct node *node;
+    int n_nodes = 1, head, tail, i;
 
     while (!feof(stdin)) {
         if (fgets(buf, sizeof(buf), stdin) == NULL)
             break;
 
-        for (ptr = buf+strlen(buf)-1; isspace(*ptr) ||
-            *ptr == '\n' || *ptr == '\r'; ptr --)
+        for (ptr = buf+strlen(buf)-1; ptr >= buf && (isspace(*ptr) ||
+            *ptr == '\n' || *ptr == '\r'); ptr --)
             *ptr = '\0';
 
         if (buf[0] == '\0') continue;
 
         if (buf[0] == '/' && buf[1] == '/')
-            printf("%s\n", buf);
-        else {
-            char *encoded = punycode_encode(buf);
-            printf("\"%s\",\n", encoded);
-            g_free(encoded);
+            continue;
+
+        add_rule(root, buf);
+    }
+
+    /* number the nodes breadth-first, siblings get consecutive indices */
+    queue = g_malloc(sizeof(struct node *));
+    queue[0] = root;
+    root->index = 0;
+    for (head = 0, tail = 1; head < tail; head++) {
+        node = queue[head];
+        qsort(node->children, node->n_children, sizeof(struct node *),
+            node_compare);
+        queue = g_realloc(queue, (tail + node->n_children) *
+            sizeof(struct node *));
+        for (i=0; i<node->n_children; i++) {
+            node->children[i]->index = tail;
+            queue[tail++] = node->children[i];
         }
     }
-    printf("NULL,\n");
+    n_nodes = tail;
+    if (n_nodes > 0xffff) {
+        fprintf(stderr, "Too many public suffix rules\n");
+        return 1;
+    }
+
+    printf("#ifndef TLDS_H\n");
+    printf("#define TLDS_H\n");
+    printf("/* generated by mktlds-header, do not edit */\n");
+    printf("#define TLD_RULE        (%d)\n", TLD_RULE);
+    printf("#define TLD_WILDCARD    (%d)\n", TLD_WILDCARD);
+    printf("#define TLD_EXCEPTION   (%d)\n", TLD_EXCEPTION);
+    printf("typedef struct _TldNode {\n");
+    printf("    const char *label;\n");
+    printf("    unsigned short children;\n");
+    printf("    unsigned short n_children;\n");
+    printf("    unsigned char flags;\n");
+    printf("} TldNode;\n");
+    printf("static const TldNode TLD_NODES[%d] = {\n", n_nodes);
+    for (i=0; i<n_nodes; i++) {
+        node = queue[i];
+        printf("    { \"%s\", %d, %d, %d },\n", node->label,
+            node->n_children > 0 ? node->children[0]->index : 0,
+            node->n_children, node->flags);
+    }
     printf("};\n");
     printf("#endif\n");
 
+    g_free(queue);
     return 0;
 }